@@ -213,7 +213,7 @@ tb_htable_lookup_common(CPUState *cpu, TCGTBCPUState s, const struct qht *ht,
     return qht_lookup_custom(ht, &desc, h, func);
 }
 
-static TranslationBlock *tb_htable_lookup(CPUState *cpu, TCGTBCPUState s)
+TranslationBlock *tb_htable_lookup(CPUState *cpu, TCGTBCPUState s)
 {
     return tb_htable_lookup_common(cpu, s, &tb_ctx.htable, tb_lookup_cmp);
 }
@@ -965,6 +965,11 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
 
         while (!cpu_handle_interrupt(cpu, &last_tb)) {
             TranslationBlock *tb;
+#ifdef XBOX
+            if (unlikely(qatomic_read(&tb_cache_preload_pending))) {
+                tb_cache_preload(cpu);
+            }
+#endif
             TCGTBCPUState s = cpu->cc->tcg_ops->get_tb_cpu_state(cpu);
             s.cflags = cpu->cflags_next_tb;
 
@@ -50,12 +50,21 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s);
 void page_init(void);
 void tb_htable_init(void);
+TranslationBlock *tb_htable_lookup(CPUState *cpu, TCGTBCPUState s);
 TranslationBlock *inv_tb_htable_lookup(CPUState *cpu, TCGTBCPUState s);
 void tb_reset_jump(TranslationBlock *tb, int n);
 TranslationBlock *tb_link_page(TranslationBlock *tb);
 void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                uintptr_t host_pc);
 
+/* Persistent TB cache, see include/accel/tcg/tb-cache.h */
+extern bool tb_cache_preload_pending;
+void tb_cache_init(void);
+void tb_cache_record(CPUState *cpu, const TranslationBlock *tb,
+                     TCGTBCPUState s);
+void tb_cache_preload(CPUState *cpu);
+void tb_cache_dump_info(GString *buf);
+
 /**
  * tlb_init - initialize a CPU's TLB
  * @cpu: CPU whose TLB should be initialized
@@ -0,0 +1,482 @@
+/*
+ * Persistent translation block cache
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "hw/core/cpu.h"
+#include "exec/tlb-flags.h"
+#include "exec/translation-block.h"
+#include "accel/tcg/cpu-mmu-index.h"
+#include "accel/tcg/probe.h"
+#include "accel/tcg/tb-cache.h"
+#include "tcg/tcg.h"
+#include "internal-common.h"
+#include "tb-code-hash.h"
+#include "tb-context.h"
+
+#define TB_CACHE_MAGIC 0x43425458 /* "XTBC" */
+#define TB_CACHE_VERSION 2
+
+/* Bounds the file to a few MiB, far more blocks than a title executes */
+#define TB_CACHE_MAX_ENTRIES (1 << 17)
+
+/*
+ * Blocks translated per pass through the execution loop, so that interrupts
+ * are still serviced while a large cache is being loaded.
+ */
+#define TB_CACHE_PRELOAD_BATCH 256
+
+/*
+ * Preloading stops once this fraction of the code buffer is in use, leaving
+ * the rest to the blocks the title translates itself. Filling the buffer
+ * would force a tb_flush and throw away everything that was preloaded.
+ */
+#define TB_CACHE_PRELOAD_SHARE_DIV 2
+
+typedef struct TBCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t count;
+} TBCacheHeader;
+
+typedef struct TBCacheFile {
+    char *path;
+    char *data;
+    gsize len;
+} TBCacheFile;
+
+typedef struct TBCacheEntry {
+    /* Lookup key */
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    /* Guest code fingerprint, as tb->ihash */
+    uint64_t hash;
+    uint16_t size;
+    uint16_t pad;
+    /* Times the guest has had to translate the block, across runs */
+    uint32_t hits;
+} TBCacheEntry;
+
+static struct {
+    QemuMutex lock;
+    /* Background save, only started and joined from the main loop */
+    QemuThread save_thread;
+    bool save_running;
+    bool save_done;
+
+    char *path;
+    GPtrArray *entries;
+    GHashTable *index;
+    bool dirty;
+    unsigned int preload_next;
+    unsigned int preload_end;
+    unsigned int preload_flush_count;
+
+    unsigned int loaded;
+    unsigned int translated;
+    unsigned int present;
+    unsigned int stale;
+    unsigned int unmapped;
+    unsigned int other_cflags;
+    unsigned int skipped;
+} tb_cache;
+
+bool tb_cache_preload_pending;
+
+/* The next block this vCPU records is a preload, which isn't a hit */
+static __thread bool tb_cache_preloading;
+
+static guint tb_cache_entry_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+    return e->pc ^ (e->pc >> 32) ^ e->cs_base ^ e->flags ^ e->cflags;
+}
+
+static gboolean tb_cache_entry_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntry *x = a, *y = b;
+    return x->pc == y->pc && x->cs_base == y->cs_base &&
+           x->flags == y->flags && x->cflags == y->cflags;
+}
+
+/* Most used blocks first, so they are the ones preloaded */
+static gint tb_cache_entry_cmp_hits(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntry *x = *(TBCacheEntry * const *)a;
+    const TBCacheEntry *y = *(TBCacheEntry * const *)b;
+    return x->hits < y->hits ? 1 : x->hits > y->hits ? -1 : 0;
+}
+
+void tb_cache_init(void)
+{
+    qemu_mutex_init(&tb_cache.lock);
+}
+
+static void tb_cache_reset_locked(void)
+{
+    g_free(tb_cache.path);
+    tb_cache.path = NULL;
+    if (tb_cache.entries) {
+        g_hash_table_destroy(tb_cache.index);
+        g_ptr_array_free(tb_cache.entries, true);
+        tb_cache.entries = NULL;
+        tb_cache.index = NULL;
+    }
+    tb_cache.dirty = false;
+    tb_cache.preload_next = tb_cache.preload_end = 0;
+    qatomic_set(&tb_cache_preload_pending, false);
+}
+
+static void tb_cache_add_locked(const TBCacheEntry *e)
+{
+    TBCacheEntry *old = g_hash_table_lookup(tb_cache.index, e);
+
+    if (old) {
+        /* Re-translated after the guest rewrote it, keep the newest code */
+        if (old->hash != e->hash || old->size != e->size) {
+            old->hash = e->hash;
+            old->size = e->size;
+            tb_cache.dirty = true;
+        }
+        if (e->hits && old->hits < UINT32_MAX) {
+            old->hits++;
+            tb_cache.dirty = true;
+        }
+        return;
+    }
+
+    if (tb_cache.entries->len >= TB_CACHE_MAX_ENTRIES) {
+        return;
+    }
+
+    TBCacheEntry *n = g_memdup2(e, sizeof(*e));
+    g_ptr_array_add(tb_cache.entries, n);
+    g_hash_table_add(tb_cache.index, n);
+    tb_cache.dirty = true;
+}
+
+static void tb_cache_load_locked(const char *path)
+{
+    g_autofree char *data = NULL;
+    gsize len = 0;
+
+    if (!g_file_get_contents(path, &data, &len, NULL)) {
+        return;
+    }
+
+    const TBCacheHeader *hdr = (const TBCacheHeader *)data;
+    if (len < sizeof(*hdr) || hdr->magic != TB_CACHE_MAGIC ||
+        hdr->version != TB_CACHE_VERSION ||
+        hdr->entry_size != sizeof(TBCacheEntry) ||
+        len != sizeof(*hdr) + (gsize)hdr->count * sizeof(TBCacheEntry)) {
+        warn_report("tcg: Ignoring invalid TB cache %s", path);
+        return;
+    }
+
+    /* tb_code_hash_func() hashes at most a page worth of code */
+    const TBCacheEntry *e = (const TBCacheEntry *)(hdr + 1);
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        if (e[i].size > 0 && e[i].size < 4096) {
+            tb_cache_add_locked(&e[i]);
+        }
+    }
+
+    g_ptr_array_sort(tb_cache.entries, tb_cache_entry_cmp_hits);
+
+    tb_cache.dirty = false;
+    tb_cache.loaded = tb_cache.entries->len;
+    tb_cache.preload_next = 0;
+    tb_cache.preload_end = tb_cache.entries->len;
+    tb_cache.preload_flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+}
+
+/* Serialize the cache for saving, or NULL if it hasn't changed */
+static TBCacheFile *tb_cache_snapshot_locked(void)
+{
+    if (!tb_cache.path || !tb_cache.dirty) {
+        return NULL;
+    }
+
+    TBCacheHeader hdr = {
+        .magic = TB_CACHE_MAGIC,
+        .version = TB_CACHE_VERSION,
+        .entry_size = sizeof(TBCacheEntry),
+        .count = tb_cache.entries->len,
+    };
+    TBCacheFile *file = g_new(TBCacheFile, 1);
+    file->path = g_strdup(tb_cache.path);
+    file->len = sizeof(hdr) + hdr.count * sizeof(TBCacheEntry);
+    file->data = g_malloc(file->len);
+
+    memcpy(file->data, &hdr, sizeof(hdr));
+    TBCacheEntry *e = (TBCacheEntry *)(file->data + sizeof(hdr));
+    for (uint32_t i = 0; i < hdr.count; i++) {
+        e[i] = *(TBCacheEntry *)g_ptr_array_index(tb_cache.entries, i);
+    }
+
+    tb_cache.dirty = false;
+    return file;
+}
+
+static bool tb_cache_write_file(TBCacheFile *file)
+{
+    g_autoptr(GError) err = NULL;
+    bool ok = g_file_set_contents(file->path, file->data, file->len, &err);
+
+    if (!ok) {
+        warn_report("tcg: Failed to write TB cache: %s", err->message);
+    }
+    g_free(file->path);
+    g_free(file->data);
+    g_free(file);
+    return ok;
+}
+
+/*
+ * Writing the file can take a while, don't hold up the main loop or vCPUs
+ * recording translations for it.
+ */
+static void *tb_cache_save_thread(void *opaque)
+{
+    TBCacheFile *file = opaque;
+    g_autofree char *path = g_strdup(file->path);
+
+    if (!tb_cache_write_file(file)) {
+        /* Try again on the next save, unless another cache is open by now */
+        QEMU_LOCK_GUARD(&tb_cache.lock);
+        if (tb_cache.path && !strcmp(tb_cache.path, path)) {
+            tb_cache.dirty = true;
+        }
+    }
+
+    qatomic_store_release(&tb_cache.save_done, true);
+    return NULL;
+}
+
+/* Let a background save finish, so it can't overwrite a newer one */
+static void tb_cache_save_join(void)
+{
+    if (tb_cache.save_running) {
+        qemu_thread_join(&tb_cache.save_thread);
+        tb_cache.save_running = false;
+    }
+}
+
+void tb_cache_open(const char *path)
+{
+    TBCacheFile *file;
+
+    WITH_QEMU_LOCK_GUARD(&tb_cache.lock) {
+        file = tb_cache_snapshot_locked();
+        tb_cache_reset_locked();
+    }
+
+    tb_cache_save_join();
+    if (file) {
+        tb_cache_write_file(file);
+    }
+
+    QEMU_LOCK_GUARD(&tb_cache.lock);
+
+    tb_cache.path = g_strdup(path);
+    tb_cache.entries = g_ptr_array_new_with_free_func(g_free);
+    tb_cache.index = g_hash_table_new(tb_cache_entry_hash,
+                                      tb_cache_entry_equal);
+    tb_cache.loaded = tb_cache.translated = tb_cache.present = 0;
+    tb_cache.stale = tb_cache.unmapped = tb_cache.other_cflags = 0;
+    tb_cache.skipped = 0;
+
+    tb_cache_load_locked(path);
+    qatomic_set(&tb_cache_preload_pending,
+                tb_cache.preload_next < tb_cache.preload_end);
+}
+
+void tb_cache_save(void)
+{
+    TBCacheFile *file;
+
+    /* Still writing the last one, the changes are picked up next time */
+    if (tb_cache.save_running &&
+        !qatomic_load_acquire(&tb_cache.save_done)) {
+        return;
+    }
+    tb_cache_save_join();
+
+    WITH_QEMU_LOCK_GUARD(&tb_cache.lock) {
+        file = tb_cache_snapshot_locked();
+    }
+    if (!file) {
+        return;
+    }
+
+    tb_cache.save_done = false;
+    tb_cache.save_running = true;
+    qemu_thread_create(&tb_cache.save_thread, "tb-cache-save",
+                       tb_cache_save_thread, file, QEMU_THREAD_JOINABLE);
+}
+
+void tb_cache_close(void)
+{
+    TBCacheFile *file;
+
+    WITH_QEMU_LOCK_GUARD(&tb_cache.lock) {
+        file = tb_cache_snapshot_locked();
+        tb_cache_reset_locked();
+    }
+
+    tb_cache_save_join();
+    if (file) {
+        tb_cache_write_file(file);
+    }
+}
+
+void tb_cache_record(CPUState *cpu, const TranslationBlock *tb,
+                     TCGTBCPUState s)
+{
+    /* Skip one-shot and other special-purpose translations */
+    if (tb_page_addr0(tb) == -1 || s.cflags != curr_cflags(cpu)) {
+        return;
+    }
+
+    TBCacheEntry e = {
+        .pc = s.pc,
+        .cs_base = s.cs_base,
+        .flags = s.flags,
+        .cflags = s.cflags,
+        .hash = tb->ihash,
+        .size = tb->size,
+        .hits = !tb_cache_preloading,
+    };
+    tb_cache_preloading = false;
+
+    QEMU_LOCK_GUARD(&tb_cache.lock);
+    if (tb_cache.entries) {
+        tb_cache_add_locked(&e);
+    }
+}
+
+static bool tb_cache_code_mapped(CPUState *cpu, vaddr addr)
+{
+    CPUTLBEntryFull *full;
+    void *host;
+    int flags = probe_access_full(cpu_env(cpu), addr, 1, MMU_INST_FETCH,
+                                  cpu_mmu_index(cpu, true), true, &host,
+                                  &full, 0);
+
+    return !(flags & (TLB_INVALID_MASK | TLB_MMIO));
+}
+
+static void tb_cache_preload_one(CPUState *cpu, const TBCacheEntry *e)
+{
+    TCGTBCPUState s = {
+        .pc = e->pc,
+        .cs_base = e->cs_base,
+        .flags = e->flags,
+        .cflags = e->cflags,
+    };
+
+    /* Recorded with different TCG settings, e.g. single-stepping */
+    if (s.cflags != curr_cflags(cpu)) {
+        qatomic_inc(&tb_cache.other_cflags);
+        return;
+    }
+
+    /* Only probe, so nothing here can raise a guest page fault */
+    if (!tb_cache_code_mapped(cpu, s.pc) ||
+        !tb_cache_code_mapped(cpu, s.pc + e->size - 1)) {
+        qatomic_inc(&tb_cache.unmapped);
+        return;
+    }
+
+    if (tb_code_hash_func(cpu_env(cpu), s.pc, e->size) != e->hash) {
+        qatomic_inc(&tb_cache.stale);
+        return;
+    }
+
+    if (tb_htable_lookup(cpu, s)) {
+        qatomic_inc(&tb_cache.present);
+        return;
+    }
+
+    mmap_lock();
+    tb_cache_preloading = true;
+    tb_gen_code(cpu, s);
+    mmap_unlock();
+    qatomic_inc(&tb_cache.translated);
+}
+
+/* The code buffer is filling up, or has already been flushed */
+static bool tb_cache_under_pressure(void)
+{
+    return qatomic_read(&tb_ctx.tb_flush_count) !=
+               tb_cache.preload_flush_count ||
+           tcg_code_size() >= tcg_code_capacity() / TB_CACHE_PRELOAD_SHARE_DIV;
+}
+
+void tb_cache_preload(CPUState *cpu)
+{
+    TBCacheEntry batch[TB_CACHE_PRELOAD_BATCH];
+    unsigned int n = 0;
+
+    WITH_QEMU_LOCK_GUARD(&tb_cache.lock) {
+        if (tb_cache_under_pressure()) {
+            tb_cache.skipped += tb_cache.preload_end - tb_cache.preload_next;
+            tb_cache.preload_next = tb_cache.preload_end;
+        }
+        while (n < ARRAY_SIZE(batch) &&
+               tb_cache.preload_next < tb_cache.preload_end) {
+            batch[n++] = *(TBCacheEntry *)g_ptr_array_index(
+                tb_cache.entries, tb_cache.preload_next++);
+        }
+        /*
+         * Advance before translating: tb_gen_code may leave the loop via
+         * cpu_loop_exit to flush a full code buffer.
+         */
+        qatomic_set(&tb_cache_preload_pending,
+                    tb_cache.preload_next < tb_cache.preload_end);
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        /* Anything translated since the batch was taken can't be undone */
+        if (qatomic_read(&tb_ctx.tb_flush_count) !=
+            tb_cache.preload_flush_count) {
+            qatomic_add(&tb_cache.skipped, n - i);
+            break;
+        }
+        tb_cache_preload_one(cpu, &batch[i]);
+    }
+}
+
+void tb_cache_dump_info(GString *buf)
+{
+    QEMU_LOCK_GUARD(&tb_cache.lock);
+
+    if (!tb_cache.entries) {
+        return;
+    }
+
+    g_string_append_printf(buf, "TB cache entries         %u/%u\n",
+                           tb_cache.entries->len, TB_CACHE_MAX_ENTRIES);
+    g_string_append_printf(buf, "TB cache loaded          %u\n",
+                           tb_cache.loaded);
+    g_string_append_printf(buf, "TB cache pre-translated  %u\n",
+                           qatomic_read(&tb_cache.translated));
+    g_string_append_printf(buf, "TB cache already present %u\n",
+                           qatomic_read(&tb_cache.present));
+    g_string_append_printf(buf, "TB cache stale           %u\n",
+                           qatomic_read(&tb_cache.stale));
+    g_string_append_printf(buf, "TB cache not mapped      %u\n",
+                           qatomic_read(&tb_cache.unmapped));
+    g_string_append_printf(buf, "TB cache other cflags    %u\n",
+                           qatomic_read(&tb_cache.other_cflags));
+    g_string_append_printf(buf, "TB cache skipped         %u\n",
+                           qatomic_read(&tb_cache.skipped));
+}
@@ -36,6 +36,12 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+#ifdef XBOX
+    /* stores to pages holding code, see tb_invalidate_phys_page_range__locked */
+    unsigned smc_write_count;
+    unsigned smc_filtered_count;
+    unsigned smc_coarse_count;
+#endif
 };
 
 extern TBContext tb_ctx;
@@ -197,8 +197,39 @@ struct PageDesc {
     QemuSpin lock;
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
+#ifdef XBOX
+    /* granules of this page holding translated code, see smc_granules() */
+    uint64_t code_bitmap;
+    /* stores to this page that missed code since it was last emptied */
+    unsigned int data_writes;
+#endif
 };
 
+#ifdef XBOX
+/*
+ * XBE images mix code with writable data and import thunks on the same
+ * pages. Each page tracks which 1/64th of it (64-byte granules for 4 KiB
+ * pages) holds translated code, so stores to data sharing a page with code
+ * do not invalidate it.
+ *
+ * A page keeps taking the slow write path for as long as it holds any
+ * code, so once a page has seen SMC_COARSE_THRESHOLD stores that missed
+ * its code, all of its TBs are invalidated as before, letting the page be
+ * unprotected.
+ */
+#define SMC_GRANULE_BITS (TARGET_PAGE_BITS - 6)
+#define SMC_COARSE_THRESHOLD 64
+
+/* Bitmap of the granules covering [start, last] within a single page */
+static inline uint64_t smc_granules(tb_page_addr_t start, tb_page_addr_t last)
+{
+    unsigned int first = (start & ~TARGET_PAGE_MASK) >> SMC_GRANULE_BITS;
+    unsigned int final = (last & ~TARGET_PAGE_MASK) >> SMC_GRANULE_BITS;
+
+    return MAKE_64BIT_MASK(first, final - first + 1);
+}
+#endif
+
 void page_table_config_init(void)
 {
     uint32_t v_l1_bits;
@@ -678,6 +709,10 @@ static void tb_remove_all_1(int level, void **lp)
         for (i = 0; i < V_L2_SIZE; ++i) {
             page_lock(&pd[i]);
             pd[i].first_tb = (uintptr_t)NULL;
+#ifdef XBOX
+            pd[i].code_bitmap = 0;
+            pd[i].data_writes = 0;
+#endif
             page_unlock(&pd[i]);
         }
     } else {
@@ -698,6 +733,27 @@ static void tb_remove_all(void)
     }
 }
 
+/*
+ * Return in [@pstart, @plast] the bytes of @tb on its page @n.
+ * NOTE: this is subtle as a TB may span two physical pages.
+ */
+static void tb_page_range(const TranslationBlock *tb, unsigned int n,
+                          tb_page_addr_t *pstart, tb_page_addr_t *plast)
+{
+    tb_page_addr_t tb_start, tb_last;
+
+    tb_start = tb_page_addr0(tb);
+    tb_last = tb_start + tb->size - 1;
+    if (n == 0) {
+        tb_last = MIN(tb_last, tb_start | ~TARGET_PAGE_MASK);
+    } else {
+        tb_start = tb_page_addr1(tb);
+        tb_last = tb_start + (tb_last & ~TARGET_PAGE_MASK);
+    }
+    *pstart = tb_start;
+    *plast = tb_last;
+}
+
 /*
  * Add the tb in the target page and protect it if necessary.
  * Called with @p->lock held.
@@ -712,6 +768,13 @@ static void tb_page_add(PageDesc *p, TranslationBlock *tb, unsigned int n)
     page_already_protected = p->first_tb != 0;
     p->first_tb = (uintptr_t)tb | n;
 
+#ifdef XBOX
+    tb_page_addr_t tb_start, tb_last;
+
+    tb_page_range(tb, n, &tb_start, &tb_last);
+    p->code_bitmap |= smc_granules(tb_start, tb_last);
+#endif
+
     /*
      * If some code is already present, then the pages are already
      * protected. So we handle the case where only the first TB is
@@ -1135,6 +1198,22 @@ tb_invalidate_phys_page_range__locked(CPUState *cpu,
     /* Range may not cross a page. */
     tcg_debug_assert(((start ^ last) & TARGET_PAGE_MASK) == 0);
 
+#ifdef XBOX
+    bool coarse = false;
+
+    qatomic_set(&tb_ctx.smc_write_count, tb_ctx.smc_write_count + 1);
+    if (p->first_tb && !(p->code_bitmap & smc_granules(start, last))) {
+        /* No code near the store, leave the page's TBs alone */
+        if (++p->data_writes < SMC_COARSE_THRESHOLD) {
+            qatomic_set(&tb_ctx.smc_filtered_count,
+                        tb_ctx.smc_filtered_count + 1);
+            return;
+        }
+        coarse = true;
+        qatomic_set(&tb_ctx.smc_coarse_count, tb_ctx.smc_coarse_count + 1);
+    }
+#endif
+
     if (retaddr && cpu && cpu->cc->tcg_ops->precise_smc) {
         current_tb = tcg_tb_lookup(retaddr);
     }
@@ -1144,21 +1223,13 @@ tb_invalidate_phys_page_range__locked(CPUState *cpu,
      * XXX: see if in some cases it could be faster to invalidate all the code
      */
     PAGE_FOR_EACH_TB(start, last, p, tb, n) {
-#ifndef XBOX
         tb_page_addr_t tb_start, tb_last;
 
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        tb_start = tb_page_addr0(tb);
-        tb_last = tb_start + tb->size - 1;
-        if (n == 0) {
-            tb_last = MIN(tb_last, tb_start | ~TARGET_PAGE_MASK);
-        } else {
-            tb_start = tb_page_addr1(tb);
-            tb_last = tb_start + (tb_last & ~TARGET_PAGE_MASK);
-        }
-        if (!(tb_last < start || tb_start > last)) {
+        tb_page_range(tb, n, &tb_start, &tb_last);
+#ifdef XBOX
+        if (coarse || !(tb_last < start || tb_start > last)) {
 #else
-        {
+        if (!(tb_last < start || tb_start > last)) {
 #endif
             if (unlikely(current_tb == tb) &&
                 (tb_cflags(current_tb) & CF_COUNT_MASK) != 1) {
@@ -1176,8 +1247,22 @@ tb_invalidate_phys_page_range__locked(CPUState *cpu,
         }
     }
 
+#ifdef XBOX
+    /* Drop granules that only held code from the TBs just invalidated */
+    p->code_bitmap = 0;
+    PAGE_FOR_EACH_TB(unused, unused, p, tb, n) {
+        tb_page_addr_t tb_start, tb_last;
+
+        tb_page_range(tb, n, &tb_start, &tb_last);
+        p->code_bitmap |= smc_granules(tb_start, tb_last);
+    }
+#endif
+
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
+#ifdef XBOX
+        p->data_writes = 0;
+#endif
         tlb_unprotect_code(start);
     }
 
@@ -152,6 +152,7 @@ static int tcg_init_machine(AccelState *as, MachineState *ms)
     page_init();
     tb_htable_init();
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_threads);
+    tb_cache_init();
 
 #if defined(CONFIG_SOFTMMU)
     /*
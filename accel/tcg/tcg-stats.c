@@ -155,6 +155,15 @@ static void tcg_dump_flush_info(GString *buf)
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+#ifdef XBOX
+    g_string_append_printf(buf, "SMC writes to code pages %u\n",
+                           qatomic_read(&tb_ctx.smc_write_count));
+    g_string_append_printf(buf, "SMC writes missing code  %u\n",
+                           qatomic_read(&tb_ctx.smc_filtered_count));
+    g_string_append_printf(buf, "SMC coarse page flushes  %u\n",
+                           qatomic_read(&tb_ctx.smc_coarse_count));
+    tb_cache_dump_info(buf);
+#endif
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
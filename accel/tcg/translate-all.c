@@ -568,6 +568,10 @@ recycle_tb:
         return existing_tb;
     }
 
+#ifdef XBOX
+    tb_cache_record(cpu, tb, s);
+#endif
+
 #if defined(CONFIG_VTUNE_JITPROFILING)
     if (iJIT_IsProfilingActive() == iJIT_SAMPLING_ON && !recycled) {
         iJIT_Method_Load *jmethod = g_malloc0(sizeof(iJIT_Method_Load));
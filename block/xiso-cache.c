@@ -0,0 +1,543 @@
+/*
+ * Read-ahead cache for Xbox disc images
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Titles stream audio and video from disc sequentially and issue many small
+ * reads during level loads. The IDE layer reads them synchronously one
+ * command at a time, so on network shares and slow disks every read pays the
+ * full latency of the image file.
+ *
+ * This format driver sits on top of the image file and keeps an LRU of
+ * clusters of 2 KiB disc sectors. Once reads are seen to follow each other,
+ * the clusters ahead of the stream are loaded in a background coroutine so
+ * they are ready by the time the guest asks for them. Alternatively the image
+ * can be memory mapped and read without going through the file at all.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "block/xiso-cache.h"
+#include "qemu/coroutine.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/stats64.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define XISO_SECTOR_SIZE 2048
+#define XISO_CLUSTER_SECTORS 32
+#define XISO_CLUSTER_SIZE (XISO_SECTOR_SIZE * XISO_CLUSTER_SECTORS)
+
+/* Reads in a row that continue the previous one before prefetching */
+#define XISO_SEQUENTIAL_THRESHOLD 2
+
+#define XISO_CACHE_OPT_CACHE_SIZE "cache-size"
+#define XISO_CACHE_OPT_READ_AHEAD "read-ahead"
+#define XISO_CACHE_OPT_MMAP "mmap"
+
+typedef struct XisoCluster {
+    int64_t index;
+    uint8_t *data;
+    int64_t len;
+    bool loading;
+    int ret;
+    unsigned int users; // Coroutines waiting for the cluster to load
+    CoQueue waiters;
+    QTAILQ_ENTRY(XisoCluster) lru;
+} XisoCluster;
+
+typedef struct BDRVXisoCacheState {
+    int64_t length;
+
+    GHashTable *clusters;
+    QTAILQ_HEAD(, XisoCluster) lru; // Most recently used first
+    unsigned int num_clusters;
+    unsigned int max_clusters;
+    unsigned int allocated; // Includes unlinked clusters still being read
+    unsigned int read_ahead;
+
+    int64_t stream_last;
+    unsigned int stream_reads;
+    int64_t prefetch_next;
+    int64_t prefetch_end;
+    bool prefetching;
+
+    GMappedFile *mapped_file;
+    const uint8_t *map;
+} BDRVXisoCacheState;
+
+static struct {
+    uint64_t cache_size;
+    uint64_t read_ahead;
+    bool mmap;
+} xiso_cache_defaults = {
+    .cache_size = 64 * MiB,
+    .read_ahead = 1 * MiB,
+    .mmap = false,
+};
+
+static struct {
+    Stat64 hits;
+    Stat64 misses;
+    Stat64 prefetched;
+    Stat64 mapped;
+    Stat64 cached_bytes;
+    bool active;
+} xiso_cache_stats;
+
+static QemuOptsList xiso_cache_runtime_opts = {
+    .name = "xiso-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(xiso_cache_runtime_opts.head),
+    .desc = {
+        {
+            .name = XISO_CACHE_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Maximum amount of image data to keep cached",
+        },
+        {
+            .name = XISO_CACHE_OPT_READ_AHEAD,
+            .type = QEMU_OPT_SIZE,
+            .help = "How far ahead of a sequential stream to prefetch",
+        },
+        {
+            .name = XISO_CACHE_OPT_MMAP,
+            .type = QEMU_OPT_BOOL,
+            .help = "Map the image file into memory instead of caching",
+        },
+        { /* end of list */ }
+    },
+};
+
+void xiso_cache_set_defaults(uint64_t cache_size, uint64_t read_ahead,
+                             bool mmap)
+{
+    xiso_cache_defaults.cache_size = cache_size;
+    xiso_cache_defaults.read_ahead = read_ahead;
+    xiso_cache_defaults.mmap = mmap;
+}
+
+void xiso_cache_get_stats(XisoCacheStats *stats)
+{
+    stats->hits = stat64_get(&xiso_cache_stats.hits);
+    stats->misses = stat64_get(&xiso_cache_stats.misses);
+    stats->prefetched = stat64_get(&xiso_cache_stats.prefetched);
+    stats->mapped = stat64_get(&xiso_cache_stats.mapped);
+    stats->cached_bytes = stat64_get(&xiso_cache_stats.cached_bytes);
+    stats->active = qatomic_read(&xiso_cache_stats.active);
+}
+
+static void xiso_cache_reset_stats(bool active)
+{
+    stat64_set(&xiso_cache_stats.hits, 0);
+    stat64_set(&xiso_cache_stats.misses, 0);
+    stat64_set(&xiso_cache_stats.prefetched, 0);
+    stat64_set(&xiso_cache_stats.mapped, 0);
+    stat64_set(&xiso_cache_stats.cached_bytes, 0);
+    qatomic_set(&xiso_cache_stats.active, active);
+}
+
+static void xiso_cache_map_file(BlockDriverState *bs)
+{
+    BDRVXisoCacheState *s = bs->opaque;
+    BlockDriverState *file_bs = bs->file->bs;
+    GError *gerr = NULL;
+
+    /* Only a plain file on the host can be mapped */
+    if (strcmp(file_bs->drv->format_name, "file")) {
+        warn_report("xiso-cache: cannot map '%s' nodes, caching instead",
+                    file_bs->drv->format_name);
+        return;
+    }
+
+    s->mapped_file = g_mapped_file_new(file_bs->filename, FALSE, &gerr);
+    if (!s->mapped_file) {
+        warn_report("xiso-cache: failed to map %s: %s", file_bs->filename,
+                    gerr->message);
+        g_error_free(gerr);
+        return;
+    }
+
+    if (g_mapped_file_get_length(s->mapped_file) < s->length) {
+        warn_report("xiso-cache: mapping of %s is short", file_bs->filename);
+        g_mapped_file_unref(s->mapped_file);
+        s->mapped_file = NULL;
+        return;
+    }
+
+    s->map = (const uint8_t *)g_mapped_file_get_contents(s->mapped_file);
+    trace_xiso_cache_mmap(bs, file_bs->filename);
+}
+
+static int xiso_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                           Error **errp)
+{
+    BDRVXisoCacheState *s = bs->opaque;
+    uint64_t cache_size, read_ahead;
+    bool map;
+    QemuOpts *opts;
+    int64_t length;
+    int ret;
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    opts = qemu_opts_create(&xiso_cache_runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+
+    cache_size = qemu_opt_get_size(opts, XISO_CACHE_OPT_CACHE_SIZE,
+                                   xiso_cache_defaults.cache_size);
+    read_ahead = qemu_opt_get_size(opts, XISO_CACHE_OPT_READ_AHEAD,
+                                   xiso_cache_defaults.read_ahead);
+    map = qemu_opt_get_bool(opts, XISO_CACHE_OPT_MMAP,
+                            xiso_cache_defaults.mmap);
+    qemu_opts_del(opts);
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    length = bdrv_getlength(bs->file->bs);
+    if (length < 0) {
+        error_setg_errno(errp, -length, "Could not get image length");
+        return length;
+    }
+
+    s->length = length;
+    s->max_clusters = MIN(cache_size / XISO_CLUSTER_SIZE, UINT_MAX);
+    // Don't let the read-ahead window push out what it just loaded
+    s->read_ahead = MIN(DIV_ROUND_UP(read_ahead, XISO_CLUSTER_SIZE),
+                        s->max_clusters / 2);
+    s->clusters = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&s->lru);
+    s->stream_last = -2;
+
+    if (map) {
+        xiso_cache_map_file(bs);
+    }
+
+    xiso_cache_reset_stats(true);
+    return 0;
+}
+
+static void xiso_cache_free_cluster(BDRVXisoCacheState *s, XisoCluster *c)
+{
+    s->allocated--;
+    stat64_set(&xiso_cache_stats.cached_bytes,
+               (uint64_t)s->allocated * XISO_CLUSTER_SIZE);
+    qemu_vfree(c->data);
+    g_free(c);
+}
+
+static void xiso_cache_close(BlockDriverState *bs)
+{
+    BDRVXisoCacheState *s = bs->opaque;
+    XisoCluster *c, *next;
+
+    QTAILQ_FOREACH_SAFE(c, &s->lru, lru, next) {
+        assert(!c->loading && !c->users);
+        xiso_cache_free_cluster(s, c);
+    }
+    g_hash_table_destroy(s->clusters);
+
+    if (s->mapped_file) {
+        g_mapped_file_unref(s->mapped_file);
+    }
+
+    xiso_cache_reset_stats(false);
+}
+
+static void xiso_cache_unlink_cluster(BDRVXisoCacheState *s, XisoCluster *c)
+{
+    g_hash_table_remove(s->clusters, &c->index);
+    QTAILQ_REMOVE(&s->lru, c, lru);
+    s->num_clusters--;
+}
+
+static XisoCluster *xiso_cache_alloc_cluster(BlockDriverState *bs,
+                                             int64_t index)
+{
+    BDRVXisoCacheState *s = bs->opaque;
+    XisoCluster *c = NULL;
+
+    if (s->num_clusters >= s->max_clusters) {
+        XisoCluster *victim;
+        QTAILQ_FOREACH_REVERSE(victim, &s->lru, lru) {
+            if (!victim->loading && !victim->users) {
+                xiso_cache_unlink_cluster(s, victim);
+                c = victim;
+                break;
+            }
+        }
+    }
+
+    if (c) {
+        uint8_t *data = c->data;
+        memset(c, 0, sizeof(*c));
+        c->data = data;
+    } else {
+        // Everything is in use, go over the limit for now
+        c = g_new0(XisoCluster, 1);
+        c->data = qemu_blockalign(bs, XISO_CLUSTER_SIZE);
+        s->allocated++;
+        stat64_set(&xiso_cache_stats.cached_bytes,
+                   (uint64_t)s->allocated * XISO_CLUSTER_SIZE);
+    }
+
+    c->index = index;
+    c->len = MIN(XISO_CLUSTER_SIZE, s->length - index * XISO_CLUSTER_SIZE);
+    c->loading = true;
+    qemu_co_queue_init(&c->waiters);
+
+    g_hash_table_insert(s->clusters, &c->index, c);
+    QTAILQ_INSERT_HEAD(&s->lru, c, lru);
+    s->num_clusters++;
+
+    return c;
+}
+
+/*
+ * Return the cluster, loading it from the image if necessary. The cluster
+ * stays valid until the calling coroutine next yields.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+xiso_cache_get_cluster(BlockDriverState *bs, int64_t index, bool prefetch,
+                       XisoCluster **out)
+{
+    BDRVXisoCacheState *s = bs->opaque;
+    XisoCluster *c;
+    int ret;
+
+    c = g_hash_table_lookup(s->clusters, &index);
+    if (c) {
+        if (!prefetch) {
+            stat64_add(&xiso_cache_stats.hits, 1);
+        }
+
+        c->users++;
+        while (c->loading) {
+            qemu_co_queue_wait(&c->waiters, NULL);
+        }
+        c->users--;
+
+        if (c->ret < 0) {
+            /* Already unlinked by the coroutine that tried to load it */
+            ret = c->ret;
+            if (!c->users) {
+                xiso_cache_free_cluster(s, c);
+            }
+            return ret;
+        }
+
+        QTAILQ_REMOVE(&s->lru, c, lru);
+        QTAILQ_INSERT_HEAD(&s->lru, c, lru);
+        *out = c;
+        return 0;
+    }
+
+    stat64_add(prefetch ? &xiso_cache_stats.prefetched :
+                          &xiso_cache_stats.misses, 1);
+
+    c = xiso_cache_alloc_cluster(bs, index);
+    ret = bdrv_co_pread(bs->file, index * XISO_CLUSTER_SIZE, c->len, c->data,
+                        0);
+    c->loading = false;
+    c->ret = ret;
+    qemu_co_queue_restart_all(&c->waiters);
+
+    if (ret < 0) {
+        xiso_cache_unlink_cluster(s, c);
+        if (!c->users) {
+            xiso_cache_free_cluster(s, c);
+        }
+        return ret;
+    }
+
+    *out = c;
+    return 0;
+}
+
+static void coroutine_fn xiso_cache_prefetch_entry(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVXisoCacheState *s = bs->opaque;
+
+    bdrv_graph_co_rdlock();
+
+    /* The window is cut short when the stream it belongs to ends */
+    while (s->prefetch_next < s->prefetch_end) {
+        int64_t index = s->prefetch_next++;
+        XisoCluster *c;
+
+        if (g_hash_table_contains(s->clusters, &index)) {
+            continue;
+        }
+        if (xiso_cache_get_cluster(bs, index, true, &c) < 0) {
+            break;
+        }
+    }
+
+    bdrv_graph_co_rdunlock();
+
+    s->prefetching = false;
+    bdrv_dec_in_flight(bs);
+}
+
+static void xiso_cache_track_stream(BlockDriverState *bs, int64_t first,
+                                    int64_t last)
+{
+    BDRVXisoCacheState *s = bs->opaque;
+
+    if (first == s->stream_last || first == s->stream_last + 1) {
+        s->stream_reads++;
+    } else {
+        s->stream_reads = 0;
+        s->prefetch_end = 0;
+    }
+    s->stream_last = last;
+
+    if (s->stream_reads < XISO_SEQUENTIAL_THRESHOLD || !s->read_ahead ||
+        s->prefetching) {
+        return;
+    }
+
+    int64_t num_clusters = DIV_ROUND_UP(s->length, XISO_CLUSTER_SIZE);
+    int64_t start = MAX(last + 1, s->prefetch_end);
+    int64_t end = MIN(last + 1 + s->read_ahead, num_clusters);
+
+    // Top up in batches rather than one cluster per read
+    if (end - start < MAX(s->read_ahead / 2, 1)) {
+        return;
+    }
+
+    trace_xiso_cache_prefetch(bs, start, end);
+
+    s->prefetch_next = start;
+    s->prefetch_end = end;
+    s->prefetching = true;
+
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(bdrv_get_aio_context(bs),
+                 qemu_coroutine_create(xiso_cache_prefetch_entry, bs));
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+xiso_cache_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                          QEMUIOVector *qiov, size_t qiov_offset,
+                          BdrvRequestFlags flags)
+{
+    BDRVXisoCacheState *s = bs->opaque;
+
+    if (offset + bytes > s->length) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    if (s->map) {
+        stat64_add(&xiso_cache_stats.mapped, 1);
+        qemu_iovec_from_buf(qiov, qiov_offset, s->map + offset, bytes);
+        return 0;
+    }
+
+    /* Large reads gain nothing from the cache and would flush it */
+    if (bytes > (int64_t)s->max_clusters * XISO_CLUSTER_SIZE / 4) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    int64_t first = offset / XISO_CLUSTER_SIZE;
+    int64_t last = (offset + bytes - 1) / XISO_CLUSTER_SIZE;
+
+    xiso_cache_track_stream(bs, first, last);
+
+    for (int64_t i = first; i <= last; i++) {
+        XisoCluster *c;
+        int ret = xiso_cache_get_cluster(bs, i, false, &c);
+        if (ret < 0) {
+            return ret;
+        }
+
+        int64_t cluster_start = i * XISO_CLUSTER_SIZE;
+        int64_t start = MAX(offset, cluster_start);
+        int64_t end = MIN(offset + bytes, cluster_start + c->len);
+        qemu_iovec_from_buf(qiov, qiov_offset + (start - offset),
+                            c->data + (start - cluster_start), end - start);
+    }
+
+    return 0;
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+xiso_cache_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+xiso_cache_co_eject(BlockDriverState *bs, bool eject_flag)
+{
+    bdrv_co_eject(bs->file->bs, eject_flag);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+xiso_cache_co_lock_medium(BlockDriverState *bs, bool locked)
+{
+    bdrv_co_lock_medium(bs->file->bs, locked);
+}
+
+static void xiso_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                  BdrvChildRole role,
+                                  BlockReopenQueue *reopen_queue,
+                                  uint64_t parent_perm,
+                                  uint64_t parent_shared,
+                                  uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, parent_perm,
+                       parent_shared, nperm, nshared);
+
+    /* Writes are not supported, never take more than the parent asked for */
+    *nperm &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+    *nperm |= parent_perm & (BLK_PERM_WRITE | BLK_PERM_RESIZE);
+}
+
+static BlockDriver bdrv_xiso_cache = {
+    .format_name          = XISO_CACHE_FORMAT,
+    .instance_size        = sizeof(BDRVXisoCacheState),
+
+    .bdrv_open            = xiso_cache_open,
+    .bdrv_close           = xiso_cache_close,
+    .bdrv_child_perm      = xiso_cache_child_perm,
+
+    .bdrv_co_preadv_part  = xiso_cache_co_preadv_part,
+    .bdrv_co_getlength    = xiso_cache_co_getlength,
+
+    .bdrv_co_eject        = xiso_cache_co_eject,
+    .bdrv_co_lock_medium  = xiso_cache_co_lock_medium,
+
+    .is_format            = true,
+};
+
+static void bdrv_xiso_cache_init(void)
+{
+    bdrv_register(&bdrv_xiso_cache);
+}
+
+block_init(bdrv_xiso_cache_init);
@@ -89,6 +89,21 @@ static void mcpx_apu_write(void *opaque, hwaddr addr, uint64_t val,
         stl_le_phys(&address_space_memory, d->regs[NV_PAPU_FEMEMADDR], val);
         qatomic_set(&d->regs[addr], val);
         break;
+    case NV_PAPU_EPOFBASE0 ...
+         NV_PAPU_EPIFCUR0 + 0x10 * (EP_INPUT_FIFO_COUNT - 1):
+        /*
+         * Pipelined EP jobs write their FIFO positions back when retired,
+         * retire them first so they don't overwrite this.
+         */
+        if (qatomic_read(&d->ep.pipeline.enabled)) {
+            qemu_mutex_lock(&d->lock);
+            mcpx_apu_dsp_pipeline_drain(d);
+            qatomic_set(&d->regs[addr], val);
+            qemu_mutex_unlock(&d->lock);
+        } else {
+            qatomic_set(&d->regs[addr], val);
+        }
+        break;
     default:
         if (addr < 0x20000) {
             qatomic_set(&d->regs[addr], val);
@@ -216,7 +231,7 @@ static void throttle(MCPXAPUState *d)
     }
 }
 
-static void se_frame(MCPXAPUState *d)
+void mcpx_apu_se_frame(MCPXAPUState *d)
 {
     mcpx_apu_update_dsp_preference(d);
     mcpx_debug_begin_frame();
@@ -241,11 +256,19 @@ static void se_frame(MCPXAPUState *d)
     }
     d->frame_count++;
 
-    /* Buffer for all mixbins for this frame */
-    float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME] = { 0 };
+    if (d->ep.pipeline.enabled) {
+        /* Mix voices for the next frame while the GP processes this one */
+        mcpx_apu_vp_frame_begin(d);
+        mcpx_apu_dsp_frame(d, d->vp_mixbins);
+        memset(d->vp_mixbins, 0, sizeof(d->vp_mixbins));
+        mcpx_apu_vp_frame_end(d, d->vp_mixbins);
+    } else {
+        /* Buffer for all mixbins for this frame */
+        float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME] = { 0 };
 
-    mcpx_apu_vp_frame(d, mixbins);
-    mcpx_apu_dsp_frame(d, mixbins);
+        mcpx_apu_vp_frame(d, mixbins);
+        mcpx_apu_dsp_frame(d, mixbins);
+    }
     mcpx_apu_monitor_frame(d);
 
     d->ep_frame_div++;
@@ -296,22 +319,23 @@ static void *mcpx_apu_frame_thread(void *arg)
         }
 
         throttle(d);
-        se_frame(d);
+        mcpx_apu_se_frame(d);
     }
     qemu_mutex_unlock(&d->lock);
     return NULL;
 }
 
-static void mcpx_apu_wait_for_idle(MCPXAPUState *d)
+void mcpx_apu_wait_for_idle(MCPXAPUState *d)
 {
     d->pause_requested = true;
     qemu_cond_signal(&d->cond);
     while (!d->is_idle) {
         qemu_cond_wait(&d->idle_cond, &d->lock);
     }
+    mcpx_apu_dsp_pipeline_drain(d);
 }
 
-static void mcpx_apu_resume(MCPXAPUState *d)
+void mcpx_apu_resume(MCPXAPUState *d)
 {
     d->pause_requested = false;
     qemu_cond_signal(&d->cond);
@@ -320,6 +344,7 @@ static void mcpx_apu_resume(MCPXAPUState *d)
 static void mcpx_apu_reset_locked(MCPXAPUState *d)
 {
     memset(d->regs, 0, sizeof(d->regs));
+    memset(d->vp_mixbins, 0, sizeof(d->vp_mixbins));
 
     mcpx_apu_vp_reset(d);
 
@@ -444,6 +469,7 @@ static void mcpx_apu_exitfn(PCIDevice *dev)
     bql_lock();
 
     qemu_thread_join(&d->apu_thread);
+    mcpx_apu_dsp_finalize(d);
     mcpx_apu_vp_finalize(d);
     mcpx_apu_monitor_finalize(d);
 }
@@ -547,7 +573,7 @@ const VMStateDescription vmstate_vp_ssl_data = {
     }
 };
 
-static const VMStateDescription vmstate_mcpx_apu = {
+const VMStateDescription vmstate_mcpx_apu = {
     .name = "mcpx-apu",
     .version_id = 1,
     .minimum_version_id = 1,
@@ -24,4 +24,7 @@
 
 void mcpx_apu_init(PCIBus *bus, int devfn, MemoryRegion *ram);
 
+/* Render frames from a capture as fast as possible, returns exit status */
+int mcpx_apu_bench(const char *path, int frames);
+
 #endif
@@ -68,6 +68,12 @@ struct McpxApuDebugVp
 struct McpxApuDebugDsp
 {
     int cycles;
+    struct {
+        bool enabled;
+        int cache_hits, cache_misses;
+        int last_compile_us;
+        int64_t total_compile_us;
+    } jit;
 };
 
 struct McpxApuDebug
@@ -104,6 +110,7 @@ void mcpx_apu_debug_toggle_mute(uint16_t v);
 bool mcpx_apu_debug_is_muted(uint16_t v);
 void mcpx_apu_debug_set_gp_realtime_enabled(bool enable);
 void mcpx_apu_debug_set_ep_realtime_enabled(bool enable);
+void mcpx_apu_debug_capture(const char *path, Error **errp);
 
 #ifdef __cplusplus
 }
@@ -95,6 +95,9 @@ typedef struct MCPXAPUState {
 
     uint32_t regs[0x20000];
 
+    /* VP output for the next frame when the DSPs are pipelined */
+    float vp_mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME];
+
     int ep_frame_div;
     int frame_work_acc_us;
     int frame_count;
@@ -120,14 +123,20 @@ typedef struct MCPXAPUState {
         int16_t frame_buf[256][2]; // 1 EP frame (0x400 bytes)
         SDL_AudioStream *stream;
         int queued_bytes_low, queued_bytes_high;
+        GChecksum *checksum; // Hash of monitored output, for benchmarking
     } monitor;
 } MCPXAPUState;
 
 extern MCPXAPUState *g_state; // Used via debug handlers
+extern const VMStateDescription vmstate_mcpx_apu;
 extern struct McpxApuDebug g_dbg, g_dbg_cache;
 extern int g_dbg_voice_monitor;
 extern uint64_t g_dbg_muted_voices[4];
 
+void mcpx_apu_se_frame(MCPXAPUState *d);
+void mcpx_apu_wait_for_idle(MCPXAPUState *d);
+void mcpx_apu_resume(MCPXAPUState *d);
+
 void mcpx_debug_begin_frame(void);
 void mcpx_debug_end_frame(void);
 
@@ -0,0 +1,280 @@
+/*
+ * QEMU MCPX Audio Processing Unit implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "apu_int.h"
+#include "io/channel-file.h"
+#include "migration/qemu-file.h"
+#include "qapi/error.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/timer.h"
+
+/*
+ * APU state capture and offline render benchmark.
+ *
+ * A capture holds everything a frame consumes: the device state serialized
+ * with the same VMState description used for snapshots (registers, GP/EP
+ * DSP state, voice SSL state), followed by every non-zero page of guest RAM
+ * so voice descriptors, SGE tables and sample data are available. The
+ * benchmark restores a capture into an APU whose CPU is never started and
+ * renders frames back-to-back, without throttling or audio output.
+ */
+
+#define CAPTURE_MAGIC 0x58415043 /* "XAPC" */
+#define CAPTURE_VERSION 1
+#define CAPTURE_PAGE_SIZE 4096
+#define CAPTURE_PAGE_END 0xFFFFFFFF
+
+/* se_frame() renders 32 samples at 48 kHz */
+#define FRAMES_PER_SEC (48000 / NUM_SAMPLES_PER_FRAME)
+
+typedef struct BenchResult {
+    int64_t total_us;
+    int64_t vp_us;
+    int64_t gp_cycles;
+    int64_t ep_cycles;
+    uint32_t programs;
+    int64_t compile_us;
+    char *hash;
+} BenchResult;
+
+void mcpx_apu_debug_capture(const char *path, Error **errp)
+{
+    MCPXAPUState *d = g_state;
+    uint64_t ram_size = memory_region_size(d->ram);
+
+    QIOChannelFile *ioc = qio_channel_file_new_path(
+        path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0660, errp);
+    if (!ioc) {
+        return;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "mcpx-apu-capture");
+    QEMUFile *f = qemu_file_new_output(QIO_CHANNEL(ioc));
+    object_unref(OBJECT(ioc));
+
+    qemu_mutex_lock(&d->lock);
+    bool was_running = !d->pause_requested;
+    mcpx_apu_wait_for_idle(d);
+    dsp_sync_to_vm(d->gp.dsp);
+    dsp_sync_to_vm(d->ep.dsp);
+
+    qemu_put_be32(f, CAPTURE_MAGIC);
+    qemu_put_be32(f, CAPTURE_VERSION);
+    qemu_put_be64(f, ram_size);
+    int ret = vmstate_save_state(f, &vmstate_mcpx_apu, d, NULL, errp);
+    if (ret == 0) {
+        for (uint64_t i = 0; i < ram_size / CAPTURE_PAGE_SIZE; i++) {
+            const uint8_t *page = d->ram_ptr + i * CAPTURE_PAGE_SIZE;
+            if (!buffer_is_zero(page, CAPTURE_PAGE_SIZE)) {
+                qemu_put_be32(f, i);
+                qemu_put_buffer(f, page, CAPTURE_PAGE_SIZE);
+            }
+        }
+        qemu_put_be32(f, CAPTURE_PAGE_END);
+    }
+
+    if (was_running) {
+        dsp_sync_from_vm(d->gp.dsp);
+        dsp_sync_from_vm(d->ep.dsp);
+        mcpx_apu_resume(d);
+    }
+    qemu_mutex_unlock(&d->lock);
+
+    if (qemu_fclose(f) < 0 && ret == 0) {
+        error_setg(errp, "Failed to write APU capture to %s", path);
+    }
+}
+
+/* Must be called with the APU idle and d->lock released */
+static bool bench_load_capture(MCPXAPUState *d, const char *path,
+                               Error **errp)
+{
+    QIOChannelFile *ioc =
+        qio_channel_file_new_path(path, O_RDONLY | O_BINARY, 0, errp);
+    if (!ioc) {
+        return false;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "mcpx-apu-capture");
+    QEMUFile *f = qemu_file_new_input(QIO_CHANNEL(ioc));
+    object_unref(OBJECT(ioc));
+
+    bool ok = false;
+    uint32_t magic = qemu_get_be32(f);
+    uint32_t version = qemu_get_be32(f);
+    if (magic != CAPTURE_MAGIC || version != CAPTURE_VERSION) {
+        error_setg(errp, "%s is not a supported APU capture", path);
+        goto out;
+    }
+
+    uint64_t ram_size = qemu_get_be64(f);
+    if (ram_size > memory_region_size(d->ram)) {
+        error_setg(errp, "Capture requires %" PRIu64 " MiB of RAM",
+                   ram_size >> 20);
+        goto out;
+    }
+
+    if (vmstate_load_state(f, &vmstate_mcpx_apu, d,
+                           vmstate_mcpx_apu.version_id, errp) < 0) {
+        goto out;
+    }
+
+    memset(d->ram_ptr, 0, memory_region_size(d->ram));
+    while (true) {
+        uint32_t page = qemu_get_be32(f);
+        if (qemu_file_get_error(f) ||
+            (page != CAPTURE_PAGE_END &&
+             page >= ram_size / CAPTURE_PAGE_SIZE)) {
+            error_setg(errp, "APU capture %s is truncated or corrupt", path);
+            goto out;
+        }
+        if (page == CAPTURE_PAGE_END) {
+            break;
+        }
+        qemu_get_buffer(f, d->ram_ptr + (uint64_t)page * CAPTURE_PAGE_SIZE,
+                        CAPTURE_PAGE_SIZE);
+    }
+    ok = true;
+
+out:
+    qemu_fclose(f);
+    return ok;
+}
+
+/* Programs translated and time spent compiling them, summed over GP and EP */
+static void bench_get_jit_stats(MCPXAPUState *d, uint32_t *programs,
+                                int64_t *compile_us)
+{
+    DSPState *dsps[] = { d->gp.dsp, d->ep.dsp };
+    DSPJitStats stats;
+
+    *programs = 0;
+    *compile_us = 0;
+    for (int i = 0; i < ARRAY_SIZE(dsps); i++) {
+        if (dsp_get_jit_stats(dsps[i], &stats)) {
+            *programs += stats.cache_misses;
+            *compile_us += stats.total_compile_us;
+        }
+    }
+}
+
+static bool bench_run(MCPXAPUState *d, const char *path, int frames, bool jit,
+                      BenchResult *r)
+{
+    Error *local_err = NULL;
+    uint32_t programs;
+    int64_t compile_us;
+
+    memset(r, 0, sizeof(*r));
+
+    /* Switch engines before restoring, so the capture lands in the new one */
+    qemu_mutex_lock(&d->lock);
+    g_config.audio.use_dsp_jit = jit;
+    mcpx_apu_update_dsp_preference(d);
+    mcpx_apu_dsp_pipeline_drain(d);
+    qemu_mutex_unlock(&d->lock);
+
+    if (!bench_load_capture(d, path, &local_err)) {
+        error_report_err(local_err);
+        return false;
+    }
+
+    qemu_mutex_lock(&d->lock);
+    dsp_sync_from_vm(d->gp.dsp);
+    dsp_sync_from_vm(d->ep.dsp);
+
+    SDL_AudioStream *stream = d->monitor.stream;
+    d->monitor.stream = NULL;
+    d->monitor.checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    d->ep_frame_div = 0;
+    bench_get_jit_stats(d, &programs, &compile_us);
+
+    for (int i = 0; i < frames; i++) {
+        int64_t start_us = get_clock_realtime() / 1000;
+        mcpx_apu_se_frame(d);
+        r->total_us += get_clock_realtime() / 1000 - start_us;
+        r->vp_us += g_dbg.vp.total_worker_time_us;
+        r->gp_cycles += g_dbg.gp.cycles;
+        r->ep_cycles += g_dbg.ep.cycles;
+    }
+    mcpx_apu_dsp_pipeline_drain(d);
+
+    bench_get_jit_stats(d, &r->programs, &r->compile_us);
+    r->programs -= programs;
+    r->compile_us -= compile_us;
+
+    r->hash = g_strdup(g_checksum_get_string(d->monitor.checksum));
+    g_checksum_free(d->monitor.checksum);
+    d->monitor.checksum = NULL;
+    d->monitor.stream = stream;
+    qemu_mutex_unlock(&d->lock);
+
+    return true;
+}
+
+int mcpx_apu_bench(const char *path, int frames)
+{
+    MCPXAPUState *d = g_state;
+    const bool use_jit = g_config.audio.use_dsp_jit;
+    BenchResult results[2] = { 0 };
+    int status = 0;
+
+    frames = MAX(frames, 1);
+
+    printf("APU benchmark: %s, %d frames (%.2f s of audio)\n", path, frames,
+           (double)frames / FRAMES_PER_SEC);
+    printf("%-7s %10s %8s %8s %8s %10s %10s  %s\n", "Engine", "Frames/s",
+           "Realtime", "Frame us", "VP us", "GP cycles", "EP cycles",
+           "Output SHA-256");
+
+    for (int i = 0; i < ARRAY_SIZE(results); i++) {
+        bool jit = (i == 1);
+        BenchResult *r = &results[i];
+        if (!bench_run(d, path, frames, jit, r)) {
+            status = 1;
+            break;
+        }
+
+        double fps = frames * 1000000.0 / MAX(r->total_us, 1);
+        printf("%-7s %10.1f %7.1fx %8.1f %8.1f %10" PRId64 " %10" PRId64
+               "  %s\n",
+               jit ? "JIT" : "C", fps, fps / FRAMES_PER_SEC,
+               (double)r->total_us / frames, (double)r->vp_us / frames,
+               r->gp_cycles / frames, r->ep_cycles / frames, r->hash);
+
+        if (jit && r->programs) {
+            printf("JIT compiled %u programs in %.1f ms\n", r->programs,
+                   r->compile_us / 1000.0);
+            if (r->compile_us <= 0) {
+                error_report("apu bench: JIT reported no compile time for "
+                             "%u new programs", r->programs);
+                status = 1;
+            }
+        }
+    }
+
+    if (status == 0 && strcmp(results[0].hash, results[1].hash)) {
+        printf("Warning: C and JIT engine output differ\n");
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(results); i++) {
+        g_free(results[i].hash);
+    }
+
+    g_config.audio.use_dsp_jit = use_jit;
+
+    return status;
+}
@@ -175,6 +175,18 @@ void dsp_write_memory(DSPState *dsp, char space, uint32_t address,
     dsp->ops->write_memory(dsp, space, address, value);
 }
 
+void dsp_read_memory_block(DSPState *dsp, char space, uint32_t address,
+                           uint32_t *data, size_t count)
+{
+    dsp->ops->read_memory_block(dsp, space, address, data, count);
+}
+
+void dsp_write_memory_block(DSPState *dsp, char space, uint32_t address,
+                            const uint32_t *data, size_t count)
+{
+    dsp->ops->write_memory_block(dsp, space, address, data, count);
+}
+
 bool dsp_get_halt_requested(DSPState *dsp)
 {
     return dsp->ops->get_halt_requested(dsp);
@@ -228,3 +240,13 @@ void dsp_set_engine(DSPState *dsp, bool use_jit)
 
     dsp_sync_from_vm(dsp);
 }
+
+bool dsp_get_jit_stats(DSPState *dsp, DSPJitStats *stats)
+{
+    if (dsp->ops != &jit_dsp_ops) {
+        return false;
+    }
+
+    dsp_jit_get_stats(dsp, stats);
+    return true;
+}
@@ -25,6 +25,7 @@
 #ifndef DSP_H
 #define DSP_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -33,6 +34,13 @@
 
 typedef struct DSPState DSPState;
 
+typedef struct DSPJitStats {
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    int64_t last_compile_us;
+    int64_t total_compile_us;
+} DSPJitStats;
+
 typedef struct DSPOps {
     void (*finalize)(DSPState *dsp);
     void (*reset)(DSPState *dsp);
@@ -43,6 +51,10 @@ typedef struct DSPOps {
     uint32_t (*read_memory)(DSPState *dsp, char space, uint32_t addr);
     void (*write_memory)(DSPState *dsp, char space, uint32_t addr,
                          uint32_t value);
+    void (*read_memory_block)(DSPState *dsp, char space, uint32_t addr,
+                              uint32_t *data, size_t count);
+    void (*write_memory_block)(DSPState *dsp, char space, uint32_t addr,
+                               const uint32_t *data, size_t count);
     bool (*get_halt_requested)(DSPState *dsp);
     void (*set_halt_requested)(DSPState *dsp, bool idle);
     uint32_t (*get_cycle_count)(DSPState *dsp);
@@ -122,6 +134,12 @@ uint32_t dsp_read_memory(DSPState *dsp, char space, uint32_t addr);
 void dsp_write_memory(DSPState *dsp, char space, uint32_t address,
                       uint32_t value);
 
+/* Block transfers of count consecutive words starting at address */
+void dsp_read_memory_block(DSPState *dsp, char space, uint32_t address,
+                           uint32_t *data, size_t count);
+void dsp_write_memory_block(DSPState *dsp, char space, uint32_t address,
+                            const uint32_t *data, size_t count);
+
 /* Accessor functions for backend-independent state access */
 bool dsp_get_halt_requested(DSPState *dsp);
 void dsp_set_halt_requested(DSPState *dsp, bool idle);
@@ -136,4 +154,7 @@ void dsp_sync_from_vm(DSPState *dsp);
 /* Engine switching */
 void dsp_set_engine(DSPState *dsp, bool use_jit);
 
+/* JIT program cache statistics, returns false if the JIT is not in use */
+bool dsp_get_jit_stats(DSPState *dsp, DSPJitStats *stats);
+
 #endif /* DSP_H */
@@ -102,49 +102,54 @@ static void dsp_c_bootstrap(DSPState *dsp)
     memset(core->pram_opcache, 0, sizeof(core->pram_opcache));
 }
 
-static uint32_t dsp_c_read_memory(DSPState *dsp, char space, uint32_t address)
+static int dsp_c_space_id(char space)
 {
-    int space_id;
-
     switch (space) {
     case 'X':
-        space_id = DSP_SPACE_X;
-        break;
+        return DSP_SPACE_X;
     case 'Y':
-        space_id = DSP_SPACE_Y;
-        break;
+        return DSP_SPACE_Y;
     case 'P':
-        space_id = DSP_SPACE_P;
-        break;
+        return DSP_SPACE_P;
     default:
-        assert(!"Invalid dsp space when reading from memory");
-        return 0;
+        assert(!"Invalid dsp space");
+        return DSP_SPACE_X;
     }
+}
 
-    return dsp56k_read_memory(c_core(dsp), space_id, address);
+static uint32_t dsp_c_read_memory(DSPState *dsp, char space, uint32_t address)
+{
+    return dsp56k_read_memory(c_core(dsp), dsp_c_space_id(space), address);
 }
 
 static void dsp_c_write_memory(DSPState *dsp, char space, uint32_t address,
                                uint32_t value)
 {
-    int space_id;
+    dsp56k_write_memory(c_core(dsp), dsp_c_space_id(space), address, value);
+}
 
-    switch (space) {
-    case 'X':
-        space_id = DSP_SPACE_X;
-        break;
-    case 'Y':
-        space_id = DSP_SPACE_Y;
-        break;
-    case 'P':
-        space_id = DSP_SPACE_P;
-        break;
-    default:
-        assert(!"Invalid dsp space when writing to memory");
-        return;
+static void dsp_c_read_memory_block(DSPState *dsp, char space,
+                                    uint32_t address, uint32_t *data,
+                                    size_t count)
+{
+    dsp_core_t *core = c_core(dsp);
+    int space_id = dsp_c_space_id(space);
+
+    for (size_t i = 0; i < count; i++) {
+        data[i] = dsp56k_read_memory(core, space_id, address + i);
     }
+}
 
-    dsp56k_write_memory(c_core(dsp), space_id, address, value);
+static void dsp_c_write_memory_block(DSPState *dsp, char space,
+                                     uint32_t address, const uint32_t *data,
+                                     size_t count)
+{
+    dsp_core_t *core = c_core(dsp);
+    int space_id = dsp_c_space_id(space);
+
+    for (size_t i = 0; i < count; i++) {
+        dsp56k_write_memory(core, space_id, address + i, data[i]);
+    }
 }
 
 static bool dsp_c_get_halt_requested(DSPState *dsp)
@@ -296,4 +301,6 @@ const DSPOps c_dsp_ops = {
     .sync_from_vm = dsp_c_sync_from_vm,
     .sync_to_vm = dsp_c_sync_to_vm,
     .write_memory = dsp_c_write_memory,
+    .read_memory_block = dsp_c_read_memory_block,
+    .write_memory_block = dsp_c_write_memory_block,
 };
@@ -24,5 +24,6 @@ void dsp_c_init(DSPState *dsp);
 
 extern const DSPOps jit_dsp_ops;
 void dsp_jit_init(DSPState *dsp);
+void dsp_jit_get_stats(DSPState *dsp, DSPJitStats *stats);
 
 #endif /* DSP_INTERNAL_H */
@@ -19,6 +19,8 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/fast-hash.h"
+#include "qemu/timer.h"
 #include "dsp_internal.h"
 #include "debug.h"
 
@@ -33,11 +35,40 @@ static const int cinterp_to_arch[4] = {
     4, /* TRAP:        vec $08, slot 4 */
 };
 
-typedef struct JitBackend {
+/* Number of idle JIT instances kept per DSP, keyed by their PRAM image */
+#define JIT_PROGRAM_CACHE_SIZE 4
+
+typedef struct JitInstance {
     Dsp56300Jit *jit;
     uint32_t *xram;
     uint32_t *yram;
     uint32_t *pram;
+} JitInstance;
+
+/*
+ * Titles bootstrap the same few microcode images over and over. Rather than
+ * discarding translations every time, the active JIT instance is parked in a
+ * small cache keyed by a hash of its PRAM when a different program is
+ * bootstrapped, and reactivated if that program is bootstrapped again. An
+ * instance's translations are always consistent with its own PRAM buffer, so
+ * a parked instance can be resumed without invalidation.
+ */
+typedef struct JitProgramCacheEntry {
+    bool valid;
+    uint64_t pram_hash;
+    uint64_t last_used;
+    JitInstance inst;
+} JitProgramCacheEntry;
+
+typedef struct JitBackend {
+    JitInstance cur;
+    JitProgramCacheEntry cache[JIT_PROGRAM_CACHE_SIZE];
+    uint64_t cache_clock;
+    uint32_t load_buf[DSP_PRAM_SIZE];
+    DSPJitStats stats;
+    bool warmup;
+    bool warmup_ran;
+    int64_t warmup_ns;
 } JitBackend;
 
 static JitBackend *jit_be(DSPState *dsp)
@@ -68,19 +99,196 @@ static void jit_write_peripheral(void *opaque, uint32_t address, uint32_t value)
     write_peripheral((DSPState *)opaque, address, value);
 }
 
+static void jit_instance_init(DSPState *dsp, JitInstance *inst)
+{
+    /* Allocate memory buffers owned by the C side */
+    inst->xram = g_new(uint32_t, DSP_XRAM_SIZE);
+    memset(inst->xram, 0xCA, DSP_XRAM_SIZE * sizeof(uint32_t));
+    inst->yram = g_new(uint32_t, DSP_YRAM_SIZE);
+    memset(inst->yram, 0xCA, DSP_YRAM_SIZE * sizeof(uint32_t));
+    inst->pram = g_new(uint32_t, DSP_PRAM_SIZE);
+    memset(inst->pram, 0xCA, DSP_PRAM_SIZE * sizeof(uint32_t));
+
+    /* X-space: XRAM [0, 0x1000), mixbuf alias [0x1400, 0x1800), peripherals */
+    Dsp56300MemoryRegion x_regions[3] = {
+        { .start = 0x0000,
+          .end = 0x1000,
+          .kind = DSP56300_REGION_BUFFER,
+          .data = { .buffer = { .base = inst->xram, .offset = 0 } } },
+        { .start = 0x1400,
+          .end = 0x1800,
+          .kind = DSP56300_REGION_BUFFER,
+          .data = { .buffer = { .base = inst->xram, .offset = 0xC00 } } },
+        { .start = 0xFFFF80,
+          .end = 0x1000000,
+          .kind = DSP56300_REGION_CALLBACK,
+          .data = { .callback = { .opaque = dsp,
+                                  .read = jit_read_peripheral,
+                                  .write = jit_write_peripheral } } },
+    };
+
+    /* Y-space: YRAM [0, 0x800) */
+    Dsp56300MemoryRegion y_regions[1] = {
+        { .start = 0x0000,
+          .end = 0x0800,
+          .kind = DSP56300_REGION_BUFFER,
+          .data = { .buffer = { .base = inst->yram, .offset = 0 } } },
+    };
+
+    /* P-space: PRAM [0, 0x1000) */
+    Dsp56300MemoryRegion p_regions[1] = {
+        { .start = 0x0000,
+          .end = 0x1000,
+          .kind = DSP56300_REGION_BUFFER,
+          .data = { .buffer = { .base = inst->pram, .offset = 0 } } },
+    };
+
+    Dsp56300CreateInfo info = {
+        .memory_map = {
+            .x_regions = x_regions,
+            .x_count = ARRAY_SIZE(x_regions),
+            .y_regions = y_regions,
+            .y_count = ARRAY_SIZE(y_regions),
+            .p_regions = p_regions,
+            .p_count = ARRAY_SIZE(p_regions),
+        },
+    };
+
+    inst->jit = dsp56300_create(&info);
+}
+
+static void jit_instance_destroy(JitInstance *inst)
+{
+    dsp56300_destroy(inst->jit);
+    g_free(inst->xram);
+    g_free(inst->yram);
+    g_free(inst->pram);
+}
+
+/* Move execution state from the active instance to another instance */
+static void jit_instance_transfer_state(JitInstance *from, JitInstance *to)
+{
+    Dsp56300State ss;
+    dsp56300_get_state(from->jit, &ss);
+    dsp56300_set_state(to->jit, &ss);
+    memcpy(to->xram, from->xram, DSP_XRAM_SIZE * sizeof(uint32_t));
+    memcpy(to->yram, from->yram, DSP_YRAM_SIZE * sizeof(uint32_t));
+}
+
 static void dsp_jit_reset(DSPState *dsp)
 {
-    dsp56300_reset(jit_be(dsp)->jit);
+    dsp56300_reset(jit_be(dsp)->cur.jit);
 }
 
 static void dsp_jit_step(DSPState *dsp)
 {
-    dsp56300_step(jit_be(dsp)->jit);
+    dsp56300_step(jit_be(dsp)->cur.jit);
 }
 
 static void dsp_jit_run(DSPState *dsp, int cycles)
 {
-    dsp56300_run(jit_be(dsp)->jit, cycles);
+    JitBackend *be = jit_be(dsp);
+
+    if (be->warmup) {
+        int64_t start_ns = get_clock_realtime();
+        dsp56300_run(be->cur.jit, cycles);
+        be->warmup_ns += get_clock_realtime() - start_ns;
+        be->warmup_ran = true;
+    } else {
+        dsp56300_run(be->cur.jit, cycles);
+    }
+}
+
+static void dsp_jit_start_frame(DSPState *dsp)
+{
+    JitBackend *be = jit_be(dsp);
+
+    /* Time spent in the first frame of a freshly translated program is
+     * dominated by JIT compilation, report it as such. The program is loaded
+     * during a frame, so wait for a frame that has actually run it.
+     */
+    if (be->warmup && be->warmup_ran) {
+        int64_t compile_us = MAX(DIV_ROUND_UP(be->warmup_ns, 1000), 1);
+        be->stats.last_compile_us = compile_us;
+        be->stats.total_compile_us += compile_us;
+        be->warmup = false;
+    }
+
+    dsp_start_frame_impl(dsp);
+}
+
+static void jit_activate(DSPState *dsp, JitInstance *inst)
+{
+    JitBackend *be = jit_be(dsp);
+
+    be->cur = *inst;
+    dsp->dma.mem_opaque = be->cur.jit;
+}
+
+/*
+ * Switch to an instance for the PRAM image in be->load_buf, reusing cached
+ * translations if this image has been run before.
+ */
+static void jit_load_program(DSPState *dsp)
+{
+    JitBackend *be = jit_be(dsp);
+    size_t pram_bytes = DSP_PRAM_SIZE * sizeof(uint32_t);
+    uint64_t cur_hash = fast_hash((uint8_t *)be->cur.pram, pram_bytes);
+    uint64_t new_hash = fast_hash((uint8_t *)be->load_buf, pram_bytes);
+
+    if (cur_hash == new_hash) {
+        /* Same program, existing translations remain valid */
+        be->stats.cache_hits++;
+        return;
+    }
+
+    JitProgramCacheEntry *entry = NULL;
+    for (int i = 0; i < JIT_PROGRAM_CACHE_SIZE; i++) {
+        if (be->cache[i].valid && be->cache[i].pram_hash == new_hash) {
+            entry = &be->cache[i];
+            break;
+        }
+    }
+
+    JitInstance next;
+    if (entry) {
+        be->stats.cache_hits++;
+        next = entry->inst;
+    } else {
+        be->stats.cache_misses++;
+
+        /* Evict the least recently used entry, or use an empty slot */
+        entry = &be->cache[0];
+        for (int i = 0; i < JIT_PROGRAM_CACHE_SIZE; i++) {
+            if (!be->cache[i].valid) {
+                entry = &be->cache[i];
+                break;
+            }
+            if (be->cache[i].last_used < entry->last_used) {
+                entry = &be->cache[i];
+            }
+        }
+        if (entry->valid) {
+            next = entry->inst;
+        } else {
+            jit_instance_init(dsp, &next);
+        }
+        memcpy(next.pram, be->load_buf, pram_bytes);
+        dsp56300_invalidate_cache(next.jit);
+        be->warmup = true;
+        be->warmup_ran = false;
+        be->warmup_ns = 0;
+    }
+
+    jit_instance_transfer_state(&be->cur, &next);
+
+    /* Park the outgoing instance with its translations intact */
+    entry->valid = true;
+    entry->pram_hash = cur_hash;
+    entry->last_used = ++be->cache_clock;
+    entry->inst = be->cur;
+
+    jit_activate(dsp, &next);
 }
 
 static void dsp_jit_bootstrap(DSPState *dsp)
@@ -88,15 +296,21 @@ static void dsp_jit_bootstrap(DSPState *dsp)
     JitBackend *be = jit_be(dsp);
 
     /* Load scratch memory into PRAM (C-side owned buffer) */
-    dsp->dma.scratch_rw(dsp->dma.rw_opaque, (uint8_t *)be->pram, 0, 0x800 * 4,
-                        false);
+    memcpy(be->load_buf, be->cur.pram, sizeof(be->load_buf));
+    dsp->dma.scratch_rw(dsp->dma.rw_opaque, (uint8_t *)be->load_buf, 0,
+                        0x800 * 4, false);
     for (int i = 0; i < 0x800; i++) {
-        if (be->pram[i] & 0xff000000) {
-            DPRINTF("Bootstrap %04x: %08x\n", i, be->pram[i]);
-            be->pram[i] &= 0x00ffffff;
+        if (be->load_buf[i] & 0xff000000) {
+            DPRINTF("Bootstrap %04x: %08x\n", i, be->load_buf[i]);
+            be->load_buf[i] &= 0x00ffffff;
         }
     }
-    dsp56300_invalidate_cache(be->jit);
+    jit_load_program(dsp);
+}
+
+void dsp_jit_get_stats(DSPState *dsp, DSPJitStats *stats)
+{
+    *stats = jit_be(dsp)->stats;
 }
 
 static uint32_t dsp_jit_read_memory(DSPState *dsp, char space, uint32_t addr)
@@ -104,7 +318,7 @@ static uint32_t dsp_jit_read_memory(DSPState *dsp, char space, uint32_t addr)
     Dsp56300MemSpace space_id = (space == 'X') ? DSP56300_MEM_SPACE_X :
                                 (space == 'Y') ? DSP56300_MEM_SPACE_Y :
                                                  DSP56300_MEM_SPACE_P;
-    return dsp56300_read_memory(jit_be(dsp)->jit, space_id, addr);
+    return dsp56300_read_memory(jit_be(dsp)->cur.jit, space_id, addr);
 }
 
 static void dsp_jit_write_memory(DSPState *dsp, char space, uint32_t addr,
@@ -113,32 +327,100 @@ static void dsp_jit_write_memory(DSPState *dsp, char space, uint32_t addr,
     Dsp56300MemSpace space_id = (space == 'X') ? DSP56300_MEM_SPACE_X :
                                 (space == 'Y') ? DSP56300_MEM_SPACE_Y :
                                                  DSP56300_MEM_SPACE_P;
-    dsp56300_write_memory(jit_be(dsp)->jit, space_id, addr, value);
+    dsp56300_write_memory(jit_be(dsp)->cur.jit, space_id, addr, value);
+}
+
+/*
+ * Return the C-side buffer backing [addr, addr + count) if the whole range is
+ * plain RAM, so block transfers can bypass the JIT's memory dispatch. P-space
+ * writes are excluded as they must go through the JIT to invalidate code.
+ */
+static uint32_t *dsp_jit_span(JitBackend *be, char space, uint32_t addr,
+                              size_t count, bool write)
+{
+    size_t end = (size_t)addr + count;
+
+    switch (space) {
+    case 'X':
+        if (end <= DSP_XRAM_SIZE) {
+            return be->cur.xram + addr;
+        }
+        if (addr >= DSP_MIXBUFFER_BASE &&
+            end <= DSP_MIXBUFFER_BASE + DSP_MIXBUFFER_SIZE) {
+            /* Mixbuffer is aliased at xram[0xC00] */
+            return be->cur.xram + 0xC00 + (addr - DSP_MIXBUFFER_BASE);
+        }
+        break;
+    case 'Y':
+        if (end <= DSP_YRAM_SIZE) {
+            return be->cur.yram + addr;
+        }
+        break;
+    case 'P':
+        if (!write && end <= DSP_PRAM_SIZE) {
+            return be->cur.pram + addr;
+        }
+        break;
+    }
+
+    return NULL;
+}
+
+static void dsp_jit_read_memory_block(DSPState *dsp, char space,
+                                      uint32_t addr, uint32_t *data,
+                                      size_t count)
+{
+    uint32_t *span = dsp_jit_span(jit_be(dsp), space, addr, count, false);
+
+    if (span) {
+        memcpy(data, span, count * sizeof(uint32_t));
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        data[i] = dsp_jit_read_memory(dsp, space, addr + i);
+    }
+}
+
+static void dsp_jit_write_memory_block(DSPState *dsp, char space,
+                                       uint32_t addr, const uint32_t *data,
+                                       size_t count)
+{
+    uint32_t *span = dsp_jit_span(jit_be(dsp), space, addr, count, true);
+
+    if (span) {
+        memcpy(span, data, count * sizeof(uint32_t));
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        dsp_jit_write_memory(dsp, space, addr + i, data[i]);
+    }
 }
 
 static bool dsp_jit_get_halt_requested(DSPState *dsp)
 {
-    return dsp56300_halt_requested(jit_be(dsp)->jit);
+    return dsp56300_halt_requested(jit_be(dsp)->cur.jit);
 }
 
 static void dsp_jit_set_halt_requested(DSPState *dsp, bool idle)
 {
-    dsp56300_set_halt_requested(jit_be(dsp)->jit, idle);
+    dsp56300_set_halt_requested(jit_be(dsp)->cur.jit, idle);
 }
 
 static uint32_t dsp_jit_get_cycle_count(DSPState *dsp)
 {
-    return dsp56300_cycle_count(jit_be(dsp)->jit);
+    return dsp56300_cycle_count(jit_be(dsp)->cur.jit);
 }
 
 static void dsp_jit_set_cycle_count(DSPState *dsp, uint32_t count)
 {
-    dsp56300_set_cycle_count(jit_be(dsp)->jit, count);
+    dsp56300_set_cycle_count(jit_be(dsp)->cur.jit, count);
 }
 
 static void dsp_jit_invalidate_opcache(DSPState *dsp)
 {
-    dsp56300_invalidate_cache(jit_be(dsp)->jit);
+    dsp56300_invalidate_cache(jit_be(dsp)->cur.jit);
 }
 
 /*
@@ -147,7 +429,7 @@ static void dsp_jit_invalidate_opcache(DSPState *dsp)
 static void dsp_jit_sync_to_vm(DSPState *dsp)
 {
     JitBackend *be = jit_be(dsp);
-    Dsp56300Jit *jit = be->jit;
+    Dsp56300Jit *jit = be->cur.jit;
     DspCoreState *vm = &dsp->core;
 
     /* Scalar state via bulk struct */
@@ -179,11 +461,11 @@ static void dsp_jit_sync_to_vm(DSPState *dsp)
     memcpy(vm->stack[1], ss.stack[1], 16 * sizeof(uint32_t));
 
     /* Memory arrays from C-side owned buffers */
-    memcpy(vm->pram, be->pram, DSP_PRAM_SIZE * sizeof(uint32_t));
-    memcpy(vm->xram, be->xram, DSP_XRAM_SIZE * sizeof(uint32_t));
-    memcpy(vm->yram, be->yram, DSP_YRAM_SIZE * sizeof(uint32_t));
+    memcpy(vm->pram, be->cur.pram, DSP_PRAM_SIZE * sizeof(uint32_t));
+    memcpy(vm->xram, be->cur.xram, DSP_XRAM_SIZE * sizeof(uint32_t));
+    memcpy(vm->yram, be->cur.yram, DSP_YRAM_SIZE * sizeof(uint32_t));
     /* Mixbuffer is aliased at xram[0xC00] */
-    memcpy(vm->mixbuffer, be->xram + 0xC00,
+    memcpy(vm->mixbuffer, be->cur.xram + 0xC00,
            DSP_MIXBUFFER_SIZE * sizeof(uint32_t));
     /* Peripheral state: read current values via callbacks */
     for (int i = 0; i < DSP_PERIPH_SIZE; i++) {
@@ -198,15 +480,15 @@ static void dsp_jit_sync_to_vm(DSPState *dsp)
 static void dsp_jit_sync_from_vm(DSPState *dsp)
 {
     JitBackend *be = jit_be(dsp);
-    Dsp56300Jit *jit = be->jit;
+    Dsp56300Jit *jit = be->cur.jit;
     DspCoreState *vm = &dsp->core;
 
     /* Memory arrays into C-side owned buffers */
-    memcpy(be->pram, vm->pram, DSP_PRAM_SIZE * sizeof(uint32_t));
-    memcpy(be->xram, vm->xram, DSP_XRAM_SIZE * sizeof(uint32_t));
-    memcpy(be->yram, vm->yram, DSP_YRAM_SIZE * sizeof(uint32_t));
+    memcpy(be->cur.pram, vm->pram, DSP_PRAM_SIZE * sizeof(uint32_t));
+    memcpy(be->cur.xram, vm->xram, DSP_XRAM_SIZE * sizeof(uint32_t));
+    memcpy(be->cur.yram, vm->yram, DSP_YRAM_SIZE * sizeof(uint32_t));
     /* Mixbuffer is aliased at xram[0xC00] */
-    memcpy(be->xram + 0xC00, vm->mixbuffer,
+    memcpy(be->cur.xram + 0xC00, vm->mixbuffer,
            DSP_MIXBUFFER_SIZE * sizeof(uint32_t));
 
     /* Scalar state via bulk struct */
@@ -260,74 +542,14 @@ static void dsp_jit_sync_from_vm(DSPState *dsp)
     dsp56300_invalidate_cache(jit);
 }
 
-static JitBackend *dsp_create_jit_backend(DSPState *dsp)
-{
-    JitBackend *be = g_new0(JitBackend, 1);
-
-    /* Allocate memory buffers owned by the C side */
-    be->xram = g_new(uint32_t, DSP_XRAM_SIZE);
-    memset(be->xram, 0xCA, DSP_XRAM_SIZE * sizeof(uint32_t));
-    be->yram = g_new(uint32_t, DSP_YRAM_SIZE);
-    memset(be->yram, 0xCA, DSP_YRAM_SIZE * sizeof(uint32_t));
-    be->pram = g_new(uint32_t, DSP_PRAM_SIZE);
-    memset(be->pram, 0xCA, DSP_PRAM_SIZE * sizeof(uint32_t));
-
-    /* X-space: XRAM [0, 0x1000), mixbuf alias [0x1400, 0x1800), peripherals */
-    Dsp56300MemoryRegion x_regions[3] = {
-        { .start = 0x0000,
-          .end = 0x1000,
-          .kind = DSP56300_REGION_BUFFER,
-          .data = { .buffer = { .base = be->xram, .offset = 0 } } },
-        { .start = 0x1400,
-          .end = 0x1800,
-          .kind = DSP56300_REGION_BUFFER,
-          .data = { .buffer = { .base = be->xram, .offset = 0xC00 } } },
-        { .start = 0xFFFF80,
-          .end = 0x1000000,
-          .kind = DSP56300_REGION_CALLBACK,
-          .data = { .callback = { .opaque = dsp,
-                                  .read = jit_read_peripheral,
-                                  .write = jit_write_peripheral } } },
-    };
-
-    /* Y-space: YRAM [0, 0x800) */
-    Dsp56300MemoryRegion y_regions[1] = {
-        { .start = 0x0000,
-          .end = 0x0800,
-          .kind = DSP56300_REGION_BUFFER,
-          .data = { .buffer = { .base = be->yram, .offset = 0 } } },
-    };
-
-    /* P-space: PRAM [0, 0x1000) */
-    Dsp56300MemoryRegion p_regions[1] = {
-        { .start = 0x0000,
-          .end = 0x1000,
-          .kind = DSP56300_REGION_BUFFER,
-          .data = { .buffer = { .base = be->pram, .offset = 0 } } },
-    };
-
-    Dsp56300CreateInfo info = {
-        .memory_map = {
-            .x_regions = x_regions,
-            .x_count = ARRAY_SIZE(x_regions),
-            .y_regions = y_regions,
-            .y_count = ARRAY_SIZE(y_regions),
-            .p_regions = p_regions,
-            .p_count = ARRAY_SIZE(p_regions),
-        },
-    };
-
-    be->jit = dsp56300_create(&info);
-    return be;
-}
-
 void dsp_jit_init(DSPState *dsp)
 {
-    JitBackend *be = dsp_create_jit_backend(dsp);
+    JitBackend *be = g_new0(JitBackend, 1);
+    jit_instance_init(dsp, &be->cur);
     dsp->backend = be;
     dsp->ops = &jit_dsp_ops;
 
-    dsp->dma.mem_opaque = be->jit;
+    dsp->dma.mem_opaque = be->cur.jit;
     dsp->dma.mem_read = jit_dma_mem_read;
     dsp->dma.mem_write = jit_dma_mem_write;
 }
@@ -335,10 +557,12 @@ void dsp_jit_init(DSPState *dsp)
 static void dsp_jit_finalize(DSPState *dsp)
 {
     JitBackend *be = jit_be(dsp);
-    dsp56300_destroy(be->jit);
-    g_free(be->xram);
-    g_free(be->yram);
-    g_free(be->pram);
+    jit_instance_destroy(&be->cur);
+    for (int i = 0; i < JIT_PROGRAM_CACHE_SIZE; i++) {
+        if (be->cache[i].valid) {
+            jit_instance_destroy(&be->cache[i].inst);
+        }
+    }
     g_free(be);
     dsp->backend = NULL;
 }
@@ -349,9 +573,11 @@ const DSPOps jit_dsp_ops = {
     .step = dsp_jit_step,
     .run = dsp_jit_run,
     .bootstrap = dsp_jit_bootstrap,
-    .start_frame = dsp_start_frame_impl,
+    .start_frame = dsp_jit_start_frame,
     .read_memory = dsp_jit_read_memory,
     .write_memory = dsp_jit_write_memory,
+    .read_memory_block = dsp_jit_read_memory_block,
+    .write_memory_block = dsp_jit_write_memory_block,
     .get_halt_requested = dsp_jit_get_halt_requested,
     .set_halt_requested = dsp_jit_set_halt_requested,
     .get_cycle_count = dsp_jit_get_cycle_count,
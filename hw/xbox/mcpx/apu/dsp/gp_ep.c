@@ -23,6 +23,9 @@
 
 static const int16_t ep_silence[256][2] = { 0 };
 
+static void ep_pipeline_start(MCPXAPUState *d);
+static void ep_pipeline_stop(MCPXAPUState *d);
+
 void mcpx_apu_update_dsp_preference(MCPXAPUState *d)
 {
     static int last_known_dsp_pref = -1;
@@ -41,7 +44,24 @@ void mcpx_apu_update_dsp_preference(MCPXAPUState *d)
         last_known_dsp_pref = g_config.audio.use_dsp;
     }
 
+    bool pipeline = g_config.audio.dsp_pipeline.enable;
+    int latency = MAX(0, MIN(g_config.audio.dsp_pipeline.latency,
+                             EP_PIPELINE_DEPTH - 2));
+    if (pipeline != d->ep.pipeline.enabled) {
+        if (pipeline) {
+            ep_pipeline_start(d);
+        } else {
+            ep_pipeline_stop(d);
+        }
+        memset(d->vp_mixbins, 0, sizeof(d->vp_mixbins));
+    }
+    if (latency != d->ep.pipeline.latency) {
+        mcpx_apu_dsp_pipeline_drain(d);
+        d->ep.pipeline.latency = latency;
+    }
+
     if (last_known_jit_pref != (int)g_config.audio.use_dsp_jit) {
+        mcpx_apu_dsp_pipeline_drain(d);
         dsp_set_engine(d->gp.dsp, g_config.audio.use_dsp_jit);
         dsp_set_engine(d->ep.dsp, g_config.audio.use_dsp_jit);
         last_known_jit_pref = g_config.audio.use_dsp_jit;
@@ -102,7 +122,13 @@ static void ep_scratch_rw(void *opaque, uint8_t *ptr, uint32_t addr, size_t len,
                           bool dir)
 {
     MCPXAPUState *d = opaque;
+    MCPXAPUEPJob *job = d->ep.pipeline.current;
     // fprintf(stderr, "EP %s scratch 0x%x bytes (0x%x words) at %x (0x%x words)\n", dir ? "writing to" : "reading from", len, len/4, addr, addr/4);
+    if (job) {
+        scatter_gather_rw(d, job->scratch_sge, job->scratch_max_sge, ptr, addr,
+                          len, dir);
+        return;
+    }
     scatter_gather_rw(d, d->regs[NV_PAPU_EPSADDR], d->regs[NV_PAPU_EPSMAXSGE],
                       ptr, addr, len, dir);
 }
@@ -189,12 +215,73 @@ static bool ep_sink_samples(MCPXAPUState *d, uint8_t *ptr, size_t len)
     } else if ((d->monitor.point == MCPX_APU_DEBUG_MON_EP) ||
         (d->monitor.point == MCPX_APU_DEBUG_MON_GP_OR_EP)) {
         assert(len == sizeof(d->monitor.frame_buf));
-        memcpy(d->monitor.frame_buf, ptr, len);
+        MCPXAPUEPJob *job = d->ep.pipeline.current;
+        if (job) {
+            /* Called from the EP thread, hand off to the APU thread */
+            memcpy(job->frame_buf, ptr, len);
+            job->valid = true;
+        } else {
+            memcpy(d->monitor.frame_buf, ptr, len);
+        }
     }
 
     return true;
 }
 
+/* FIFO access by the EP thread, against the state captured in the job */
+static void ep_job_fifo_rw(MCPXAPUState *d, MCPXAPUEPJob *job, uint8_t *ptr,
+                           unsigned int index, size_t len, bool dir)
+{
+    MCPXAPUEPFifo *fifo;
+    if (dir) {
+        assert(index < EP_OUTPUT_FIFO_COUNT);
+        fifo = &job->fifo_out[index];
+    } else {
+        assert(index < EP_INPUT_FIFO_COUNT);
+        fifo = &job->fifo_in[index];
+    }
+
+    if (dir && index == 0 && ep_sink_samples(d, ptr, len)) {
+        assert(len <= sizeof(ep_silence));
+        ptr = (uint8_t*)ep_silence;
+    }
+
+    if (fifo->end <= fifo->base) {
+        /* Not set up, nothing was captured */
+        if (!dir) {
+            memset(ptr, 0, len);
+        }
+        return;
+    }
+
+    uint32_t cur = fifo->cur;
+    if (cur >= fifo->end) {
+        cur = cur % (fifo->end - fifo->base);
+    }
+    if (cur < fifo->base) {
+        cur = fifo->base;
+    }
+
+    if (dir) {
+        cur = circular_scatter_gather_rw(d, job->fifo_sge, job->fifo_max_sge,
+                                         ptr, fifo->base, fifo->end, cur, len,
+                                         dir);
+    } else {
+        while (len > 0) {
+            size_t n = MIN(fifo->end - cur, len);
+            memcpy(ptr, job->in_data[index] + (cur - fifo->base), n);
+            ptr += n;
+            len -= n;
+            cur += n;
+            if (cur >= fifo->end) {
+                cur = fifo->base;
+            }
+        }
+    }
+
+    fifo->cur = cur;
+}
+
 static void ep_fifo_rw(void *opaque, uint8_t *ptr, unsigned int index,
                        size_t len, bool dir)
 {
@@ -202,6 +289,12 @@ static void ep_fifo_rw(void *opaque, uint8_t *ptr, unsigned int index,
     uint32_t base;
     uint32_t end;
     hwaddr cur_reg;
+
+    if (d->ep.pipeline.current) {
+        ep_job_fifo_rw(d, d->ep.pipeline.current, ptr, index, len, dir);
+        return;
+    }
+
     if (dir) {
         assert(index < EP_OUTPUT_FIFO_COUNT);
         base = GET_MASK(d->regs[NV_PAPU_EPOFBASE0 + 0x10 * index],
@@ -360,26 +453,44 @@ static uint64_t ep_read(void *opaque, hwaddr addr, unsigned int size)
 {
     MCPXAPUState *d = opaque;
 
+    /*
+     * While the EP thread is running a job its memory can't be read directly,
+     * use what it published after the last one rather than waiting for it.
+     * No job can be queued while we hold the lock. Without the pipeline, read
+     * without the lock so the guest doesn't wait for the SE frame.
+     */
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+    bool pipelined = qatomic_read(&p->enabled);
+    bool busy = false;
+    if (pipelined) {
+        qemu_mutex_lock(&d->lock);
+        busy = p->enabled &&
+               qatomic_load_acquire(&p->completed) != p->submitted;
+        if (busy) {
+            qemu_mutex_lock(&p->mem_lock);
+        }
+    }
+
     assert(size == 4);
     assert(addr % 4 == 0);
 
     uint64_t r = 0;
     switch (addr) {
-    case NV_PAPU_EPXMEM ... NV_PAPU_EPXMEM + 0xC00 * 4 - 1: {
+    case NV_PAPU_EPXMEM ... NV_PAPU_EPXMEM + EP_XMEM_SIZE * 4 - 1: {
         uint32_t xaddr = (addr - NV_PAPU_EPXMEM) / 4;
-        r = dsp_read_memory(d->ep.dsp, 'X', xaddr);
+        r = busy ? p->mem.x[xaddr] : dsp_read_memory(d->ep.dsp, 'X', xaddr);
         // fprintf(stderr, "read EP  NV_PAPU_EPXMEM [%x] -> %x\n", xaddr, r);
         break;
     }
-    case NV_PAPU_EPYMEM ... NV_PAPU_EPYMEM + 0x100 * 4 - 1: {
+    case NV_PAPU_EPYMEM ... NV_PAPU_EPYMEM + EP_YMEM_SIZE * 4 - 1: {
         uint32_t yaddr = (addr - NV_PAPU_EPYMEM) / 4;
-        r = dsp_read_memory(d->ep.dsp, 'Y', yaddr);
+        r = busy ? p->mem.y[yaddr] : dsp_read_memory(d->ep.dsp, 'Y', yaddr);
         // fprintf(stderr, "read EP  NV_PAPU_EPYMEM [%x] -> %x\n", yaddr, r);
         break;
     }
-    case NV_PAPU_EPPMEM ... NV_PAPU_EPPMEM + 0x1000 * 4 - 1: {
+    case NV_PAPU_EPPMEM ... NV_PAPU_EPPMEM + EP_PMEM_SIZE * 4 - 1: {
         uint32_t paddr = (addr - NV_PAPU_EPPMEM) / 4;
-        r = dsp_read_memory(d->ep.dsp, 'P', paddr);
+        r = busy ? p->mem.p[paddr] : dsp_read_memory(d->ep.dsp, 'P', paddr);
         // fprintf(stderr, "read EP  NV_PAPU_EPPMEM [%x] -> %x\n", paddr, r);
         break;
     }
@@ -389,6 +500,13 @@ static uint64_t ep_read(void *opaque, hwaddr addr, unsigned int size)
     }
     DPRINTF("mcpx apu EP: read [0x%" HWADDR_PRIx "] -> 0x%lx\n", addr, r);
 
+    if (busy) {
+        qemu_mutex_unlock(&p->mem_lock);
+    }
+    if (pipelined) {
+        qemu_mutex_unlock(&d->lock);
+    }
+
     return r;
 }
 
@@ -403,20 +521,22 @@ static void ep_write(void *opaque, hwaddr addr, uint64_t val, unsigned int size)
 
     DPRINTF("mcpx apu EP: [0x%" HWADDR_PRIx "] = 0x%lx\n", addr, val);
 
+    mcpx_apu_dsp_pipeline_drain(d);
+
     switch (addr) {
-    case NV_PAPU_EPXMEM ... NV_PAPU_EPXMEM + 0xC00 * 4 - 1: {
+    case NV_PAPU_EPXMEM ... NV_PAPU_EPXMEM + EP_XMEM_SIZE * 4 - 1: {
         uint32_t xaddr = (addr - NV_PAPU_EPXMEM) / 4;
         dsp_write_memory(d->ep.dsp, 'X', xaddr, val);
         // fprintf(stderr, "ep write xmem %x = %x\n", xaddr, val);
         break;
     }
-    case NV_PAPU_EPYMEM ... NV_PAPU_EPYMEM + 0x100 * 4 - 1: {
+    case NV_PAPU_EPYMEM ... NV_PAPU_EPYMEM + EP_YMEM_SIZE * 4 - 1: {
         uint32_t yaddr = (addr - NV_PAPU_EPYMEM) / 4;
         dsp_write_memory(d->ep.dsp, 'Y', yaddr, val);
         // fprintf(stderr, "ep write ymem %x = %x\n", yaddr, val);
         break;
     }
-    case NV_PAPU_EPPMEM ... NV_PAPU_EPPMEM + 0x1000 * 4 - 1: {
+    case NV_PAPU_EPPMEM ... NV_PAPU_EPPMEM + EP_PMEM_SIZE * 4 - 1: {
         uint32_t paddr = (addr - NV_PAPU_EPPMEM) / 4;
         // fprintf(stderr, "ep write pmem %x = %x\n", paddr, val);
         dsp_write_memory(d->ep.dsp, 'P', paddr, val);
@@ -440,17 +560,280 @@ const MemoryRegionOps ep_ops = {
     .write = ep_write,
 };
 
-void mcpx_apu_dsp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME])
+static void update_jit_debug(DSPState *dsp, struct McpxApuDebugDsp *dbg)
 {
-    /* Write VP results to the GP DSP MIXBUF */
-    for (int mixbin = 0; mixbin < NUM_MIXBINS; mixbin++) {
-        uint32_t base = GP_DSP_MIXBUF_BASE + mixbin * NUM_SAMPLES_PER_FRAME;
-        for (int sample = 0; sample < NUM_SAMPLES_PER_FRAME; sample++) {
-            dsp_write_memory(d->gp.dsp, 'X', base + sample,
-                             float_to_24b(mixbins[mixbin][sample]));
+    DSPJitStats stats;
+
+    dbg->jit.enabled = dsp_get_jit_stats(dsp, &stats);
+    if (dbg->jit.enabled) {
+        dbg->jit.cache_hits = stats.cache_hits;
+        dbg->jit.cache_misses = stats.cache_misses;
+        dbg->jit.last_compile_us = stats.last_compile_us;
+        dbg->jit.total_compile_us = stats.total_compile_us;
+    }
+}
+
+static void ep_run_frame(MCPXAPUState *d)
+{
+    dsp_start_frame(d->ep.dsp);
+    dsp_set_halt_requested(d->ep.dsp, false);
+    dsp_set_cycle_count(d->ep.dsp, 0);
+    do {
+        dsp_run(d->ep.dsp, 1000);
+    } while (!dsp_get_halt_requested(d->ep.dsp) && d->ep.realtime);
+    g_dbg.ep.cycles = dsp_get_cycle_count(d->ep.dsp);
+    update_jit_debug(d->ep.dsp, &g_dbg.ep);
+}
+
+/* Publish EP memory for MMIO reads, the EP must not be running */
+static void ep_pipeline_publish_mem(MCPXAPUState *d)
+{
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+
+    qemu_mutex_lock(&p->mem_lock);
+    dsp_read_memory_block(d->ep.dsp, 'X', 0, p->mem.x, EP_XMEM_SIZE);
+    dsp_read_memory_block(d->ep.dsp, 'Y', 0, p->mem.y, EP_YMEM_SIZE);
+    dsp_read_memory_block(d->ep.dsp, 'P', 0, p->mem.p, EP_PMEM_SIZE);
+    qemu_mutex_unlock(&p->mem_lock);
+}
+
+static void *ep_pipeline_thread(void *arg)
+{
+    MCPXAPUState *d = arg;
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+
+    rcu_register_thread();
+
+    while (true) {
+        qemu_event_reset(&p->kick);
+        if (qatomic_read(&p->exiting)) {
+            break;
+        }
+
+        uint32_t seq = p->completed;
+        if (qatomic_load_acquire(&p->submitted) == seq) {
+            qemu_event_wait(&p->kick);
+            continue;
+        }
+
+        MCPXAPUEPJob *job = &p->jobs[seq % EP_PIPELINE_DEPTH];
+
+        /* FIFO positions carry over from the previous job */
+        for (int i = 0; i < EP_INPUT_FIFO_COUNT; i++) {
+            if (!job->resync) {
+                job->fifo_in[i].cur = p->in_cur[i];
+            }
         }
+        for (int i = 0; i < EP_OUTPUT_FIFO_COUNT; i++) {
+            if (!job->resync) {
+                job->fifo_out[i].cur = p->out_cur[i];
+            }
+        }
+
+        p->current = job;
+        ep_run_frame(d);
+        p->current = NULL;
+
+        for (int i = 0; i < EP_INPUT_FIFO_COUNT; i++) {
+            p->in_cur[i] = job->fifo_in[i].cur;
+        }
+        for (int i = 0; i < EP_OUTPUT_FIFO_COUNT; i++) {
+            p->out_cur[i] = job->fifo_out[i].cur;
+        }
+        ep_pipeline_publish_mem(d);
+
+        qatomic_store_release(&p->completed, seq + 1);
+        qemu_event_set(&p->done);
     }
 
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/* Wait until the EP thread has completed the given job */
+static void ep_pipeline_wait(MCPXAPUEPPipeline *p, uint32_t seq)
+{
+    while ((int32_t)(qatomic_load_acquire(&p->completed) - seq) <= 0) {
+        qemu_event_reset(&p->done);
+        if ((int32_t)(qatomic_load_acquire(&p->completed) - seq) > 0) {
+            break;
+        }
+        qemu_event_wait(&p->done);
+    }
+}
+
+/* Retire the oldest job: write back FIFO positions and deliver its output */
+static void ep_pipeline_retire(MCPXAPUState *d, bool deliver)
+{
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+    MCPXAPUEPJob *job = &p->jobs[p->consumed % EP_PIPELINE_DEPTH];
+
+    ep_pipeline_wait(p, p->consumed);
+
+    for (int i = 0; i < EP_INPUT_FIFO_COUNT; i++) {
+        SET_MASK(d->regs[NV_PAPU_EPIFCUR0 + 0x10 * i],
+                 NV_PAPU_GPOFCUR0_VALUE, job->fifo_in[i].cur);
+    }
+    for (int i = 0; i < EP_OUTPUT_FIFO_COUNT; i++) {
+        SET_MASK(d->regs[NV_PAPU_EPOFCUR0 + 0x10 * i],
+                 NV_PAPU_GPOFCUR0_VALUE, job->fifo_out[i].cur);
+    }
+
+    if (deliver && job->valid) {
+        memcpy(d->monitor.frame_buf, job->frame_buf,
+               sizeof(d->monitor.frame_buf));
+    }
+    p->consumed++;
+}
+
+static void ep_capture_fifo(MCPXAPUState *d, MCPXAPUEPFifo *fifo,
+                            hwaddr base_reg, hwaddr end_reg, hwaddr cur_reg)
+{
+    fifo->base = GET_MASK(d->regs[base_reg], NV_PAPU_GPOFBASE0_VALUE);
+    fifo->end = GET_MASK(d->regs[end_reg], NV_PAPU_GPOFEND0_VALUE);
+    fifo->cur = GET_MASK(d->regs[cur_reg], NV_PAPU_GPOFCUR0_VALUE);
+}
+
+/*
+ * Queue an EP frame, copying the GP output it will read. Returns false if the
+ * frame can't be handed off and must run on the calling thread.
+ */
+static bool ep_pipeline_submit(MCPXAPUState *d)
+{
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+
+    /* The queue is bounded, wait for the EP to free a slot */
+    while (p->submitted - p->consumed >= EP_PIPELINE_DEPTH) {
+        ep_pipeline_retire(d, true);
+    }
+
+    MCPXAPUEPJob *job = &p->jobs[p->submitted % EP_PIPELINE_DEPTH];
+
+    for (int i = 0; i < EP_INPUT_FIFO_COUNT; i++) {
+        ep_capture_fifo(d, &job->fifo_in[i], NV_PAPU_EPIFBASE0 + 0x10 * i,
+                        NV_PAPU_EPIFEND0 + 0x10 * i,
+                        NV_PAPU_EPIFCUR0 + 0x10 * i);
+        if (job->fifo_in[i].end > job->fifo_in[i].base &&
+            job->fifo_in[i].end - job->fifo_in[i].base >
+                EP_PIPELINE_FIFO_MAX) {
+            return false;
+        }
+    }
+    for (int i = 0; i < EP_OUTPUT_FIFO_COUNT; i++) {
+        ep_capture_fifo(d, &job->fifo_out[i], NV_PAPU_EPOFBASE0 + 0x10 * i,
+                        NV_PAPU_EPOFEND0 + 0x10 * i,
+                        NV_PAPU_EPOFCUR0 + 0x10 * i);
+    }
+
+    job->fifo_sge = d->regs[NV_PAPU_EPFADDR];
+    job->fifo_max_sge = d->regs[NV_PAPU_EPFMAXSGE];
+    job->scratch_sge = d->regs[NV_PAPU_EPSADDR];
+    job->scratch_max_sge = d->regs[NV_PAPU_EPSMAXSGE];
+
+    for (int i = 0; i < EP_INPUT_FIFO_COUNT; i++) {
+        MCPXAPUEPFifo *fifo = &job->fifo_in[i];
+        if (fifo->end <= fifo->base) {
+            continue;
+        }
+        size_t size = fifo->end - fifo->base;
+        if (job->in_capacity[i] < size) {
+            job->in_data[i] = g_realloc(job->in_data[i], size);
+            job->in_capacity[i] = size;
+        }
+        scatter_gather_rw(d, job->fifo_sge, job->fifo_max_sge,
+                          job->in_data[i], fifo->base, size, false);
+    }
+
+    /* With nothing in flight the registers are current */
+    job->resync = p->submitted == p->consumed;
+    job->valid = false;
+
+    if (p->mem_stale) {
+        /* EP is idle, nothing can be in flight after a drain */
+        assert(job->resync);
+        ep_pipeline_publish_mem(d);
+        p->mem_stale = false;
+    }
+
+    qatomic_store_release(&p->submitted, p->submitted + 1);
+    qemu_event_set(&p->kick);
+
+    return true;
+}
+
+/* Deliver EP output that has aged past the configured latency */
+static void ep_pipeline_consume(MCPXAPUState *d, int latency)
+{
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+
+    while (p->submitted - p->consumed > latency) {
+        ep_pipeline_retire(d, true);
+    }
+}
+
+void mcpx_apu_dsp_pipeline_drain(MCPXAPUState *d)
+{
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+
+    if (!p->enabled) {
+        return;
+    }
+
+    while (p->submitted != p->consumed) {
+        ep_pipeline_retire(d, false);
+    }
+
+    /* Callers drain before touching EP memory */
+    p->mem_stale = true;
+}
+
+static void ep_pipeline_start(MCPXAPUState *d)
+{
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+
+    assert(!p->enabled);
+    p->exiting = false;
+    p->submitted = p->completed = p->consumed = 0;
+    p->mem_stale = true;
+    qemu_mutex_init(&p->mem_lock);
+    qemu_event_init(&p->kick, false);
+    qemu_event_init(&p->done, false);
+    qemu_thread_create(&p->thread, "mcpx.ep_thread", ep_pipeline_thread, d,
+                       QEMU_THREAD_JOINABLE);
+    qatomic_set(&p->enabled, true);
+}
+
+static void ep_pipeline_stop(MCPXAPUState *d)
+{
+    MCPXAPUEPPipeline *p = &d->ep.pipeline;
+
+    assert(p->enabled);
+    mcpx_apu_dsp_pipeline_drain(d);
+    qatomic_set(&p->exiting, true);
+    qemu_event_set(&p->kick);
+    qemu_thread_join(&p->thread);
+    qemu_event_destroy(&p->kick);
+    qemu_event_destroy(&p->done);
+    qemu_mutex_destroy(&p->mem_lock);
+    qatomic_set(&p->enabled, false);
+
+    for (int i = 0; i < EP_PIPELINE_DEPTH; i++) {
+        for (int j = 0; j < EP_INPUT_FIFO_COUNT; j++) {
+            g_free(p->jobs[i].in_data[j]);
+            p->jobs[i].in_data[j] = NULL;
+            p->jobs[i].in_capacity[j] = 0;
+        }
+    }
+}
+
+void mcpx_apu_dsp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME])
+{
+    /* Write VP results to the GP DSP MIXBUF */
+    uint32_t mixbuf[NUM_MIXBINS * NUM_SAMPLES_PER_FRAME];
+    float_to_24b_array(&mixbins[0][0], mixbuf, ARRAY_SIZE(mixbuf));
+    dsp_write_memory_block(d->gp.dsp, 'X', GP_DSP_MIXBUF_BASE, mixbuf,
+                           ARRAY_SIZE(mixbuf));
+
     bool ep_enabled = (d->ep.regs[NV_PAPU_EPRST] & NV_PAPU_GPRST_GPRST) &&
                       (d->ep.regs[NV_PAPU_EPRST] & NV_PAPU_GPRST_GPDSPRST);
 
@@ -464,33 +847,33 @@ void mcpx_apu_dsp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_
             dsp_run(d->gp.dsp, 1000);
         } while (!dsp_get_halt_requested(d->gp.dsp) && d->gp.realtime);
         g_dbg.gp.cycles = dsp_get_cycle_count(d->gp.dsp);
+        update_jit_debug(d->gp.dsp, &g_dbg.gp);
 
         if ((d->monitor.point == MCPX_APU_DEBUG_MON_GP) ||
             (d->monitor.point == MCPX_APU_DEBUG_MON_GP_OR_EP && !ep_enabled)) {
             int off = (d->ep_frame_div % 8) * NUM_SAMPLES_PER_FRAME;
+            uint32_t lr[2][NUM_SAMPLES_PER_FRAME];
+            dsp_read_memory_block(d->gp.dsp, 'X', 0x1400, &lr[0][0],
+                                  2 * NUM_SAMPLES_PER_FRAME);
             for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
-                uint32_t l = dsp_read_memory(d->gp.dsp, 'X', 0x1400 + i);
-                d->monitor.frame_buf[off + i][0] = l >> 8;
-                uint32_t r =
-                    dsp_read_memory(d->gp.dsp, 'X', 0x1400 + 1 * 0x20 + i);
-                d->monitor.frame_buf[off + i][1] = r >> 8;
+                d->monitor.frame_buf[off + i][0] = lr[0][i] >> 8;
+                d->monitor.frame_buf[off + i][1] = lr[1][i] >> 8;
             }
         }
     }
 
     /* Run EP */
-    if ((d->ep.regs[NV_PAPU_EPRST] & NV_PAPU_GPRST_GPRST) &&
-        (d->ep.regs[NV_PAPU_EPRST] & NV_PAPU_GPRST_GPDSPRST)) {
-        if (d->ep_frame_div % 8 == 0) {
-            dsp_start_frame(d->ep.dsp);
-            dsp_set_halt_requested(d->ep.dsp, false);
-            dsp_set_cycle_count(d->ep.dsp, 0);
-            do {
-                dsp_run(d->ep.dsp, 1000);
-            } while (!dsp_get_halt_requested(d->ep.dsp) && d->ep.realtime);
-            g_dbg.ep.cycles = dsp_get_cycle_count(d->ep.dsp);
+    if (ep_enabled && d->ep_frame_div % 8 == 0) {
+        if (!d->ep.pipeline.enabled || !ep_pipeline_submit(d)) {
+            mcpx_apu_dsp_pipeline_drain(d);
+            ep_run_frame(d);
         }
     }
+
+    /* Collect pipelined EP output before the monitor frame is sent */
+    if (d->ep.pipeline.enabled && d->ep_frame_div % 8 == 7) {
+        ep_pipeline_consume(d, ep_enabled ? d->ep.pipeline.latency : 0);
+    }
 }
 
 void mcpx_apu_dsp_init(MCPXAPUState *d)
@@ -508,3 +891,10 @@ void mcpx_apu_dsp_init(MCPXAPUState *d)
      */
     mcpx_apu_update_dsp_preference(d);
 }
+
+void mcpx_apu_dsp_finalize(MCPXAPUState *d)
+{
+    if (d->ep.pipeline.enabled) {
+        ep_pipeline_stop(d);
+    }
+}
@@ -24,6 +24,7 @@
 #include "qemu/osdep.h"
 #include "hw/hw.h"
 #include "hw/pci/pci.h"
+#include "qemu/thread.h"
 #include "hw/xbox/mcpx/apu/apu_regs.h"
 
 #include "dsp.h"
@@ -37,17 +38,94 @@ typedef struct MCPXAPUGPState {
     uint32_t regs[0x10000];
 } MCPXAPUGPState;
 
+/* Number of EP frames that can be in flight when the EP is pipelined */
+#define EP_PIPELINE_DEPTH 4
+
+/* Largest EP input FIFO that is copied into a job, bigger ones run inline */
+#define EP_PIPELINE_FIFO_MAX (64 * 1024)
+
+#define EP_XMEM_SIZE 0xC00
+#define EP_YMEM_SIZE 0x100
+#define EP_PMEM_SIZE 0x1000
+
+typedef struct MCPXAPUEPFifo {
+    uint32_t base;
+    uint32_t end;
+    uint32_t cur;
+} MCPXAPUEPFifo;
+
+/*
+ * One EP frame queued for the EP thread. Everything the EP reads from outside
+ * its own memory is captured when the job is queued: the GP output sitting in
+ * the EP input FIFOs is copied, so the GP can keep writing its next frames
+ * while the EP runs.
+ */
+typedef struct MCPXAPUEPJob {
+    bool resync; /* Take FIFO positions from the job rather than the last one */
+    uint32_t fifo_sge;
+    uint32_t fifo_max_sge;
+    uint32_t scratch_sge;
+    uint32_t scratch_max_sge;
+    MCPXAPUEPFifo fifo_in[EP_INPUT_FIFO_COUNT];
+    MCPXAPUEPFifo fifo_out[EP_OUTPUT_FIFO_COUNT];
+    uint8_t *in_data[EP_INPUT_FIFO_COUNT];
+    size_t in_capacity[EP_INPUT_FIFO_COUNT];
+
+    /* Output sunk for the monitor */
+    bool valid;
+    int16_t frame_buf[256][2];
+} MCPXAPUEPJob;
+
+/*
+ * When pipelined, the EP runs on its own thread, created only while the mode
+ * is enabled. The APU thread queues one job per EP frame in a bounded ring and
+ * the EP thread completes them in order; the APU thread retires them
+ * `latency` EP frames later, delivering monitor output and FIFO positions.
+ * Job counters are only ever advanced by a single thread each.
+ *
+ * MMIO reads of EP memory while a job is in flight are served from `mem`,
+ * which the EP thread publishes after each job, so they never wait for it.
+ */
+typedef struct MCPXAPUEPPipeline {
+    bool enabled;
+    int latency;
+    bool exiting;
+    QemuThread thread;
+    QemuEvent kick;
+    QemuEvent done;
+    uint32_t submitted; /* Written by APU thread */
+    uint32_t completed; /* Written by EP thread */
+    uint32_t consumed;  /* Written by APU thread */
+    MCPXAPUEPJob jobs[EP_PIPELINE_DEPTH];
+
+    /* Owned by the EP thread */
+    MCPXAPUEPJob *current;
+    uint32_t in_cur[EP_INPUT_FIFO_COUNT];
+    uint32_t out_cur[EP_OUTPUT_FIFO_COUNT];
+
+    QemuMutex mem_lock;
+    bool mem_stale; /* EP memory changed since `mem` was last published */
+    struct {
+        uint32_t x[EP_XMEM_SIZE];
+        uint32_t y[EP_YMEM_SIZE];
+        uint32_t p[EP_PMEM_SIZE];
+    } mem;
+} MCPXAPUEPPipeline;
+
 typedef struct MCPXAPUEPState {
     bool realtime;
     MemoryRegion mmio;
     DSPState *dsp;
     uint32_t regs[0x10000];
+    MCPXAPUEPPipeline pipeline;
 } MCPXAPUEPState;
 
 extern const MemoryRegionOps gp_ops;
 extern const MemoryRegionOps ep_ops;
 
 void mcpx_apu_dsp_init(MCPXAPUState *d);
+void mcpx_apu_dsp_finalize(MCPXAPUState *d);
+void mcpx_apu_dsp_pipeline_drain(MCPXAPUState *d);
 void mcpx_apu_update_dsp_preference(MCPXAPUState *d);
 void mcpx_apu_dsp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME]);
 
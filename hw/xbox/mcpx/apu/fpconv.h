@@ -67,4 +67,20 @@ static inline uint32_t float_to_24b(float value)
     return int24 & 0xffffff;
 }
 
+/* Array form of float_to_24b. Rounding is done with the double-precision
+ * magic-number trick rather than lrint() so the loop has no libm calls and
+ * can be vectorized; results are identical under the default rounding mode.
+ */
+static inline void float_to_24b_array(const float *in, uint32_t *out,
+                                      int count)
+{
+    for (int i = 0; i < count; i++) {
+        double v = in[i] * (8.0 * 0x100000);
+        v = (v >= (1.0 * 0x7fffff)) ? (1.0 * 0x7fffff) : v;
+        v = (v <= (-8.0 * 0x100000)) ? (-8.0 * 0x100000) : v;
+        v = (v + 6755399441055744.0) - 6755399441055744.0;
+        out[i] = (int32_t)v & 0xffffff;
+    }
+}
+
 #endif
@@ -73,6 +73,12 @@ void mcpx_apu_monitor_frame(MCPXAPUState *d)
         return;
     }
 
+    if (d->monitor.checksum) {
+        g_checksum_update(d->monitor.checksum,
+                          (const guchar *)d->monitor.frame_buf,
+                          sizeof(d->monitor.frame_buf));
+    }
+
     if (d->monitor.stream) {
         float vu = pow(fmax(0.0, fmin(g_config.audio.volume_limit, 1.0)), M_E);
         SDL_SetAudioStreamGain(d->monitor.stream, vu);
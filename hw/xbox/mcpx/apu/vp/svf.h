@@ -88,4 +88,50 @@ static inline float run_svf(sv_filter *sv, float in) {
     return out;
 }
 
+/* Structure-of-arrays variant of the low-pass SV filter above. Each lane is
+ * an independent filter instance (e.g. one channel of one voice), allowing
+ * many filters to be run in a single pass. Sample buffers are laid out
+ * lane-minor, buf[sample * SVF_BATCH_LANES + lane], so the inner loop over
+ * lanes can be vectorized by the compiler. Unused lanes should be left with
+ * zeroed coefficients.
+ */
+#define SVF_BATCH_LANES 16
+
+typedef struct {
+    float f[SVF_BATCH_LANES];
+    float q[SVF_BATCH_LANES];
+    float qnrm[SVF_BATCH_LANES];
+    float b[SVF_BATCH_LANES];
+    float l[SVF_BATCH_LANES];
+} sv_filter_batch;
+
+static inline void setup_svf_batch_lane(sv_filter_batch *sv, int lane,
+                                        float fc, float q)
+{
+    sv->f[lane] = fc;
+    sv->q[lane] = q;
+    sv->qnrm[lane] = sqrtf(q/2.0f+0.01f);
+}
+
+/* Run num_samples samples of every lane through the low-pass SV filter */
+static inline void run_svf_lp_batch(sv_filter_batch *restrict sv,
+                                    float *restrict buf, int num_samples)
+{
+    for (int i = 0; i < num_samples; i++) {
+        float *in = &buf[i * SVF_BATCH_LANES];
+        for (int j = 0; j < SVF_BATCH_LANES; j++) {
+            float x = sv->qnrm[j] * in[j];
+            float b = sv->b[j];
+            float l = sv->l[j];
+            b = flush_to_zero(b - b * b * b * 0.001f);
+            float h = flush_to_zero(x - l - sv->q[j] * b);
+            b = b + sv->f[j] * h;
+            l = flush_to_zero(l + sv->f[j] * b);
+            sv->b[j] = b;
+            sv->l[j] = l;
+            in[j] = l;
+        }
+    }
+}
+
 #endif
@@ -54,7 +54,8 @@ static void set_notify_status(MCPXAPUState *d, uint32_t v, int notifier,
 static void voice_reset_filters(MCPXAPUState *d, uint16_t v)
 {
     assert(v < MCPX_HW_MAX_VOICES);
-    memset(&d->vp.filters[v].svf, 0, sizeof(d->vp.filters[v].svf));
+    memset(d->vp.svf.b[v], 0, sizeof(d->vp.svf.b[v]));
+    memset(d->vp.svf.l[v], 0, sizeof(d->vp.svf.l[v]));
     hrtf_filter_clear_history(&d->vp.filters[v].hrtf);
     if (d->vp.filters[v].resampler) {
         src_reset(d->vp.filters[v].resampler);
@@ -1285,10 +1286,150 @@ static void get_multipass_samples(MCPXAPUState *d,
     dump_multipass_unused_debug_info(d, v);
 }
 
-static void voice_process(MCPXAPUState *d,
-                          float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME],
-                          float sample_buf[NUM_SAMPLES_PER_FRAME][2],
-                          uint16_t v, int voice_list)
+static void voice_filter_batch(MCPXAPUState *d, VoiceWorker *w,
+                               VoiceMixItem **items, int *chs, int num_lanes)
+{
+    sv_filter_batch sv = { 0 };
+
+    for (int j = 0; j < num_lanes; j++) {
+        uint16_t v = items[j]->voice;
+        int ch = chs[j];
+        setup_svf_batch_lane(&sv, j, items[j]->fc[ch], items[j]->q[ch]);
+        sv.b[j] = d->vp.svf.b[v][ch];
+        sv.l[j] = d->vp.svf.l[v][ch];
+        for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
+            w->svf_buf[i * SVF_BATCH_LANES + j] = items[j]->samples[i][ch];
+        }
+    }
+    for (int j = num_lanes; j < SVF_BATCH_LANES; j++) {
+        for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
+            w->svf_buf[i * SVF_BATCH_LANES + j] = 0.0f;
+        }
+    }
+
+    run_svf_lp_batch(&sv, w->svf_buf, NUM_SAMPLES_PER_FRAME);
+
+    for (int j = 0; j < num_lanes; j++) {
+        uint16_t v = items[j]->voice;
+        int ch = chs[j];
+        d->vp.svf.b[v][ch] = sv.b[j];
+        d->vp.svf.l[v][ch] = sv.l[j];
+        for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
+            items[j]->samples[i][ch] =
+                clampf(w->svf_buf[i * SVF_BATCH_LANES + j], -1.0f, 1.0f);
+        }
+    }
+}
+
+static void voice_mix(MCPXAPUState *d, VoiceWorker *w, VoiceMixItem *item)
+{
+    uint16_t v = item->voice;
+    unsigned int channels = item->channels;
+    float ea_value = item->ea_value;
+    int *bin = item->bin;
+    uint16_t *vol = item->vol;
+    float (*samples)[2] = item->samples;
+    float (*mixbins)[NUM_SAMPLES_PER_FRAME] = w->mixbins;
+    float (*sample_buf)[2] = w->sample_buf;
+    struct McpxApuDebugVoice *dbg = &g_dbg.vp.v[v];
+
+    if (item->hrtf) {
+        hrtf_filter_process(&d->vp.filters[v].hrtf, samples, samples);
+    }
+
+    // FIXME: ParaEQ
+
+    for (int b = 0; b < 8; b++) {
+        float g = ea_value;
+        float hr;
+        if ((v < MCPX_HW_MAX_3D_VOICES) && (b < 4)) {
+            // FIXME: Not sure if submix/voice headroom factor in for HRTF
+            hr = 1 << d->vp.hrtf_headroom;
+        } else {
+            hr = 1 << d->vp.submix_headroom[bin[b]];
+        }
+        g *= attenuate(vol[b])/hr;
+        for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
+            mixbins[bin[b]][i] += g*samples[i][b % channels];
+        }
+    }
+
+    if (d->monitor.point == MCPX_APU_DEBUG_MON_VP) {
+        /* For VP mon, simply mix all voices together here, selecting the
+         * maximal volume used for any given mixbin as the overall volume for
+         * this voice.
+         *
+         * If the current voice belongs to a multipass sub-voice group we must
+         * skip it here to avoid mixing it in twice because the sub-voices are
+         * mixed into the multipass bin and that sub-mix will be mixed in here
+         * later when the destination (i.e. second pass) voice is processed.
+         * TODO: Are the 2D, 3D and MP voice lists merely a DirectSound
+         *       convention? Perhaps hardware doesn't care if e.g. a multipass
+         *       voice is in the 2D or 3D list. On the other hand, MON_VP is
+         *       not how the hardware works anyway so not much point worrying
+         *       about precise emulation here. DirectSound compatibility is
+         *       enough.
+         */
+        int mp_bin = -1;
+        uint16_t mp_dst_voice = 0xFFFF;
+        if (item->list == NV1BA0_PIO_SET_ANTECEDENT_VOICE_LIST_MP_TOP - 1) {
+            mp_bin = peek_ahead_multipass_bin(d, v, &mp_dst_voice);
+        }
+        dbg->multipass_dst_voice = mp_dst_voice;
+
+        bool debug_isolation =
+            g_dbg_voice_monitor >= 0 && g_dbg_voice_monitor == v;
+        float g = 0.0f;
+        for (int b = 0; b < 8; b++) {
+            if (bin[b] == mp_bin && !debug_isolation) {
+                continue;
+            }
+            float hr = 1 << d->vp.submix_headroom[bin[b]];
+            g = fmax(g, attenuate(vol[b]) / hr);
+        }
+        g *= ea_value;
+        for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
+            sample_buf[i][0] += g*samples[i][0];
+            sample_buf[i][1] += g*samples[i][1];
+        }
+    }
+}
+
+/* Filter and mix all voices pending in the worker's mix queue. Low-pass
+ * filtering is done across voices in batches of SVF_BATCH_LANES channels.
+ */
+static void voice_mix_flush(MCPXAPUState *d, VoiceWorker *w)
+{
+    VoiceMixItem *items[SVF_BATCH_LANES];
+    int chs[SVF_BATCH_LANES];
+    int num_lanes = 0;
+
+    for (int i = 0; i < w->mix_queue_len; i++) {
+        VoiceMixItem *item = &w->mix_queue[i];
+        if (!item->lpf) {
+            continue;
+        }
+        for (int ch = 0; ch < 2; ch++) {
+            items[num_lanes] = item;
+            chs[num_lanes] = ch;
+            if (++num_lanes == SVF_BATCH_LANES) {
+                voice_filter_batch(d, w, items, chs, num_lanes);
+                num_lanes = 0;
+            }
+        }
+    }
+    if (num_lanes) {
+        voice_filter_batch(d, w, items, chs, num_lanes);
+    }
+
+    for (int i = 0; i < w->mix_queue_len; i++) {
+        voice_mix(d, w, &w->mix_queue[i]);
+    }
+    w->mix_queue_len = 0;
+}
+
+static void voice_process(MCPXAPUState *d, VoiceWorker *w, uint16_t v,
+                          int voice_list)
 {
     assert(v < MCPX_HW_MAX_VOICES);
     bool stereo = voice_get_mask(d, v, NV_PAVS_VOICE_CFG_FMT,
@@ -1328,14 +1469,22 @@ static void voice_process(MCPXAPUState *d,
     assert(ea_value >= 0.0f);
     assert(ea_value <= 1.0f);
 
-    float samples[NUM_SAMPLES_PER_FRAME][2] = { 0 };
-
     bool multipass = voice_get_mask(d, v, NV_PAVS_VOICE_CFG_FMT,
                                     NV_PAVS_VOICE_CFG_FMT_MULTIPASS);
     dbg->multipass = multipass;
 
     if (multipass) {
-        get_multipass_samples(d, mixbins, v, samples);
+        /* Sub-voices must be mixed before their submix is read back */
+        voice_mix_flush(d, w);
+    }
+
+    assert(w->mix_queue_len < ARRAY_SIZE(w->mix_queue));
+    VoiceMixItem *item = &w->mix_queue[w->mix_queue_len];
+    float (*samples)[2] = item->samples;
+    memset(item->samples, 0, sizeof(item->samples));
+
+    if (multipass) {
+        get_multipass_samples(d, w->mixbins, v, samples);
     } else {
         for (int sample_count = 0; sample_count < NUM_SAMPLES_PER_FRAME;) {
             int active = voice_get_mask(d, v, NV_PAVS_VOICE_PAR_STATE,
@@ -1441,85 +1590,31 @@ static void voice_process(MCPXAPUState *d,
             int16_t fc = voice_get_mask(
                 d, v, NV_PAVS_VOICE_TAR_FCA + (ch % channels) * 4,
                 NV_PAVS_VOICE_TAR_FCA_FC0);
-            float fc_f = clampf(pow(2, fc / 4096.0), 0.003906f, 1.0f);
+            item->fc[ch] = clampf(pow(2, fc / 4096.0), 0.003906f, 1.0f);
             uint16_t q = voice_get_mask(
                 d, v, NV_PAVS_VOICE_TAR_FCA + (ch % channels) * 4,
                 NV_PAVS_VOICE_TAR_FCA_FC1);
-            float q_f = clampf(q / (1.0 * 0x8000), 0.079407f, 1.0f);
-            sv_filter *filter = &d->vp.filters[v].svf[ch];
-            setup_svf(filter, fc_f, q_f, F_LP);
-            for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
-                samples[i][ch] = run_svf(filter, samples[i][ch]);
-                samples[i][ch] = fmin(fmax(samples[i][ch], -1.0), 1.0);
-            }
+            item->q[ch] = clampf(q / (1.0 * 0x8000), 0.079407f, 1.0f);
         }
     }
 
+    bool hrtf = false;
     if (v < MCPX_HW_MAX_3D_VOICES && g_config.audio.hrtf) {
         uint16_t hrtf_handle =
             voice_get_mask(d, v, NV_PAVS_VOICE_CFG_HRTF_TARGET,
                            NV_PAVS_VOICE_CFG_HRTF_TARGET_HANDLE);
-        if (hrtf_handle != HRTF_NULL_HANDLE) {
-            hrtf_filter_process(&d->vp.filters[v].hrtf, samples, samples);
-        }
-    }
-
-    // FIXME: ParaEQ
-
-    for (int b = 0; b < 8; b++) {
-        float g = ea_value;
-        float hr;
-        if ((v < MCPX_HW_MAX_3D_VOICES) && (b < 4)) {
-            // FIXME: Not sure if submix/voice headroom factor in for HRTF
-            hr = 1 << d->vp.hrtf_headroom;
-        } else {
-            hr = 1 << d->vp.submix_headroom[bin[b]];
-        }
-        g *= attenuate(vol[b])/hr;
-        for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
-            mixbins[bin[b]][i] += g*samples[i][b % channels];
-        }
-    }
-
-    if (d->monitor.point == MCPX_APU_DEBUG_MON_VP) {
-        /* For VP mon, simply mix all voices together here, selecting the
-         * maximal volume used for any given mixbin as the overall volume for
-         * this voice.
-         *
-         * If the current voice belongs to a multipass sub-voice group we must
-         * skip it here to avoid mixing it in twice because the sub-voices are
-         * mixed into the multipass bin and that sub-mix will be mixed in here
-         * later when the destination (i.e. second pass) voice is processed.
-         * TODO: Are the 2D, 3D and MP voice lists merely a DirectSound
-         *       convention? Perhaps hardware doesn't care if e.g. a multipass
-         *       voice is in the 2D or 3D list. On the other hand, MON_VP is
-         *       not how the hardware works anyway so not much point worrying
-         *       about precise emulation here. DirectSound compatibility is
-         *       enough.
-         */
-        int mp_bin = -1;
-        uint16_t mp_dst_voice = 0xFFFF;
-        if (voice_list == NV1BA0_PIO_SET_ANTECEDENT_VOICE_LIST_MP_TOP - 1) {
-            mp_bin = peek_ahead_multipass_bin(d, v, &mp_dst_voice);
-        }
-        dbg->multipass_dst_voice = mp_dst_voice;
-
-        bool debug_isolation =
-            g_dbg_voice_monitor >= 0 && g_dbg_voice_monitor == v;
-        float g = 0.0f;
-        for (int b = 0; b < 8; b++) {
-            if (bin[b] == mp_bin && !debug_isolation) {
-                continue;
-            }
-            float hr = 1 << d->vp.submix_headroom[bin[b]];
-            g = fmax(g, attenuate(vol[b]) / hr);
-        }
-        g *= ea_value;
-        for (int i = 0; i < NUM_SAMPLES_PER_FRAME; i++) {
-            sample_buf[i][0] += g*samples[i][0];
-            sample_buf[i][1] += g*samples[i][1];
-        }
-    }
+        hrtf = (hrtf_handle != HRTF_NULL_HANDLE);
+    }
+
+    item->voice = v;
+    item->list = voice_list;
+    item->channels = channels;
+    item->lpf = lpf;
+    item->hrtf = hrtf;
+    item->ea_value = ea_value;
+    memcpy(item->bin, bin, sizeof(item->bin));
+    memcpy(item->vol, vol, sizeof(item->vol));
+    w->mix_queue_len++;
 }
 
 static void get_voice_bin_src_dst(MCPXAPUState *d, int v,
@@ -1607,9 +1702,10 @@ static void *voice_worker_thread(void *arg)
                 memset(self->sample_buf, 0, sizeof(self->sample_buf));
             }
             for (int i = 0; i < self->queue_len; i++) {
-                voice_process(d, self->mixbins, self->sample_buf,
-                              self->queue[i].voice, self->queue[i].list);
+                voice_process(d, self, self->queue[i].voice,
+                              self->queue[i].list);
             }
+            voice_mix_flush(d, self);
 
             qemu_mutex_lock(&vwd->lock);
 
@@ -1717,13 +1813,12 @@ static bool any_queued_voice_locked(MCPXAPUState *d)
     return false;
 }
 
-static void
-voice_work_dispatch(MCPXAPUState *d,
-                    float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME])
+/* Hand queued voices to the workers without waiting for them to finish */
+static void voice_work_begin(MCPXAPUState *d)
 {
     VoiceWorkDispatch *vwd = &d->vp.voice_work_dispatch;
 
-    int64_t start_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    vwd->start_time_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
 
     while (true) {
         if (qatomic_read(&d->pause_requested)) {
@@ -1743,11 +1838,26 @@ voice_work_dispatch(MCPXAPUState *d,
     if (vwd->queue_len) {
         memset(vwd->mixbins, 0, sizeof(vwd->mixbins));
 
-        // Signal workers and wait for completion
+        // Signal workers
         voice_work_schedule(d);
         qemu_cond_broadcast(&vwd->work_pending);
-        qemu_cond_wait(&vwd->work_finished, &vwd->lock);
-        assert(!vwd->workers_pending);
+    }
+
+    qemu_mutex_unlock(&vwd->lock);
+}
+
+/* Wait for the workers to finish and collect their contributions */
+static void voice_work_end(MCPXAPUState *d,
+                           float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME])
+{
+    VoiceWorkDispatch *vwd = &d->vp.voice_work_dispatch;
+
+    qemu_mutex_lock(&vwd->lock);
+
+    if (vwd->queue_len) {
+        while (vwd->workers_pending) {
+            qemu_cond_wait(&vwd->work_finished, &vwd->lock);
+        }
         vwd->queue_len = 0;
 
         // Add voice contributions
@@ -1759,7 +1869,7 @@ voice_work_dispatch(MCPXAPUState *d,
     }
 
     int64_t end_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
-    g_dbg.vp.total_worker_time_us = end_time - start_time;
+    g_dbg.vp.total_worker_time_us = end_time - vwd->start_time_us;
 
     qemu_mutex_unlock(&vwd->lock);
 }
@@ -1806,7 +1916,7 @@ static void voice_work_finalize(MCPXAPUState *d)
     vwd->workers = NULL;
 }
 
-void mcpx_apu_vp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME])
+void mcpx_apu_vp_frame_begin(MCPXAPUState *d)
 {
     memset(d->vp.sample_buf, 0, sizeof(d->vp.sample_buf));
 
@@ -1839,7 +1949,13 @@ void mcpx_apu_vp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_P
             d->regs[current] = d->regs[next];
         }
     }
-    voice_work_dispatch(d, mixbins);
+    voice_work_begin(d);
+}
+
+void mcpx_apu_vp_frame_end(MCPXAPUState *d,
+                           float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME])
+{
+    voice_work_end(d, mixbins);
 
     if (d->monitor.point == MCPX_APU_DEBUG_MON_VP) {
         /* Mix all voices together to hear any audible voice */
@@ -1857,6 +1973,12 @@ void mcpx_apu_vp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_P
     }
 }
 
+void mcpx_apu_vp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME])
+{
+    mcpx_apu_vp_frame_begin(d);
+    mcpx_apu_vp_frame_end(d, mixbins);
+}
+
 void mcpx_apu_vp_init(MCPXAPUState *d)
 {
     voice_work_init(d);
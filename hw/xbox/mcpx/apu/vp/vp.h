@@ -44,21 +44,46 @@ typedef struct MCPXAPUVoiceFilter {
     uint16_t voice;
     float resample_buf[NUM_SAMPLES_PER_FRAME * 2];
     SRC_STATE *resampler;
-    sv_filter svf[2];
     HrtfFilter hrtf;
 } MCPXAPUVoiceFilter;
 
+/* Persistent SV filter state for all voices, in structure-of-arrays form so
+ * it can be gathered into sv_filter_batch lanes. Each voice is owned by
+ * exactly one worker per frame, so workers never touch the same entries.
+ */
+typedef struct MCPXAPUVoiceSvfState {
+    float b[MCPX_HW_MAX_VOICES][2];
+    float l[MCPX_HW_MAX_VOICES][2];
+} MCPXAPUVoiceSvfState;
+
 typedef struct VoiceWorkItem {
     int voice;
     int list;
 } VoiceWorkItem;
 
+/* Voice output pending filtering and mixing */
+typedef struct VoiceMixItem {
+    uint16_t voice;
+    int list;
+    unsigned int channels;
+    bool lpf;
+    bool hrtf;
+    float ea_value;
+    float fc[2], q[2];
+    int bin[8];
+    uint16_t vol[8];
+    float samples[NUM_SAMPLES_PER_FRAME][2];
+} VoiceMixItem;
+
 typedef struct VoiceWorker {
     QemuThread thread;
     float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME];
     float sample_buf[NUM_SAMPLES_PER_FRAME][2];
     VoiceWorkItem queue[MCPX_HW_MAX_VOICES];
     int queue_len;
+    VoiceMixItem mix_queue[MCPX_HW_MAX_VOICES];
+    int mix_queue_len;
+    float svf_buf[NUM_SAMPLES_PER_FRAME * SVF_BATCH_LANES];
 } VoiceWorker;
 
 typedef struct VoiceWorkDispatch {
@@ -69,6 +94,7 @@ typedef struct VoiceWorkDispatch {
     QemuCond work_pending;
     uint64_t workers_pending;
     QemuCond work_finished;
+    int64_t start_time_us;
     float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME];
     VoiceWorkItem queue[MCPX_HW_MAX_VOICES];
     int queue_len;
@@ -78,6 +104,7 @@ typedef struct {
     MemoryRegion mmio;
     VoiceWorkDispatch voice_work_dispatch;
     MCPXAPUVoiceFilter filters[MCPX_HW_MAX_VOICES];
+    MCPXAPUVoiceSvfState svf;
 
     // FIXME: Where are these stored?
     int ssl_base_page;
@@ -106,6 +133,9 @@ extern const MemoryRegionOps vp_ops;
 void mcpx_apu_vp_init(MCPXAPUState *d);
 void mcpx_apu_vp_finalize(MCPXAPUState *d);
 void mcpx_apu_vp_frame(MCPXAPUState *d, float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME]);
+void mcpx_apu_vp_frame_begin(MCPXAPUState *d);
+void mcpx_apu_vp_frame_end(MCPXAPUState *d,
+                           float mixbins[NUM_MIXBINS][NUM_SAMPLES_PER_FRAME]);
 void mcpx_apu_vp_reset(MCPXAPUState *d);
 
 #endif
@@ -36,6 +36,7 @@
 #define MMIO_SIZE 0x400
 #define PHY_ADDR 1
 #define AUTONEG_DURATION_MS 250
+#define TX_MAX_FRAGS 16
 
 #define GET_MASK(v, mask) (((v) & (mask)) >> ctz32(mask))
 
@@ -68,9 +69,9 @@ typedef struct NvNetState {
 
     uint32_t tx_dma_buf_offset;
     uint8_t tx_dma_buf[TX_ALLOC_BUFSIZE];
-    uint8_t rx_dma_buf[RX_ALLOC_BUFSIZE];
 
     QEMUTimer *autoneg_timer;
+    QEMUBH *rx_irq_bh;
 
     /* Deprecated */
     uint8_t tx_ring_index;
@@ -83,6 +84,21 @@ struct RingDesc {
     uint16_t flags;
 } QEMU_PACKED;
 
+/*
+ * Fragments of a packet being transmitted. Descriptor buffers are mapped
+ * and handed to the backend as-is where possible, otherwise the packet so
+ * far is gathered into tx_dma_buf, which is then always the first element.
+ * The descriptors are only handed back to the guest once their buffers are
+ * no longer referenced, i.e. once sent or gathered into tx_dma_buf.
+ */
+typedef struct TxPacket {
+    struct iovec iov[TX_MAX_FRAGS];
+    int iovcnt;
+    size_t size;
+    uint32_t first_desc_addr;
+    unsigned int num_descs;
+} TxPacket;
+
 #define R(r) \
     case r:  \
         return #r;
@@ -256,14 +272,6 @@ static void set_mii_intr_status(NvNetState *s, uint32_t status)
     // FIXME: MII status mask?
 }
 
-static void send_packet(NvNetState *s, const uint8_t *buf, size_t size)
-{
-    NetClientState *nc = qemu_get_queue(s->nic);
-
-    trace_nvnet_packet_tx(size);
-    qemu_send_packet(nc, buf, size);
-}
-
 static uint16_t get_tx_ring_size(NvNetState *s)
 {
     uint32_t ring_size = get_reg(s, NVNET_RING_SIZE);
@@ -371,21 +379,17 @@ static void store_ring_desc(NvNetState *s, dma_addr_t desc_addr,
     pci_dma_write(d, desc_addr, &raw_desc, sizeof(raw_desc));
 }
 
-static bool rx_buf_available(NvNetState *s)
+static bool can_receive(NvNetState *s, uint32_t *desc_addr,
+                        struct RingDesc *desc)
 {
-    uint32_t cur_desc_addr = update_current_rx_ring_desc_addr(s);
-    struct RingDesc desc = load_ring_desc(s, cur_desc_addr);
-    return desc.flags & NV_RX_AVAIL;
-}
-
-static bool nvnet_can_receive(NetClientState *nc)
-{
-    NvNetState *s = qemu_get_nic_opaque(nc);
-
     bool rx_en = rx_enabled(s);
     bool dma_en = dma_enabled(s);
     bool link_en = link_up(s);
-    bool buf_avail = rx_buf_available(s);
+
+    *desc_addr = update_current_rx_ring_desc_addr(s);
+    *desc = load_ring_desc(s, *desc_addr);
+
+    bool buf_avail = desc->flags & NV_RX_AVAIL;
     bool can_rx = rx_en && dma_en && link_en && buf_avail;
 
     if (!can_rx) {
@@ -395,51 +399,72 @@ static bool nvnet_can_receive(NetClientState *nc)
     return can_rx;
 }
 
-static ssize_t dma_packet_to_guest(NvNetState *s, const uint8_t *buf,
-                                   size_t size)
+static bool nvnet_can_receive(NetClientState *nc)
+{
+    NvNetState *s = qemu_get_nic_opaque(nc);
+    uint32_t desc_addr;
+    struct RingDesc desc;
+
+    return can_receive(s, &desc_addr, &desc);
+}
+
+static void rx_irq_bh(void *opaque)
+{
+    NvNetState *s = opaque;
+
+    update_irq(s);
+}
+
+/*
+ * Queued packets are delivered back to back when the guest frees up
+ * descriptors, each landing in the next one. The RX interrupt is raised
+ * once from a bottom half after the whole burst rather than per packet.
+ */
+static void flush_rx_queue(NvNetState *s)
+{
+    qemu_flush_queued_packets(qemu_get_queue(s->nic));
+}
+
+static ssize_t dma_packet_to_guest(NvNetState *s, const struct iovec *iov,
+                                   int iovcnt, size_t size)
 {
     PCIDevice *d = PCI_DEVICE(s);
-    NetClientState *nc = qemu_get_queue(s->nic);
-    ssize_t rval;
+    uint32_t cur_desc_addr;
+    struct RingDesc desc;
 
-    if (!nvnet_can_receive(nc)) {
+    if (!can_receive(s, &cur_desc_addr, &desc)) {
         return -1;
     }
 
     set_dma_idle(s, false);
 
-    uint32_t base_desc_addr = get_reg(s, NVNET_RX_RING_PHYS_ADDR);
-    uint32_t cur_desc_addr = update_current_rx_ring_desc_addr(s);
-    struct RingDesc desc = load_ring_desc(s, cur_desc_addr);
-
     NVNET_DPRINTF("RX: Looking at ring descriptor %zd (0x%x): "
                   "Buffer: 0x%x, Length: 0x%x, Flags: 0x%x\n",
-                  (cur_desc_addr - base_desc_addr) / sizeof(struct RingDesc),
+                  (cur_desc_addr - get_reg(s, NVNET_RX_RING_PHYS_ADDR)) /
+                      sizeof(struct RingDesc),
                   cur_desc_addr, desc.buffer_addr, desc.length, desc.flags);
 
-    if (desc.flags & NV_RX_AVAIL) {
-        assert((desc.length + 1) >= size); // FIXME
+    assert((desc.length + 1) >= size); // FIXME
 
-        trace_nvnet_rx_dma(desc.buffer_addr, size);
-        pci_dma_write(d, desc.buffer_addr, buf, size);
+    trace_nvnet_rx_dma(desc.buffer_addr, size);
+    dma_addr_t buf_addr = desc.buffer_addr;
+    for (int i = 0; i < iovcnt; i++) {
+        pci_dma_write(d, buf_addr, iov[i].iov_base, iov[i].iov_len);
+        buf_addr += iov[i].iov_len;
+    }
 
-        desc.length = size;
-        desc.flags = NV_RX_BIT4 | NV_RX_DESCRIPTORVALID;
-        store_ring_desc(s, cur_desc_addr, desc);
+    desc.length = size;
+    desc.flags = NV_RX_BIT4 | NV_RX_DESCRIPTORVALID;
+    store_ring_desc(s, cur_desc_addr, desc);
 
-        set_intr_status(s, NVNET_IRQ_STATUS_RX);
+    or_reg(s, NVNET_IRQ_STATUS, NVNET_IRQ_STATUS_RX);
+    qemu_bh_schedule(s->rx_irq_bh);
 
-        advance_next_rx_ring_desc_addr(s);
-
-        rval = size;
-    } else {
-        NVNET_DPRINTF("Could not find free buffer!\n");
-        rval = -1;
-    }
+    advance_next_rx_ring_desc_addr(s);
 
     set_dma_idle(s, true);
 
-    return rval;
+    return size;
 }
 
 static bool tx_enabled(NvNetState *s)
@@ -491,10 +516,138 @@ static void advance_next_tx_ring_desc_addr(NvNetState *s)
     set_reg(s, NVNET_TX_RING_NEXT_DESC_PHYS_ADDR, next_desc_addr);
 }
 
-static void dma_packet_from_guest(NvNetState *s)
+static void tx_packet_init(NvNetState *s, TxPacket *pkt)
+{
+    pkt->iovcnt = 0;
+    pkt->size = s->tx_dma_buf_offset;
+
+    /* Fragments of a packet left incomplete by a previous kick */
+    if (s->tx_dma_buf_offset) {
+        pkt->iov[pkt->iovcnt++] = (struct iovec){
+            .iov_base = s->tx_dma_buf,
+            .iov_len = s->tx_dma_buf_offset,
+        };
+    }
+}
+
+static bool is_tx_fragment_mapped(NvNetState *s, const struct iovec *iov)
+{
+    return iov->iov_base != s->tx_dma_buf;
+}
+
+static void tx_packet_release(NvNetState *s, TxPacket *pkt)
 {
     PCIDevice *d = PCI_DEVICE(s);
-    bool packet_sent = false;
+
+    for (int i = 0; i < pkt->iovcnt; i++) {
+        struct iovec *iov = &pkt->iov[i];
+        if (is_tx_fragment_mapped(s, iov)) {
+            pci_dma_unmap(d, iov->iov_base, iov->iov_len,
+                          DMA_DIRECTION_TO_DEVICE, iov->iov_len);
+        }
+    }
+
+    pkt->iovcnt = 0;
+    pkt->size = 0;
+}
+
+/* Gather all fragments into tx_dma_buf */
+static void tx_packet_flatten(NvNetState *s, TxPacket *pkt)
+{
+    size_t offset = 0;
+
+    for (int i = 0; i < pkt->iovcnt; i++) {
+        struct iovec *iov = &pkt->iov[i];
+        if (is_tx_fragment_mapped(s, iov)) {
+            memcpy(&s->tx_dma_buf[offset], iov->iov_base, iov->iov_len);
+        }
+        offset += iov->iov_len;
+    }
+
+    tx_packet_release(s, pkt);
+    s->tx_dma_buf_offset = offset;
+    tx_packet_init(s, pkt);
+}
+
+static void tx_packet_add(NvNetState *s, TxPacket *pkt, dma_addr_t addr,
+                          size_t length)
+{
+    PCIDevice *d = PCI_DEVICE(s);
+
+    assert((pkt->size + length) <= sizeof(s->tx_dma_buf));
+
+    trace_nvnet_tx_dma(addr, length);
+
+    if (pkt->iovcnt < TX_MAX_FRAGS) {
+        dma_addr_t mapped_length = length;
+        void *buf =
+            pci_dma_map(d, addr, &mapped_length, DMA_DIRECTION_TO_DEVICE);
+        if (buf && mapped_length == length) {
+            pkt->iov[pkt->iovcnt++] = (struct iovec){
+                .iov_base = buf,
+                .iov_len = length,
+            };
+            pkt->size += length;
+            return;
+        }
+        if (buf) {
+            pci_dma_unmap(d, buf, mapped_length, DMA_DIRECTION_TO_DEVICE, 0);
+        }
+    }
+
+    /* Not directly accessible, or too fragmented */
+    tx_packet_flatten(s, pkt);
+    pci_dma_read(d, addr, &s->tx_dma_buf[s->tx_dma_buf_offset], length);
+    s->tx_dma_buf_offset += length;
+    pkt->iov[0] = (struct iovec){
+        .iov_base = s->tx_dma_buf,
+        .iov_len = s->tx_dma_buf_offset,
+    };
+    pkt->iovcnt = 1;
+    pkt->size = s->tx_dma_buf_offset;
+}
+
+/* Return the packet's descriptors to the guest */
+static void tx_packet_complete_descs(NvNetState *s, TxPacket *pkt)
+{
+    uint32_t base_desc_addr = get_reg(s, NVNET_TX_RING_PHYS_ADDR);
+    uint32_t max_desc_addr =
+        base_desc_addr + get_tx_ring_size(s) * sizeof(struct RingDesc);
+    uint32_t desc_addr = pkt->first_desc_addr;
+
+    for (unsigned int i = 0; i < pkt->num_descs; i++) {
+        struct RingDesc desc = load_ring_desc(s, desc_addr);
+        desc.flags &= ~(NV_TX_VALID | NV_TX_RETRYERROR | NV_TX_DEFERRED |
+                        NV_TX_CARRIERLOST | NV_TX_LATECOLLISION |
+                        NV_TX_UNDERFLOW | NV_TX_ERROR);
+        store_ring_desc(s, desc_addr, desc);
+
+        desc_addr += sizeof(struct RingDesc);
+        if (desc_addr >= max_desc_addr) {
+            desc_addr = base_desc_addr;
+        }
+    }
+
+    pkt->num_descs = 0;
+}
+
+static void tx_packet_send(NvNetState *s, TxPacket *pkt)
+{
+    NetClientState *nc = qemu_get_queue(s->nic);
+
+    trace_nvnet_packet_tx(pkt->size);
+    qemu_sendv_packet(nc, pkt->iov, pkt->iovcnt);
+
+    tx_packet_release(s, pkt);
+    tx_packet_complete_descs(s, pkt);
+    s->tx_dma_buf_offset = 0;
+}
+
+static void dma_packet_from_guest(NvNetState *s)
+{
+    unsigned int packets_sent = 0;
+    unsigned int descs_used = 0;
+    TxPacket pkt;
 
     if (!can_transmit(s)) {
         return;
@@ -504,6 +657,9 @@ static void dma_packet_from_guest(NvNetState *s)
 
     uint32_t base_desc_addr = get_reg(s, NVNET_TX_RING_PHYS_ADDR);
 
+    tx_packet_init(s, &pkt);
+    pkt.num_descs = 0;
+
     for (int i = 0; i < get_tx_ring_size(s); i++) {
         uint32_t cur_desc_addr = update_current_tx_ring_desc_addr(s);
         struct RingDesc desc = load_ring_desc(s, cur_desc_addr);
@@ -519,36 +675,31 @@ static void dma_packet_from_guest(NvNetState *s)
             break;
         }
 
-        assert((s->tx_dma_buf_offset + length) <= sizeof(s->tx_dma_buf));
-
-        trace_nvnet_tx_dma(desc.buffer_addr, length);
-        pci_dma_read(d, desc.buffer_addr, &s->tx_dma_buf[s->tx_dma_buf_offset],
-                     length);
-        s->tx_dma_buf_offset += length;
-
-        bool is_last_packet = desc.flags & NV_TX_LASTPACKET;
-        if (is_last_packet) {
-            send_packet(s, s->tx_dma_buf, s->tx_dma_buf_offset);
-            s->tx_dma_buf_offset = 0;
-            packet_sent = true;
+        if (!pkt.num_descs) {
+            pkt.first_desc_addr = cur_desc_addr;
         }
+        pkt.num_descs++;
+        tx_packet_add(s, &pkt, desc.buffer_addr, length);
 
-        desc.flags &= ~(NV_TX_VALID | NV_TX_RETRYERROR | NV_TX_DEFERRED |
-                        NV_TX_CARRIERLOST | NV_TX_LATECOLLISION |
-                        NV_TX_UNDERFLOW | NV_TX_ERROR);
-        store_ring_desc(s, cur_desc_addr, desc);
+        if (desc.flags & NV_TX_LASTPACKET) {
+            tx_packet_send(s, &pkt);
+            tx_packet_init(s, &pkt);
+            packets_sent++;
+        }
 
         advance_next_tx_ring_desc_addr(s);
-
-        if (is_last_packet) {
-            // FIXME
-            break;
-        }
+        descs_used++;
     }
 
+    /* Keep an incomplete packet until the guest queues the rest of it */
+    tx_packet_flatten(s, &pkt);
+    tx_packet_release(s, &pkt);
+    tx_packet_complete_descs(s, &pkt);
+
     set_dma_idle(s, true);
 
-    if (packet_sent) {
+    if (packets_sent) {
+        trace_nvnet_tx_batch(packets_sent, descs_used);
         set_intr_status(s, NVNET_IRQ_STATUS_TX);
     }
 }
@@ -614,20 +765,21 @@ static ssize_t nvnet_receive_iov(NetClientState *nc, const struct iovec *iov,
 {
     NvNetState *s = qemu_get_nic_opaque(nc);
     size_t size = iov_size(iov, iovcnt);
+    uint8_t dest_addr[ETH_ALEN];
 
     if (is_packet_oversized(size)) {
         trace_nvnet_rx_oversized(size);
         return size;
     }
 
-    iov_to_buf(iov, iovcnt, 0, s->rx_dma_buf, size);
+    iov_to_buf(iov, iovcnt, 0, dest_addr, sizeof(dest_addr));
 
-    if (!receive_filter(s, s->rx_dma_buf, size)) {
+    if (!receive_filter(s, dest_addr, size)) {
         trace_nvnet_rx_filter_dropped();
         return size;
     }
 
-    return dma_packet_to_guest(s, s->rx_dma_buf, size);
+    return dma_packet_to_guest(s, iov, iovcnt, size);
 }
 
 static ssize_t nvnet_receive(NetClientState *nc, const uint8_t *buf,
@@ -839,6 +991,7 @@ static void nvnet_mmio_write(void *opaque, hwaddr addr, uint64_t val,
         if (val & NVNET_TX_RX_CONTROL_KICK) {
             dump_ring_descriptors(s);
             dma_packet_from_guest(s);
+            flush_rx_queue(s);
         }
 
         if (val & NVNET_TX_RX_CONTROL_RESET) {
@@ -861,6 +1014,10 @@ static void nvnet_mmio_write(void *opaque, hwaddr addr, uint64_t val,
     case NVNET_MII_STATUS:
         set_reg_ext(s, addr, get_reg_ext(s, addr, size) & ~val, size);
         update_irq(s);
+        if (addr == NVNET_IRQ_STATUS && (val & NVNET_IRQ_STATUS_RX)) {
+            /* Guest has processed received packets, refill its ring */
+            flush_rx_queue(s);
+        }
         break;
 
     case NVNET_IRQ_MASK:
@@ -921,11 +1078,14 @@ static void nvnet_realize(PCIDevice *pci_dev, Error **errp)
                           &dev->mem_reentrancy_guard, s);
 
     s->autoneg_timer = timer_new_ms(QEMU_CLOCK_VIRTUAL, autoneg_timer, s);
+    s->rx_irq_bh =
+        qemu_bh_new_guarded(rx_irq_bh, s, &dev->mem_reentrancy_guard);
 }
 
 static void nvnet_uninit(PCIDevice *dev)
 {
     NvNetState *s = NVNET(dev);
+    qemu_bh_delete(s->rx_irq_bh);
     qemu_del_nic(s->nic);
     timer_free(s->autoneg_timer);
 }
@@ -972,10 +1132,10 @@ static void nvnet_reset(void *opaque)
 
     reset_phy_regs(s);
     memset(&s->tx_dma_buf, 0, sizeof(s->tx_dma_buf));
-    memset(&s->rx_dma_buf, 0, sizeof(s->rx_dma_buf));
     s->tx_dma_buf_offset = 0;
 
     timer_del(s->autoneg_timer);
+    qemu_bh_cancel(s->rx_irq_bh);
 
     if (qemu_get_queue(s->nic)->link_down) {
         update_regs_on_link_down(s);
@@ -1026,6 +1186,9 @@ static int nvnet_post_load(void *opaque, int version_id)
         restart_autoneg(s);
     }
 
+    /* An RX interrupt may still have been pending in the bottom half */
+    update_irq(s);
+
     return 0;
 }
 
@@ -114,6 +114,8 @@
     _X(NV2A_PROF_QUEUE_SUBMIT_3) \
     _X(NV2A_PROF_QUEUE_SUBMIT_4) \
     _X(NV2A_PROF_QUEUE_SUBMIT_5) \
+    _X(NV2A_PROF_MMIO_POLL_BLOCK) \
+    _X(NV2A_PROF_MMIO_POLL_BLOCK_US) \
 
 enum NV2A_PROF_COUNTERS_ENUM {
     #define _X(x) x,
@@ -123,6 +125,7 @@ enum NV2A_PROF_COUNTERS_ENUM {
 };
 
 #define NV2A_PROF_NUM_FRAMES 300
+#define NV2A_PROF_RESUME_FRAMES 60
 
 typedef struct NV2AStats {
     int64_t last_flip_time;
@@ -133,6 +136,14 @@ typedef struct NV2AStats {
         int counters[NV2A_PROF__COUNT];
     } frame_working, frame_history[NV2A_PROF_NUM_FRAMES];
     unsigned int frame_ptr;
+    int64_t counter_totals[NV2A_PROF__COUNT];
+    struct {
+        int64_t sync_us;         // Time to bring guest RAM up to date
+        unsigned int surfaces;   // Surfaces downloaded to do so
+        uint64_t bytes;
+        unsigned int resume_frame;
+        int resume_max_mspf;     // Worst frame time shortly after resuming
+    } savevm;
 } NV2AStats;
 
 #ifdef __cplusplus
@@ -143,8 +154,10 @@ extern NV2AStats g_nv2a_stats;
 
 const char *nv2a_profile_get_counter_name(unsigned int cnt);
 int nv2a_profile_get_counter_value(unsigned int cnt);
+int64_t nv2a_profile_get_counter_total(unsigned int cnt);
 void nv2a_profile_increment(void);
 void nv2a_profile_flip_stall(void);
+void nv2a_profile_savevm_surface(unsigned int size);
 
 static inline void nv2a_profile_inc_counter(enum NV2A_PROF_COUNTERS_ENUM cnt)
 {
@@ -20,7 +20,9 @@
  */
 
 #include "hw/xbox/nv2a/nv2a_int.h"
+#include "ui/xemu-settings.h"
 #include "qemu/main-loop.h"
+#include "exec/icount.h"
 
 void nv2a_update_irq(NV2AState *d)
 {
@@ -53,6 +55,72 @@ void nv2a_update_irq(NV2AState *d)
     }
 }
 
+/*
+ * Guest code waiting on the GPU (e.g. D3D polling DMA_GET or REF until the
+ * pusher drains, or PTIMER until some time has passed) reads the same
+ * register in a tight loop. After NV2A_POLL_THRESHOLD such reads the MMIO
+ * handler blocks instead of returning straight away, freeing the host core
+ * and the locks the spinning vCPU would otherwise contend on.
+ */
+#define NV2A_POLL_THRESHOLD 16
+#define NV2A_POLL_WINDOW_NS (20 * SCALE_US)
+#define NV2A_POLL_MIN_BLOCK_NS (10 * SCALE_US)
+
+bool nv2a_poll_detect(NV2APollDetector *p, hwaddr addr, uint64_t val,
+                      bool same_val)
+{
+    int64_t now = get_clock();
+
+    if (p->addr != addr || (same_val && p->val != val) ||
+        now - p->last_read_ns > NV2A_POLL_WINDOW_NS) {
+        p->addr = addr;
+        p->val = val;
+        p->count = 0;
+    }
+    p->last_read_ns = now;
+
+    return ++p->count >= NV2A_POLL_THRESHOLD;
+}
+
+void nv2a_poll_reset(NV2APollDetector *p)
+{
+    p->count = 0;
+}
+
+/*
+ * How long a polling vCPU may block, up to @max_ns, or 0 if it should not.
+ * The vCPU cannot take interrupts while blocked in an MMIO handler, so never
+ * sleep past the next virtual clock timer and not at all with an interrupt
+ * already pending. With icount, guest time only advances as the vCPU
+ * executes, so blocking would not let the awaited event arrive any sooner.
+ */
+int64_t nv2a_poll_block_budget_ns(int64_t max_ns)
+{
+    if (icount_enabled() ||
+        (current_cpu && cpu_test_interrupt(current_cpu, CPU_INTERRUPT_HARD))) {
+        return 0;
+    }
+
+    int64_t budget = max_ns;
+    int64_t deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                                  QEMU_TIMER_ATTR_ALL);
+    if (deadline >= 0) {
+        budget = MIN(budget, deadline);
+    }
+
+    return budget >= NV2A_POLL_MIN_BLOCK_NS ? budget : 0;
+}
+
+void nv2a_poll_account(NV2AState *d, int block, hwaddr addr, int64_t start_ns)
+{
+    int64_t ns = get_clock() - start_ns;
+
+    nv2a_profile_inc_counter(NV2A_PROF_MMIO_POLL_BLOCK);
+    g_nv2a_stats.frame_working.counters[NV2A_PROF_MMIO_POLL_BLOCK_US] +=
+        ns / SCALE_US;
+    trace_nv2a_poll_block(blocktable[block].name, addr, ns);
+}
+
 DMAObject nv_dma_load(NV2AState *d, hwaddr dma_obj_address)
 {
     assert(dma_obj_address < memory_region_size(&d->ramin));
@@ -265,7 +333,7 @@ static void nv2a_init_vga(NV2AState *d)
 static void nv2a_lock_fifo(NV2AState *d)
 {
     qemu_mutex_lock(&d->pfifo.lock);
-    qemu_cond_broadcast(&d->pfifo.fifo_cond);
+    qemu_event_set(&d->pfifo.fifo_doorbell);
     bql_unlock();
     qemu_cond_wait(&d->pfifo.fifo_idle_cond, &d->pfifo.lock);
     bql_lock();
@@ -354,7 +422,7 @@ static void nv2a_realize(PCIDevice *dev, Error **errp)
     }
 
     qemu_mutex_init(&d->pfifo.lock);
-    qemu_cond_init(&d->pfifo.fifo_cond);
+    qemu_event_init(&d->pfifo.fifo_doorbell, false);
     qemu_cond_init(&d->pfifo.fifo_idle_cond);
 }
 
@@ -363,9 +431,9 @@ static void nv2a_exitfn(PCIDevice *dev)
     NV2AState *d;
     d = NV2A_DEVICE(dev);
 
-    d->exiting = true;
+    qatomic_set(&d->exiting, true);
 
-    qemu_cond_broadcast(&d->pfifo.fifo_cond);
+    qemu_event_set(&d->pfifo.fifo_doorbell);
     qemu_thread_join(&d->pfifo.thread);
 
     pgraph_destroy(&d->pgraph);
@@ -380,10 +448,19 @@ static void nv2a_reset_hold(Object *obj, ResetType type)
 // Note: This is handled as a VM state change and not as a `pre_save` callback
 // because we want to halt the FIFO before any VM state is saved/restored to
 // avoid corruption.
+//
+// Saving only needs guest RAM to hold what the guest would see, so renderers
+// download just the surfaces that are dirty relative to it. Guest memory does
+// not change across a save, so texture, shader and surface caches all stay
+// valid and the game resumes warm.
 static void nv2a_vm_state_change(void *opaque, bool running, RunState state)
 {
     NV2AState *d = opaque;
     if (state == RUN_STATE_SAVE_VM) {
+        int64_t start = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        g_nv2a_stats.savevm.surfaces = 0;
+        g_nv2a_stats.savevm.bytes = 0;
+
         nv2a_lock_fifo(d);
         qatomic_set(&d->pfifo.halt, true);
         pgraph_pre_savevm_trigger(d);
@@ -392,6 +469,14 @@ static void nv2a_vm_state_change(void *opaque, bool running, RunState state)
         pgraph_pre_savevm_wait(d);
         bql_lock();
         nv2a_lock_fifo(d);
+
+        g_nv2a_stats.savevm.sync_us =
+            qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start;
+        g_nv2a_stats.savevm.resume_frame = g_nv2a_stats.frame_count;
+        g_nv2a_stats.savevm.resume_max_mspf = 0;
+        trace_nv2a_savevm_sync(g_nv2a_stats.savevm.surfaces,
+                               g_nv2a_stats.savevm.bytes,
+                               g_nv2a_stats.savevm.sync_us);
     } else if (state == RUN_STATE_RESTORE_VM) {
         nv2a_lock_fifo(d);
         qatomic_set(&d->pfifo.halt, true);
@@ -442,6 +527,61 @@ const VMStateDescription vmstate_nv2a_pgraph_vertex_attributes = {
     }
 };
 
+static bool nv2a_warm_needed(void *opaque)
+{
+    return g_config.perf.snapshot_warm_start;
+}
+
+static int nv2a_warm_pre_save(void *opaque)
+{
+    NV2AState *d = opaque;
+    pgraph_warm_pre_save(&d->pgraph);
+    return 0;
+}
+
+static int nv2a_warm_post_save(void *opaque)
+{
+    NV2AState *d = opaque;
+    pgraph_warm_release(&d->pgraph);
+    return 0;
+}
+
+static int nv2a_warm_pre_load(void *opaque)
+{
+    NV2AState *d = opaque;
+    pgraph_warm_release(&d->pgraph);
+    return 0;
+}
+
+static int nv2a_warm_post_load(void *opaque, int version_id)
+{
+    NV2AState *d = opaque;
+    pgraph_warm_post_load(&d->pgraph);
+    return 0;
+}
+
+// Optional, so snapshots saved without it still load
+static const VMStateDescription vmstate_nv2a_warm = {
+    .name = "nv2a/warm",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = nv2a_warm_needed,
+    .pre_save = nv2a_warm_pre_save,
+    .post_save = nv2a_warm_post_save,
+    .pre_load = nv2a_warm_pre_load,
+    .post_load = nv2a_warm_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT64(pgraph.warm.abi, NV2AState),
+        VMSTATE_UINT32(pgraph.warm.saved_textures_size, NV2AState),
+        VMSTATE_VBUFFER_ALLOC_UINT32(pgraph.warm.saved_textures, NV2AState, 0,
+                                     NULL, pgraph.warm.saved_textures_size),
+        VMSTATE_UINT32(pgraph.warm.saved_shaders_size, NV2AState),
+        VMSTATE_VBUFFER_ALLOC_UINT32(pgraph.warm.saved_shaders, NV2AState, 0,
+                                     NULL, pgraph.warm.saved_shaders_size),
+        VMSTATE_END_OF_LIST()
+    },
+};
+
 static const VMStateDescription vmstate_nv2a = {
     .name = "nv2a",
     .version_id = 3,
@@ -566,6 +706,10 @@ static const VMStateDescription vmstate_nv2a = {
         VMSTATE_BOOL(pgraph.waiting_for_context_switch, NV2AState),
         VMSTATE_END_OF_LIST()
     },
+    .subsections = (const VMStateDescription * const []) {
+        &vmstate_nv2a_warm,
+        NULL
+    },
 };
 
 static void nv2a_class_init(ObjectClass *klass, const void *data)
@@ -29,5 +29,6 @@ void nv2a_set_surface_scale_factor(unsigned int scale);
 unsigned int nv2a_get_surface_scale_factor(void);
 const uint8_t *nv2a_get_dac_palette(void);
 int nv2a_get_screen_off(void);
+void nv2a_set_flip_notifier(void (*notify)(void));
 
 #endif
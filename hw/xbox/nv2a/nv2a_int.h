@@ -67,6 +67,17 @@ typedef struct DMAObject {
     hwaddr limit;
 } DMAObject;
 
+/*
+ * Tracks back-to-back guest reads of one register, to recognize a CPU that
+ * is spinning on it
+ */
+typedef struct NV2APollDetector {
+    hwaddr addr;
+    uint64_t val;
+    int64_t last_read_ns;
+    unsigned int count;
+} NV2APollDetector;
+
 typedef struct NV2AState {
     /*< private >*/
     PCIDevice parent_obj;
@@ -99,7 +110,7 @@ typedef struct NV2AState {
         uint32_t regs[0x2000];
         QemuMutex lock;
         QemuThread thread;
-        QemuCond fifo_cond;
+        QemuEvent fifo_doorbell;
         QemuCond fifo_idle_cond;
         bool fifo_kick;
         bool halt;
@@ -150,6 +161,11 @@ typedef struct NV2AState {
         uint8_t palette[256*3];
     } puserdac;
 
+    struct {
+        NV2APollDetector user;
+        NV2APollDetector ptimer;
+    } poll;
+
 } NV2AState;
 
 typedef struct NV2ABlockInfo {
@@ -162,6 +178,12 @@ extern const NV2ABlockInfo blocktable[NV_NUM_BLOCKS];
 
 void nv2a_update_irq(NV2AState *d);
 
+bool nv2a_poll_detect(NV2APollDetector *p, hwaddr addr, uint64_t val,
+                      bool same_val);
+void nv2a_poll_reset(NV2APollDetector *p);
+int64_t nv2a_poll_block_budget_ns(int64_t max_ns);
+void nv2a_poll_account(NV2AState *d, int block, hwaddr addr, int64_t start_ns);
+
 static inline
 void nv2a_reg_log_read(int block, hwaddr addr, unsigned int size, uint64_t val)
 {
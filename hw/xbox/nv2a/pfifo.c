@@ -52,7 +52,8 @@ uint64_t pfifo_read(void *opaque, hwaddr addr, unsigned int size)
         r = NV_PFIFO_RUNOUT_STATUS_LOW_MARK; /* low mark empty */
         break;
     default:
-        r = d->pfifo.regs[addr];
+        /* DMA_PUT, DMA_GET and REF are also accessed without the lock */
+        r = qatomic_load_acquire(&d->pfifo.regs[addr]);
         break;
     }
 
@@ -80,7 +81,7 @@ void pfifo_write(void *opaque, hwaddr addr, uint64_t val, unsigned int size)
         nv2a_update_irq(d);
         break;
     default:
-        d->pfifo.regs[addr] = val;
+        qatomic_store_release(&d->pfifo.regs[addr], val);
         break;
     }
 
@@ -89,10 +90,16 @@ void pfifo_write(void *opaque, hwaddr addr, uint64_t val, unsigned int size)
     qemu_mutex_unlock(&d->pfifo.lock);
 }
 
+/*
+ * Ask the pfifo thread for another pass. May be called without pfifo.lock.
+ * Kicks coalesce until the thread picks them up, and the doorbell only
+ * costs a wake-up syscall when the thread is actually parked on it.
+ */
 void pfifo_kick(NV2AState *d)
 {
-    d->pfifo.fifo_kick = true;
-    qemu_cond_broadcast(&d->pfifo.fifo_cond);
+    if (!qatomic_xchg(&d->pfifo.fifo_kick, true)) {
+        qemu_event_set(&d->pfifo.fifo_doorbell);
+    }
 }
 
 static bool can_fifo_access(NV2AState *d) {
@@ -292,8 +299,12 @@ static void pfifo_run_pusher(NV2AState *d)
     uint8_t *dma = nv_dma_map(d, dma_instance, &dma_len);
 
     while (!pfifo_pusher_should_stall(d)) {
-        uint32_t dma_get_v = *dma_get;
-        uint32_t dma_put_v = *dma_put;
+        /*
+         * PUT and GET are accessed by the guest without pfifo.lock, see
+         * user_write. Acquire PUT so the commands before it are visible.
+         */
+        uint32_t dma_get_v = qatomic_load_acquire(dma_get);
+        uint32_t dma_put_v = qatomic_load_acquire(dma_put);
         if (dma_get_v == dma_put_v) break;
         if (dma_get_v >= dma_len) {
             assert(!"Dma value is out of range in PFIFO pusher");
@@ -427,7 +438,7 @@ static void pfifo_run_pusher(NV2AState *d)
             }
         }
 
-        *dma_get = dma_get_v;
+        qatomic_store_release(dma_get, dma_get_v);
 
         if (GET_MASK(*dma_state, NV_PFIFO_CACHE1_DMA_STATE_ERROR)) {
             break;
@@ -459,7 +470,7 @@ void *pfifo_thread(void *arg)
 
     qemu_mutex_lock(&d->pfifo.lock);
     while (true) {
-        d->pfifo.fifo_kick = false;
+        qatomic_set(&d->pfifo.fifo_kick, false);
 
         pgraph_process_pending(d);
 
@@ -469,14 +480,22 @@ void *pfifo_thread(void *arg)
 
         pgraph_process_pending_reports(d);
 
-        if (!d->pfifo.fifo_kick) {
+        if (!qatomic_read(&d->pfifo.fifo_kick)) {
             qemu_cond_broadcast(&d->pfifo.fifo_idle_cond);
 
-            // Both the pusher and puller are waiting for some action
-            qemu_cond_wait(&d->pfifo.fifo_cond, &d->pfifo.lock);
+            // Both the pusher and puller are waiting for some action. Reset
+            // the doorbell before the final check, so a kick landing in
+            // between still wakes us.
+            qemu_event_reset(&d->pfifo.fifo_doorbell);
+            if (!qatomic_read(&d->pfifo.fifo_kick) &&
+                !qatomic_read(&d->exiting)) {
+                qemu_mutex_unlock(&d->pfifo.lock);
+                qemu_event_wait(&d->pfifo.fifo_doorbell);
+                qemu_mutex_lock(&d->pfifo.lock);
+            }
         }
 
-        if (d->exiting) {
+        if (qatomic_read(&d->exiting)) {
             break;
         }
     }
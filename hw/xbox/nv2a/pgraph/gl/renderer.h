@@ -189,6 +189,8 @@ typedef struct PGRAPHGLState {
     QemuEvent downloads_complete;
     bool download_dirty_surfaces_pending;
     QemuEvent dirty_surfaces_download_complete; // common
+    bool rescale_surfaces_pending;
+    QemuEvent rescale_surfaces_complete;
 
     TextureBinding *texture_binding[NV2A_MAX_TEXTURES];
     Lru texture_cache;
@@ -258,6 +260,8 @@ void pgraph_gl_flush_draw(NV2AState *d);
 void pgraph_gl_get_report(NV2AState *d, uint32_t parameter);
 void pgraph_gl_image_blit(NV2AState *d);
 void pgraph_gl_mark_textures_possibly_dirty(NV2AState *d, hwaddr addr, hwaddr size);
+unsigned int pgraph_gl_warm_textures(NV2AState *d, const PGRAPHWarmTexture *textures, unsigned int num_textures);
+void pgraph_gl_warm_shaders(PGRAPHState *pg, const ShaderState *states, unsigned int num_states);
 void pgraph_gl_process_pending_reports(NV2AState *d);
 void pgraph_gl_surface_flush(NV2AState *d);
 void pgraph_gl_surface_update(NV2AState *d, bool upload, bool color_write, bool zeta_write);
@@ -277,6 +281,7 @@ void pgraph_gl_init_buffers(NV2AState *d);
 void pgraph_gl_finalize_buffers(PGRAPHState *pg);
 void pgraph_gl_process_pending_downloads(NV2AState *d);
 void pgraph_gl_reload_surface_scale_factor(PGRAPHState *pg);
+void pgraph_gl_rescale_surfaces(NV2AState *d);
 void pgraph_gl_render_surface_to_texture(NV2AState *d, SurfaceBinding *surface, TextureBinding *texture, TextureShape *texture_shape, int texture_unit);
 void pgraph_gl_set_surface_dirty(PGRAPHState *pg, bool color, bool zeta);
 void pgraph_gl_surface_download_if_dirty(NV2AState *d, SurfaceBinding *surface);
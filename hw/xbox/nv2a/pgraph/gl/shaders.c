@@ -789,6 +789,47 @@ static void update_shader_uniforms(PGRAPHState *pg, ShaderBinding *binding)
                           &psh_values, PshUniform__COUNT);
 }
 
+static uint64_t get_shader_state_hash(const ShaderState *state)
+{
+    return fast_hash((uint8_t *)state, sizeof(ShaderState));
+}
+
+// Must be called with shader_cache_lock held
+static ShaderBinding *get_shader_binding_for_state(PGRAPHGLState *r,
+                                                   const ShaderState *state,
+                                                   uint64_t shader_state_hash)
+{
+    LruNode *node = lru_lookup(&r->shader_cache, shader_state_hash, state);
+    ShaderBinding *binding = container_of(node, ShaderBinding, node);
+
+    if (!binding->initialized && !pgraph_gl_shader_load_from_memory(binding)) {
+        nv2a_profile_inc_counter(NV2A_PROF_SHADER_GEN);
+        generate_shaders(r, binding);
+        if (g_config.perf.cache_shaders) {
+            pgraph_gl_shader_cache_to_disk(binding);
+        }
+    }
+    assert(binding->initialized);
+
+    return binding;
+}
+
+// Compile the shaders a loaded snapshot was using ahead of its first draw
+void pgraph_gl_warm_shaders(PGRAPHState *pg, const ShaderState *states,
+                            unsigned int num_states)
+{
+    PGRAPHGLState *r = pg->gl_renderer_state;
+
+    qemu_mutex_lock(&r->shader_cache_lock);
+    for (unsigned int i = 0; i < num_states; i++) {
+        get_shader_binding_for_state(r, &states[i],
+                                     get_shader_state_hash(&states[i]));
+    }
+    // Lookups may have evicted the bound shader, look it up again on bind
+    r->shader_binding = NULL;
+    qemu_mutex_unlock(&r->shader_cache_lock);
+}
+
 void pgraph_gl_bind_shaders(PGRAPHState *pg)
 {
     PGRAPHGLState *r = pg->gl_renderer_state;
@@ -802,27 +843,14 @@ void pgraph_gl_bind_shaders(PGRAPHState *pg)
 
     ShaderBinding *old_binding = r->shader_binding;
     ShaderState state = pgraph_glsl_get_shader_state(pg);
+    uint64_t state_hash = get_shader_state_hash(&state);
 
     NV2A_GL_DGROUP_BEGIN("%s (%s)", __func__,
                          state.vsh.is_fixed_function ? "FF" : "PROG");
 
     qemu_mutex_lock(&r->shader_cache_lock);
 
-    uint64_t shader_state_hash =
-        fast_hash((uint8_t *)&state, sizeof(ShaderState));
-
-    LruNode *node = lru_lookup(&r->shader_cache, shader_state_hash, &state);
-    ShaderBinding *binding = container_of(node, ShaderBinding, node);
-
-    if (!binding->initialized && !pgraph_gl_shader_load_from_memory(binding)) {
-        nv2a_profile_inc_counter(NV2A_PROF_SHADER_GEN);
-        generate_shaders(r, binding);
-        if (g_config.perf.cache_shaders) {
-            pgraph_gl_shader_cache_to_disk(binding);
-        }
-    }
-    assert(binding->initialized);
-    r->shader_binding = binding;
+    r->shader_binding = get_shader_binding_for_state(r, &state, state_hash);
     pg->program_data_dirty = false;
 
     qemu_mutex_unlock(&r->shader_cache_lock);
@@ -831,6 +859,7 @@ void pgraph_gl_bind_shaders(PGRAPHState *pg)
     if (binding_changed) {
         nv2a_profile_inc_counter(NV2A_PROF_SHADER_BIND);
         glUseProgram(r->shader_binding->gl_program);
+        pgraph_warm_record_shader(pg, state_hash, &state);
     }
 
     // FIXME: Clear only the registers that are consumed by this binding.
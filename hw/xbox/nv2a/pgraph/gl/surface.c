@@ -44,22 +44,13 @@ void pgraph_gl_set_surface_scale_factor(NV2AState *d, unsigned int scale)
     qemu_mutex_unlock(&d->pfifo.lock);
 
     qemu_mutex_lock(&d->pgraph.lock);
-    qemu_event_reset(&r->dirty_surfaces_download_complete);
-    qatomic_set(&r->download_dirty_surfaces_pending, true);
+    qemu_event_reset(&r->rescale_surfaces_complete);
+    qatomic_set(&r->rescale_surfaces_pending, true);
     qemu_mutex_unlock(&d->pgraph.lock);
     qemu_mutex_lock(&d->pfifo.lock);
     pfifo_kick(d);
     qemu_mutex_unlock(&d->pfifo.lock);
-    qemu_event_wait(&r->dirty_surfaces_download_complete);
-
-    qemu_mutex_lock(&d->pgraph.lock);
-    qemu_event_reset(&d->pgraph.flush_complete);
-    qatomic_set(&d->pgraph.flush_pending, true);
-    qemu_mutex_unlock(&d->pgraph.lock);
-    qemu_mutex_lock(&d->pfifo.lock);
-    pfifo_kick(d);
-    qemu_mutex_unlock(&d->pfifo.lock);
-    qemu_event_wait(&d->pgraph.flush_complete);
+    qemu_event_wait(&r->rescale_surfaces_complete);
 
     qemu_mutex_lock(&d->pfifo.lock);
     qatomic_set(&d->pfifo.halt, false);
@@ -808,6 +799,9 @@ void pgraph_gl_download_dirty_surfaces(NV2AState *d)
 
     SurfaceBinding *surface;
     QTAILQ_FOREACH(surface, &r->surfaces, entry) {
+        if (surface->draw_dirty) {
+            nv2a_profile_savevm_surface(surface->pitch * surface->height);
+        }
         pgraph_gl_surface_download_if_dirty(d, surface);
     }
 
@@ -1409,6 +1403,108 @@ static void surface_get_dimensions(PGRAPHState *pg, unsigned int *width,
     }
 }
 
+/* Replace the surface texture with one at the current scale factor, blitting
+ * the old contents across.
+ */
+static void rescale_surface(PGRAPHState *pg, SurfaceBinding *surface,
+                            unsigned int old_scale, const GLuint fbos[2])
+{
+    unsigned int width = surface->width ? surface->width : 1;
+    unsigned int height = surface->height ? surface->height : 1;
+    unsigned int scaled_width = width, scaled_height = height;
+    pgraph_apply_scaling_factor(pg, &scaled_width, &scaled_height);
+
+    GLuint gl_buffer;
+    glGenTextures(1, &gl_buffer);
+    glBindTexture(GL_TEXTURE_2D, gl_buffer);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, surface->fmt.gl_internal_format,
+                 scaled_width, scaled_height, 0, surface->fmt.gl_format,
+                 surface->fmt.gl_type, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (!surface->upload_pending) {
+        GLbitfield mask = surface->color ? GL_COLOR_BUFFER_BIT :
+                                           GL_DEPTH_BUFFER_BIT;
+        if (surface->fmt.gl_attachment == GL_DEPTH_STENCIL_ATTACHMENT) {
+            mask |= GL_STENCIL_BUFFER_BIT;
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbos[0]);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, surface->fmt.gl_attachment,
+                               GL_TEXTURE_2D, surface->gl_buffer, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[1]);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, surface->fmt.gl_attachment,
+                               GL_TEXTURE_2D, gl_buffer, 0);
+        assert(glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) ==
+               GL_FRAMEBUFFER_COMPLETE);
+
+        glBlitFramebuffer(0, 0, width * old_scale, height * old_scale, 0, 0,
+                          scaled_width, scaled_height, mask,
+                          surface->color ? GL_LINEAR : GL_NEAREST);
+
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, surface->fmt.gl_attachment,
+                               GL_TEXTURE_2D, 0, 0);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, surface->fmt.gl_attachment,
+                               GL_TEXTURE_2D, 0, 0);
+    }
+
+    glDeleteTextures(1, &surface->gl_buffer);
+    surface->gl_buffer = gl_buffer;
+}
+
+/* Apply a new scale factor while keeping surfaces and caches. Surfaces are
+ * resampled on the GPU. Textures rendered from surfaces record the scale they
+ * were rendered at, so they stay valid until the surface is drawn to again.
+ */
+void pgraph_gl_rescale_surfaces(NV2AState *d)
+{
+    PGRAPHState *pg = &d->pgraph;
+    PGRAPHGLState *r = pg->gl_renderer_state;
+    unsigned int old_scale = pg->surface_scale_factor;
+
+    pgraph_gl_reload_surface_scale_factor(pg);
+
+    if (pg->surface_scale_factor != old_scale) {
+        bool update_surface = (r->color_binding || r->zeta_binding);
+
+        /* Rebind with the new textures at next draw */
+        memset(&pg->last_surface_shape, 0, sizeof(pg->last_surface_shape));
+        pg->surface_color.buffer_dirty = true;
+        pg->surface_zeta.buffer_dirty = true;
+        pgraph_gl_unbind_surface(d, true);
+        pgraph_gl_unbind_surface(d, false);
+
+        GLuint fbos[2];
+        glGenFramebuffers(2, fbos);
+        glDisable(GL_SCISSOR_TEST);
+        glColorMask(true, true, true, true);
+        glDepthMask(GL_TRUE);
+        glStencilMask(0xff);
+
+        SurfaceBinding *s;
+        QTAILQ_FOREACH(s, &r->surfaces, entry) {
+            rescale_surface(pg, s, old_scale, fbos);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, r->gl_framebuffer);
+        glDeleteFramebuffers(2, fbos);
+
+        for (int i = 0; i < NV2A_MAX_TEXTURES; i++) {
+            pg->texture_dirty[i] = true;
+        }
+
+        if (update_surface) {
+            pgraph_gl_surface_update(d, true, true, true);
+        }
+    }
+
+    qatomic_set(&r->rescale_surfaces_pending, false);
+    qemu_event_set(&r->rescale_surfaces_complete);
+}
+
 void pgraph_gl_init_surfaces(PGRAPHState *pg)
 {
     PGRAPHGLState *r = pg->gl_renderer_state;
@@ -1420,6 +1516,7 @@ void pgraph_gl_init_surfaces(PGRAPHState *pg)
     r->downloads_pending = false;
     qemu_event_init(&r->downloads_complete, false);
     qemu_event_init(&r->dirty_surfaces_download_complete, false);
+    qemu_event_init(&r->rescale_surfaces_complete, false);
 
     init_render_to_texture(pg);
 }
@@ -107,6 +107,77 @@ static bool check_texture_possibly_dirty(NV2AState *d,
     return possibly_dirty;
 }
 
+struct pgraph_warm_textures_struct {
+    const PGRAPHWarmTexture *textures;
+    unsigned int num_textures;
+    GPtrArray *matches;
+};
+
+static void warm_textures_visitor(Lru *lru, LruNode *node, void *opaque)
+{
+    struct pgraph_warm_textures_struct *warm =
+        (struct pgraph_warm_textures_struct *)opaque;
+
+    struct TextureLruNode *tnode = container_of(node, TextureLruNode, node);
+    if (tnode->binding == NULL || !tnode->possibly_dirty) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < warm->num_textures; i++) {
+        if (pgraph_warm_texture_matches(
+                &warm->textures[i], &tnode->key.state,
+                tnode->key.texture_vram_offset, tnode->key.texture_length,
+                tnode->key.palette_vram_offset, tnode->key.palette_length)) {
+            g_ptr_array_add(warm->matches, tnode);
+            return;
+        }
+    }
+}
+
+// Rehash cached textures a loaded snapshot was using, so that binding them
+// again does not have to
+unsigned int pgraph_gl_warm_textures(NV2AState *d,
+                                     const PGRAPHWarmTexture *textures,
+                                     unsigned int num_textures)
+{
+    PGRAPHGLState *r = d->pgraph.gl_renderer_state;
+    unsigned int revalidated = 0;
+
+    struct pgraph_warm_textures_struct warm = {
+        .textures = textures,
+        .num_textures = num_textures,
+        .matches = g_ptr_array_new(),
+    };
+    lru_visit_active(&r->texture_cache, warm_textures_visitor, &warm);
+
+    for (unsigned int i = 0; i < warm.matches->len; i++) {
+        TextureLruNode *tnode =
+            (TextureLruNode *)g_ptr_array_index(warm.matches, i);
+        TextureKey *key = &tnode->key;
+
+        check_texture_possibly_dirty(d, key->texture_vram_offset,
+                                     key->texture_length,
+                                     key->palette_vram_offset,
+                                     key->palette_length);
+
+        uint64_t tex_data_hash =
+            fast_hash(d->vram_ptr + key->texture_vram_offset,
+                      key->texture_length);
+        if (key->palette_length) {
+            tex_data_hash ^= fast_hash(d->vram_ptr + key->palette_vram_offset,
+                                       key->palette_length);
+        }
+        if (tex_data_hash == tnode->binding->data_hash) {
+            tnode->possibly_dirty = false;
+            revalidated++;
+        }
+    }
+
+    g_ptr_array_free(warm.matches, true);
+
+    return revalidated;
+}
+
 static void apply_texture_parameters(PGRAPHGLState *r,
                                      TextureBinding *binding,
                                      const BasicColorFormatInfo *f,
@@ -323,8 +394,16 @@ void pgraph_gl_bind_textures(NV2AState *d)
             key.palette_length = palette_length;
         }
 
-        // Search for existing texture binding in cache
         uint64_t tex_binding_hash = fast_hash((uint8_t*)&key, sizeof(key));
+
+        if (!surf_to_tex) {
+            pgraph_warm_record_texture(pg, tex_binding_hash, &state,
+                                       texture_vram_offset, length,
+                                       key.palette_vram_offset,
+                                       key.palette_length);
+        }
+
+        // Search for existing texture binding in cache
         LruNode *found = lru_lookup(&r->texture_cache,
                                      tex_binding_hash, &key);
         TextureLruNode *key_out = container_of(found, TextureLruNode, node);
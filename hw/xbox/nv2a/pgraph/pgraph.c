@@ -39,6 +39,14 @@
 
 NV2AState *g_nv2a;
 
+// Installed by the UI, if any, to be told when the guest flips
+static void (*flip_notifier)(void);
+
+void nv2a_set_flip_notifier(void (*notify)(void))
+{
+    qatomic_set(&flip_notifier, notify);
+}
+
 uint64_t pgraph_read(void *opaque, hwaddr addr, unsigned int size)
 {
     NV2AState *d = (NV2AState *)opaque;
@@ -114,6 +122,10 @@ void pgraph_write(void *opaque, hwaddr addr, uint64_t val, unsigned int size)
                         % PG_GET_MASK(NV_PGRAPH_SURFACE,
                                    NV_PGRAPH_SURFACE_MODULO_3D) );
             nv2a_profile_increment();
+            void (*notify)(void) = qatomic_read(&flip_notifier);
+            if (notify) {
+                notify();
+            }
             pfifo_kick(d);
         }
         break;
@@ -227,6 +239,7 @@ void pgraph_init(NV2AState *d)
     qemu_cond_init(&pg->framebuffer_released);
     qemu_event_init(&pg->renderer_switch_complete, false);
     pg->renderer_switch_phase = PGRAPH_RENDERER_SWITCH_PHASE_IDLE;
+    pgraph_warm_init(pg);
 
     pg->frame_time = 0;
     pg->draw_time = 0;
@@ -351,6 +364,7 @@ void pgraph_destroy(PGRAPHState *pg)
        pg->renderer->ops.finalize(d);
     }
 
+    pgraph_warm_destroy(pg);
     qemu_mutex_destroy(&pg->lock);
 }
 
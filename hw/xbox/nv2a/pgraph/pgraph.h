@@ -33,6 +33,7 @@
 #include "texture.h"
 #include "util.h"
 #include "vsh_regs.h"
+#include "warm.h"
 
 typedef struct NV2AState NV2AState;
 typedef struct PGRAPHNullState PGRAPHNullState;
@@ -264,6 +265,8 @@ typedef struct PGRAPHState {
     unsigned int surface_scale_factor;
     uint8_t *scale_buf;
 
+    PGRAPHWarmState warm;
+
     const PGRAPHRenderer *renderer;
     union {
         PGRAPHNullState *null_renderer_state;
@@ -45,14 +45,33 @@ void nv2a_profile_flip_stall(void)
     int64_t render_time = (now-g_nv2a_stats.last_flip_time)/1000;
 
     g_nv2a_stats.frame_working.mspf = render_time;
+
+    // The first frame after a save also spans the pause itself, skip it
+    unsigned int since_resume =
+        g_nv2a_stats.frame_count - g_nv2a_stats.savevm.resume_frame;
+    if (g_nv2a_stats.savevm.sync_us && since_resume > 0 &&
+        since_resume <= NV2A_PROF_RESUME_FRAMES) {
+        g_nv2a_stats.savevm.resume_max_mspf =
+            MAX(g_nv2a_stats.savevm.resume_max_mspf, render_time);
+    }
+
     g_nv2a_stats.frame_history[g_nv2a_stats.frame_ptr] =
         g_nv2a_stats.frame_working;
     g_nv2a_stats.frame_ptr =
         (g_nv2a_stats.frame_ptr + 1) % NV2A_PROF_NUM_FRAMES;
     g_nv2a_stats.frame_count++;
+    for (int i = 0; i < NV2A_PROF__COUNT; i++) {
+        g_nv2a_stats.counter_totals[i] += g_nv2a_stats.frame_working.counters[i];
+    }
     memset(&g_nv2a_stats.frame_working, 0, sizeof(g_nv2a_stats.frame_working));
 }
 
+void nv2a_profile_savevm_surface(unsigned int size)
+{
+    g_nv2a_stats.savevm.surfaces++;
+    g_nv2a_stats.savevm.bytes += size;
+}
+
 const char *nv2a_profile_get_counter_name(unsigned int cnt)
 {
     const char *default_names[NV2A_PROF__COUNT] = {
@@ -72,3 +91,9 @@ int nv2a_profile_get_counter_value(unsigned int cnt)
                        NV2A_PROF_NUM_FRAMES;
     return g_nv2a_stats.frame_history[idx].counters[cnt];
 }
+
+int64_t nv2a_profile_get_counter_total(unsigned int cnt)
+{
+    assert(cnt < NV2A_PROF__COUNT);
+    return g_nv2a_stats.counter_totals[cnt];
+}
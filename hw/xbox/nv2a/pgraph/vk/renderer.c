@@ -85,6 +85,30 @@ static void pgraph_vk_finalize(NV2AState *d)
     pg->vk_renderer_state = NULL;
 }
 
+// Bring back caches a just loaded snapshot was using
+static void pgraph_vk_warm_start(NV2AState *d)
+{
+    PGRAPHState *pg = &d->pgraph;
+    PGRAPHWarmTexture *textures;
+    ShaderState *shaders;
+    unsigned int num_textures, num_shaders;
+
+    if (!pgraph_warm_take(pg, &textures, &num_textures, &shaders,
+                          &num_shaders)) {
+        return;
+    }
+
+    int64_t start = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    pgraph_vk_warm_shaders(pg, shaders, num_shaders);
+    unsigned int revalidated =
+        pgraph_vk_warm_textures(d, textures, num_textures);
+    trace_nv2a_warm_start(num_shaders, num_textures, revalidated,
+                          qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start);
+
+    g_free(textures);
+    g_free(shaders);
+}
+
 static void pgraph_vk_flush(NV2AState *d)
 {
     PGRAPHState *pg = &d->pgraph;
@@ -100,6 +124,8 @@ static void pgraph_vk_flush(NV2AState *d)
 
     /* FIXME: Flush more? */
 
+    pgraph_vk_warm_start(d);
+
     qatomic_set(&d->pgraph.flush_pending, false);
     qemu_event_set(&d->pgraph.flush_complete);
 }
@@ -119,6 +145,7 @@ static void pgraph_vk_process_pending(NV2AState *d)
 
     if (qatomic_read(&r->downloads_pending) ||
         qatomic_read(&r->download_dirty_surfaces_pending) ||
+        qatomic_read(&r->rescale_surfaces_pending) ||
         qatomic_read(&d->pgraph.sync_pending) ||
         qatomic_read(&d->pgraph.flush_pending)
     ) {
@@ -130,6 +157,9 @@ static void pgraph_vk_process_pending(NV2AState *d)
         if (qatomic_read(&r->download_dirty_surfaces_pending)) {
             pgraph_vk_download_dirty_surfaces(d);
         }
+        if (qatomic_read(&r->rescale_surfaces_pending)) {
+            pgraph_vk_rescale_surfaces(d);
+        }
         if (qatomic_read(&d->pgraph.sync_pending)) {
             pgraph_vk_sync(d);
         }
@@ -391,6 +391,8 @@ typedef struct PGRAPHVkState {
     QemuEvent downloads_complete;
     bool download_dirty_surfaces_pending;
     QemuEvent dirty_surfaces_download_complete; // common
+    bool rescale_surfaces_pending;
+    QemuEvent rescale_surfaces_complete;
 
     Lru texture_cache;
     TextureBinding *texture_cache_entries;
@@ -524,6 +526,7 @@ void pgraph_vk_set_surface_dirty(PGRAPHState *pg, bool color, bool zeta);
 void pgraph_vk_set_surface_scale_factor(NV2AState *d, unsigned int scale);
 unsigned int pgraph_vk_get_surface_scale_factor(NV2AState *d);
 void pgraph_vk_reload_surface_scale_factor(PGRAPHState *pg);
+void pgraph_vk_rescale_surfaces(NV2AState *d);
 
 // surface-compute.c
 void pgraph_vk_init_compute(PGRAPHState *pg);
@@ -549,12 +552,17 @@ void pgraph_vk_bind_textures(NV2AState *d);
 void pgraph_vk_mark_textures_possibly_dirty(NV2AState *d, hwaddr addr,
                                             hwaddr size);
 void pgraph_vk_trim_texture_cache(PGRAPHState *pg);
+unsigned int pgraph_vk_warm_textures(NV2AState *d,
+                                     const PGRAPHWarmTexture *textures,
+                                     unsigned int num_textures);
 
 // shaders.c
 void pgraph_vk_init_shaders(PGRAPHState *pg);
 void pgraph_vk_finalize_shaders(PGRAPHState *pg);
 void pgraph_vk_update_descriptor_sets(PGRAPHState *pg);
 void pgraph_vk_bind_shaders(PGRAPHState *pg);
+void pgraph_vk_warm_shaders(PGRAPHState *pg, const ShaderState *states,
+                            unsigned int num_states);
 
 // reports.c
 void pgraph_vk_init_reports(PGRAPHState *pg);
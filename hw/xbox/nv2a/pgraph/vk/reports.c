@@ -153,7 +153,7 @@ void pgraph_vk_process_pending_reports(NV2AState *d)
     uint32_t *dma_get = &d->pfifo.regs[NV_PFIFO_CACHE1_DMA_GET];
     uint32_t *dma_put = &d->pfifo.regs[NV_PFIFO_CACHE1_DMA_PUT];
 
-    if (*dma_get == *dma_put && r->in_command_buffer &&
+    if (*dma_get == qatomic_read(dma_put) && r->in_command_buffer &&
         !QSIMPLEQ_EMPTY(&r->report_queue)) {
         pgraph_vk_finish(pg, VK_FINISH_REASON_STALLED);
     }
@@ -415,10 +415,15 @@ static void shader_cache_finalize(PGRAPHState *pg)
     r->shader_module_cache_entries = NULL;
 }
 
+static uint64_t get_shader_state_hash(const ShaderState *state)
+{
+    return fast_hash((void *)state, sizeof(*state));
+}
+
 static ShaderBinding *get_shader_binding_for_state(PGRAPHVkState *r,
-                                                   const ShaderState *state)
+                                                   const ShaderState *state,
+                                                   uint64_t hash)
 {
-    uint64_t hash = fast_hash((void *)state, sizeof(*state));
     LruNode *node = lru_lookup(&r->shader_cache, hash, state);
     ShaderBinding *binding = container_of(node, ShaderBinding, node);
     NV2A_VK_DPRINTF("shader state hash: %016" PRIx64 " %p", hash, binding);
@@ -505,8 +510,12 @@ void pgraph_vk_bind_shaders(PGRAPHState *pg)
         ShaderState new_state = pgraph_glsl_get_shader_state(pg);
         if (!r->shader_binding || memcmp(&r->shader_binding->state, &new_state,
                                          sizeof(ShaderState))) {
-            r->shader_binding = get_shader_binding_for_state(r, &new_state);
+            // The binding's LRU hash is not set yet on a cache miss
+            uint64_t hash = get_shader_state_hash(&new_state);
+            r->shader_binding =
+                get_shader_binding_for_state(r, &new_state, hash);
             r->shader_bindings_changed = true;
+            pgraph_warm_record_shader(pg, hash, &new_state);
         }
     } else {
         nv2a_profile_inc_counter(NV2A_PROF_SHADER_BIND_NOTDIRTY);
@@ -517,6 +526,21 @@ void pgraph_vk_bind_shaders(PGRAPHState *pg)
     NV2A_VK_DGROUP_END();
 }
 
+// Compile the shaders a loaded snapshot was using ahead of its first draw
+void pgraph_vk_warm_shaders(PGRAPHState *pg, const ShaderState *states,
+                            unsigned int num_states)
+{
+    PGRAPHVkState *r = pg->vk_renderer_state;
+
+    for (unsigned int i = 0; i < num_states; i++) {
+        get_shader_binding_for_state(r, &states[i],
+                                     get_shader_state_hash(&states[i]));
+    }
+
+    // Lookups may have evicted the bound shader, look it up again on bind
+    r->shader_binding = NULL;
+}
+
 void pgraph_vk_init_shaders(PGRAPHState *pg)
 {
     PGRAPHVkState *r = pg->vk_renderer_state;
@@ -34,30 +34,22 @@ const int max_surface_frame_time_delta = 5;
 
 void pgraph_vk_set_surface_scale_factor(NV2AState *d, unsigned int scale)
 {
+    PGRAPHVkState *r = d->pgraph.vk_renderer_state;
+
     g_config.display.quality.surface_scale = scale < 1 ? 1 : scale;
 
     qemu_mutex_lock(&d->pfifo.lock);
     qatomic_set(&d->pfifo.halt, true);
     qemu_mutex_unlock(&d->pfifo.lock);
 
-    // FIXME: It's just flush
     qemu_mutex_lock(&d->pgraph.lock);
-    qemu_event_reset(&d->pgraph.vk_renderer_state->dirty_surfaces_download_complete);
-    qatomic_set(&d->pgraph.vk_renderer_state->download_dirty_surfaces_pending, true);
+    qemu_event_reset(&r->rescale_surfaces_complete);
+    qatomic_set(&r->rescale_surfaces_pending, true);
     qemu_mutex_unlock(&d->pgraph.lock);
     qemu_mutex_lock(&d->pfifo.lock);
     pfifo_kick(d);
     qemu_mutex_unlock(&d->pfifo.lock);
-    qemu_event_wait(&d->pgraph.vk_renderer_state->dirty_surfaces_download_complete);
-
-    qemu_mutex_lock(&d->pgraph.lock);
-    qemu_event_reset(&d->pgraph.flush_complete);
-    qatomic_set(&d->pgraph.flush_pending, true);
-    qemu_mutex_unlock(&d->pgraph.lock);
-    qemu_mutex_lock(&d->pfifo.lock);
-    pfifo_kick(d);
-    qemu_mutex_unlock(&d->pfifo.lock);
-    qemu_event_wait(&d->pgraph.flush_complete);
+    qemu_event_wait(&r->rescale_surfaces_complete);
 
     qemu_mutex_lock(&d->pfifo.lock);
     qatomic_set(&d->pfifo.halt, false);
@@ -527,6 +519,9 @@ void pgraph_vk_download_dirty_surfaces(NV2AState *d)
 
     SurfaceBinding *surface;
     QTAILQ_FOREACH(surface, &r->surfaces, entry) {
+        if (surface->draw_dirty) {
+            nv2a_profile_savevm_surface(surface->pitch * surface->height);
+        }
         pgraph_vk_surface_download_if_dirty(d, surface);
     }
 
@@ -936,6 +931,137 @@ static bool check_surface_compatibility(SurfaceBinding const *s1,
     }
 }
 
+static bool check_surface_blit_supported(PGRAPHVkState *r,
+                                         SurfaceBinding const *surface,
+                                         bool *linear)
+{
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(r->physical_device,
+                                        surface->host_fmt.vk_format, &props);
+
+    VkFormatFeatureFlags features = props.optimalTilingFeatures;
+    *linear = surface->color &&
+              (features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+
+    return (features & VK_FORMAT_FEATURE_BLIT_SRC_BIT) &&
+           (features & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+}
+
+// Replace the surface images with ones at the current scale factor, blitting
+// the old contents across.
+static void rescale_surface(PGRAPHState *pg, SurfaceBinding *surface,
+                            unsigned int old_scale, bool linear)
+{
+    PGRAPHVkState *r = pg->vk_renderer_state;
+
+    SurfaceBinding old = *surface;
+    surface->image = VK_NULL_HANDLE;
+    surface->image_view = VK_NULL_HANDLE;
+    surface->allocation = VK_NULL_HANDLE;
+    surface->image_scratch = VK_NULL_HANDLE;
+    surface->allocation_scratch = VK_NULL_HANDLE;
+    create_surface_image(pg, surface);
+    set_surface_label(pg, surface);
+
+    if (!surface->upload_pending) {
+        unsigned int width = surface->width ? surface->width : 1;
+        unsigned int height = surface->height ? surface->height : 1;
+        unsigned int scaled_width = width, scaled_height = height;
+        pgraph_apply_scaling_factor(pg, &scaled_width, &scaled_height);
+
+        VkImageLayout attachment_layout =
+            surface->color ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL :
+                             VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkCommandBuffer cmd = pgraph_vk_begin_single_time_commands(pg);
+        pgraph_vk_begin_debug_marker(r, cmd, RGBA_RED, __func__);
+
+        pgraph_vk_transition_image_layout(pg, cmd, old.image,
+                                          surface->host_fmt.vk_format,
+                                          attachment_layout,
+                                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        pgraph_vk_transition_image_layout(pg, cmd, surface->image,
+                                          surface->host_fmt.vk_format,
+                                          attachment_layout,
+                                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+        VkImageBlit blit_region = {
+            .srcSubresource.aspectMask = surface->host_fmt.aspect,
+            .srcSubresource.mipLevel = 0,
+            .srcSubresource.baseArrayLayer = 0,
+            .srcSubresource.layerCount = 1,
+            .srcOffsets[0] = (VkOffset3D){ 0, 0, 0 },
+            .srcOffsets[1] = (VkOffset3D){ width * old_scale,
+                                           height * old_scale, 1 },
+
+            .dstSubresource.aspectMask = surface->host_fmt.aspect,
+            .dstSubresource.mipLevel = 0,
+            .dstSubresource.baseArrayLayer = 0,
+            .dstSubresource.layerCount = 1,
+            .dstOffsets[0] = (VkOffset3D){ 0, 0, 0 },
+            .dstOffsets[1] = (VkOffset3D){ scaled_width, scaled_height, 1 },
+        };
+        vkCmdBlitImage(cmd, old.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       surface->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                       &blit_region,
+                       linear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST);
+
+        pgraph_vk_transition_image_layout(pg, cmd, surface->image,
+                                          surface->host_fmt.vk_format,
+                                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                          attachment_layout);
+
+        pgraph_vk_end_debug_marker(r, cmd);
+        pgraph_vk_end_single_time_commands(pg, cmd);
+    }
+
+    destroy_surface_image(r, &old);
+}
+
+// Apply a new scale factor while keeping surfaces and caches. Surfaces are
+// resampled on the GPU, and only texture bindings to them, whose cache keys
+// include the scale, need to be looked up again.
+void pgraph_vk_rescale_surfaces(NV2AState *d)
+{
+    PGRAPHState *pg = &d->pgraph;
+    PGRAPHVkState *r = pg->vk_renderer_state;
+    unsigned int old_scale = pg->surface_scale_factor;
+
+    pgraph_vk_reload_surface_scale_factor(pg);
+
+    if (pg->surface_scale_factor != old_scale) {
+        pgraph_vk_finish(pg, VK_FINISH_REASON_FLUSH);
+
+        // Rebind at next draw, with a framebuffer for the new images
+        memset(&pg->last_surface_shape, 0, sizeof(pg->last_surface_shape));
+        pg->surface_color.buffer_dirty = true;
+        pg->surface_zeta.buffer_dirty = true;
+        unbind_surface(d, true);
+        unbind_surface(d, false);
+
+        SurfaceBinding *s, *next;
+        QTAILQ_FOREACH_SAFE(s, &r->surfaces, entry, next) {
+            bool linear;
+            if (check_surface_blit_supported(r, s, &linear)) {
+                rescale_surface(pg, s, old_scale, linear);
+            } else {
+                pgraph_vk_surface_download_if_dirty(d, s);
+                invalidate_surface(d, s);
+            }
+        }
+
+        // Spare images are sized for the old scale
+        prune_invalid_surfaces(r, 0);
+
+        for (int i = 0; i < NV2A_MAX_TEXTURES; i++) {
+            pg->texture_dirty[i] = true;
+        }
+    }
+
+    qatomic_set(&r->rescale_surfaces_pending, false);
+    qemu_event_set(&r->rescale_surfaces_complete);
+}
+
 void pgraph_vk_surface_download_if_dirty(NV2AState *d, SurfaceBinding *surface)
 {
     if (surface->draw_dirty) {
@@ -1722,6 +1848,7 @@ void pgraph_vk_init_surfaces(PGRAPHState *pg)
     r->downloads_pending = false;
     qemu_event_init(&r->downloads_complete, false);
     qemu_event_init(&r->dirty_surfaces_download_complete, false);
+    qemu_event_init(&r->rescale_surfaces_complete, false);
 
     r->color_binding = NULL;
     r->zeta_binding = NULL;
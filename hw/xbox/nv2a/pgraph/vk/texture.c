@@ -473,6 +473,75 @@ static bool check_texture_possibly_dirty(NV2AState *d,
     return possibly_dirty;
 }
 
+struct pgraph_warm_textures_struct {
+    const PGRAPHWarmTexture *textures;
+    unsigned int num_textures;
+    GPtrArray *matches;
+};
+
+static void warm_textures_visitor(Lru *lru, LruNode *node, void *opaque)
+{
+    struct pgraph_warm_textures_struct *warm = opaque;
+
+    TextureBinding *tnode = container_of(node, TextureBinding, node);
+    if (tnode->image == VK_NULL_HANDLE || !tnode->possibly_dirty) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < warm->num_textures; i++) {
+        if (pgraph_warm_texture_matches(
+                &warm->textures[i], &tnode->key.state,
+                tnode->key.texture_vram_offset, tnode->key.texture_length,
+                tnode->key.palette_vram_offset, tnode->key.palette_length)) {
+            g_ptr_array_add(warm->matches, tnode);
+            return;
+        }
+    }
+}
+
+// Rehash cached textures a loaded snapshot was using, so that binding them
+// again does not have to
+unsigned int pgraph_vk_warm_textures(NV2AState *d,
+                                     const PGRAPHWarmTexture *textures,
+                                     unsigned int num_textures)
+{
+    PGRAPHVkState *r = d->pgraph.vk_renderer_state;
+    unsigned int revalidated = 0;
+
+    struct pgraph_warm_textures_struct warm = {
+        .textures = textures,
+        .num_textures = num_textures,
+        .matches = g_ptr_array_new(),
+    };
+    lru_visit_active(&r->texture_cache, warm_textures_visitor, &warm);
+
+    for (unsigned int i = 0; i < warm.matches->len; i++) {
+        TextureBinding *tnode = g_ptr_array_index(warm.matches, i);
+        TextureKey *key = &tnode->key;
+
+        check_texture_possibly_dirty(d, key->texture_vram_offset,
+                                     key->texture_length,
+                                     key->palette_vram_offset,
+                                     key->palette_length);
+
+        uint64_t content_hash =
+            fast_hash(d->vram_ptr + key->texture_vram_offset,
+                      key->texture_length);
+        if (key->palette_length) {
+            content_hash ^= fast_hash(d->vram_ptr + key->palette_vram_offset,
+                                      key->palette_length);
+        }
+        if (content_hash == tnode->hash) {
+            tnode->possibly_dirty = false;
+            revalidated++;
+        }
+    }
+
+    g_ptr_array_free(warm.matches, true);
+
+    return revalidated;
+}
+
 // FIXME: Make sure we update sampler when data matches. Should we add filtering
 // options to the textureshape?
 static void upload_texture_image(PGRAPHState *pg, int texture_idx,
@@ -1149,6 +1218,13 @@ static void create_texture(PGRAPHState *pg, int texture_idx)
     }
 
     uint64_t key_hash = fast_hash((void*)&key, sizeof(key));
+
+    if (!surface_to_texture) {
+        pgraph_warm_record_texture(pg, key_hash, &state, texture_vram_offset,
+                                   texture_length, key.palette_vram_offset,
+                                   key.palette_length);
+    }
+
     LruNode *node = lru_lookup(&r->texture_cache, key_hash, &key);
     TextureBinding *snode = container_of(node, TextureBinding, node);
     bool binding_found = snode->image != VK_NULL_HANDLE;
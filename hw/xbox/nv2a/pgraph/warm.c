@@ -0,0 +1,204 @@
+/*
+ * QEMU Geforce NV2A snapshot warm start
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loading a snapshot invalidates everything the renderer caches about guest
+ * memory, and the first frames after it pay to rebuild that lazily. To start
+ * warm, the renderer keeps a short history of the shader states and textures
+ * it bound, which is saved with the snapshot. After a load, the renderer's
+ * flush compiles those shaders and revalidates those textures before it
+ * processes any new commands.
+ *
+ * The history holds raw renderer structures, so it is only used by the build
+ * that saved it.
+ */
+
+#include "hw/xbox/nv2a/nv2a_int.h"
+#include "qemu/fast-hash.h"
+#include "ui/xemu-settings.h"
+#include "xemu-version.h"
+#include "warm.h"
+
+static uint64_t warm_abi(void)
+{
+    uint64_t sizes[] = { sizeof(PGRAPHWarmTexture), sizeof(ShaderState) };
+    return fast_hash((const uint8_t *)xemu_commit, strlen(xemu_commit)) ^
+           fast_hash((const uint8_t *)sizes, sizeof(sizes));
+}
+
+void pgraph_warm_init(PGRAPHState *pg)
+{
+    PGRAPHWarmState *w = &pg->warm;
+
+    // Keys point into the hash rings, which outlive the sets
+    w->texture_set = g_hash_table_new(g_int64_hash, g_int64_equal);
+    w->shader_set = g_hash_table_new(g_int64_hash, g_int64_equal);
+}
+
+void pgraph_warm_destroy(PGRAPHState *pg)
+{
+    PGRAPHWarmState *w = &pg->warm;
+
+    pgraph_warm_release(pg);
+    g_hash_table_destroy(w->texture_set);
+    w->texture_set = NULL;
+    g_hash_table_destroy(w->shader_set);
+    w->shader_set = NULL;
+}
+
+// Returns the ring slot to store the new entry in, or -1 if already recorded
+static int record(GHashTable *set, uint64_t *hashes, unsigned int *num,
+                  unsigned int head, unsigned int max, uint64_t hash)
+{
+    if (g_hash_table_contains(set, &hash)) {
+        return -1;
+    }
+
+    if (*num == max) {
+        g_hash_table_remove(set, &hashes[head]);
+    }
+    hashes[head] = hash;
+    g_hash_table_add(set, &hashes[head]);
+    *num = MIN(*num + 1, max);
+    return head;
+}
+
+void pgraph_warm_record_texture(PGRAPHState *pg, uint64_t hash,
+                                const TextureShape *shape,
+                                hwaddr texture_vram_offset,
+                                hwaddr texture_length,
+                                hwaddr palette_vram_offset,
+                                hwaddr palette_length)
+{
+    PGRAPHWarmState *w = &pg->warm;
+
+    if (!g_config.perf.snapshot_warm_start) {
+        return;
+    }
+
+    int slot = record(w->texture_set, w->texture_hashes, &w->num_textures,
+                      w->texture_head, PGRAPH_WARM_MAX_TEXTURES, hash);
+    if (slot < 0) {
+        return;
+    }
+
+    PGRAPHWarmTexture *t = &w->textures[slot];
+    memset(t, 0, sizeof(*t));
+    t->shape = *shape;
+    t->texture_vram_offset = texture_vram_offset;
+    t->texture_length = texture_length;
+    t->palette_vram_offset = palette_vram_offset;
+    t->palette_length = palette_length;
+    w->texture_head = (slot + 1) % PGRAPH_WARM_MAX_TEXTURES;
+}
+
+void pgraph_warm_record_shader(PGRAPHState *pg, uint64_t hash,
+                               const ShaderState *state)
+{
+    PGRAPHWarmState *w = &pg->warm;
+
+    if (!g_config.perf.snapshot_warm_start) {
+        return;
+    }
+
+    int slot = record(w->shader_set, w->shader_hashes, &w->num_shaders,
+                      w->shader_head, PGRAPH_WARM_MAX_SHADERS, hash);
+    if (slot < 0) {
+        return;
+    }
+
+    w->shaders[slot] = *state;
+    w->shader_head = (slot + 1) % PGRAPH_WARM_MAX_SHADERS;
+}
+
+bool pgraph_warm_texture_matches(const PGRAPHWarmTexture *t,
+                                 const TextureShape *shape,
+                                 hwaddr texture_vram_offset,
+                                 hwaddr texture_length,
+                                 hwaddr palette_vram_offset,
+                                 hwaddr palette_length)
+{
+    return t->texture_vram_offset == texture_vram_offset &&
+           t->texture_length == texture_length &&
+           t->palette_vram_offset == palette_vram_offset &&
+           t->palette_length == palette_length &&
+           !memcmp(&t->shape, shape, sizeof(*shape));
+}
+
+void pgraph_warm_pre_save(PGRAPHState *pg)
+{
+    PGRAPHWarmState *w = &pg->warm;
+
+    pgraph_warm_release(pg);
+
+    w->abi = warm_abi();
+    w->saved_textures_size = w->num_textures * sizeof(PGRAPHWarmTexture);
+    w->saved_textures = g_memdup2(w->textures, w->saved_textures_size);
+    w->saved_shaders_size = w->num_shaders * sizeof(ShaderState);
+    w->saved_shaders = g_memdup2(w->shaders, w->saved_shaders_size);
+}
+
+void pgraph_warm_post_load(PGRAPHState *pg)
+{
+    PGRAPHWarmState *w = &pg->warm;
+
+    w->load_pending =
+        w->abi == warm_abi() &&
+        w->saved_textures_size % sizeof(PGRAPHWarmTexture) == 0 &&
+        w->saved_textures_size <=
+            PGRAPH_WARM_MAX_TEXTURES * sizeof(PGRAPHWarmTexture) &&
+        w->saved_shaders_size % sizeof(ShaderState) == 0 &&
+        w->saved_shaders_size <= PGRAPH_WARM_MAX_SHADERS * sizeof(ShaderState);
+}
+
+// Drop the snapshot copy once saved, or before loading into it
+void pgraph_warm_release(PGRAPHState *pg)
+{
+    PGRAPHWarmState *w = &pg->warm;
+
+    g_free(w->saved_textures);
+    w->saved_textures = NULL;
+    w->saved_textures_size = 0;
+    g_free(w->saved_shaders);
+    w->saved_shaders = NULL;
+    w->saved_shaders_size = 0;
+    w->load_pending = false;
+}
+
+bool pgraph_warm_take(PGRAPHState *pg, PGRAPHWarmTexture **textures,
+                      unsigned int *num_textures, ShaderState **shaders,
+                      unsigned int *num_shaders)
+{
+    PGRAPHWarmState *w = &pg->warm;
+
+    if (!w->load_pending) {
+        return false;
+    }
+    w->load_pending = false;
+
+    *textures = (PGRAPHWarmTexture *)w->saved_textures;
+    *num_textures = w->saved_textures_size / sizeof(PGRAPHWarmTexture);
+    *shaders = (ShaderState *)w->saved_shaders;
+    *num_shaders = w->saved_shaders_size / sizeof(ShaderState);
+
+    w->saved_textures = NULL;
+    w->saved_textures_size = 0;
+    w->saved_shaders = NULL;
+    w->saved_shaders_size = 0;
+
+    return true;
+}
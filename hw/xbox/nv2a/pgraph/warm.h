@@ -0,0 +1,93 @@
+/*
+ * QEMU Geforce NV2A snapshot warm start
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_XBOX_NV2A_PGRAPH_WARM_H
+#define HW_XBOX_NV2A_PGRAPH_WARM_H
+
+#include "qemu/osdep.h"
+#include "exec/hwaddr.h"
+#include "texture.h"
+#include "glsl/shaders.h"
+
+#define PGRAPH_WARM_MAX_TEXTURES 64
+#define PGRAPH_WARM_MAX_SHADERS 32
+
+// Renderer independent part of a texture cache key
+typedef struct PGRAPHWarmTexture {
+    TextureShape shape;
+    hwaddr texture_vram_offset;
+    hwaddr texture_length;
+    hwaddr palette_vram_offset;
+    hwaddr palette_length;
+} PGRAPHWarmTexture;
+
+typedef struct PGRAPHWarmState {
+    // Recently bound, recorded by the renderer as it runs
+    PGRAPHWarmTexture textures[PGRAPH_WARM_MAX_TEXTURES];
+    uint64_t texture_hashes[PGRAPH_WARM_MAX_TEXTURES];
+    GHashTable *texture_set;
+    unsigned int num_textures, texture_head;
+
+    ShaderState shaders[PGRAPH_WARM_MAX_SHADERS];
+    uint64_t shader_hashes[PGRAPH_WARM_MAX_SHADERS];
+    GHashTable *shader_set;
+    unsigned int num_shaders, shader_head;
+
+    // Snapshot copy, only valid to load into the build that saved it
+    uint64_t abi;
+    uint32_t saved_textures_size;
+    uint8_t *saved_textures;
+    uint32_t saved_shaders_size;
+    uint8_t *saved_shaders;
+    bool load_pending;
+} PGRAPHWarmState;
+
+typedef struct NV2AState NV2AState;
+typedef struct PGRAPHState PGRAPHState;
+
+void pgraph_warm_init(PGRAPHState *pg);
+void pgraph_warm_destroy(PGRAPHState *pg);
+
+// Record a bound entry, keyed by the hash the renderer looked it up with
+void pgraph_warm_record_texture(PGRAPHState *pg, uint64_t hash,
+                                const TextureShape *shape,
+                                hwaddr texture_vram_offset,
+                                hwaddr texture_length,
+                                hwaddr palette_vram_offset,
+                                hwaddr palette_length);
+void pgraph_warm_record_shader(PGRAPHState *pg, uint64_t hash,
+                               const ShaderState *state);
+
+bool pgraph_warm_texture_matches(const PGRAPHWarmTexture *t,
+                                 const TextureShape *shape,
+                                 hwaddr texture_vram_offset,
+                                 hwaddr texture_length,
+                                 hwaddr palette_vram_offset,
+                                 hwaddr palette_length);
+
+// Snapshot support, called with the FIFO halted
+void pgraph_warm_pre_save(PGRAPHState *pg);
+void pgraph_warm_post_load(PGRAPHState *pg);
+void pgraph_warm_release(PGRAPHState *pg);
+
+// Render thread: take the entries of a just loaded snapshot, if any. The
+// caller owns the returned arrays.
+bool pgraph_warm_take(PGRAPHState *pg, PGRAPHWarmTexture **textures,
+                      unsigned int *num_textures, ShaderState **shaders,
+                      unsigned int *num_shaders);
+
+#endif
@@ -21,6 +21,9 @@
 
 #include "nv2a_int.h"
 
+/* Short enough not to overshoot the delays guests typically spin for */
+#define PTIMER_POLL_SLEEP_NS (50 * SCALE_US)
+
 /* PTIMER - time measurement and time-based alarms */
 static uint64_t ptimer_get_clock(NV2AState *d)
 {
@@ -31,6 +34,26 @@ static uint64_t ptimer_get_clock(NV2AState *d)
                     d->ptimer.numerator);
 }
 
+/*
+ * Called when the guest keeps reading the time, i.e. busy-waits for some
+ * amount of it to pass. Give the host core back for a short while; the
+ * counter is derived from the virtual clock, so it stays consistent with
+ * however long the vCPU was asleep.
+ */
+static void ptimer_poll_sleep(NV2AState *d, hwaddr addr)
+{
+    int64_t budget = nv2a_poll_block_budget_ns(PTIMER_POLL_SLEEP_NS);
+    if (!budget) {
+        return;
+    }
+
+    int64_t start = get_clock();
+    bql_unlock();
+    g_usleep(budget / SCALE_US);
+    bql_lock();
+    nv2a_poll_account(d, NV_PTIMER, addr, start);
+}
+
 uint64_t ptimer_read(void *opaque, hwaddr addr, unsigned int size)
 {
     NV2AState *d = opaque;
@@ -60,6 +83,16 @@ uint64_t ptimer_read(void *opaque, hwaddr addr, unsigned int size)
     }
 
     nv2a_reg_log_read(NV_PTIMER, addr, size, r);
+
+    /*
+     * The time changes on every read, so only look for back-to-back reads.
+     * Both halves count as one register, guests often read them in turn.
+     */
+    if ((addr == NV_PTIMER_TIME_0 || addr == NV_PTIMER_TIME_1) &&
+        nv2a_poll_detect(&d->poll.ptimer, NV_PTIMER_TIME_0, r, false)) {
+        ptimer_poll_sleep(d, addr);
+    }
+
     return r;
 }
 
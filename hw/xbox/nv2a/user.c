@@ -21,52 +21,106 @@
 
 #include "nv2a_int.h"
 
-/* USER - PFIFO MMIO and DMA submission area */
-uint64_t user_read(void *opaque, hwaddr addr, unsigned int size)
+/* The pusher has work left, or has been kicked and not yet looked */
+static bool user_fifo_busy(NV2AState *d)
 {
-    NV2AState *d = (NV2AState *)opaque;
+    return qatomic_read(&d->pfifo.fifo_kick) ||
+           qatomic_load_acquire(&d->pfifo.regs[NV_PFIFO_CACHE1_DMA_GET]) !=
+               qatomic_load_acquire(&d->pfifo.regs[NV_PFIFO_CACHE1_DMA_PUT]);
+}
 
-    unsigned int channel_id = addr >> 16;
-    assert(channel_id < NV2A_NUM_CHANNELS);
+/*
+ * Called when the guest keeps reading an unchanged DMA_GET or REF, which it
+ * does while waiting for the pusher to drain. Rather than spin, sleep until
+ * the pusher has caught up with PUT or the vCPU has to service a timer.
+ */
+static void user_wait_for_fifo(NV2AState *d, hwaddr addr)
+{
+    if (!user_fifo_busy(d)) {
+        return;
+    }
 
-    qemu_mutex_lock(&d->pfifo.lock);
+    int64_t budget = nv2a_poll_block_budget_ns(SCALE_MS);
+    if (!budget) {
+        return;
+    }
 
-    uint32_t channel_modes = d->pfifo.regs[NV_PFIFO_MODE];
-
-    uint64_t r = 0;
-    if (channel_modes & (1 << channel_id)) {
-        /* DMA Mode */
-
-        unsigned int cur_channel_id =
-            GET_MASK(d->pfifo.regs[NV_PFIFO_CACHE1_PUSH1],
-                     NV_PFIFO_CACHE1_PUSH1_CHID);
-
-        if (channel_id == cur_channel_id) {
-            switch (addr & 0xFFFF) {
-            case NV_USER_DMA_PUT:
-                r = d->pfifo.regs[NV_PFIFO_CACHE1_DMA_PUT];
-                break;
-            case NV_USER_DMA_GET:
-                r = d->pfifo.regs[NV_PFIFO_CACHE1_DMA_GET];
-                break;
-            case NV_USER_REF:
-                r = d->pfifo.regs[NV_PFIFO_CACHE1_REF];
-                break;
-            default:
-                break;
-            }
-        } else {
-            /* ramfc */
-            assert(!"Unsupported: channel_id != cur_channel_id");
+    int64_t start = get_clock();
+    int64_t deadline = start + budget;
+    bql_unlock();
+    qemu_mutex_lock(&d->pfifo.lock);
+    while (user_fifo_busy(d)) {
+        int64_t remaining = deadline - get_clock();
+        if (remaining <= 0) {
+            break;
         }
-    } else {
+        qemu_cond_timedwait_ns(&d->pfifo.fifo_idle_cond, &d->pfifo.lock,
+                               remaining);
+    }
+    qemu_mutex_unlock(&d->pfifo.lock);
+    bql_lock();
+    nv2a_poll_account(d, NV_USER, addr, start);
+}
+
+/*
+ * USER - PFIFO MMIO and DMA submission area
+ *
+ * The guest touches these registers at a very high rate, so they are
+ * accessed without pfifo.lock. DMA_PUT, DMA_GET and REF are published with
+ * release stores and read with acquire loads, pairing with the pusher: a PUT
+ * it observes covers every push buffer write the guest made before it, and
+ * a GET the guest observes covers everything the pusher consumed.
+ * Channel mode and ID change only while the channel is being set up.
+ */
+static uint32_t *user_get_reg(NV2AState *d, hwaddr addr)
+{
+    unsigned int channel_id = addr >> 16;
+    assert(channel_id < NV2A_NUM_CHANNELS);
+
+    uint32_t channel_modes = qatomic_read(&d->pfifo.regs[NV_PFIFO_MODE]);
+    if (!(channel_modes & (1 << channel_id))) {
         /* PIO Mode */
         assert(!"Failed to enter DMA mode - entered PIO mode");
+        return NULL;
     }
 
-    qemu_mutex_unlock(&d->pfifo.lock);
+    /* DMA Mode */
+    unsigned int cur_channel_id =
+        GET_MASK(qatomic_read(&d->pfifo.regs[NV_PFIFO_CACHE1_PUSH1]),
+                 NV_PFIFO_CACHE1_PUSH1_CHID);
+    if (channel_id != cur_channel_id) {
+        /* ramfc */
+        assert(!"Unsupported: channel_id != cur_channel_id");
+        return NULL;
+    }
+
+    switch (addr & 0xFFFF) {
+    case NV_USER_DMA_PUT:
+        return &d->pfifo.regs[NV_PFIFO_CACHE1_DMA_PUT];
+    case NV_USER_DMA_GET:
+        return &d->pfifo.regs[NV_PFIFO_CACHE1_DMA_GET];
+    case NV_USER_REF:
+        return &d->pfifo.regs[NV_PFIFO_CACHE1_REF];
+    default:
+        return NULL;
+    }
+}
+
+uint64_t user_read(void *opaque, hwaddr addr, unsigned int size)
+{
+    NV2AState *d = (NV2AState *)opaque;
+
+    uint32_t *reg = user_get_reg(d, addr);
+    uint64_t r = reg ? qatomic_load_acquire(reg) : 0;
 
     nv2a_reg_log_read(NV_USER, addr, size, r);
+
+    /* Guests wait for the pusher by spinning on these two */
+    bool pollable = reg && (addr & 0xFFFF) != NV_USER_DMA_PUT;
+    if (pollable && nv2a_poll_detect(&d->poll.user, addr, r, true)) {
+        user_wait_for_fifo(d, addr);
+    }
+
     return r;
 }
 
@@ -76,46 +130,16 @@ void user_write(void *opaque, hwaddr addr, uint64_t val, unsigned int size)
 
     nv2a_reg_log_write(NV_USER, addr, size, val);
 
-    unsigned int channel_id = addr >> 16;
-    assert(channel_id < NV2A_NUM_CHANNELS);
-
-    qemu_mutex_lock(&d->pfifo.lock);
+    nv2a_poll_reset(&d->poll.user);
 
-    uint32_t channel_modes = d->pfifo.regs[NV_PFIFO_MODE];
-    if (channel_modes & (1 << channel_id)) {
-        /* DMA Mode */
-        unsigned int cur_channel_id =
-            GET_MASK(d->pfifo.regs[NV_PFIFO_CACHE1_PUSH1],
-                     NV_PFIFO_CACHE1_PUSH1_CHID);
-
-        if (channel_id == cur_channel_id) {
-            switch (addr & 0xFFFF) {
-            case NV_USER_DMA_PUT:
-                d->pfifo.regs[NV_PFIFO_CACHE1_DMA_PUT] = val;
-                break;
-            case NV_USER_DMA_GET:
-                d->pfifo.regs[NV_PFIFO_CACHE1_DMA_GET] = val;
-                break;
-            case NV_USER_REF:
-                d->pfifo.regs[NV_PFIFO_CACHE1_REF] = val;
-                break;
-            default:
-                NV2A_DPRINTF(true, "Unsupported NV_USER write: channel=%u offset=0x%04x\n", channel_id, (unsigned)(addr & 0xFFFF));
-                assert(!"Unsupported NV_USER DMA register write offset");
-                break;
-            }
-
-            pfifo_kick(d);
-
-        } else {
-            /* ramfc */
-            assert(!"Invalid channel id");
-        }
-    } else {
-        /* PIO Mode */
-        assert(!"Failed to enter DMA mode - entered PIO mode");
+    uint32_t *reg = user_get_reg(d, addr);
+    if (!reg) {
+        NV2A_DPRINTF("Unsupported NV_USER write: channel=%u offset=0x%04x\n",
+                     (unsigned)(addr >> 16), (unsigned)(addr & 0xFFFF));
+        assert(!"Unsupported NV_USER DMA register write offset");
+        return;
     }
 
-    qemu_mutex_unlock(&d->pfifo.lock);
-
+    qatomic_store_release(reg, val);
+    pfifo_kick(d);
 }
@@ -56,6 +56,7 @@
 #include "hw/xbox/mcpx/apu/apu.h"
 
 #include "hw/xbox/xbox.h"
+#include "xemu-tb-cache.h"
 #include "smbus.h"
 
 #define MAX_IDE_BUS 2
@@ -170,6 +171,9 @@ static void xbox_flash_init(MachineState *ms, MemoryRegion *rom_memory)
     rom_add_blob_fixed("xbox.mcpx", bios_data, bios_size, -bios_size);
     memory_region_add_subregion_overlap(rom_memory, -bios_size, mcpx, 1);
 
+    /* Translated code depends on the kernel, so key the code cache by it */
+    xemu_tb_cache_init(bios_data, bios_size);
+
     g_free(bios_data); /* duplicated by `rom_add_blob_fixed` */
 }
 
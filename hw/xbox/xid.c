@@ -59,9 +59,9 @@ void update_input(USBXIDGamepadState *s)
         return;
     }
 
-    ControllerState *state = xemu_input_get_bound(s->device_index);
-    assert(state);
-    xemu_input_update_controller(state);
+    ControllerSnapshot snapshot;
+    xemu_input_read_controller(s->device_index, &snapshot);
+    const ControllerSnapshot *state = &snapshot;
 
     const int button_map_analog[6][2] = {
         { GAMEPAD_A,     CONTROLLER_BUTTON_A     },
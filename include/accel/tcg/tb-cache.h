@@ -0,0 +1,49 @@
+/*
+ * Persistent translation block cache
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_CACHE_H
+#define ACCEL_TCG_TB_CACHE_H
+
+/*
+ * The cache records the CPU state (pc, cs_base, flags, cflags) and a hash of
+ * the guest code of every TB translated while it is open. When a cache file
+ * is opened, the recorded blocks are translated ahead of time by the vCPU
+ * thread, skipping any whose guest code is no longer mapped or no longer
+ * hashes the same, so a title does not pay the full translation cost again
+ * on every boot. Blocks the guest has translated most often go first, and
+ * preloading stops before it could fill the code buffer.
+ *
+ * Only guest-side descriptors are stored: generated host code references
+ * helpers and globals by absolute address and cannot be reused across runs.
+ */
+
+/**
+ * tb_cache_open:
+ * @path: cache file to load from and save to
+ *
+ * Close any open cache, then load @path (if it exists) and schedule its
+ * blocks for translation. Called from the main loop.
+ */
+void tb_cache_open(const char *path);
+
+/**
+ * tb_cache_save:
+ *
+ * Write the open cache back to its file, if anything was recorded since it
+ * was last loaded or saved. The file is written in the background. Called
+ * from the main loop.
+ */
+void tb_cache_save(void);
+
+/**
+ * tb_cache_close:
+ *
+ * Save and close the open cache, waiting for the file to be written. New
+ * translations are no longer recorded. Called from the main loop.
+ */
+void tb_cache_close(void);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Read-ahead cache for Xbox disc images
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOCK_XISO_CACHE_H
+#define BLOCK_XISO_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define XISO_CACHE_FORMAT "xiso-cache"
+
+typedef struct XisoCacheStats {
+    uint64_t hits;       // Cluster reads served from the cache
+    uint64_t misses;     // Cluster reads that had to wait on the image
+    uint64_t prefetched; // Clusters loaded ahead of a sequential stream
+    uint64_t mapped;     // Reads served from a memory mapped image
+    uint64_t cached_bytes;
+    bool active;
+} XisoCacheStats;
+
+// Defaults for images opened without explicit options, 0 disables a feature
+void xiso_cache_set_defaults(uint64_t cache_size, uint64_t read_ahead,
+                             bool mmap);
+
+void xiso_cache_get_stats(XisoCacheStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -68,4 +68,37 @@ bool delete_snapshot(const char *name,
  */
 void load_snapshot_resume(RunState state);
 
+#ifdef XBOX
+typedef void SaveSnapshotCompleteFunc(void *opaque, Error *err);
+
+/**
+ * save_snapshot_background: Save an internal snapshot, writing it out after
+ * the VM has resumed.
+ * @name: name of internal snapshot
+ * @overwrite: replace existing snapshot with @name
+ * @compress: compress the VM state after the VM has resumed
+ * @cb: called from the main loop once the snapshot is complete or has failed
+ * @opaque: passed to @cb
+ * @errp: pointer to error object
+ * On success, return %true and call @cb later.
+ * On failure, store an error through @errp and return %false.
+ */
+bool save_snapshot_background(const char *name, bool overwrite,
+                              bool compress, SaveSnapshotCompleteFunc *cb,
+                              void *opaque, Error **errp);
+
+/**
+ * save_snapshot_in_progress: Whether a background save has not completed yet.
+ */
+bool save_snapshot_in_progress(void);
+
+/**
+ * save_snapshot_background_wait: Wait for a background save to complete.
+ *
+ * The save holds a drained reference to the vmstate node until it completes,
+ * so this must be called before the block layer is shut down.
+ */
+void save_snapshot_background_wait(void);
+#endif
+
 #endif
@@ -453,6 +453,7 @@ void main_loop_poll_remove_notifier(Notifier *notify);
 void qemu_init_main_loop_lock(void);
 void qemu_mutex_lock_main_loop(void);
 void qemu_mutex_unlock_main_loop(void);
+bool qemu_mutex_trylock_main_loop(void);
 #endif
 
 #endif
@@ -192,6 +192,12 @@ static inline bool (qemu_cond_timedwait)(QemuCond *cond, QemuMutex *mutex,
     return qemu_cond_timedwait(cond, mutex, ms);
 }
 
+/*
+ * Like qemu_cond_timedwait, with the timeout in nanoseconds. Where the host
+ * only supports millisecond timeouts, it is rounded up.
+ */
+bool qemu_cond_timedwait_ns(QemuCond *cond, QemuMutex *mutex, int64_t ns);
+
 void qemu_sem_init(QemuSemaphore *sem, int init);
 void qemu_sem_post(QemuSemaphore *sem);
 void qemu_sem_wait(QemuSemaphore *sem);
@@ -55,6 +55,7 @@
 #include "qemu/iov.h"
 #include "qemu/job.h"
 #include "qemu/main-loop.h"
+#include "block/aio-wait.h"
 #include "block/snapshot.h"
 #include "block/thread-pool.h"
 #include "qemu/cutils.h"
@@ -72,6 +73,11 @@
 #include "system/qtest.h"
 #include "options.h"
 
+#include "block/block.h"
+#include "qemu/bswap.h"
+#include "qemu/coroutine.h"
+#include "qemu/units.h"
+#include "ui/xemu-snapshot-stream.h"
 #include "ui/xemu-snapshots.h"
 
 const unsigned int postcopy_ram_discard_version;
@@ -3314,6 +3320,250 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
     return ret == 0;
 }
 
+#ifdef XBOX
+/*
+ * Background snapshot save
+ *
+ * The VM is only stopped for as long as it takes to serialize its state into
+ * memory. Writing that out to the image, which is what takes most of the time
+ * for a large guest, happens in a coroutine on the main loop once the guest
+ * is running again. The vmstate node stays drained until the snapshot has
+ * been created, so guest requests to it queue up instead of ending up in the
+ * snapshot. Compression, when enabled, also happens after the guest resumes.
+ */
+
+#define BACKGROUND_SAVE_CHUNK (1 * MiB)
+
+typedef struct BackgroundSave {
+    BlockDriverState *bs;
+    QEMUSnapshotInfo sn;
+    QIOChannelBuffer *bioc;
+    uint64_t vm_state_size;
+    bool compress;
+    size_t data_size;
+    uint8_t *stream;
+    size_t stream_size;
+    int ret;
+    QEMUBH *done_bh;
+    SaveSnapshotCompleteFunc *cb;
+    void *opaque;
+} BackgroundSave;
+
+static BackgroundSave *background_save;
+
+bool save_snapshot_in_progress(void)
+{
+    return background_save != NULL;
+}
+
+void save_snapshot_background_wait(void)
+{
+    GLOBAL_STATE_CODE();
+
+    /* The write-out and its completion BH both run in the main context */
+    AIO_WAIT_WHILE_UNLOCKED(NULL, background_save != NULL);
+}
+
+/* Size of the xemu data leading the VM state, which is never compressed */
+static size_t xemu_vmstate_data_size(const uint8_t *buf, size_t size)
+{
+    if (size < 12 || ldl_be_p(buf) != XEMU_SNAPSHOT_DATA_MAGIC) {
+        return 0;
+    }
+    return MIN(size, 12 + (size_t)ldl_be_p(buf + 8));
+}
+
+static void background_save_done(void *opaque)
+{
+    BackgroundSave *s = opaque;
+    Error *local_err = NULL;
+
+    if (s->ret < 0) {
+        error_setg_errno(&local_err, -s->ret, "Error while writing VM state");
+    } else if (bdrv_all_create_snapshot(&s->sn, s->bs, s->vm_state_size,
+                                        false, NULL, &local_err) < 0) {
+        bdrv_all_delete_snapshot(s->sn.name, false, NULL, NULL);
+    }
+
+    bdrv_drained_end(s->bs);
+    bdrv_unref(s->bs);
+
+    qemu_bh_delete(s->done_bh);
+    object_unref(OBJECT(s->bioc));
+    g_free(s->stream);
+    background_save = NULL;
+
+    xemu_snapshots_mark_dirty();
+
+    if (s->cb) {
+        s->cb(s->opaque, local_err);
+    }
+    error_free(local_err);
+    g_free(s);
+}
+
+static int coroutine_fn background_save_write(BackgroundSave *s,
+                                              uint8_t *buf, size_t size,
+                                              int64_t offset)
+{
+    for (size_t pos = 0; pos < size; pos += BACKGROUND_SAVE_CHUNK) {
+        size_t len = MIN(BACKGROUND_SAVE_CHUNK, size - pos);
+        QEMUIOVector qiov = QEMU_IOVEC_INIT_BUF(qiov, buf + pos, len);
+        int ret;
+
+        bdrv_graph_co_rdlock();
+        ret = bdrv_writev_vmstate(s->bs, &qiov, offset + pos);
+        bdrv_graph_co_rdunlock();
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+#ifdef CONFIG_ZSTD
+static int background_save_compress(void *opaque)
+{
+    BackgroundSave *s = opaque;
+
+    s->stream = xemu_snapshot_stream_compress(s->bioc->data + s->data_size,
+                                              s->vm_state_size - s->data_size,
+                                              &s->stream_size);
+    return 0;
+}
+#endif
+
+static void coroutine_fn background_save_co(void *opaque)
+{
+    BackgroundSave *s = opaque;
+
+    s->data_size = s->vm_state_size;
+#ifdef CONFIG_ZSTD
+    if (s->compress) {
+        s->data_size = xemu_vmstate_data_size(s->bioc->data, s->vm_state_size);
+        thread_pool_submit_co(background_save_compress, s);
+    }
+#endif
+
+    s->ret = background_save_write(s, s->bioc->data, s->data_size, 0);
+    if (s->ret == 0 && s->stream) {
+        s->ret = background_save_write(s, s->stream, s->stream_size,
+                                       s->data_size);
+        s->vm_state_size = s->data_size + s->stream_size;
+    }
+
+    qemu_bh_schedule(s->done_bh);
+}
+
+bool save_snapshot_background(const char *name, bool overwrite,
+                              bool compress, SaveSnapshotCompleteFunc *cb,
+                              void *opaque, Error **errp)
+{
+    BlockDriverState *bs;
+    BackgroundSave *s;
+    QEMUFile *f;
+    RunState saved_state = runstate_get();
+    int ret, ret2;
+    g_autoptr(GDateTime) now = g_date_time_new_now_local();
+
+    GLOBAL_STATE_CODE();
+
+    if (background_save) {
+        error_setg(errp, "A snapshot is already being saved");
+        return false;
+    }
+
+    if (!migrate_can_snapshot(errp) || migration_is_blocked(errp)) {
+        return false;
+    }
+
+    if (!bdrv_all_can_snapshot(false, NULL, errp)) {
+        return false;
+    }
+
+    if (name) {
+        if (overwrite) {
+            if (bdrv_all_delete_snapshot(name, false, NULL, errp) < 0) {
+                return false;
+            }
+        } else {
+            ret2 = bdrv_all_has_snapshot(name, false, NULL, errp);
+            if (ret2 < 0) {
+                return false;
+            }
+            if (ret2 == 1) {
+                error_setg(errp,
+                           "Snapshot '%s' already exists in one or more devices",
+                           name);
+                return false;
+            }
+        }
+    }
+
+    bs = bdrv_all_find_vmstate_bs(NULL, false, NULL, errp);
+    if (bs == NULL) {
+        return false;
+    }
+
+    s = g_new0(BackgroundSave, 1);
+    s->bs = bs;
+    s->compress = compress;
+    s->cb = cb;
+    s->opaque = opaque;
+
+    global_state_store();
+    vm_stop(RUN_STATE_SAVE_VM);
+
+    bdrv_drain_all_begin();
+
+    s->sn.date_sec = g_date_time_to_unix(now);
+    s->sn.date_nsec = g_date_time_get_microsecond(now) * 1000;
+    s->sn.vm_clock_nsec = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    s->sn.icount = -1ULL;
+
+    if (name) {
+        pstrcpy(s->sn.name, sizeof(s->sn.name), name);
+    } else {
+        g_autofree char *autoname = g_date_time_format(now, "vm-%Y%m%d%H%M%S");
+        pstrcpy(s->sn.name, sizeof(s->sn.name), autoname);
+    }
+
+    /* Size the buffer for guest RAM up front to avoid regrowing it */
+    s->bioc = qio_channel_buffer_new(ram_bytes_total());
+    f = qemu_file_new_output(QIO_CHANNEL(s->bioc));
+    ret = qemu_savevm_state(f, errp);
+    s->vm_state_size = qemu_file_transferred(f);
+    ret2 = qemu_fclose(f);
+    if (ret == 0 && ret2 < 0) {
+        error_setg_errno(errp, -ret2, "Error while serializing VM state");
+        ret = ret2;
+    }
+
+    if (ret < 0) {
+        bdrv_drain_all_end();
+        vm_resume(saved_state);
+        object_unref(OBJECT(s->bioc));
+        g_free(s);
+        return false;
+    }
+
+    /* Only keep the node holding the snapshot quiesced */
+    bdrv_ref(bs);
+    bdrv_drained_begin(bs);
+    bdrv_drain_all_end();
+
+    vm_resume(saved_state);
+
+    background_save = s;
+    s->done_bh = qemu_bh_new(background_save_done, s);
+    aio_co_schedule(qemu_get_aio_context(),
+                    qemu_coroutine_create(background_save_co, s));
+
+    return true;
+}
+#endif
+
 void qmp_xen_save_devices_state(const char *filename, bool has_live, bool live,
                                 Error **errp)
 {
@@ -3393,6 +3643,78 @@ void qmp_xen_load_devices_state(const char *filename, Error **errp)
     migration_incoming_state_destroy();
 }
 
+#ifdef XBOX
+#define XEMU_VMSTATE_READ_CHUNK (64 * MiB)
+
+/*
+ * Open the VM state for loading. A compressed VM state is expanded into
+ * memory up front, on all cores, rather than streamed from the image.
+ */
+static QEMUFile *xemu_open_vmstate(BlockDriverState *bs, Error **errp)
+{
+    uint8_t hdr[XEMU_SNAPSHOT_STREAM_HEADER_SIZE];
+    size_t data_size = 0;
+
+    if (bdrv_load_vmstate(bs, hdr, 0, 12) == 12) {
+        data_size = xemu_vmstate_data_size(hdr, SIZE_MAX);
+    }
+    if (bdrv_load_vmstate(bs, hdr, data_size, sizeof(hdr)) != sizeof(hdr) ||
+        ldl_be_p(hdr) != XEMU_SNAPSHOT_STREAM_MAGIC) {
+        return qemu_fopen_bdrv(bs, 0);
+    }
+
+#ifdef CONFIG_ZSTD
+    uint64_t raw_size, stream_size;
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+
+    if (!xemu_snapshot_stream_parse_header(hdr, &raw_size, &stream_size,
+                                           errp)) {
+        return NULL;
+    }
+
+    uint8_t *buf = g_try_malloc(data_size + raw_size);
+    g_autofree uint8_t *stream = g_try_malloc(stream_size);
+    if (!buf || !stream) {
+        error_setg(errp, "Not enough memory to expand snapshot VM state");
+        g_free(buf);
+        return NULL;
+    }
+
+    if (bdrv_load_vmstate(bs, buf, 0, data_size) != (int)data_size) {
+        goto read_err;
+    }
+    for (uint64_t pos = 0; pos < stream_size; pos += XEMU_VMSTATE_READ_CHUNK) {
+        int len = MIN(XEMU_VMSTATE_READ_CHUNK, stream_size - pos);
+        if (bdrv_load_vmstate(bs, stream + pos, data_size + pos, len) != len) {
+            goto read_err;
+        }
+    }
+
+    if (!xemu_snapshot_stream_decompress(stream, stream_size, buf + data_size,
+                                         raw_size, errp)) {
+        g_free(buf);
+        return NULL;
+    }
+
+    bioc = qio_channel_buffer_new(0);
+    bioc->data = buf;
+    bioc->capacity = bioc->usage = data_size + raw_size;
+    f = qemu_file_new_input(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+    return f;
+
+read_err:
+    error_setg(errp, "Error while reading VM state");
+    g_free(buf);
+    return NULL;
+#else
+    error_setg(errp, "Snapshot is compressed, but xemu was built without zstd");
+    return NULL;
+#endif
+}
+#endif
+
 bool load_snapshot(const char *name, const char *vmstate,
                    bool has_devices, strList *devices, Error **errp)
 {
@@ -3450,11 +3772,18 @@ bool load_snapshot(const char *name, const char *vmstate,
     }
 
     /* restore the VM state */
+#ifdef XBOX
+    f = xemu_open_vmstate(bs_vm_state, errp);
+    if (!f) {
+        goto err_drain;
+    }
+#else
     f = qemu_fopen_bdrv(bs_vm_state, 0);
     if (!f) {
         error_setg(errp, "Could not open VM state file");
         goto err_drain;
     }
+#endif
 
     qemu_system_reset(SHUTDOWN_CAUSE_SNAPSHOT_LOAD);
     mis->from_src_file = f;
@@ -35,6 +35,7 @@
 #include "hw/resettable.h"
 #include "migration/misc.h"
 #include "migration/postcopy-ram.h"
+#include "migration/snapshot.h"
 #include "monitor/monitor.h"
 #include "net/net.h"
 #include "net/vhost_net.h"
@@ -975,6 +976,14 @@ void qemu_cleanup(int status)
      */
     migration_shutdown();
 
+#ifdef XBOX
+    /*
+     * A snapshot still being written out keeps its node drained and
+     * referenced, let it complete before the block layer goes away.
+     */
+    save_snapshot_background_wait();
+#endif
+
     /*
      * Close the exports before draining the block layer. The export
      * drivers may have coroutines yielding on it, so we need to clean
@@ -147,7 +147,12 @@
 #include "ui/xemu-notifications.h"
 #include "ui/xemu-net.h"
 #include "ui/xemu-input.h"
+#include "ui/xemu-hdd.h"
+#include "ui/xemu-args.h"
 #include "hw/xbox/eeprom_generation.h"
+#include "hw/xbox/mcpx/apu/apu.h"
+#include "xemu-benchmark.h"
+#include "block/xiso-cache.h"
 
 #define MAX_VIRTIO_CONSOLES 1
 
@@ -176,6 +181,10 @@ static const char *incoming;
 static const char *incoming_str[MIGRATION_CHANNEL_TYPE__MAX];
 static MigrationChannel *incoming_channels[MIGRATION_CHANNEL_TYPE__MAX];
 static const char *loadvm;
+static const char *apu_bench_path;
+static int apu_bench_frames = 6000;
+static const char *hdd_bench_dir;
+static int hdd_bench_writes = 8192;
 static const char *accelerators;
 static bool have_custom_ram_size;
 static const char *ram_memdev_id;
@@ -675,6 +684,7 @@ static int drive_init_func(void *opaque, QemuOpts *opts, Error **errp)
         xemu_queue_error_message(msg);
         g_free(msg);
         qemu_opt_set(opts, "file", "", errp);
+        qemu_opt_unset(opts, "format");
         failed = drive_new(opts, *block_default_type, errp) == NULL;
     }
 
@@ -2879,6 +2889,27 @@ void qmp_x_exit_preconfig(Error **errp)
         return;
     }
 
+#ifdef XBOX
+    if (apu_bench_path) {
+        // Leave through the main loop, so the display and devices shut down
+        qemu_system_shutdown_request_with_code(
+            SHUTDOWN_CAUSE_HOST_UI,
+            mcpx_apu_bench(apu_bench_path, apu_bench_frames));
+        return;
+    }
+    if (hdd_bench_dir) {
+        qemu_system_shutdown_request_with_code(
+            SHUTDOWN_CAUSE_HOST_UI,
+            xemu_hdd_bench(hdd_bench_dir, hdd_bench_writes));
+        return;
+    }
+    if (xemu_benchmark_is_active() && !autostart) {
+        error_report("benchmark: machine cannot boot, check the flash and "
+                     "EEPROM paths in settings");
+        exit(1);
+    }
+#endif
+
     if (loadvm) {
         RunState state = autostart ? RUN_STATE_RUNNING : runstate_get();
         load_snapshot(loadvm, NULL, false, NULL, &error_fatal);
@@ -2887,6 +2918,11 @@ void qmp_x_exit_preconfig(Error **errp)
     if (replay_mode != REPLAY_MODE_NONE) {
         replay_vmstate_init();
     }
+#ifdef XBOX
+    if (xemu_benchmark_is_active()) {
+        xemu_benchmark_start();
+    }
+#endif
 
     if (incoming) {
         Error *local_err = NULL;
@@ -3066,36 +3102,63 @@ void qemu_init(int argc, char **argv)
         } else {
             fake_argv[fake_argc++] = strdup("-drive");
             char *escaped_hdd_path = strdup_double_commas(hdd_path);
-            fake_argv[fake_argc++] = g_strdup_printf("index=0,media=disk,file=%s%s",
+            char *hdd_options = xemu_hdd_get_drive_options(hdd_path);
+            fake_argv[fake_argc++] = g_strdup_printf("index=0,media=disk,file=%s%s%s",
                 escaped_hdd_path,
-                strlen(escaped_hdd_path) > 0 ? ",locked=on" : "");
+                strlen(escaped_hdd_path) > 0 ? ",locked=on" : "",
+                hdd_options);
+            g_free(hdd_options);
             free(escaped_hdd_path);
         }
     }
 
     const char *dvd_path = g_config.sys.files.dvd_path;
     // Allow overriding the dvd path from command line
-    for (int i = 1; i < argc; i++) {
-        if (argv[i] && strcmp(argv[i], "-dvd_path") == 0) {
-            argv[i] = NULL;
-            if (i < argc - 1 && argv[i+1]) {
-                dvd_path = argv[i+1];
-                argv[i+1] = NULL;
-            }
-            break;
-        }
+    const char *dvd_path_arg = xemu_args_take_str(argc, argv, "-dvd_path");
+    if (dvd_path_arg) {
+        dvd_path = dvd_path_arg;
+    }
+
+    // Render APU frames from a capture made in the audio debug window, without
+    // starting the CPU, then exit
+    apu_bench_path = xemu_args_take_str(argc, argv, "-apu_bench");
+    xemu_args_take_int(argc, argv, "-apu_bench_frames", 1, &apu_bench_frames);
+    if (apu_bench_path) {
+        autostart = 0;
+    }
+
+    // Time random writes to freshly created HDD images in a directory, then
+    // exit
+    hdd_bench_dir = xemu_args_take_str(argc, argv, "-hdd_bench");
+    xemu_args_take_int(argc, argv, "-hdd_bench_writes", 1, &hdd_bench_writes);
+    if (hdd_bench_dir) {
+        autostart = 0;
     }
 
     // Always populate DVD drive. If disc path is the empty string, drive is
     // connected but no media present.
     fake_argv[fake_argc++] = strdup("-drive");
     char *escaped_dvd_path = strdup_double_commas(dvd_path);
-    fake_argv[fake_argc++] = g_strdup_printf("index=1,media=cdrom,file=%s",
-        escaped_dvd_path);
+    bool dvd_cache = g_config.perf.dvd_cache.enable && strlen(dvd_path) > 0;
+    xiso_cache_set_defaults(g_config.perf.dvd_cache.size_mb * MiB,
+                            g_config.perf.dvd_cache.read_ahead_kb * KiB,
+                            g_config.perf.dvd_cache.mmap);
+    fake_argv[fake_argc++] = g_strdup_printf("index=1,media=cdrom,file=%s%s",
+        escaped_dvd_path, dvd_cache ? ",format=" XISO_CACHE_FORMAT : "");
     free(escaped_dvd_path);
 
     fake_argv[fake_argc++] = strdup("-display");
-    fake_argv[fake_argc++] = strdup("xemu");
+    if (xemu_benchmark_is_active()) {
+        // Headless run, see xemu-benchmark.c
+        fake_argv[fake_argc++] = strdup("none");
+        const char *snapshot = xemu_benchmark_get_snapshot();
+        if (snapshot) {
+            fake_argv[fake_argc++] = strdup("-loadvm");
+            fake_argv[fake_argc++] = strdup(snapshot);
+        }
+    } else {
+        fake_argv[fake_argc++] = strdup("xemu");
+    }
 
     // Create USB Daughterboard for 1.0 Xbox. This is connected to Port 1 of the Root hub.
     fake_argv[fake_argc++] = strdup("-device");
@@ -3107,11 +3170,12 @@ void qemu_init(int argc, char **argv)
         }
     }
 
-    printf("Created QEMU launch parameters: ");
+    // Log to stderr, stdout carries benchmark output
+    fprintf(stderr, "Created QEMU launch parameters: ");
     for (int i = 0; i < fake_argc; i++) {
-        printf("%s ", fake_argv[i]);
+        fprintf(stderr, "%s ", fake_argv[i]);
     }
-    printf("\n");
+    fprintf(stderr, "\n");
 
     argc = fake_argc;
     argv = fake_argv;
@@ -463,8 +463,15 @@ void glue(helper_pshufhw, SUFFIX)(Reg *d, Reg *s, int order)
 /* FPU ops */
 /* XXX: not accurate */
 
+/* Softfloat versions of the helpers that have a host-float variant */
+#if defined(XBOX) && defined(__x86_64__)
+#define SSE_HS(name) glue(name, __soft)
+#else
+#define SSE_HS(name) name
+#endif
+
 #define SSE_HELPER_P(name, F)                                           \
-    void glue(helper_ ## name ## ps, SUFFIX)(CPUX86State *env,          \
+    void SSE_HS(glue(helper_ ## name ## ps, SUFFIX))(CPUX86State *env,  \
             Reg *d, Reg *v, Reg *s)                                     \
     {                                                                   \
         int i;                                                          \
@@ -473,7 +480,7 @@ void glue(helper_pshufhw, SUFFIX)(Reg *d, Reg *s, int order)
         }                                                               \
     }                                                                   \
                                                                         \
-    void glue(helper_ ## name ## pd, SUFFIX)(CPUX86State *env,          \
+    void SSE_HS(glue(helper_ ## name ## pd, SUFFIX))(CPUX86State *env,  \
             Reg *d, Reg *v, Reg *s)                                     \
     {                                                                   \
         int i;                                                          \
@@ -487,7 +494,8 @@ void glue(helper_pshufhw, SUFFIX)(Reg *d, Reg *s, int order)
 #define SSE_HELPER_S(name, F)                                           \
     SSE_HELPER_P(name, F)                                               \
                                                                         \
-    void helper_ ## name ## ss(CPUX86State *env, Reg *d, Reg *v, Reg *s)\
+    void SSE_HS(helper_ ## name ## ss)(CPUX86State *env,                \
+            Reg *d, Reg *v, Reg *s)                                     \
     {                                                                   \
         int i;                                                          \
         d->ZMM_S(0) = F(32, v->ZMM_S(0), s->ZMM_S(0));                  \
@@ -496,7 +504,8 @@ void glue(helper_pshufhw, SUFFIX)(Reg *d, Reg *s, int order)
         }                                                               \
     }                                                                   \
                                                                         \
-    void helper_ ## name ## sd(CPUX86State *env, Reg *d, Reg *v, Reg *s)\
+    void SSE_HS(helper_ ## name ## sd)(CPUX86State *env,                \
+            Reg *d, Reg *v, Reg *s)                                     \
     {                                                                   \
         int i;                                                          \
         d->ZMM_D(0) = F(64, v->ZMM_D(0), s->ZMM_D(0));                  \
@@ -532,7 +541,7 @@ SSE_HELPER_S(div, FPU_DIV)
 SSE_HELPER_S(min, FPU_MIN)
 SSE_HELPER_S(max, FPU_MAX)
 
-void glue(helper_sqrtps, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
+void SSE_HS(glue(helper_sqrtps, SUFFIX))(CPUX86State *env, Reg *d, Reg *s)
 {
     int i;
     for (i = 0; i < 2 << SHIFT; i++) {
@@ -540,7 +549,7 @@ void glue(helper_sqrtps, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
     }
 }
 
-void glue(helper_sqrtpd, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
+void SSE_HS(glue(helper_sqrtpd, SUFFIX))(CPUX86State *env, Reg *d, Reg *s)
 {
     int i;
     for (i = 0; i < 1 << SHIFT; i++) {
@@ -549,7 +558,7 @@ void glue(helper_sqrtpd, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 }
 
 #if SHIFT == 1
-void helper_sqrtss(CPUX86State *env, Reg *d, Reg *v, Reg *s)
+void SSE_HS(helper_sqrtss)(CPUX86State *env, Reg *d, Reg *v, Reg *s)
 {
     int i;
     d->ZMM_S(0) = float32_sqrt(s->ZMM_S(0), &env->sse_status);
@@ -558,7 +567,7 @@ void helper_sqrtss(CPUX86State *env, Reg *d, Reg *v, Reg *s)
     }
 }
 
-void helper_sqrtsd(CPUX86State *env, Reg *d, Reg *v, Reg *s)
+void SSE_HS(helper_sqrtsd)(CPUX86State *env, Reg *d, Reg *v, Reg *s)
 {
     int i;
     d->ZMM_D(0) = float64_sqrt(s->ZMM_D(0), &env->sse_status);
@@ -840,7 +849,8 @@ int64_t helper_cvttsd2sq(CPUX86State *env, ZMMReg *s)
 #endif
 #endif
 
-void glue(helper_rsqrtps, SUFFIX)(CPUX86State *env, ZMMReg *d, ZMMReg *s)
+void SSE_HS(glue(helper_rsqrtps, SUFFIX))(CPUX86State *env, ZMMReg *d,
+                                          ZMMReg *s)
 {
     int old_flags = get_float_exception_flags(&env->sse_status);
     int i;
@@ -853,7 +863,8 @@ void glue(helper_rsqrtps, SUFFIX)(CPUX86State *env, ZMMReg *d, ZMMReg *s)
 }
 
 #if SHIFT == 1
-void helper_rsqrtss(CPUX86State *env, ZMMReg *d, ZMMReg *v, ZMMReg *s)
+void SSE_HS(helper_rsqrtss)(CPUX86State *env, ZMMReg *d, ZMMReg *v,
+                             ZMMReg *s)
 {
     int old_flags = get_float_exception_flags(&env->sse_status);
     int i;
@@ -867,7 +878,8 @@ void helper_rsqrtss(CPUX86State *env, ZMMReg *d, ZMMReg *v, ZMMReg *s)
 }
 #endif
 
-void glue(helper_rcpps, SUFFIX)(CPUX86State *env, ZMMReg *d, ZMMReg *s)
+void SSE_HS(glue(helper_rcpps, SUFFIX))(CPUX86State *env, ZMMReg *d,
+                                        ZMMReg *s)
 {
     int old_flags = get_float_exception_flags(&env->sse_status);
     int i;
@@ -878,7 +890,8 @@ void glue(helper_rcpps, SUFFIX)(CPUX86State *env, ZMMReg *d, ZMMReg *s)
 }
 
 #if SHIFT == 1
-void helper_rcpss(CPUX86State *env, ZMMReg *d, ZMMReg *v, ZMMReg *s)
+void SSE_HS(helper_rcpss)(CPUX86State *env, ZMMReg *d, ZMMReg *v,
+                           ZMMReg *s)
 {
     int old_flags = get_float_exception_flags(&env->sse_status);
     int i;
@@ -2664,6 +2677,7 @@ void helper_sha256msg2(Reg *d, Reg *a, Reg *b)
 #endif
 
 #undef SSE_HELPER_S
+#undef SSE_HS
 
 #undef LANE_WIDTH
 #undef SHIFT
@@ -0,0 +1,252 @@
+/*
+ *  SSE/SSE2 arithmetic helpers using host floating point
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The guest and host share the same SSE semantics, so instead of going
+ * through softfloat lane by lane, these helpers run the host instruction on
+ * each 128-bit chunk with the guest rounding mode, DAZ and FTZ loaded into
+ * the host MXCSR. Exception flags raised by the host are folded back into
+ * sse_status. When the guest has unmasked any SIMD exception, the softfloat
+ * helper is used instead.
+ *
+ * Included from fpu_helper.c when building with USE_HARD_FPU, with SHIFT 1
+ * (xmm) or 2 (ymm).
+ */
+
+#define Reg ZMMReg
+#if SHIFT == 1
+#define SUFFIX _xmm
+#else
+#define SUFFIX _ymm
+#endif
+
+/* Number of 128-bit chunks in a register */
+#define CHUNKS (1 << (SHIFT - 1))
+
+#define SSE_HARD_P(name, OP)                                                \
+    void glue(glue(helper_ ## name ## ps, SUFFIX), __hard)(                 \
+            CPUX86State *env, Reg *d, Reg *v, Reg *s)                       \
+    {                                                                       \
+        uint32_t host_csr;                                                  \
+        if (!sse_hard_begin(env, &host_csr)) {                              \
+            glue(glue(helper_ ## name ## ps, SUFFIX), __soft)(env, d, v, s); \
+            return;                                                         \
+        }                                                                   \
+        for (int i = 0; i < CHUNKS; i++) {                                  \
+            __m128 a = _mm_loadu_ps((float *)&v->ZMM_S(4 * i));             \
+            __m128 b = _mm_loadu_ps((float *)&s->ZMM_S(4 * i));             \
+            SSE_HARD_FENCE(a);                                              \
+            SSE_HARD_FENCE(b);                                              \
+            __m128 r = OP ## _ps(a, b);                                     \
+            SSE_HARD_FENCE(r);                                              \
+            _mm_storeu_ps((float *)&d->ZMM_S(4 * i), r);                    \
+        }                                                                   \
+        sse_hard_end(env, host_csr);                                        \
+    }                                                                       \
+                                                                            \
+    void glue(glue(helper_ ## name ## pd, SUFFIX), __hard)(                 \
+            CPUX86State *env, Reg *d, Reg *v, Reg *s)                       \
+    {                                                                       \
+        uint32_t host_csr;                                                  \
+        if (!sse_hard_begin(env, &host_csr)) {                              \
+            glue(glue(helper_ ## name ## pd, SUFFIX), __soft)(env, d, v, s); \
+            return;                                                         \
+        }                                                                   \
+        for (int i = 0; i < CHUNKS; i++) {                                  \
+            __m128d a = _mm_loadu_pd((double *)&v->ZMM_D(2 * i));           \
+            __m128d b = _mm_loadu_pd((double *)&s->ZMM_D(2 * i));           \
+            SSE_HARD_FENCE(a);                                              \
+            SSE_HARD_FENCE(b);                                              \
+            __m128d r = OP ## _pd(a, b);                                    \
+            SSE_HARD_FENCE(r);                                              \
+            _mm_storeu_pd((double *)&d->ZMM_D(2 * i), r);                   \
+        }                                                                   \
+        sse_hard_end(env, host_csr);                                        \
+    }
+
+#if SHIFT == 1
+
+/* Scalar forms take the upper lanes from v, like the host instructions */
+#define SSE_HARD_S(name, OP)                                                \
+    SSE_HARD_P(name, OP)                                                    \
+                                                                            \
+    void helper_ ## name ## ss__hard(CPUX86State *env,                      \
+            Reg *d, Reg *v, Reg *s)                                         \
+    {                                                                       \
+        uint32_t host_csr;                                                  \
+        if (!sse_hard_begin(env, &host_csr)) {                              \
+            helper_ ## name ## ss__soft(env, d, v, s);                      \
+            return;                                                         \
+        }                                                                   \
+        __m128 a = _mm_loadu_ps((float *)&v->ZMM_S(0));                     \
+        __m128 b = _mm_loadu_ps((float *)&s->ZMM_S(0));                     \
+        SSE_HARD_FENCE(a);                                                  \
+        SSE_HARD_FENCE(b);                                                  \
+        __m128 r = OP ## _ss(a, b);                                         \
+        SSE_HARD_FENCE(r);                                                  \
+        _mm_storeu_ps((float *)&d->ZMM_S(0), r);                            \
+        sse_hard_end(env, host_csr);                                        \
+    }                                                                       \
+                                                                            \
+    void helper_ ## name ## sd__hard(CPUX86State *env,                      \
+            Reg *d, Reg *v, Reg *s)                                         \
+    {                                                                       \
+        uint32_t host_csr;                                                  \
+        if (!sse_hard_begin(env, &host_csr)) {                              \
+            helper_ ## name ## sd__soft(env, d, v, s);                      \
+            return;                                                         \
+        }                                                                   \
+        __m128d a = _mm_loadu_pd((double *)&v->ZMM_D(0));                   \
+        __m128d b = _mm_loadu_pd((double *)&s->ZMM_D(0));                   \
+        SSE_HARD_FENCE(a);                                                  \
+        SSE_HARD_FENCE(b);                                                  \
+        __m128d r = OP ## _sd(a, b);                                        \
+        SSE_HARD_FENCE(r);                                                  \
+        _mm_storeu_pd((double *)&d->ZMM_D(0), r);                           \
+        sse_hard_end(env, host_csr);                                        \
+    }
+
+#else
+
+#define SSE_HARD_S(name, OP) SSE_HARD_P(name, OP)
+
+#endif
+
+SSE_HARD_S(add, _mm_add)
+SSE_HARD_S(sub, _mm_sub)
+SSE_HARD_S(mul, _mm_mul)
+SSE_HARD_S(div, _mm_div)
+SSE_HARD_S(min, _mm_min)
+SSE_HARD_S(max, _mm_max)
+
+void glue(glue(helper_sqrtps, SUFFIX), __hard)(CPUX86State *env, Reg *d,
+                                                Reg *s)
+{
+    uint32_t host_csr;
+    if (!sse_hard_begin(env, &host_csr)) {
+        glue(glue(helper_sqrtps, SUFFIX), __soft)(env, d, s);
+        return;
+    }
+    for (int i = 0; i < CHUNKS; i++) {
+        __m128 a = _mm_loadu_ps((float *)&s->ZMM_S(4 * i));
+        SSE_HARD_FENCE(a);
+        __m128 r = _mm_sqrt_ps(a);
+        SSE_HARD_FENCE(r);
+        _mm_storeu_ps((float *)&d->ZMM_S(4 * i), r);
+    }
+    sse_hard_end(env, host_csr);
+}
+
+void glue(glue(helper_sqrtpd, SUFFIX), __hard)(CPUX86State *env, Reg *d,
+                                                Reg *s)
+{
+    uint32_t host_csr;
+    if (!sse_hard_begin(env, &host_csr)) {
+        glue(glue(helper_sqrtpd, SUFFIX), __soft)(env, d, s);
+        return;
+    }
+    for (int i = 0; i < CHUNKS; i++) {
+        __m128d a = _mm_loadu_pd((double *)&s->ZMM_D(2 * i));
+        SSE_HARD_FENCE(a);
+        __m128d r = _mm_sqrt_pd(a);
+        SSE_HARD_FENCE(r);
+        _mm_storeu_pd((double *)&d->ZMM_D(2 * i), r);
+    }
+    sse_hard_end(env, host_csr);
+}
+
+#if SHIFT == 1
+void helper_sqrtss__hard(CPUX86State *env, Reg *d, Reg *v, Reg *s)
+{
+    uint32_t host_csr;
+    if (!sse_hard_begin(env, &host_csr)) {
+        helper_sqrtss__soft(env, d, v, s);
+        return;
+    }
+    __m128 a = _mm_loadu_ps((float *)&v->ZMM_S(0));
+    __m128 b = _mm_loadu_ps((float *)&s->ZMM_S(0));
+    SSE_HARD_FENCE(a);
+    SSE_HARD_FENCE(b);
+    __m128 r = _mm_move_ss(a, _mm_sqrt_ss(b));
+    SSE_HARD_FENCE(r);
+    _mm_storeu_ps((float *)&d->ZMM_S(0), r);
+    sse_hard_end(env, host_csr);
+}
+
+void helper_sqrtsd__hard(CPUX86State *env, Reg *d, Reg *v, Reg *s)
+{
+    uint32_t host_csr;
+    if (!sse_hard_begin(env, &host_csr)) {
+        helper_sqrtsd__soft(env, d, v, s);
+        return;
+    }
+    __m128d a = _mm_loadu_pd((double *)&v->ZMM_D(0));
+    __m128d b = _mm_loadu_pd((double *)&s->ZMM_D(0));
+    SSE_HARD_FENCE(a);
+    SSE_HARD_FENCE(b);
+    __m128d r = _mm_sqrt_sd(a, b);
+    SSE_HARD_FENCE(r);
+    _mm_storeu_pd((double *)&d->ZMM_D(0), r);
+    sse_hard_end(env, host_csr);
+}
+#endif
+
+/*
+ * RSQRT and RCP never raise exceptions and ignore the rounding mode, so they
+ * don't need the guest MXCSR. Like a real CPU, these return the 12-bit
+ * approximation rather than the exactly rounded result softfloat computes.
+ */
+void glue(glue(helper_rsqrtps, SUFFIX), __hard)(CPUX86State *env, ZMMReg *d,
+                                                 ZMMReg *s)
+{
+    for (int i = 0; i < CHUNKS; i++) {
+        __m128 a = _mm_loadu_ps((float *)&s->ZMM_S(4 * i));
+        _mm_storeu_ps((float *)&d->ZMM_S(4 * i), _mm_rsqrt_ps(a));
+    }
+}
+
+void glue(glue(helper_rcpps, SUFFIX), __hard)(CPUX86State *env, ZMMReg *d,
+                                               ZMMReg *s)
+{
+    for (int i = 0; i < CHUNKS; i++) {
+        __m128 a = _mm_loadu_ps((float *)&s->ZMM_S(4 * i));
+        _mm_storeu_ps((float *)&d->ZMM_S(4 * i), _mm_rcp_ps(a));
+    }
+}
+
+#if SHIFT == 1
+void helper_rsqrtss__hard(CPUX86State *env, ZMMReg *d, ZMMReg *v, ZMMReg *s)
+{
+    __m128 a = _mm_loadu_ps((float *)&v->ZMM_S(0));
+    __m128 b = _mm_loadu_ps((float *)&s->ZMM_S(0));
+    _mm_storeu_ps((float *)&d->ZMM_S(0), _mm_move_ss(a, _mm_rsqrt_ss(b)));
+}
+
+void helper_rcpss__hard(CPUX86State *env, ZMMReg *d, ZMMReg *v, ZMMReg *s)
+{
+    __m128 a = _mm_loadu_ps((float *)&v->ZMM_S(0));
+    __m128 b = _mm_loadu_ps((float *)&s->ZMM_S(0));
+    _mm_storeu_ps((float *)&d->ZMM_S(0), _mm_move_ss(a, _mm_rcp_ss(b)));
+}
+#endif
+
+#undef SSE_HARD_P
+#undef SSE_HARD_S
+#undef CHUNKS
+#undef SHIFT
+#undef Reg
+#undef SUFFIX
@@ -0,0 +1,73 @@
+/*
+ *  Running guest SSE arithmetic on the host SSE unit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef I386_SSE_HARD_H
+#define I386_SSE_HARD_H
+
+#include <emmintrin.h>
+#include "fpu/softfloat.h"
+
+/* MXCSR layout, shared by guest and host */
+#define SSE_IE_FLAG         0x0001
+#define SSE_DE_FLAG         0x0002
+#define SSE_ZE_FLAG         0x0004
+#define SSE_OE_FLAG         0x0008
+#define SSE_UE_FLAG         0x0010
+#define SSE_PE_FLAG         0x0020
+#define SSE_FLAG_MASK       0x003f
+#define SSE_DAZ             0x0040
+#define SSE_EXCP_MASK       0x1f80
+#define SSE_RC_MASK         (3 << 13)
+#define SSE_FZ              0x8000
+
+/* Keep the compiler from moving SSE arithmetic across MXCSR accesses */
+#define SSE_HARD_FENCE(x) asm volatile("" : "+x"(x))
+
+/*
+ * Load the guest rounding mode, DAZ and FTZ from @mxcsr into the host MXCSR
+ * with all exceptions masked and the status flags clear, saving the host's
+ * in @host_csr. Returns false if the guest has unmasked an exception, in
+ * which case softfloat must be used.
+ */
+static inline bool sse_hard_load_mxcsr(uint32_t mxcsr, uint32_t *host_csr)
+{
+    if ((mxcsr & SSE_EXCP_MASK) != SSE_EXCP_MASK) {
+        return false;
+    }
+    *host_csr = _mm_getcsr();
+    _mm_setcsr(mxcsr & (SSE_EXCP_MASK | SSE_RC_MASK | SSE_DAZ | SSE_FZ));
+    return true;
+}
+
+/* Restore the host MXCSR and raise the flags set by the guest op in @s */
+static inline void sse_hard_restore_mxcsr(uint32_t host_csr, float_status *s)
+{
+    uint32_t flags = _mm_getcsr();
+
+    _mm_setcsr(host_csr);
+    if (flags & SSE_FLAG_MASK) {
+        float_raise((flags & SSE_IE_FLAG ? float_flag_invalid : 0) |
+                    (flags & SSE_DE_FLAG ? float_flag_input_denormal_used : 0) |
+                    (flags & SSE_ZE_FLAG ? float_flag_divbyzero : 0) |
+                    (flags & SSE_OE_FLAG ? float_flag_overflow : 0) |
+                    (flags & SSE_UE_FLAG ? float_flag_underflow : 0) |
+                    (flags & SSE_PE_FLAG ? float_flag_inexact : 0),
+                    s);
+    }
+}
+
+#endif
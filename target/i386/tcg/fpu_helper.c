@@ -3515,4 +3515,24 @@ void helper_emms(CPUX86State *env)
 #define SHIFT 2
 #include "ops_sse.h"
 
+#else /* USE_HARD_FPU */
+
+#include "sse_hard.h"
+
+static inline bool sse_hard_begin(CPUX86State *env, uint32_t *host_csr)
+{
+    return sse_hard_load_mxcsr(env->mxcsr, host_csr);
+}
+
+static inline void sse_hard_end(CPUX86State *env, uint32_t host_csr)
+{
+    sse_hard_restore_mxcsr(host_csr, &env->sse_status);
+}
+
+#define SHIFT 1
+#include "ops_sse_hard.h"
+
+#define SHIFT 2
+#include "ops_sse_hard.h"
+
 #endif
@@ -121,6 +121,55 @@ static int g_use_hard_fpu;
 #define gen_helper_fldenv         MAP_GEN_HELPER_SOFT_HARD(fldenv)
 #define gen_helper_fsave          MAP_GEN_HELPER_SOFT_HARD(fsave)
 #define gen_helper_frstor         MAP_GEN_HELPER_SOFT_HARD(frstor)
+
+#define gen_helper_addps_xmm      MAP_GEN_HELPER_SOFT_HARD(addps_xmm)
+#define gen_helper_addpd_xmm      MAP_GEN_HELPER_SOFT_HARD(addpd_xmm)
+#define gen_helper_addps_ymm      MAP_GEN_HELPER_SOFT_HARD(addps_ymm)
+#define gen_helper_addpd_ymm      MAP_GEN_HELPER_SOFT_HARD(addpd_ymm)
+#define gen_helper_addss          MAP_GEN_HELPER_SOFT_HARD(addss)
+#define gen_helper_addsd          MAP_GEN_HELPER_SOFT_HARD(addsd)
+#define gen_helper_subps_xmm      MAP_GEN_HELPER_SOFT_HARD(subps_xmm)
+#define gen_helper_subpd_xmm      MAP_GEN_HELPER_SOFT_HARD(subpd_xmm)
+#define gen_helper_subps_ymm      MAP_GEN_HELPER_SOFT_HARD(subps_ymm)
+#define gen_helper_subpd_ymm      MAP_GEN_HELPER_SOFT_HARD(subpd_ymm)
+#define gen_helper_subss          MAP_GEN_HELPER_SOFT_HARD(subss)
+#define gen_helper_subsd          MAP_GEN_HELPER_SOFT_HARD(subsd)
+#define gen_helper_mulps_xmm      MAP_GEN_HELPER_SOFT_HARD(mulps_xmm)
+#define gen_helper_mulpd_xmm      MAP_GEN_HELPER_SOFT_HARD(mulpd_xmm)
+#define gen_helper_mulps_ymm      MAP_GEN_HELPER_SOFT_HARD(mulps_ymm)
+#define gen_helper_mulpd_ymm      MAP_GEN_HELPER_SOFT_HARD(mulpd_ymm)
+#define gen_helper_mulss          MAP_GEN_HELPER_SOFT_HARD(mulss)
+#define gen_helper_mulsd          MAP_GEN_HELPER_SOFT_HARD(mulsd)
+#define gen_helper_divps_xmm      MAP_GEN_HELPER_SOFT_HARD(divps_xmm)
+#define gen_helper_divpd_xmm      MAP_GEN_HELPER_SOFT_HARD(divpd_xmm)
+#define gen_helper_divps_ymm      MAP_GEN_HELPER_SOFT_HARD(divps_ymm)
+#define gen_helper_divpd_ymm      MAP_GEN_HELPER_SOFT_HARD(divpd_ymm)
+#define gen_helper_divss          MAP_GEN_HELPER_SOFT_HARD(divss)
+#define gen_helper_divsd          MAP_GEN_HELPER_SOFT_HARD(divsd)
+#define gen_helper_minps_xmm      MAP_GEN_HELPER_SOFT_HARD(minps_xmm)
+#define gen_helper_minpd_xmm      MAP_GEN_HELPER_SOFT_HARD(minpd_xmm)
+#define gen_helper_minps_ymm      MAP_GEN_HELPER_SOFT_HARD(minps_ymm)
+#define gen_helper_minpd_ymm      MAP_GEN_HELPER_SOFT_HARD(minpd_ymm)
+#define gen_helper_minss          MAP_GEN_HELPER_SOFT_HARD(minss)
+#define gen_helper_minsd          MAP_GEN_HELPER_SOFT_HARD(minsd)
+#define gen_helper_maxps_xmm      MAP_GEN_HELPER_SOFT_HARD(maxps_xmm)
+#define gen_helper_maxpd_xmm      MAP_GEN_HELPER_SOFT_HARD(maxpd_xmm)
+#define gen_helper_maxps_ymm      MAP_GEN_HELPER_SOFT_HARD(maxps_ymm)
+#define gen_helper_maxpd_ymm      MAP_GEN_HELPER_SOFT_HARD(maxpd_ymm)
+#define gen_helper_maxss          MAP_GEN_HELPER_SOFT_HARD(maxss)
+#define gen_helper_maxsd          MAP_GEN_HELPER_SOFT_HARD(maxsd)
+#define gen_helper_sqrtps_xmm     MAP_GEN_HELPER_SOFT_HARD(sqrtps_xmm)
+#define gen_helper_sqrtpd_xmm     MAP_GEN_HELPER_SOFT_HARD(sqrtpd_xmm)
+#define gen_helper_sqrtps_ymm     MAP_GEN_HELPER_SOFT_HARD(sqrtps_ymm)
+#define gen_helper_sqrtpd_ymm     MAP_GEN_HELPER_SOFT_HARD(sqrtpd_ymm)
+#define gen_helper_sqrtss         MAP_GEN_HELPER_SOFT_HARD(sqrtss)
+#define gen_helper_sqrtsd         MAP_GEN_HELPER_SOFT_HARD(sqrtsd)
+#define gen_helper_rsqrtps_xmm    MAP_GEN_HELPER_SOFT_HARD(rsqrtps_xmm)
+#define gen_helper_rsqrtps_ymm    MAP_GEN_HELPER_SOFT_HARD(rsqrtps_ymm)
+#define gen_helper_rsqrtss        MAP_GEN_HELPER_SOFT_HARD(rsqrtss)
+#define gen_helper_rcpps_xmm      MAP_GEN_HELPER_SOFT_HARD(rcpps_xmm)
+#define gen_helper_rcpps_ymm      MAP_GEN_HELPER_SOFT_HARD(rcpps_ymm)
+#define gen_helper_rcpss          MAP_GEN_HELPER_SOFT_HARD(rcpss)
 #endif /* defined(XBOX) && defined(__x86_64__) */
 
 #define HELPER_H "helper.h"
@@ -238,6 +287,8 @@ typedef struct DisasContext {
     int fpstt_delta;
     TCGv_fp fpregs[8];
     TCGv_fp ft0;
+    uint8_t fptags_dirty; /* tags not yet stored, same indexing as fpregs */
+    uint8_t fptags_empty;
 } DisasContext;
 
 /*
@@ -1618,13 +1669,34 @@ static TCGv_ptr gen_ft0_ptr(void)
     return ft0;
 }
 
-static void gen_set_fptag(int offs, int value)
+/*
+ * Tag updates from push/pop are recorded here and only stored to
+ * env->fptags when the FP registers are flushed.
+ */
+static void gen_set_fptag(DisasContext *s, int value)
 {
-    TCGv_ptr p = tcg_temp_new_ptr();
-    tcg_gen_ext_i32_ptr(p, fpstt);
-    tcg_gen_add_ptr(p, tcg_env, p);
-    TCGv_i32 tmp = tcg_constant_i32(value);
-    tcg_gen_st8_i32(tmp, p, offsetof(CPUX86State, fptags[0]) + offs);
+    int slot = s->fpstt_delta & 7;
+
+    s->fptags_dirty |= 1 << slot;
+    s->fptags_empty = deposit32(s->fptags_empty, slot, 1, value);
+}
+
+static void gen_flush_fptags(DisasContext *s)
+{
+    for (int slot = 0; s->fptags_dirty; slot++) {
+        if (!(s->fptags_dirty & (1 << slot))) {
+            continue;
+        }
+        TCGv_i32 offset = tcg_temp_new_i32();
+        tcg_gen_addi_i32(offset, fpstt, (slot - s->fpstt_delta) & 7);
+        tcg_gen_andi_i32(offset, offset, 7);
+        TCGv_ptr p = tcg_temp_new_ptr();
+        tcg_gen_ext_i32_ptr(p, offset);
+        tcg_gen_add_ptr(p, tcg_env, p);
+        tcg_gen_st8_i32(tcg_constant_i32((s->fptags_empty >> slot) & 1), p,
+                        offsetof(CPUX86State, fptags[0]));
+        s->fptags_dirty &= ~(1 << slot);
+    }
 }
 
 static bool fpu_using_double_precision(DisasContext *s)
@@ -1724,6 +1796,7 @@ static void gen_mov64i_f64(TCGv_f64 ret, TCGv_i64 arg)
 static void gen_flush_fp(DisasContext *s)
 {
     fp_pc_wrapper(flush_fp_regs)(s);
+    gen_flush_fptags(s);
     s->fpstt_delta = 0;
     s->flcr_set = false;
 }
@@ -1761,16 +1834,16 @@ static void gen_fpush(DisasContext *s)
 
     tcg_gen_subi_i32(fpstt, fpstt, 1);
     tcg_gen_andi_i32(fpstt, fpstt, 7);
-    gen_set_fptag(0, 0); /* validate stack entry */
 
     s->fpstt_delta -= 1;
+    gen_set_fptag(s, 0); /* validate stack entry */
 }
 
 static void gen_fpop(DisasContext *s)
 {
     GEN_HELPER_FALLBACK_v_v(fpop);
 
-    gen_set_fptag(0, 1); /* invalidate stack entry */
+    gen_set_fptag(s, 1); /* invalidate stack entry */
     tcg_gen_addi_i32(fpstt, fpstt, 1);
     tcg_gen_andi_i32(fpstt, fpstt, 7);
 
@@ -1874,6 +1947,18 @@ static void gen_fildll_ST0(DisasContext *s, TCGv_i64 arg)
     fp_pc_wrapper(gen_fildll_ST0)(s, arg);
 }
 
+static void gen_fnstsw(DisasContext *s, TCGv_i32 ret)
+{
+    GEN_HELPER_FALLBACK_T_v(fnstsw, ret);
+
+    TCGv_i32 top = tcg_temp_new_i32();
+    tcg_gen_ld16u_i32(ret, tcg_env, offsetof(CPUX86State, fpus));
+    tcg_gen_andi_i32(ret, ret, ~0x3800);
+    tcg_gen_shli_i32(top, fpstt, 11);
+    tcg_gen_andi_i32(top, top, 0x3800);
+    tcg_gen_or_i32(ret, ret, top);
+}
+
 static void gen_fsts_ST0(DisasContext *s, TCGv_i32 arg)
 {
     GEN_HELPER_FALLBACK_T_v(fsts_ST0, arg);
@@ -3123,7 +3208,7 @@ static void gen_x87(DisasContext *s, X86DecodedInsn *decode)
             update_fip = update_fdp = false;
             break;
         case 0x2f: /* fnstsw mem */
-            gen_helper_fnstsw(s->tmp2_i32, tcg_env);
+            gen_fnstsw(s, s->tmp2_i32);
             tcg_gen_qemu_st_i32(s->tmp2_i32, s->A0,
                                 s->mem_index, MO_LEUW);
             update_fip = update_fdp = false;
@@ -3426,7 +3511,7 @@ static void gen_x87(DisasContext *s, X86DecodedInsn *decode)
         case 0x3c: /* df/4 */
             switch (rm) {
             case 0:
-                gen_helper_fnstsw(s->tmp2_i32, tcg_env);
+                gen_fnstsw(s, s->tmp2_i32);
                 tcg_gen_extu_i32_tl(s->T0, s->tmp2_i32);
                 gen_op_mov_reg_v(s, MO_16, R_EAX, s->T0);
                 break;
@@ -4291,6 +4376,8 @@ static void i386_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cpu)
     dc->fpstt_delta = 0;
     dc->ft0 = NULL;
     dc->flcr_set = false;
+    dc->fptags_dirty = 0;
+    dc->fptags_empty = 0;
 }
 
 static void i386_tr_tb_start(DisasContextBase *db, CPUState *cpu)
@@ -2726,7 +2726,13 @@ static void tcg_gen_callN(void *func, TCGHelperInfo *info,
         g_once_init_leave(HELPER_INFO_INIT(info), HELPER_INFO_INIT_VAL(info));
     }
 
-    gen_bb_epilogue();
+    /*
+     * Pure helpers can neither observe guest state nor raise exceptions, so
+     * there is no need to write back state cached by the frontend.
+     */
+    if ((info->flags & TCG_CALL_NO_RWG_SE) != TCG_CALL_NO_RWG_SE) {
+        gen_bb_epilogue();
+    }
 
     total_args = info->nr_out + info->nr_in + 2;
     op = tcg_op_alloc(INDEX_op_call, total_args);
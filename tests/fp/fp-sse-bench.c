@@ -0,0 +1,187 @@
+/*
+ * fp-sse-bench.c - Packed single-precision SSE throughput, softfloat vs host
+ *
+ * Mirrors the per-vector work done by the i386 SSE helpers: the softfloat
+ * path runs each lane through float32_* with an x86-style float_status, the
+ * hard path wraps the host instruction in the same MXCSR load and flag
+ * fold-back the __hard helpers use, from target/i386/sse_hard.h.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef HW_POISON_H
+#error Must define HW_POISON_H to work around TARGET_* poisoning
+#endif
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "fpu/softfloat.h"
+#include "target/i386/sse_hard.h"
+
+#define N_VECS          1024
+#define DEFAULT_DURATION_SECS 1
+
+enum op {
+    OP_ADD,
+    OP_MUL,
+    OP_RSQRT,
+    OP_MAX_NR,
+};
+
+static const char * const op_names[] = {
+    [OP_ADD] = "addps",
+    [OP_MUL] = "mulps",
+    [OP_RSQRT] = "rsqrtps",
+};
+
+typedef union Vec {
+    float32 l[4];
+    float f[4];
+} QEMU_ALIGNED(16) Vec;
+
+static Vec src_a[N_VECS], src_b[N_VECS], dst[N_VECS];
+static float_status sse_status;
+static uint32_t mxcsr = SSE_EXCP_MASK;
+static unsigned int duration = DEFAULT_DURATION_SECS;
+
+static void soft_op(enum op op, Vec *d, const Vec *a, const Vec *b)
+{
+    int old_flags;
+
+    switch (op) {
+    case OP_ADD:
+        for (int i = 0; i < 4; i++) {
+            d->l[i] = float32_add(a->l[i], b->l[i], &sse_status);
+        }
+        break;
+    case OP_MUL:
+        for (int i = 0; i < 4; i++) {
+            d->l[i] = float32_mul(a->l[i], b->l[i], &sse_status);
+        }
+        break;
+    case OP_RSQRT:
+        old_flags = get_float_exception_flags(&sse_status);
+        for (int i = 0; i < 4; i++) {
+            d->l[i] = float32_div(float32_one,
+                                  float32_sqrt(b->l[i], &sse_status),
+                                  &sse_status);
+        }
+        set_float_exception_flags(old_flags, &sse_status);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static void hard_op(enum op op, Vec *d, const Vec *a, const Vec *b)
+{
+    __m128 va = _mm_load_ps(a->f);
+    __m128 vb = _mm_load_ps(b->f);
+    __m128 r;
+
+    if (op == OP_RSQRT) {
+        _mm_store_ps(d->f, _mm_rsqrt_ps(vb));
+        return;
+    }
+
+    uint32_t host_csr;
+    if (!sse_hard_load_mxcsr(mxcsr, &host_csr)) {
+        soft_op(op, d, a, b);
+        return;
+    }
+    SSE_HARD_FENCE(va);
+    SSE_HARD_FENCE(vb);
+    r = op == OP_ADD ? _mm_add_ps(va, vb) : _mm_mul_ps(va, vb);
+    SSE_HARD_FENCE(r);
+    sse_hard_restore_mxcsr(host_csr, &sse_status);
+    _mm_store_ps(d->f, r);
+}
+
+static void fill_inputs(void)
+{
+    GRand *rand = g_rand_new_with_seed(0xdeadface);
+
+    for (int i = 0; i < N_VECS; i++) {
+        for (int j = 0; j < 4; j++) {
+            src_a[i].f[j] = g_rand_double_range(rand, -1000.0, 1000.0);
+            src_b[i].f[j] = g_rand_double_range(rand, 0.001, 1000.0);
+        }
+    }
+    g_rand_free(rand);
+}
+
+/* Returns millions of packed operations per second */
+static double bench(enum op op, bool hard)
+{
+    int64_t t0 = get_clock();
+    int64_t tf = t0 + duration * 1000000000LL;
+    uint64_t n = 0;
+
+    do {
+        if (hard) {
+            for (int i = 0; i < N_VECS; i++) {
+                hard_op(op, &dst[i], &src_a[i], &src_b[i]);
+            }
+        } else {
+            for (int i = 0; i < N_VECS; i++) {
+                soft_op(op, &dst[i], &src_a[i], &src_b[i]);
+            }
+        }
+        n += N_VECS;
+    } while (get_clock() < tf);
+
+    return n * 1e3 / (get_clock() - t0);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+            "  -d = duration of each benchmark, in seconds. Default: %d\n"
+            "  -h = show this help message\n"
+            "  -z = enable DAZ and FTZ\n",
+            name, DEFAULT_DURATION_SECS);
+}
+
+int main(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "d:hz");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        case 'z':
+            mxcsr |= SSE_DAZ | SSE_FZ;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Same configuration update_mxcsr_status() derives from the MXCSR */
+    set_float_rounding_mode(float_round_nearest_even, &sse_status);
+    set_flush_inputs_to_zero(!!(mxcsr & SSE_DAZ), &sse_status);
+    set_flush_to_zero(!!(mxcsr & SSE_FZ), &sse_status);
+
+    fill_inputs();
+
+    printf("%-8s %12s %12s %8s\n", "Op", "Soft Mop/s", "Hard Mop/s",
+           "Speedup");
+    for (int op = 0; op < OP_MAX_NR; op++) {
+        double soft = bench(op, false);
+        double hard = bench(op, true);
+        printf("%-8s %12.1f %12.1f %7.1fx\n", op_names[op], soft, hard,
+               hard / soft);
+    }
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Test xemu snapshot stream compression
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qapi/error.h"
+#include "ui/xemu-snapshot-stream.h"
+
+#define PAGE_SIZE 4096
+
+/*
+ * Something shaped like a saved guest: runs of zero pages, pages of
+ * repetitive data structures, pages that don't compress at all, and a size
+ * that isn't a multiple of the chunk size.
+ */
+static uint8_t *make_ram_image(size_t size)
+{
+    uint8_t *buf = g_malloc0(size);
+    GRand *rand = g_rand_new_with_seed(0x78656d75);
+
+    for (size_t page = 0; page < size / PAGE_SIZE; page++) {
+        uint8_t *p = buf + page * PAGE_SIZE;
+        switch (g_rand_int_range(rand, 0, 4)) {
+        case 0:
+            break;
+        case 1:
+            for (int i = 0; i < PAGE_SIZE; i += 4) {
+                stl_le_p(p + i, 0x80000000 | (page << 12) | (i & 0xff0));
+            }
+            break;
+        case 2:
+            for (int i = 0; i < PAGE_SIZE; i += 4) {
+                stl_le_p(p + i, g_rand_int(rand));
+            }
+            break;
+        case 3:
+            memset(p, page & 0xff, PAGE_SIZE / 2);
+            break;
+        }
+    }
+
+    g_rand_free(rand);
+    return buf;
+}
+
+static void round_trip(size_t size)
+{
+    g_autofree uint8_t *ram = make_ram_image(size);
+    g_autofree uint8_t *out = g_malloc(size);
+    size_t stream_size;
+    uint64_t raw_size, header_stream_size;
+
+    g_autofree uint8_t *stream =
+        xemu_snapshot_stream_compress(ram, size, &stream_size);
+    g_assert_cmpuint(stream_size, >=, XEMU_SNAPSHOT_STREAM_HEADER_SIZE);
+
+    g_assert_true(xemu_snapshot_stream_parse_header(stream, &raw_size,
+                                                    &header_stream_size,
+                                                    &error_abort));
+    g_assert_cmpuint(raw_size, ==, size);
+    g_assert_cmpuint(header_stream_size, ==, stream_size);
+
+    g_assert_true(xemu_snapshot_stream_decompress(stream, stream_size, out,
+                                                  size, &error_abort));
+    g_assert_true(memcmp(ram, out, size) == 0);
+}
+
+static void test_round_trip(void)
+{
+    round_trip(16 * MiB + 3 * PAGE_SIZE + 17);
+}
+
+static void test_round_trip_small(void)
+{
+    round_trip(PAGE_SIZE);
+    round_trip(1);
+}
+
+static void test_empty(void)
+{
+    size_t stream_size;
+    g_autofree uint8_t *stream =
+        xemu_snapshot_stream_compress(NULL, 0, &stream_size);
+
+    g_assert_cmpuint(stream_size, ==, XEMU_SNAPSHOT_STREAM_HEADER_SIZE);
+    g_assert_true(xemu_snapshot_stream_decompress(stream, stream_size, NULL, 0,
+                                                  &error_abort));
+}
+
+static void test_zero_pages(void)
+{
+    size_t size = 8 * XEMU_SNAPSHOT_STREAM_CHUNK_SIZE;
+    g_autofree uint8_t *ram = g_malloc0(size);
+    g_autofree uint8_t *out = g_malloc(size);
+    size_t stream_size;
+
+    // Zero chunks cost only their table entry
+    g_autofree uint8_t *stream =
+        xemu_snapshot_stream_compress(ram, size, &stream_size);
+    g_assert_cmpuint(stream_size, ==, XEMU_SNAPSHOT_STREAM_HEADER_SIZE + 8 * 4);
+
+    memset(out, 0xff, size);
+    g_assert_true(xemu_snapshot_stream_decompress(stream, stream_size, out,
+                                                  size, &error_abort));
+    g_assert_true(out[0] == 0 && !memcmp(out, out + 1, size - 1));
+}
+
+static void test_corrupt(void)
+{
+    size_t size = 4 * MiB;
+    g_autofree uint8_t *ram = make_ram_image(size);
+    g_autofree uint8_t *out = g_malloc(size);
+    size_t stream_size;
+    Error *err = NULL;
+
+    g_autofree uint8_t *stream =
+        xemu_snapshot_stream_compress(ram, size, &stream_size);
+
+    // Wrong expanded size
+    g_assert_false(xemu_snapshot_stream_decompress(stream, stream_size, out,
+                                                   size - 1, &err));
+    error_free_or_abort(&err);
+
+    // Truncated payload
+    g_assert_false(xemu_snapshot_stream_decompress(stream, stream_size - 1, out,
+                                                   size, &err));
+    error_free_or_abort(&err);
+
+    // Newer format version
+    stl_be_p(stream + 4, XEMU_SNAPSHOT_STREAM_VERSION + 1);
+    g_assert_false(xemu_snapshot_stream_decompress(stream, stream_size, out,
+                                                   size, &err));
+    error_free_or_abort(&err);
+    stl_be_p(stream + 4, XEMU_SNAPSHOT_STREAM_VERSION);
+
+    // Chunk table that doesn't add up
+    uint8_t *entry = stream + XEMU_SNAPSHOT_STREAM_HEADER_SIZE;
+    stl_be_p(entry, ldl_be_p(entry) + 1);
+    g_assert_false(xemu_snapshot_stream_decompress(stream, stream_size, out,
+                                                   size, &err));
+    error_free_or_abort(&err);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/xemu-snapshot-stream/round-trip", test_round_trip);
+    g_test_add_func("/xemu-snapshot-stream/round-trip-small",
+                    test_round_trip_small);
+    g_test_add_func("/xemu-snapshot-stream/empty", test_empty);
+    g_test_add_func("/xemu-snapshot-stream/zero-pages", test_zero_pages);
+    g_test_add_func("/xemu-snapshot-stream/corrupt", test_corrupt);
+    return g_test_run();
+}
@@ -3,6 +3,27 @@
 #include "qemu/bswap.h"
 
 #define FATX_SIGNATURE 0x58544146
+#define FATX_SECTOR_SIZE 512
+#define FATX_PAGE_SIZE 4096
+#define FATX_HDD_CLUSTER_SECTORS 32
+#define FATX_HDD_CLUSTER_SIZE (FATX_HDD_CLUSTER_SECTORS * FATX_SECTOR_SIZE)
+#define FATX_FAT16_MAX_CLUSTERS 65525
+#define FATX_HDD_MIN_PARTITION_SIZE 0x100000
+
+// Partitions past this point are only reachable with LBA48, the F: partition
+// ends here and anything beyond becomes G:
+#define FATX_HDD_LBA28_LIMIT (0x0fffffffULL * FATX_SECTOR_SIZE)
+
+static const struct {
+    uint64_t offset;
+    uint64_t size;
+} fatx_retail_partitions[] = {
+    { 0x00080000, 0x2ee00000 }, // X: game cache
+    { 0x2ee80000, 0x2ee00000 }, // Y: game cache
+    { 0x5dc80000, 0x2ee00000 }, // Z: game cache
+    { 0x8ca80000, 0x1f400000 }, // C: system
+    { FATX_HDD_DATA_OFFSET, FATX_HDD_DATA_SIZE }, // E: data
+};
 
 // This is from libfatx
 #pragma pack(1)
@@ -49,3 +70,78 @@ bool create_fatx_image(const char *filename, unsigned int size)
 
     return false;
 }
+
+static bool fatx_format_partition(uint64_t offset, uint64_t size,
+                                  FatxWriteFunc writer, void *opaque)
+{
+    struct fatx_superblock superblock;
+    uint8_t *buf;
+    bool ok;
+
+    memset(&superblock, 0xff, sizeof(superblock));
+    superblock.signature = cpu_to_le32(FATX_SIGNATURE);
+    superblock.volume_id = (uint32_t)rand();
+    superblock.sectors_per_cluster = cpu_to_le32(FATX_HDD_CLUSTER_SECTORS);
+    superblock.root_cluster = cpu_to_le32(1);
+    superblock.unknown1 = 0;
+
+    if (!writer(opaque, offset, &superblock, sizeof(superblock))) {
+        return false;
+    }
+
+    // Same sizing as the kernel uses to find the first cluster
+    uint64_t num_clusters = size / FATX_HDD_CLUSTER_SIZE;
+    bool fat16 = num_clusters < FATX_FAT16_MAX_CLUSTERS;
+    uint64_t fat_size = ROUND_UP(num_clusters * (fat16 ? 2 : 4),
+                                 FATX_PAGE_SIZE);
+    uint64_t fat_offset = offset + sizeof(superblock);
+
+    // Media descriptor, then the root directory's single cluster chain
+    buf = g_malloc0(FATX_HDD_CLUSTER_SIZE);
+    if (fat16) {
+        stw_le_p(buf, 0xfff8);
+        stw_le_p(buf + 2, 0xffff);
+    } else {
+        stl_le_p(buf, 0xfffffff8);
+        stl_le_p(buf + 4, 0xffffffff);
+    }
+    ok = writer(opaque, fat_offset, buf, FATX_PAGE_SIZE);
+
+    // An empty root directory, 0xff marks the end of the entries
+    memset(buf, 0xff, FATX_HDD_CLUSTER_SIZE);
+    ok = ok && writer(opaque, fat_offset + fat_size, buf,
+                     FATX_HDD_CLUSTER_SIZE);
+
+    g_free(buf);
+    return ok;
+}
+
+bool fatx_format_hdd(uint64_t size, FatxWriteFunc writer, void *opaque)
+{
+    if (size < FATX_HDD_RETAIL_SIZE) {
+        return false;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(fatx_retail_partitions); i++) {
+        if (!fatx_format_partition(fatx_retail_partitions[i].offset,
+                                   fatx_retail_partitions[i].size, writer,
+                                   opaque)) {
+            return false;
+        }
+    }
+
+    // Extended partitions for BIOSes that support them
+    uint64_t f_end = MIN(size, FATX_HDD_LBA28_LIMIT);
+    if (f_end - FATX_HDD_RETAIL_SIZE >= FATX_HDD_MIN_PARTITION_SIZE &&
+        !fatx_format_partition(FATX_HDD_RETAIL_SIZE,
+                               f_end - FATX_HDD_RETAIL_SIZE, writer, opaque)) {
+        return false;
+    }
+    if (size >= FATX_HDD_LBA28_LIMIT + FATX_HDD_MIN_PARTITION_SIZE &&
+        !fatx_format_partition(FATX_HDD_LBA28_LIMIT,
+                               size - FATX_HDD_LBA28_LIMIT, writer, opaque)) {
+        return false;
+    }
+
+    return true;
+}
@@ -9,6 +9,21 @@ extern "C" {
 
 bool create_fatx_image(const char *filename, unsigned int size);
 
+// End of the retail E: partition, the smallest usable HDD image
+#define FATX_HDD_RETAIL_SIZE 0x1dd156000ULL
+
+// The retail E: data partition
+#define FATX_HDD_DATA_OFFSET 0xabe80000ULL
+#define FATX_HDD_DATA_SIZE 0x1312d6000ULL
+
+typedef bool (*FatxWriteFunc)(void *opaque, uint64_t offset, const void *buf,
+                              size_t len);
+
+// Write empty FATX partitions for an HDD image of the given size. Only the
+// superblocks, the start of each FAT and the root directories are written,
+// the rest of the image must already read as zero.
+bool fatx_format_hdd(uint64_t size, FatxWriteFunc writer, void *opaque);
+
 #ifdef __cplusplus
 }
 #endif
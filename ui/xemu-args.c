@@ -0,0 +1,92 @@
+/*
+ * xemu command line options
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "xemu-args.h"
+
+bool xemu_args_take_flag(int argc, char **argv, const char *name)
+{
+    bool found = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i] && strcmp(argv[i], name) == 0) {
+            argv[i] = NULL;
+            found = true;
+        }
+    }
+    return found;
+}
+
+const char *xemu_args_take_str(int argc, char **argv, const char *name)
+{
+    const char *val = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!argv[i] || strcmp(argv[i], name) != 0) {
+            continue;
+        }
+        argv[i] = NULL;
+        if (i == argc - 1 || !argv[i + 1]) {
+            error_report("%s: missing argument", name);
+            exit(1);
+        }
+        if (val) {
+            error_report("%s: option given more than once", name);
+            exit(1);
+        }
+        val = argv[i + 1];
+        argv[i + 1] = NULL;
+        i++;
+    }
+    return val;
+}
+
+void xemu_args_take_int(int argc, char **argv, const char *name, int min,
+                        int *val)
+{
+    const char *str = xemu_args_take_str(argc, argv, name);
+    int v;
+
+    if (!str) {
+        return;
+    }
+    if (qemu_strtoi(str, NULL, 10, &v) < 0 || v < min) {
+        error_report("%s: expected an integer of at least %d, got '%s'", name,
+                     min, str);
+        exit(1);
+    }
+    *val = v;
+}
+
+void xemu_args_take_double(int argc, char **argv, const char *name,
+                           double min, double *val)
+{
+    const char *str = xemu_args_take_str(argc, argv, name);
+    double v;
+
+    if (!str) {
+        return;
+    }
+    if (qemu_strtod_finite(str, NULL, &v) < 0 || v < min) {
+        error_report("%s: expected a number of at least %g, got '%s'", name,
+                     min, str);
+        exit(1);
+    }
+    *val = v;
+}
@@ -0,0 +1,50 @@
+/*
+ * xemu command line options
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEMU_ARGS_H
+#define XEMU_ARGS_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// xemu's own options are taken out of argv before it is handed to QEMU's
+// parser, by replacing them and their values with NULL. An invalid or missing
+// value, or an option with a value given more than once, is reported and
+// exits, like any other command line error.
+
+// Remove every occurrence of a flag, returns true if it was present
+bool xemu_args_take_flag(int argc, char **argv, const char *name);
+
+// Remove an option and its value, returns the value or NULL
+const char *xemu_args_take_str(int argc, char **argv, const char *name);
+
+// Remove an integer option, *val is left unchanged if it isn't present
+void xemu_args_take_int(int argc, char **argv, const char *name, int min,
+                        int *val);
+
+// Remove a floating point option, *val is left unchanged if it isn't present
+void xemu_args_take_double(int argc, char **argv, const char *name,
+                           double min, double *val);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * xemu frame pacing
+ *
+ * Aligns the emulated vblank with host display refresh and measures when
+ * guest frames actually reach the screen.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/lockable.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "xemu-frame-pacing.h"
+#include "xemu-settings.h"
+
+#include <SDL3/SDL.h>
+
+/*
+ * A guest frame becomes visible when the guest's vblank handler completes
+ * the flip, and reaches the screen with the first host present after that.
+ * With a free-running vblank the two clocks drift against each other, so a
+ * frame waits anywhere between zero and one host refresh, and every so often
+ * two guest frames land in one refresh while the next gets none.
+ *
+ * When the host refresh matches the guest's, the time each present completes
+ * (with vsync, a host vblank) feeds a simple phase-locked loop, and the
+ * emulated vblank is placed just ahead of the predicted host vblank. The lead
+ * adapts to how long the guest takes from vblank to flip, and in low latency
+ * mode also to how long the UI takes to render, since the UI then presents
+ * as soon as the flip happens rather than on its own schedule.
+ */
+
+#define LEAD_MIN_NS          (1 * SCALE_MS)
+#define LEAD_MARGIN_NS       (1 * SCALE_MS)
+#define PLL_LOCK_COUNT       30
+#define MAX_PERIOD_MISMATCH  200 /* 0.5% */
+#define FLIP_WAIT_PERIODS    2
+
+static struct {
+    bool initialized;       // Only the display sets up pacing
+    QemuMutex lock;
+    QemuCond flip_cond;
+
+    int64_t guest_period;
+    int64_t host_period;
+    int64_t host_vblank;    // Reference point of the phase-locked loop
+    unsigned int pll_good;  // Consecutive presents that agreed with it
+    unsigned int resyncs;
+
+    int64_t next_vblank;
+    int64_t last_vblank;
+    int64_t lead;
+    int64_t render_cost;
+
+    uint64_t flip_seq;
+    int64_t last_flip;
+
+    uint64_t frame_seq;     // Guest frame picked up by the frame in progress
+    int64_t frame_flip;
+    int64_t frame_start;
+    uint64_t presented_seq;
+    int64_t last_present;
+
+    float frame_ms[XEMU_FRAME_PACING_HISTORY];
+    float latency_ms[XEMU_FRAME_PACING_HISTORY];
+    unsigned int hist_ptr;
+    unsigned int hist_count;
+} pacing;
+
+static int64_t now_ns(void)
+{
+    return qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+}
+
+void xemu_frame_pacing_init(int64_t guest_interval_ns)
+{
+    qemu_mutex_init(&pacing.lock);
+    qemu_cond_init(&pacing.flip_cond);
+    pacing.guest_period = guest_interval_ns;
+    pacing.lead = LEAD_MIN_NS;
+    pacing.next_vblank = now_ns();
+    qatomic_store_release(&pacing.initialized, true);
+}
+
+/* Headless runs, e.g. -benchmark, never set up the display or pacing */
+static bool is_initialized(void)
+{
+    return qatomic_load_acquire(&pacing.initialized);
+}
+
+void xemu_frame_pacing_set_host_refresh(float hz)
+{
+    if (!is_initialized()) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&pacing.lock);
+
+    pacing.host_period = hz > 0 ? (int64_t)(NANOSECONDS_PER_SECOND / hz) : 0;
+    pacing.host_vblank = 0;
+    pacing.pll_good = 0;
+}
+
+static bool is_aligned_locked(void)
+{
+    if (g_config.display.window.frame_pacing ==
+            CONFIG_DISPLAY_WINDOW_FRAME_PACING_FIXED ||
+        !g_config.display.window.vsync || !pacing.host_period ||
+        pacing.pll_good < PLL_LOCK_COUNT) {
+        return false;
+    }
+
+    int64_t diff = pacing.host_period - pacing.guest_period;
+    return llabs(diff) * MAX_PERIOD_MISMATCH < pacing.guest_period;
+}
+
+/* Nearest predicted host vblank to t */
+static int64_t snap_to_host_locked(int64_t t)
+{
+    int64_t hp = pacing.host_period;
+    if (t < pacing.host_vblank) {
+        return t;
+    }
+    int64_t n = (t - pacing.host_vblank + hp / 2) / hp;
+    return pacing.host_vblank + n * hp;
+}
+
+void xemu_frame_pacing_wait_vblank(void)
+{
+    if (!is_initialized()) {
+        return;
+    }
+
+    int64_t now = now_ns();
+    int64_t next;
+
+    WITH_QEMU_LOCK_GUARD(&pacing.lock) {
+        next = pacing.next_vblank + pacing.guest_period;
+        if (is_aligned_locked()) {
+            next = snap_to_host_locked(next + pacing.lead) - pacing.lead;
+        }
+        if (now > next + pacing.guest_period) {
+            // We've fallen behind by more than one frame, reset to avoid
+            // rapid-fire catch-up
+            next = now;
+        }
+        pacing.next_vblank = next;
+    }
+
+    if (now < next) {
+        SDL_DelayPrecise(next - now);
+    }
+
+    WITH_QEMU_LOCK_GUARD(&pacing.lock) {
+        pacing.last_vblank = now_ns();
+    }
+}
+
+static void update_lead_locked(int64_t target)
+{
+    // Grow straight away to stop missing refreshes, shrink slowly
+    if (target > pacing.lead) {
+        pacing.lead = target;
+    } else {
+        pacing.lead -= (pacing.lead - target) / 32;
+    }
+    pacing.lead = MAX(LEAD_MIN_NS, MIN(pacing.lead, pacing.guest_period / 2));
+}
+
+void xemu_frame_pacing_guest_flip(void)
+{
+    if (!is_initialized()) {
+        return;
+    }
+
+    int64_t now = now_ns();
+
+    QEMU_LOCK_GUARD(&pacing.lock);
+
+    pacing.flip_seq++;
+    pacing.last_flip = now;
+
+    int64_t since_vblank = now - pacing.last_vblank;
+    if (pacing.last_vblank && since_vblank < pacing.guest_period) {
+        int64_t target = since_vblank + LEAD_MARGIN_NS;
+        if (g_config.display.window.frame_pacing ==
+            CONFIG_DISPLAY_WINDOW_FRAME_PACING_LOW_LATENCY) {
+            target += pacing.render_cost;
+        }
+        update_lead_locked(target);
+    }
+
+    qemu_cond_broadcast(&pacing.flip_cond);
+}
+
+void xemu_frame_pacing_wait_for_flip(void)
+{
+    if (!is_initialized()) {
+        return;
+    }
+
+    if (g_config.display.window.frame_pacing !=
+        CONFIG_DISPLAY_WINDOW_FRAME_PACING_LOW_LATENCY) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&pacing.lock);
+
+    // Time out so the HUD stays live while the guest isn't flipping
+    int64_t deadline = now_ns() + FLIP_WAIT_PERIODS * pacing.guest_period;
+    while (pacing.flip_seq == pacing.presented_seq) {
+        int64_t remaining = deadline - now_ns();
+        if (remaining <= 0) {
+            break;
+        }
+        qemu_cond_timedwait_ns(&pacing.flip_cond, &pacing.lock, remaining);
+    }
+}
+
+void xemu_frame_pacing_begin_frame(void)
+{
+    if (!is_initialized()) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&pacing.lock);
+
+    pacing.frame_start = now_ns();
+    pacing.frame_seq = pacing.flip_seq;
+    pacing.frame_flip = pacing.last_flip;
+}
+
+static void update_pll_locked(int64_t t)
+{
+    int64_t hp = pacing.host_period;
+
+    if (!hp || !g_config.display.window.vsync) {
+        return;
+    }
+
+    if (pacing.host_vblank) {
+        int64_t predicted = snap_to_host_locked(t);
+        int64_t err = t - predicted;
+        if (llabs(err) < hp / 4) {
+            pacing.host_vblank = predicted + err / 8;
+            pacing.pll_good++;
+            return;
+        }
+        pacing.resyncs++;
+    }
+
+    // Unlocked, or presents aren't following a fixed refresh (e.g. VRR)
+    pacing.host_vblank = t;
+    pacing.pll_good = 0;
+}
+
+void xemu_frame_pacing_end_frame(int64_t swap_start_ns)
+{
+    if (!is_initialized()) {
+        return;
+    }
+
+    int64_t now = now_ns();
+
+    QEMU_LOCK_GUARD(&pacing.lock);
+
+    update_pll_locked(now);
+
+    int64_t cost = swap_start_ns - pacing.frame_start;
+    pacing.render_cost += (cost - pacing.render_cost) / 8;
+
+    if (pacing.frame_seq == pacing.presented_seq) {
+        return;
+    }
+    pacing.presented_seq = pacing.frame_seq;
+
+    if (pacing.last_present) {
+        unsigned int i = pacing.hist_ptr;
+        pacing.frame_ms[i] = (now - pacing.last_present) / (float)SCALE_MS;
+        pacing.latency_ms[i] = (now - pacing.frame_flip) / (float)SCALE_MS;
+        pacing.hist_ptr = (i + 1) % XEMU_FRAME_PACING_HISTORY;
+        pacing.hist_count = MIN(pacing.hist_count + 1,
+                                XEMU_FRAME_PACING_HISTORY);
+    }
+    pacing.last_present = now;
+}
+
+void xemu_frame_pacing_get_stats(XemuFramePacingStats *stats)
+{
+    if (!is_initialized()) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&pacing.lock);
+
+    memcpy(stats->frame_ms, pacing.frame_ms, sizeof(stats->frame_ms));
+    memcpy(stats->latency_ms, pacing.latency_ms, sizeof(stats->latency_ms));
+    stats->count = pacing.hist_count;
+    stats->host_refresh_hz = pacing.host_period ?
+        (float)NANOSECONDS_PER_SECOND / pacing.host_period : 0;
+    stats->vblank_lead_ms = pacing.lead / (float)SCALE_MS;
+    stats->aligned = is_aligned_locked();
+    stats->resyncs = pacing.resyncs;
+}
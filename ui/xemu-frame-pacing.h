@@ -0,0 +1,66 @@
+/*
+ * xemu frame pacing
+ *
+ * Aligns the emulated vblank with host display refresh and measures when
+ * guest frames actually reach the screen.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEMU_FRAME_PACING_H
+#define XEMU_FRAME_PACING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define XEMU_FRAME_PACING_HISTORY 256
+
+typedef struct XemuFramePacingStats {
+    // Time between presents that showed a new guest frame
+    float frame_ms[XEMU_FRAME_PACING_HISTORY];
+    // Time from guest flip to the present that showed it
+    float latency_ms[XEMU_FRAME_PACING_HISTORY];
+    int count;
+
+    float host_refresh_hz;
+    float vblank_lead_ms;
+    bool aligned;
+    unsigned int resyncs;
+} XemuFramePacingStats;
+
+void xemu_frame_pacing_init(int64_t guest_interval_ns);
+void xemu_frame_pacing_set_host_refresh(float hz);
+
+// Vblank thread: sleep until the next emulated vblank is due
+void xemu_frame_pacing_wait_vblank(void);
+
+// Guest has completed a flip (NV_PGRAPH_INCREMENT)
+void xemu_frame_pacing_guest_flip(void);
+
+// UI thread: bracket rendering and presenting one host frame
+void xemu_frame_pacing_wait_for_flip(void);
+void xemu_frame_pacing_begin_frame(void);
+void xemu_frame_pacing_end_frame(int64_t swap_start_ns);
+
+void xemu_frame_pacing_get_stats(XemuFramePacingStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * xemu HDD image creation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "qobject/qdict.h"
+#include "block/block.h"
+#include "system/block-backend.h"
+#include "xemu-hdd.h"
+#include "thirdparty/fatx/fatx.h"
+
+/*
+ * The guest writes the HDD in 16 KiB FATX clusters, scattered over the disk.
+ * qcow2 images use 64 KiB clusters with extended L2 entries, so each cluster
+ * has 2 KiB subclusters and a 16 KiB write never has to copy or zero the
+ * rest of a newly allocated cluster. Lazy refcounts avoid a metadata flush on
+ * every allocation; the image is repaired on open after an unclean exit.
+ */
+#define XEMU_HDD_QCOW2_OPTIONS \
+    "cluster_size=65536,extended_l2=on,lazy_refcounts=on"
+
+#define XEMU_HDD_L2_CACHE_MAX (64 * MiB)
+
+#define QCOW2_MAGIC (('Q' << 24) | ('F' << 16) | ('I' << 8) | 0xfb)
+#define QCOW2_HEADER_SIZE 80
+#define QCOW2_INCOMPAT_EXTL2 (1ULL << 4)
+
+#define BENCH_WRITE_SIZE (16 * KiB)
+#define BENCH_SEED 0x58454d55 /* "XEMU" */
+
+static bool xemu_hdd_write(void *opaque, uint64_t offset, const void *buf,
+                           size_t len)
+{
+    return blk_pwrite(opaque, offset, len, buf, 0) >= 0;
+}
+
+bool xemu_hdd_create(const char *path, const char *format, uint64_t size,
+                     bool preallocate, Error **errp)
+{
+    ERRP_GUARD();
+    bool qcow2 = !strcmp(format, "qcow2");
+    BlockBackend *blk;
+    QDict *options;
+    int ret;
+
+    // falloc reserves the whole image up front, so it is laid out in as few
+    // extents as the host filesystem allows, without writing any zeroes
+    g_autofree char *create_options = g_strdup_printf(
+        "preallocation=%s%s", preallocate ? "falloc" : "off",
+        qcow2 ? "," XEMU_HDD_QCOW2_OPTIONS : "");
+
+    bdrv_img_create(path, format, NULL, NULL, create_options, size, 0, true,
+                    errp);
+    if (*errp) {
+        return false;
+    }
+
+    options = qdict_new();
+    qdict_put_str(options, "driver", format);
+    blk = blk_new_open(path, NULL, options, BDRV_O_RDWR, errp);
+    if (!blk) {
+        return false;
+    }
+
+    if (!fatx_format_hdd(size, xemu_hdd_write, blk)) {
+        error_setg(errp, "Failed to write partitions to %s", path);
+        blk_unref(blk);
+        return false;
+    }
+
+    ret = blk_flush(blk);
+    blk_unref(blk);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to flush %s", path);
+        return false;
+    }
+
+    return true;
+}
+
+/* L2 cache size to cover the whole of a qcow2 image, or 0 if not qcow2 */
+static uint64_t xemu_hdd_get_l2_cache_size(const char *path)
+{
+    uint8_t header[QCOW2_HEADER_SIZE];
+
+    int fd = qemu_open(path, O_RDONLY | O_BINARY, NULL);
+    if (fd < 0) {
+        return 0;
+    }
+    ssize_t len = read(fd, header, sizeof(header));
+    qemu_close(fd);
+    if (len != sizeof(header) || ldl_be_p(header) != QCOW2_MAGIC) {
+        return 0;
+    }
+
+    uint32_t version = ldl_be_p(header + 4);
+    uint32_t cluster_bits = ldl_be_p(header + 20);
+    uint64_t size = ldq_be_p(header + 24);
+    bool extended_l2 =
+        version >= 3 && (ldq_be_p(header + 72) & QCOW2_INCOMPAT_EXTL2);
+    if (cluster_bits < 9 || cluster_bits > 21) {
+        return 0;
+    }
+
+    uint64_t cluster_size = 1ULL << cluster_bits;
+    uint64_t l2_size =
+        DIV_ROUND_UP(size, cluster_size) * (extended_l2 ? 16 : 8);
+
+    return MIN(MAX(ROUND_UP(l2_size, cluster_size), 2 * cluster_size),
+               XEMU_HDD_L2_CACHE_MAX);
+}
+
+char *xemu_hdd_get_drive_options(const char *path)
+{
+    uint64_t l2_cache_size = xemu_hdd_get_l2_cache_size(path);
+    if (!l2_cache_size) {
+        return g_strdup("");
+    }
+
+    // QEMU's default only covers 8 GiB of 64 KiB clusters on some hosts,
+    // random accesses beyond that would keep reloading L2 tables
+    return g_strdup_printf(",format=qcow2,l2-cache-size=%" PRIu64,
+                           l2_cache_size);
+}
+
+typedef struct BenchResult {
+    int64_t create_us;
+    int64_t total_us;
+    int64_t max_us;
+    int64_t allocated;
+    bool direct;
+} BenchResult;
+
+static bool bench_run(const char *path, const char *format, bool preallocate,
+                      int writes, BenchResult *r)
+{
+    Error *err = NULL;
+    BlockBackend *blk;
+    QDict *options;
+    bool ok = true;
+
+    int64_t start_us = get_clock() / 1000;
+    if (!xemu_hdd_create(path, format, FATX_HDD_RETAIL_SIZE, preallocate,
+                         &err)) {
+        error_report_err(err);
+        return false;
+    }
+    r->create_us = get_clock() / 1000 - start_us;
+
+    // Bypass the host page cache where the filesystem allows it, otherwise
+    // this measures memcpy rather than the image layout
+    for (int direct = 1; direct >= 0; direct--) {
+        options = qdict_new();
+        qdict_put_str(options, "driver", format);
+        uint64_t l2_cache_size = xemu_hdd_get_l2_cache_size(path);
+        if (l2_cache_size) {
+            qdict_put_int(options, "l2-cache-size", l2_cache_size);
+        }
+        blk = blk_new_open(path, NULL, options,
+                           BDRV_O_RDWR | (direct ? BDRV_O_NOCACHE : 0),
+                           direct ? NULL : &err);
+        if (blk) {
+            r->direct = direct;
+            break;
+        }
+    }
+    if (!blk) {
+        error_report_err(err);
+        unlink(path);
+        return false;
+    }
+
+    uint8_t *buf = blk_blockalign(blk, BENCH_WRITE_SIZE);
+    GRand *rng = g_rand_new_with_seed(BENCH_SEED);
+    for (int i = 0; i < BENCH_WRITE_SIZE / 4; i++) {
+        stl_he_p(buf + i * 4, g_rand_int(rng));
+    }
+
+    // Cluster aligned writes within E:, past its FAT
+    uint64_t first = (FATX_HDD_DATA_OFFSET + 4 * MiB) / BENCH_WRITE_SIZE;
+    uint64_t last = (FATX_HDD_DATA_OFFSET + FATX_HDD_DATA_SIZE) /
+                    BENCH_WRITE_SIZE;
+
+    for (int i = 0; i < writes && ok; i++) {
+        uint64_t cluster = first + (uint64_t)(g_rand_double(rng) *
+                                              (last - first));
+        int64_t write_start_us = get_clock() / 1000;
+        ok = blk_pwrite(blk, cluster * BENCH_WRITE_SIZE, BENCH_WRITE_SIZE,
+                        buf, 0) >= 0;
+        int64_t write_us = get_clock() / 1000 - write_start_us;
+        r->total_us += write_us;
+        r->max_us = MAX(r->max_us, write_us);
+    }
+
+    start_us = get_clock() / 1000;
+    ok = ok && blk_flush(blk) >= 0;
+    r->total_us += get_clock() / 1000 - start_us;
+
+    r->allocated = bdrv_get_allocated_file_size(blk_bs(blk));
+
+    g_rand_free(rng);
+    qemu_vfree(buf);
+    blk_unref(blk);
+    unlink(path);
+
+    if (!ok) {
+        error_report("hdd bench: write to %s failed", path);
+    }
+    return ok;
+}
+
+int xemu_hdd_bench(const char *dir, int writes)
+{
+    static const struct {
+        const char *name;
+        const char *filename;
+        bool preallocate;
+    } configs[] = {
+        { "raw", "xemu-hdd-bench.img", false },
+        { "raw", "xemu-hdd-bench.img", true },
+        { "qcow2", "xemu-hdd-bench.qcow2", false },
+        { "qcow2", "xemu-hdd-bench.qcow2", true },
+    };
+
+    writes = MAX(writes, 1);
+
+    printf("HDD benchmark: %s, %d random %d KiB writes to a %" PRIu64
+           " MiB image\n", dir, writes, (int)(BENCH_WRITE_SIZE / KiB),
+           (uint64_t)(FATX_HDD_RETAIL_SIZE / MiB));
+    printf("%-6s %-8s %9s %8s %8s %8s %8s %10s\n", "Format", "Alloc",
+           "Create ms", "IOPS", "MiB/s", "Avg us", "Max us", "Disk MiB");
+
+    for (int i = 0; i < ARRAY_SIZE(configs); i++) {
+        g_autofree char *path = g_build_filename(dir, configs[i].filename,
+                                                 NULL);
+        BenchResult r = { 0 };
+
+        if (!bench_run(path, configs[i].name, configs[i].preallocate, writes,
+                       &r)) {
+            return 1;
+        }
+
+        double seconds = MAX(r.total_us, 1) / 1000000.0;
+        printf("%-6s %-8s %9.1f %8.0f %8.1f %8.1f %8" PRId64 " %10.1f%s\n",
+               configs[i].name, configs[i].preallocate ? "falloc" : "sparse",
+               r.create_us / 1000.0, writes / seconds,
+               (double)writes * BENCH_WRITE_SIZE / MiB / seconds,
+               (double)r.total_us / writes, r.max_us,
+               r.allocated < 0 ? 0.0 : (double)r.allocated / MiB,
+               r.direct ? "" : " (page cache)");
+    }
+
+    return 0;
+}
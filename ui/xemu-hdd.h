@@ -0,0 +1,45 @@
+/*
+ * xemu HDD image creation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEMU_HDD_H
+#define XEMU_HDD_H
+
+#include "qemu/osdep.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Create a "qcow2" or "raw" HDD image with empty FATX partitions. Unless
+// preallocated the image is sparse and only the partition metadata is
+// written. Runs synchronously; preallocating can take minutes on host file
+// systems without fallocate support, which have to be filled with zeroes.
+bool xemu_hdd_create(const char *path, const char *format, uint64_t size,
+                     bool preallocate, Error **errp);
+
+// Extra -drive options for the image, e.g. a qcow2 L2 cache large enough to
+// cover the whole disk. Never NULL, free with g_free.
+char *xemu_hdd_get_drive_options(const char *path);
+
+// Time random 16 KiB writes to raw and qcow2 images created in dir
+int xemu_hdd_bench(const char *dir, int writes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
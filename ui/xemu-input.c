@@ -27,6 +27,9 @@
 #include "qemu/option.h"
 #include "qemu/timer.h"
 #include "qemu/config-file.h"
+#include "qemu/lockable.h"
+#include "qemu/seqlock.h"
+#include "qemu/thread.h"
 
 #include "xemu-input.h"
 #include "xemu-notifications.h"
@@ -49,6 +52,42 @@
 #define XEMU_INPUT_MIN_INPUT_UPDATE_INTERVAL_US  2500
 #define XEMU_INPUT_MIN_RUMBLE_UPDATE_INTERVAL_US 2500
 
+/*
+ * With the input thread enabled, devices are sampled at a fixed rate away
+ * from both the UI loop and the USB emulation, and the state of each bound
+ * port is published through a seqlock. XID devices read the latest snapshot
+ * without calling into SDL or waiting on the UI loop to poll events.
+ */
+typedef struct InputPort {
+    QemuSeqLock seq;
+    ControllerSnapshot snapshot;
+    int64_t delivered_ns; // changed_ns of the last snapshot the guest read
+} InputPort;
+
+static struct {
+    QemuThread thread;
+    bool running;
+    bool stop;
+
+    // Held while sampling, and while the controller list or port bindings
+    // are changed under it
+    QemuMutex lock;
+    InputPort ports[4];
+    int64_t poll_period_ns;
+
+    QemuMutex stats_lock;
+    float latency_ms[XEMU_INPUT_LATENCY_HISTORY];
+    unsigned int hist_ptr;
+    unsigned int hist_count;
+} input;
+
+static const int poll_rate_hz[] = {
+    [CONFIG_INPUT_POLL_RATE_HZ125] = 125,
+    [CONFIG_INPUT_POLL_RATE_HZ250] = 250,
+    [CONFIG_INPUT_POLL_RATE_HZ500] = 500,
+    [CONFIG_INPUT_POLL_RATE_HZ1000] = 1000,
+};
+
 #if 0
 static void xemu_input_print_controller_state(ControllerState *state)
 {
@@ -260,8 +299,100 @@ static const char *get_bound_driver(int port)
 
 static const int port_map[4] = { 3, 4, 1, 2 };
 
+static int64_t now_ns(void)
+{
+    return qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+}
+
+static void sample_controller(ControllerState *state)
+{
+    if (state->type == INPUT_DEVICE_SDL_KEYBOARD) {
+        xemu_input_update_sdl_kbd_controller_state(state);
+    } else if (state->type == INPUT_DEVICE_SDL_GAMEPAD) {
+        xemu_input_update_sdl_controller_state(state);
+    }
+
+    state->last_input_updated_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+}
+
+static void publish_snapshot(int index, const ControllerState *state,
+                             int64_t sampled_ns)
+{
+    InputPort *port = &input.ports[index];
+    ControllerSnapshot *snapshot = &port->snapshot;
+
+    bool changed = snapshot->buttons != state->buttons ||
+                   memcmp(snapshot->axis, state->axis, sizeof(state->axis));
+
+    seqlock_write_begin(&port->seq);
+    snapshot->sampled_ns = sampled_ns;
+    if (changed) {
+        snapshot->changed_ns = sampled_ns;
+        snapshot->buttons = state->buttons;
+        memcpy(snapshot->axis, state->axis, sizeof(snapshot->axis));
+    }
+    seqlock_write_end(&port->seq);
+}
+
+static void clear_snapshot(int index)
+{
+    InputPort *port = &input.ports[index];
+
+    seqlock_write_begin(&port->seq);
+    memset(&port->snapshot, 0, sizeof(port->snapshot));
+    seqlock_write_end(&port->seq);
+    port->delivered_ns = 0;
+}
+
+static void *input_thread(void *opaque)
+{
+    int64_t last = now_ns();
+    int64_t next = last;
+
+    while (!qatomic_read(&input.stop)) {
+        int64_t now = now_ns();
+
+        SDL_UpdateGamepads();
+
+        WITH_QEMU_LOCK_GUARD(&input.lock) {
+            ControllerState *iter;
+            QTAILQ_FOREACH(iter, &available_controllers, entry) {
+                sample_controller(iter);
+                if (iter->bound >= 0) {
+                    publish_snapshot(iter->bound, iter, now);
+                }
+            }
+        }
+
+        int64_t period = qatomic_read(&input.poll_period_ns);
+        qatomic_set(&input.poll_period_ns, period + (now - last - period) / 16);
+        last = now;
+
+        int rate = poll_rate_hz[g_config.input.poll_rate];
+        next += NANOSECONDS_PER_SECOND / rate;
+        now = now_ns();
+        if (now < next) {
+            // A plain sleep, SDL_DelayPrecise spins for the last millisecond
+            // which at 1000 Hz would keep a host core busy. Oversleeping is
+            // made up for by the next period, as next is absolute.
+            SDL_DelayNS(next - now);
+        } else {
+            // Fell behind, don't try to catch up
+            next = now;
+        }
+    }
+
+    return NULL;
+}
+
 void xemu_input_init(void)
 {
+    qemu_mutex_init(&input.lock);
+    qemu_mutex_init(&input.stats_lock);
+    for (int i = 0; i < ARRAY_SIZE(input.ports); i++) {
+        seqlock_init(&input.ports[i].seq);
+    }
+
     if (g_config.input.background_input_capture) {
         SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
     }
@@ -308,6 +439,21 @@ void xemu_input_init(void)
     }
 
     QTAILQ_INSERT_TAIL(&available_controllers, new_con, entry);
+
+    if (g_config.input.poll_thread) {
+        input.running = true;
+        qemu_thread_create(&input.thread, "xemu-input", input_thread, NULL,
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+void xemu_input_shutdown(void)
+{
+    if (input.running) {
+        qatomic_set(&input.stop, true);
+        qemu_thread_join(&input.thread);
+        input.running = false;
+    }
 }
 
 int xemu_input_get_controller_default_bind_port(ControllerState *state, int start)
@@ -378,8 +524,11 @@ void xemu_input_process_sdl_events(const SDL_Event *event)
         SDL_GUIDToString(new_con->sdl_joystick_guid, guid_buf, sizeof(guid_buf));
         DPRINTF("Opened %s (%s)\n", new_con->name, guid_buf);
 
-        QTAILQ_INSERT_TAIL(&available_controllers, new_con, entry);
-        xemu_input_bindings_reload_map(new_con);
+        // Reloading may reallocate the mappings of other controllers
+        WITH_QEMU_LOCK_GUARD(&input.lock) {
+            QTAILQ_INSERT_TAIL(&available_controllers, new_con, entry);
+            xemu_input_bindings_reload_map(new_con);
+        }
 
         // Do not replace binding for a currently bound device. In the case that
         // the same GUID is specified multiple times, on different ports, allow
@@ -454,7 +603,9 @@ void xemu_input_process_sdl_events(const SDL_Event *event)
                 }
 
                 // Unlink
+                qemu_mutex_lock(&input.lock);
                 QTAILQ_REMOVE(&available_controllers, iter, entry);
+                qemu_mutex_unlock(&input.lock);
 
                 // Deallocate
                 if (iter->sdl_gamepad) {
@@ -487,20 +638,16 @@ void xemu_input_update_controller(ControllerState *state)
         return;
     }
 
-    if (state->type == INPUT_DEVICE_SDL_KEYBOARD) {
-        xemu_input_update_sdl_kbd_controller_state(state);
-    } else if (state->type == INPUT_DEVICE_SDL_GAMEPAD) {
-        xemu_input_update_sdl_controller_state(state);
-    }
-
-    state->last_input_updated_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    sample_controller(state);
 }
 
 void xemu_input_update_controllers(void)
 {
     ControllerState *iter;
-    QTAILQ_FOREACH(iter, &available_controllers, entry) {
-        xemu_input_update_controller(iter);
+    if (!input.running) {
+        QTAILQ_FOREACH(iter, &available_controllers, entry) {
+            xemu_input_update_controller(iter);
+        }
     }
     QTAILQ_FOREACH(iter, &available_controllers, entry) {
         xemu_input_update_rumble(iter);
@@ -651,6 +798,51 @@ ControllerState *xemu_input_get_bound(int index)
     return bound_controllers[index];
 }
 
+static void record_latency(int64_t latency_ns)
+{
+    QEMU_LOCK_GUARD(&input.stats_lock);
+
+    input.latency_ms[input.hist_ptr] = latency_ns / (float)SCALE_MS;
+    input.hist_ptr = (input.hist_ptr + 1) % XEMU_INPUT_LATENCY_HISTORY;
+    input.hist_count = MIN(input.hist_count + 1, XEMU_INPUT_LATENCY_HISTORY);
+}
+
+void xemu_input_read_controller(int index, ControllerSnapshot *snapshot)
+{
+    InputPort *port = &input.ports[index];
+
+    if (!input.running) {
+        ControllerState *state = xemu_input_get_bound(index);
+        assert(state);
+        xemu_input_update_controller(state);
+        publish_snapshot(index, state, now_ns());
+    }
+
+    unsigned int start;
+    do {
+        start = seqlock_read_begin(&port->seq);
+        *snapshot = port->snapshot;
+    } while (seqlock_read_retry(&port->seq, start));
+
+    if (snapshot->changed_ns && snapshot->changed_ns != port->delivered_ns) {
+        port->delivered_ns = snapshot->changed_ns;
+        record_latency(now_ns() - snapshot->changed_ns);
+    }
+}
+
+void xemu_input_get_latency_stats(XemuInputLatencyStats *stats)
+{
+    WITH_QEMU_LOCK_GUARD(&input.stats_lock) {
+        memcpy(stats->latency_ms, input.latency_ms, sizeof(stats->latency_ms));
+        stats->count = input.hist_count;
+    }
+
+    int64_t period = qatomic_read(&input.poll_period_ns);
+    stats->threaded = input.running;
+    stats->poll_rate_hz =
+        input.running && period ? (float)NANOSECONDS_PER_SECOND / period : 0;
+}
+
 void xemu_input_bind(int index, ControllerState *state, int save)
 {
     // FIXME: Attempt to disable rumble when unbinding so it's not left
@@ -679,9 +871,12 @@ void xemu_input_bind(int index, ControllerState *state, int save)
         qdev_unplug((DeviceState *)bound_controllers[index]->device, &err);
         assert(err == NULL);
 
-        bound_controllers[index]->bound = -1;
-        bound_controllers[index]->device = NULL;
-        bound_controllers[index] = NULL;
+        WITH_QEMU_LOCK_GUARD(&input.lock) {
+            bound_controllers[index]->bound = -1;
+            bound_controllers[index]->device = NULL;
+            bound_controllers[index] = NULL;
+            clear_snapshot(index);
+        }
     }
 
     // Save this controller's GUID in settings for auto re-connect
@@ -706,8 +901,11 @@ void xemu_input_bind(int index, ControllerState *state, int save)
             xemu_input_bind(state->bound, NULL, 1);
         }
 
-        bound_controllers[index] = state;
-        bound_controllers[index]->bound = index;
+        WITH_QEMU_LOCK_GUARD(&input.lock) {
+            bound_controllers[index] = state;
+            bound_controllers[index]->bound = index;
+            clear_snapshot(index);
+        }
 
         char *tmp;
 
@@ -75,6 +75,25 @@ enum controller_input_device_type {
 
 enum peripheral_type { PERIPHERAL_NONE, PERIPHERAL_XMU, PERIPHERAL_TYPE_COUNT };
 
+// Controller input as last sampled, see xemu_input_read_controller
+typedef struct ControllerSnapshot {
+    int64_t sampled_ns; // When the device was last read
+    int64_t changed_ns; // When the input last changed
+    uint16_t buttons;
+    int16_t  axis[CONTROLLER_AXIS__COUNT];
+} ControllerSnapshot;
+
+#define XEMU_INPUT_LATENCY_HISTORY 256
+
+typedef struct XemuInputLatencyStats {
+    // Time from an input change being sampled to the guest reading it
+    float latency_ms[XEMU_INPUT_LATENCY_HISTORY];
+    int count;
+
+    bool threaded;
+    float poll_rate_hz;
+} XemuInputLatencyStats;
+
 typedef struct XmuState {
     const char *filename;
     void *dev;
@@ -125,6 +144,7 @@ extern "C" {
 extern int *g_keyboard_scancode_map[25];
 
 void xemu_input_init(void);
+void xemu_input_shutdown(void);
 void xemu_input_process_sdl_events(const SDL_Event *event); // SDL_EVENT_GAMEPAD_ADDED, SDL_EVENT_GAMEPAD_REMOVED
 void xemu_input_update_controllers(void);
 void xemu_input_update_controller(ControllerState *state);
@@ -132,6 +152,8 @@ void xemu_input_update_sdl_kbd_controller_state(ControllerState *state);
 void xemu_input_update_sdl_controller_state(ControllerState *state);
 void xemu_input_update_rumble(ControllerState *state);
 ControllerState *xemu_input_get_bound(int index);
+void xemu_input_read_controller(int index, ControllerSnapshot *snapshot);
+void xemu_input_get_latency_stats(XemuInputLatencyStats *stats);
 void xemu_input_bind(int index, ControllerState *state, int save);
 bool xemu_input_bind_xmu(int player_index, int peripheral_port_index,
                          const char *filename, bool is_rebind);
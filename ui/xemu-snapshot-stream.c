@@ -0,0 +1,252 @@
+/*
+ * xemu snapshot stream compression
+ *
+ * Frames the VM state of a snapshot as independently compressed chunks, so
+ * it can be compressed and expanded on all host cores.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "xemu-snapshot-stream.h"
+
+#include <zstd.h>
+
+// RAM compresses well at the fastest level, and save time is what users see
+#define COMPRESSION_LEVEL 1
+#define MAX_THREADS 8
+
+typedef struct StreamJob {
+    const uint8_t *src;
+    uint8_t *dst;
+    size_t size;
+    uint32_t num_chunks;
+    size_t *offsets;        // Payload offset of each chunk in dst
+    uint32_t *sizes;        // Table entry of each chunk
+    size_t slot_size;       // Compression: room for each chunk in dst
+    int next;
+    int failed;
+} StreamJob;
+
+static size_t chunk_len(const StreamJob *job, uint32_t i)
+{
+    return MIN(XEMU_SNAPSHOT_STREAM_CHUNK_SIZE,
+               job->size - (size_t)i * XEMU_SNAPSHOT_STREAM_CHUNK_SIZE);
+}
+
+static bool is_zero(const uint8_t *buf, size_t len)
+{
+    return buf[0] == 0 && !memcmp(buf, buf + 1, len - 1);
+}
+
+static void run_job(StreamJob *job, void *(*fn)(void *))
+{
+    QemuThread threads[MAX_THREADS];
+    int n = MIN(MIN(g_get_num_processors(), MAX_THREADS), job->num_chunks);
+
+    for (int i = 1; i < n; i++) {
+        qemu_thread_create(&threads[i], "snapshot-zstd", fn, job,
+                           QEMU_THREAD_JOINABLE);
+    }
+    fn(job);
+    for (int i = 1; i < n; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static void *compress_worker(void *opaque)
+{
+    StreamJob *job = opaque;
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    uint32_t i;
+
+    while ((i = qatomic_fetch_inc(&job->next)) < job->num_chunks) {
+        const uint8_t *src = job->src + (size_t)i * XEMU_SNAPSHOT_STREAM_CHUNK_SIZE;
+        uint8_t *dst = job->dst + (size_t)i * job->slot_size;
+        size_t len = chunk_len(job, i);
+
+        if (is_zero(src, len)) {
+            job->sizes[i] = 0;
+            continue;
+        }
+
+        size_t ret = ZSTD_compressCCtx(cctx, dst, job->slot_size, src, len,
+                                       COMPRESSION_LEVEL);
+        if (ZSTD_isError(ret) || ret >= len) {
+            memcpy(dst, src, len);
+            job->sizes[i] = len | XEMU_SNAPSHOT_STREAM_CHUNK_RAW;
+        } else {
+            job->sizes[i] = ret;
+        }
+    }
+
+    ZSTD_freeCCtx(cctx);
+    return NULL;
+}
+
+void *xemu_snapshot_stream_compress(const void *buf, size_t size,
+                                    size_t *stream_size)
+{
+    StreamJob job = {
+        .src = buf,
+        .size = size,
+        .num_chunks = DIV_ROUND_UP(size, XEMU_SNAPSHOT_STREAM_CHUNK_SIZE),
+        .slot_size = ZSTD_compressBound(XEMU_SNAPSHOT_STREAM_CHUNK_SIZE),
+    };
+    size_t table_end = XEMU_SNAPSHOT_STREAM_HEADER_SIZE + job.num_chunks * 4;
+
+    // Each chunk is compressed into its own slot, then packed down in order
+    uint8_t *out = g_malloc(table_end + job.num_chunks * job.slot_size);
+    job.dst = out + table_end;
+    job.sizes = g_new(uint32_t, job.num_chunks);
+    if (job.num_chunks) {
+        run_job(&job, compress_worker);
+    }
+
+    size_t pos = table_end;
+    for (uint32_t i = 0; i < job.num_chunks; i++) {
+        size_t len = job.sizes[i] & ~XEMU_SNAPSHOT_STREAM_CHUNK_RAW;
+        memmove(out + pos, job.dst + (size_t)i * job.slot_size, len);
+        stl_be_p(out + XEMU_SNAPSHOT_STREAM_HEADER_SIZE + i * 4, job.sizes[i]);
+        pos += len;
+    }
+    g_free(job.sizes);
+
+    stl_be_p(out, XEMU_SNAPSHOT_STREAM_MAGIC);
+    stl_be_p(out + 4, XEMU_SNAPSHOT_STREAM_VERSION);
+    stl_be_p(out + 8, XEMU_SNAPSHOT_STREAM_CHUNK_SIZE);
+    stl_be_p(out + 12, job.num_chunks);
+    stq_be_p(out + 16, size);
+    stq_be_p(out + 24, pos);
+
+    *stream_size = pos;
+    return g_realloc(out, pos);
+}
+
+bool xemu_snapshot_stream_parse_header(const void *hdr, uint64_t *raw_size,
+                                       uint64_t *stream_size, Error **errp)
+{
+    const uint8_t *p = hdr;
+
+    if (ldl_be_p(p) != XEMU_SNAPSHOT_STREAM_MAGIC) {
+        error_setg(errp, "Snapshot VM state is not compressed");
+        return false;
+    }
+    if (ldl_be_p(p + 4) != XEMU_SNAPSHOT_STREAM_VERSION) {
+        error_setg(errp, "Unsupported snapshot compression version %u",
+                   ldl_be_p(p + 4));
+        return false;
+    }
+    if (ldl_be_p(p + 8) != XEMU_SNAPSHOT_STREAM_CHUNK_SIZE) {
+        error_setg(errp, "Unsupported snapshot compression chunk size");
+        return false;
+    }
+
+    *raw_size = ldq_be_p(p + 16);
+    *stream_size = ldq_be_p(p + 24);
+    uint64_t num_chunks = ldl_be_p(p + 12);
+    if (num_chunks != DIV_ROUND_UP(*raw_size, XEMU_SNAPSHOT_STREAM_CHUNK_SIZE) ||
+        *stream_size < XEMU_SNAPSHOT_STREAM_HEADER_SIZE + num_chunks * 4) {
+        error_setg(errp, "Corrupt snapshot compression header");
+        return false;
+    }
+
+    return true;
+}
+
+static void *decompress_worker(void *opaque)
+{
+    StreamJob *job = opaque;
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    uint32_t i;
+
+    while ((i = qatomic_fetch_inc(&job->next)) < job->num_chunks) {
+        uint8_t *dst = job->dst + (size_t)i * XEMU_SNAPSHOT_STREAM_CHUNK_SIZE;
+        const uint8_t *src = job->src + job->offsets[i];
+        size_t len = chunk_len(job, i);
+        size_t size = job->sizes[i] & ~XEMU_SNAPSHOT_STREAM_CHUNK_RAW;
+
+        if (job->sizes[i] == 0) {
+            memset(dst, 0, len);
+        } else if (job->sizes[i] & XEMU_SNAPSHOT_STREAM_CHUNK_RAW) {
+            if (size != len) {
+                qatomic_set(&job->failed, 1);
+                break;
+            }
+            memcpy(dst, src, len);
+        } else if (ZSTD_decompressDCtx(dctx, dst, len, src, size) != len) {
+            qatomic_set(&job->failed, 1);
+            break;
+        }
+    }
+
+    ZSTD_freeDCtx(dctx);
+    return NULL;
+}
+
+bool xemu_snapshot_stream_decompress(const void *stream, size_t stream_size,
+                                     void *buf, size_t size, Error **errp)
+{
+    uint64_t raw_size, expected_size;
+
+    if (stream_size < XEMU_SNAPSHOT_STREAM_HEADER_SIZE) {
+        error_setg(errp, "Truncated snapshot VM state");
+        return false;
+    }
+    if (!xemu_snapshot_stream_parse_header(stream, &raw_size, &expected_size,
+                                           errp)) {
+        return false;
+    }
+    if (raw_size != size || expected_size != stream_size) {
+        error_setg(errp, "Snapshot VM state size mismatch");
+        return false;
+    }
+
+    StreamJob job = {
+        .src = stream,
+        .dst = buf,
+        .size = size,
+        .num_chunks = DIV_ROUND_UP(size, XEMU_SNAPSHOT_STREAM_CHUNK_SIZE),
+    };
+    job.offsets = g_new(size_t, job.num_chunks);
+    job.sizes = g_new(uint32_t, job.num_chunks);
+
+    // Lay out the payloads up front so chunks can be expanded in any order
+    const uint8_t *table = (const uint8_t *)stream +
+                           XEMU_SNAPSHOT_STREAM_HEADER_SIZE;
+    size_t pos = XEMU_SNAPSHOT_STREAM_HEADER_SIZE + job.num_chunks * 4;
+    for (uint32_t i = 0; i < job.num_chunks; i++) {
+        job.sizes[i] = ldl_be_p(table + i * 4);
+        job.offsets[i] = pos;
+        pos += job.sizes[i] & ~XEMU_SNAPSHOT_STREAM_CHUNK_RAW;
+    }
+
+    if (pos != stream_size) {
+        error_setg(errp, "Corrupt snapshot compression chunk table");
+    } else if (job.num_chunks) {
+        run_job(&job, decompress_worker);
+        if (job.failed) {
+            error_setg(errp, "Corrupt compressed snapshot VM state");
+        }
+    }
+
+    bool ok = pos == stream_size && !job.failed;
+    g_free(job.offsets);
+    g_free(job.sizes);
+    return ok;
+}
@@ -0,0 +1,64 @@
+/*
+ * xemu snapshot stream compression
+ *
+ * Frames the VM state of a snapshot as independently compressed chunks, so
+ * it can be compressed and expanded on all host cores.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEMU_SNAPSHOT_STREAM_H
+#define XEMU_SNAPSHOT_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "qemu/typedefs.h"
+#include "qemu/units.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Follows the xemu snapshot data (XEMU_SNAPSHOT_DATA_MAGIC) when the rest of
+// the VM state is compressed. All fields are big endian:
+//
+//   u32 magic, u32 version, u32 chunk size, u32 chunk count,
+//   u64 expanded size, u64 stream size (header, chunk table and payload)
+//
+// followed by one u32 per chunk giving its payload size, then the payloads.
+// A size of 0 marks a chunk of zeroes, and XEMU_SNAPSHOT_STREAM_CHUNK_RAW a
+// chunk stored as is because it didn't compress.
+#define XEMU_SNAPSHOT_STREAM_MAGIC 0x787a7374 // 'xzst'
+#define XEMU_SNAPSHOT_STREAM_VERSION 1
+#define XEMU_SNAPSHOT_STREAM_HEADER_SIZE 32
+#define XEMU_SNAPSHOT_STREAM_CHUNK_SIZE (1 * MiB)
+#define XEMU_SNAPSHOT_STREAM_CHUNK_RAW 0x80000000
+
+// Implemented in xemu-snapshot-stream.c, only built with zstd support
+void *xemu_snapshot_stream_compress(const void *buf, size_t size,
+                                    size_t *stream_size);
+
+// Validate a stream header, returning the sizes it describes
+bool xemu_snapshot_stream_parse_header(const void *hdr, uint64_t *raw_size,
+                                       uint64_t *stream_size, Error **errp);
+
+bool xemu_snapshot_stream_decompress(const void *stream, size_t stream_size,
+                                     void *buf, size_t size, Error **errp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
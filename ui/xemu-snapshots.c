@@ -18,6 +18,7 @@
  */
 
 #include "xemu-snapshots.h"
+#include "xemu-notifications.h"
 #include "xemu-settings.h"
 #include "xemu-xbe.h"
 
@@ -33,6 +34,9 @@
 #include "migration/snapshot.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block.h"
+#include "qemu/cutils.h"
+#include "qemu/lockable.h"
+#include "qemu/thread.h"
 #include "system/runstate.h"
 
 #include "ui/console.h"
@@ -50,30 +54,332 @@ const char **g_snapshot_shortcut_index_key_map[] = {
     &g_config.general.snapshots.shortcuts.f8,
 };
 
-static void xemu_snapshots_load_data(BlockDriverState *bs_ro,
-                                     QEMUSnapshotInfo *info,
-                                     XemuSnapshotData *data, Error **err)
+/*
+ * Listing snapshots needs the title, disc and thumbnail stored at the start
+ * of each snapshot's VM state. Reading those means activating every snapshot
+ * in turn, so they are kept in an index file next to the HDD image, with the
+ * thumbnail already decoded. Entries are matched to snapshots by id, name,
+ * date and size, so a stale index only costs a reload of what changed.
+ * Thumbnails of snapshots missing from the index are decoded on a worker
+ * thread, and show up once they are ready.
+ */
+
+#define XEMU_SNAPSHOT_INDEX_MAGIC 0x78736964 // 'xsid'
+#define XEMU_SNAPSHOT_INDEX_VERSION 1
+
+typedef struct XemuSnapshotIndexEntry {
+    char id_str[sizeof(((QEMUSnapshotInfo *)0)->id_str)];
+    char name[sizeof(((QEMUSnapshotInfo *)0)->name)];
+    uint64_t vm_state_size;
+    uint32_t date_sec;
+    uint32_t date_nsec;
+
+    char *disc_path;
+    char *xbe_title_name;
+    uint8_t *thumbnail; // XEMU_SNAPSHOT_THUMBNAIL_BYTES of RGB, or NULL
+    uint64_t seq;       // Identifies thumbnail decode jobs
+    bool failed;        // Not fully read, read it again on the next list
+} XemuSnapshotIndexEntry;
+
+typedef struct ThumbnailJob {
+    uint64_t seq;
+    void *png;
+    size_t png_size;
+    uint8_t *rgb;
+
+    // Alternatively, write an index
+    char *index_path;
+    GByteArray *index;
+} ThumbnailJob;
+
+static XemuSnapshotIndexEntry **xemu_snapshots_index = NULL;
+static int xemu_snapshots_index_len = 0;
+static bool xemu_snapshots_index_read = false;
+static bool xemu_snapshots_index_modified = false;
+static uint64_t xemu_snapshots_index_seq = 0;
+static int xemu_snapshots_thumbnails_pending = 0;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;
+    QemuThread thread;
+    bool started;
+    GQueue jobs;
+    GQueue done;
+} thumbnail_worker;
+
+static char *xemu_snapshots_index_path(void)
+{
+    return g_strdup_printf("%s.snapshot-index", g_config.sys.files.hdd_path);
+}
+
+static void xemu_snapshots_index_entry_free(XemuSnapshotIndexEntry *entry)
+{
+    if (entry) {
+        g_free(entry->disc_path);
+        g_free(entry->xbe_title_name);
+        g_free(entry->thumbnail);
+        g_free(entry);
+    }
+}
+
+static bool xemu_snapshots_index_entry_matches(XemuSnapshotIndexEntry *entry,
+                                               QEMUSnapshotInfo *info)
+{
+    return !entry->failed && !strcmp(entry->id_str, info->id_str) &&
+           !strcmp(entry->name, info->name) &&
+           entry->vm_state_size == info->vm_state_size &&
+           entry->date_sec == info->date_sec &&
+           entry->date_nsec == info->date_nsec;
+}
+
+static void *thumbnail_worker_thread(void *opaque)
+{
+    while (true) {
+        qemu_mutex_lock(&thumbnail_worker.lock);
+        while (g_queue_is_empty(&thumbnail_worker.jobs)) {
+            qemu_cond_wait(&thumbnail_worker.cond, &thumbnail_worker.lock);
+        }
+        ThumbnailJob *job = g_queue_pop_head(&thumbnail_worker.jobs);
+        qemu_mutex_unlock(&thumbnail_worker.lock);
+
+        if (job->index) {
+            g_file_set_contents(job->index_path, (const char *)job->index->data,
+                                job->index->len, NULL);
+            g_byte_array_unref(job->index);
+            g_free(job->index_path);
+            g_free(job);
+            continue;
+        }
+
+        job->rgb = g_malloc(XEMU_SNAPSHOT_THUMBNAIL_BYTES);
+        if (!xemu_snapshots_decode_png_thumbnail(job->png, job->png_size,
+                                                 job->rgb)) {
+            g_free(job->rgb);
+            job->rgb = NULL;
+        }
+        g_free(job->png);
+        job->png = NULL;
+
+        qemu_mutex_lock(&thumbnail_worker.lock);
+        g_queue_push_tail(&thumbnail_worker.done, job);
+        qemu_mutex_unlock(&thumbnail_worker.lock);
+    }
+
+    return NULL;
+}
+
+static void thumbnail_worker_queue(ThumbnailJob *job)
+{
+    if (!thumbnail_worker.started) {
+        qemu_mutex_init(&thumbnail_worker.lock);
+        qemu_cond_init(&thumbnail_worker.cond);
+        g_queue_init(&thumbnail_worker.jobs);
+        g_queue_init(&thumbnail_worker.done);
+        qemu_thread_create(&thumbnail_worker.thread, "xemu-thumbnails",
+                           thumbnail_worker_thread, NULL,
+                           QEMU_THREAD_DETACHED);
+        thumbnail_worker.started = true;
+    }
+
+    qemu_mutex_lock(&thumbnail_worker.lock);
+    g_queue_push_tail(&thumbnail_worker.jobs, job);
+    qemu_cond_signal(&thumbnail_worker.cond);
+    qemu_mutex_unlock(&thumbnail_worker.lock);
+}
+
+static void put_be32(GByteArray *buf, uint32_t v)
+{
+    v = cpu_to_be32(v);
+    g_byte_array_append(buf, (const guint8 *)&v, sizeof(v));
+}
+
+static void put_str(GByteArray *buf, const char *str)
+{
+    uint32_t len = str ? strlen(str) : 0;
+    put_be32(buf, len);
+    g_byte_array_append(buf, (const guint8 *)str, len);
+}
+
+static void xemu_snapshots_index_write(void)
+{
+    GByteArray *buf = g_byte_array_new();
+
+    put_be32(buf, XEMU_SNAPSHOT_INDEX_MAGIC);
+    put_be32(buf, XEMU_SNAPSHOT_INDEX_VERSION);
+    put_be32(buf, XEMU_SNAPSHOT_THUMBNAIL_WIDTH);
+    put_be32(buf, XEMU_SNAPSHOT_THUMBNAIL_HEIGHT);
+
+    int count = 0;
+    for (int i = 0; i < xemu_snapshots_index_len; i++) {
+        count += xemu_snapshots_index[i] && !xemu_snapshots_index[i]->failed;
+    }
+    put_be32(buf, count);
+
+    for (int i = 0; i < xemu_snapshots_index_len; i++) {
+        XemuSnapshotIndexEntry *entry = xemu_snapshots_index[i];
+        if (!entry || entry->failed) {
+            continue;
+        }
+        put_str(buf, entry->id_str);
+        put_str(buf, entry->name);
+        put_be32(buf, entry->vm_state_size >> 32);
+        put_be32(buf, entry->vm_state_size);
+        put_be32(buf, entry->date_sec);
+        put_be32(buf, entry->date_nsec);
+        put_str(buf, entry->disc_path);
+        put_str(buf, entry->xbe_title_name);
+        put_be32(buf, entry->thumbnail != NULL);
+        if (entry->thumbnail) {
+            g_byte_array_append(buf, entry->thumbnail,
+                                XEMU_SNAPSHOT_THUMBNAIL_BYTES);
+        }
+    }
+
+    ThumbnailJob *job = g_new0(ThumbnailJob, 1);
+    job->index_path = xemu_snapshots_index_path();
+    job->index = buf;
+    thumbnail_worker_queue(job);
+
+    xemu_snapshots_index_modified = false;
+}
+
+typedef struct IndexReader {
+    const uint8_t *buf;
+    size_t size;
+    size_t offset;
+} IndexReader;
+
+static bool get_be32(IndexReader *r, uint32_t *v)
+{
+    if (r->size - r->offset < 4) {
+        return false;
+    }
+    *v = be32_to_cpu(*(uint32_t *)&r->buf[r->offset]);
+    r->offset += 4;
+    return true;
+}
+
+static bool get_bytes(IndexReader *r, void *dst, size_t len)
+{
+    if (r->size - r->offset < len) {
+        return false;
+    }
+    memcpy(dst, &r->buf[r->offset], len);
+    r->offset += len;
+    return true;
+}
+
+static bool get_str(IndexReader *r, char **str)
+{
+    uint32_t len;
+    if (!get_be32(r, &len) || r->size - r->offset < len) {
+        return false;
+    }
+    *str = len ? g_strndup((const char *)&r->buf[r->offset], len) : NULL;
+    r->offset += len;
+    return true;
+}
+
+static bool get_fixed_str(IndexReader *r, char *dst, size_t dst_size)
+{
+    char *str = NULL;
+    if (!get_str(r, &str)) {
+        return false;
+    }
+    pstrcpy(dst, dst_size, str ? str : "");
+    g_free(str);
+    return true;
+}
+
+static XemuSnapshotIndexEntry *xemu_snapshots_index_read_entry(IndexReader *r)
+{
+    XemuSnapshotIndexEntry *entry = g_new0(XemuSnapshotIndexEntry, 1);
+    uint32_t size_hi, size_lo, has_thumbnail;
+
+    if (!get_fixed_str(r, entry->id_str, sizeof(entry->id_str)) ||
+        !get_fixed_str(r, entry->name, sizeof(entry->name)) ||
+        !get_be32(r, &size_hi) || !get_be32(r, &size_lo) ||
+        !get_be32(r, &entry->date_sec) || !get_be32(r, &entry->date_nsec) ||
+        !get_str(r, &entry->disc_path) ||
+        !get_str(r, &entry->xbe_title_name) || !get_be32(r, &has_thumbnail)) {
+        xemu_snapshots_index_entry_free(entry);
+        return NULL;
+    }
+    entry->vm_state_size = ((uint64_t)size_hi << 32) | size_lo;
+
+    if (has_thumbnail) {
+        entry->thumbnail = g_malloc(XEMU_SNAPSHOT_THUMBNAIL_BYTES);
+        if (!get_bytes(r, entry->thumbnail, XEMU_SNAPSHOT_THUMBNAIL_BYTES)) {
+            xemu_snapshots_index_entry_free(entry);
+            return NULL;
+        }
+    }
+
+    return entry;
+}
+
+// Read the index left by a previous session, ignoring it if it's unusable
+static void xemu_snapshots_index_load(void)
+{
+    g_autofree char *path = xemu_snapshots_index_path();
+    g_autofree char *contents = NULL;
+    gsize size;
+    uint32_t magic, version, width, height, count;
+
+    if (!g_file_get_contents(path, &contents, &size, NULL)) {
+        return;
+    }
+
+    IndexReader r = { (const uint8_t *)contents, size, 0 };
+    if (!get_be32(&r, &magic) || magic != XEMU_SNAPSHOT_INDEX_MAGIC ||
+        !get_be32(&r, &version) || version != XEMU_SNAPSHOT_INDEX_VERSION ||
+        !get_be32(&r, &width) || width != XEMU_SNAPSHOT_THUMBNAIL_WIDTH ||
+        !get_be32(&r, &height) || height != XEMU_SNAPSHOT_THUMBNAIL_HEIGHT ||
+        !get_be32(&r, &count) || count > size) {
+        return;
+    }
+
+    xemu_snapshots_index = g_new0(XemuSnapshotIndexEntry *, count);
+    for (uint32_t i = 0; i < count; i++) {
+        xemu_snapshots_index[i] = xemu_snapshots_index_read_entry(&r);
+        if (!xemu_snapshots_index[i]) {
+            break;
+        }
+        xemu_snapshots_index_len = i + 1;
+    }
+}
+
+// Read the xemu data at the start of a snapshot's VM state
+static XemuSnapshotIndexEntry *
+xemu_snapshots_load_data(BlockDriverState *bs_ro, QEMUSnapshotInfo *info,
+                         Error **err)
 {
-    data->disc_path = NULL;
-    data->xbe_title_name = NULL;
-    data->gl_thumbnail = 0;
+    XemuSnapshotIndexEntry *entry = g_new0(XemuSnapshotIndexEntry, 1);
+    pstrcpy(entry->id_str, sizeof(entry->id_str), info->id_str);
+    pstrcpy(entry->name, sizeof(entry->name), info->name);
+    entry->vm_state_size = info->vm_state_size;
+    entry->date_sec = info->date_sec;
+    entry->date_nsec = info->date_nsec;
 
     int res = bdrv_snapshot_load_tmp(bs_ro, info->id_str, info->name, err);
     if (res < 0) {
-        return;
+        entry->failed = true;
+        return entry;
     }
 
     uint32_t header[3];
     int64_t offset = 0;
     res = bdrv_load_vmstate(bs_ro, (uint8_t *)&header, offset, sizeof(header));
     if (res != sizeof(header)) {
-        return;
+        entry->failed = true;
+        return entry;
     }
     offset += res;
 
     if (be32_to_cpu(header[0]) != XEMU_SNAPSHOT_DATA_MAGIC ||
         be32_to_cpu(header[1]) != XEMU_SNAPSHOT_DATA_VERSION) {
-        return;
+        return entry;
     }
 
     size_t size = be32_to_cpu(header[2]);
@@ -81,7 +387,8 @@ static void xemu_snapshots_load_data(BlockDriverState *bs_ro,
     res = bdrv_load_vmstate(bs_ro, buf, offset, size);
     if (res != size) {
         g_free(buf);
-        return;
+        entry->failed = true;
+        return entry;
     }
 
     assert(size >= 9);
@@ -92,10 +399,10 @@ static void xemu_snapshots_load_data(BlockDriverState *bs_ro,
     offset += 4;
 
     if (disc_path_size) {
-        data->disc_path = (char *)g_malloc(disc_path_size + 1);
+        entry->disc_path = (char *)g_malloc(disc_path_size + 1);
         assert(size >= (offset + disc_path_size));
-        memcpy(data->disc_path, &buf[offset], disc_path_size);
-        data->disc_path[disc_path_size] = 0;
+        memcpy(entry->disc_path, &buf[offset], disc_path_size);
+        entry->disc_path[disc_path_size] = 0;
         offset += disc_path_size;
     }
 
@@ -104,10 +411,10 @@ static void xemu_snapshots_load_data(BlockDriverState *bs_ro,
     offset += 1;
 
     if (xbe_title_name_size) {
-        data->xbe_title_name = (char *)g_malloc(xbe_title_name_size + 1);
+        entry->xbe_title_name = (char *)g_malloc(xbe_title_name_size + 1);
         assert(size >= (offset + xbe_title_name_size));
-        memcpy(data->xbe_title_name, &buf[offset], xbe_title_name_size);
-        data->xbe_title_name[xbe_title_name_size] = 0;
+        memcpy(entry->xbe_title_name, &buf[offset], xbe_title_name_size);
+        entry->xbe_title_name[xbe_title_name_size] = 0;
         offset += xbe_title_name_size;
     }
 
@@ -115,32 +422,84 @@ static void xemu_snapshots_load_data(BlockDriverState *bs_ro,
     offset += 4;
 
     if (thumbnail_size) {
-        GLuint thumbnail;
-        glGenTextures(1, &thumbnail);
         assert(size >= (offset + thumbnail_size));
-        if (xemu_snapshots_load_png_to_texture(thumbnail, &buf[offset],
-                                               thumbnail_size)) {
-            data->gl_thumbnail = thumbnail;
-        } else {
-            glDeleteTextures(1, &thumbnail);
-        }
+        ThumbnailJob *job = g_new0(ThumbnailJob, 1);
+        job->seq = entry->seq = ++xemu_snapshots_index_seq;
+        job->png = g_memdup2(&buf[offset], thumbnail_size);
+        job->png_size = thumbnail_size;
+        thumbnail_worker_queue(job);
+        xemu_snapshots_thumbnails_pending++;
         offset += thumbnail_size;
     }
 
     g_free(buf);
+    return entry;
+}
+
+static void xemu_snapshots_set_thumbnail(XemuSnapshotData *data,
+                                         const uint8_t *rgb)
+{
+    GLuint thumbnail;
+    glGenTextures(1, &thumbnail);
+    xemu_snapshots_load_thumbnail_to_texture(thumbnail, rgb);
+    data->gl_thumbnail = thumbnail;
+}
+
+// Pick up thumbnails the worker has finished decoding
+static void xemu_snapshots_poll_thumbnails(void)
+{
+    GQueue done = G_QUEUE_INIT;
+
+    if (!xemu_snapshots_thumbnails_pending) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&thumbnail_worker.lock) {
+        done = thumbnail_worker.done;
+        g_queue_init(&thumbnail_worker.done);
+    }
+
+    ThumbnailJob *job;
+    while ((job = g_queue_pop_head(&done))) {
+        xemu_snapshots_thumbnails_pending--;
+
+        for (int i = 0; i < xemu_snapshots_index_len; i++) {
+            XemuSnapshotIndexEntry *entry = xemu_snapshots_index[i];
+            if (entry && entry->seq == job->seq && !job->rgb) {
+                entry->failed = true;
+                break;
+            }
+            if (entry && entry->seq == job->seq) {
+                entry->thumbnail = job->rgb;
+                job->rgb = NULL;
+                if (xemu_snapshots_extra_data && i < xemu_snapshots_len) {
+                    xemu_snapshots_set_thumbnail(&xemu_snapshots_extra_data[i],
+                                                 entry->thumbnail);
+                }
+                break;
+            }
+        }
+
+        g_free(job->rgb);
+        g_free(job);
+    }
+
+    if (!xemu_snapshots_thumbnails_pending && xemu_snapshots_index_modified) {
+        xemu_snapshots_index_write();
+    }
 }
 
 static void xemu_snapshots_all_load_data(QEMUSnapshotInfo **info,
                                          XemuSnapshotData **data,
                                          int snapshots_len, Error **err)
 {
-    BlockDriverState *bs_ro;
-    QDict *opts = qdict_new();
+    BlockDriverState *bs_ro = NULL;
 
     assert(info && data);
 
     if (*data) {
         for (int i = 0; i < xemu_snapshots_len; ++i) {
+            g_free((*data)[i].disc_path);
             g_free((*data)[i].xbe_title_name);
             if ((*data)[i].gl_thumbnail) {
                 glDeleteTextures(1, &((*data)[i].gl_thumbnail));
@@ -153,26 +512,79 @@ static void xemu_snapshots_all_load_data(QEMUSnapshotInfo **info,
         (XemuSnapshotData *)g_malloc(sizeof(XemuSnapshotData) * snapshots_len);
     memset(*data, 0, sizeof(XemuSnapshotData) * snapshots_len);
 
-    qdict_put_bool(opts, BDRV_OPT_READ_ONLY, true);
-    bs_ro = bdrv_open(g_config.sys.files.hdd_path, NULL, opts,
-                      BDRV_O_RO_WRITE_SHARE | BDRV_O_AUTO_RDONLY, err);
-    if (!bs_ro) {
-        return;
+    if (!xemu_snapshots_index_read) {
+        xemu_snapshots_index_load();
+        xemu_snapshots_index_read = true;
     }
 
+    XemuSnapshotIndexEntry **old_index = xemu_snapshots_index;
+    int old_index_len = xemu_snapshots_index_len;
+    xemu_snapshots_index = g_new0(XemuSnapshotIndexEntry *, snapshots_len);
+    xemu_snapshots_index_len = snapshots_len;
+
     for (int i = 0; i < snapshots_len; ++i) {
-        xemu_snapshots_load_data(bs_ro, (*info) + i, (*data) + i, err);
+        XemuSnapshotIndexEntry *entry = NULL;
+
+        for (int j = 0; j < old_index_len; j++) {
+            if (old_index[j] &&
+                xemu_snapshots_index_entry_matches(old_index[j],
+                                                   (*info) + i)) {
+                entry = old_index[j];
+                old_index[j] = NULL;
+                break;
+            }
+        }
+
+        if (!entry) {
+            if (!bs_ro) {
+                QDict *opts = qdict_new();
+                qdict_put_bool(opts, BDRV_OPT_READ_ONLY, true);
+                bs_ro = bdrv_open(g_config.sys.files.hdd_path, NULL, opts,
+                                  BDRV_O_RO_WRITE_SHARE | BDRV_O_AUTO_RDONLY,
+                                  err);
+                if (!bs_ro) {
+                    break;
+                }
+            }
+            entry = xemu_snapshots_load_data(bs_ro, (*info) + i, err);
+            xemu_snapshots_index_modified = true;
+        }
+
+        xemu_snapshots_index[i] = entry;
+        (*data)[i].disc_path = g_strdup(entry->disc_path);
+        (*data)[i].xbe_title_name = g_strdup(entry->xbe_title_name);
+        if (entry->thumbnail) {
+            xemu_snapshots_set_thumbnail((*data) + i, entry->thumbnail);
+        }
+
         if (*err) {
             break;
         }
     }
 
-    bdrv_flush(bs_ro);
-    bdrv_drain(bs_ro);
-    assert(bs_ro->refcnt == 1);
-    bdrv_unref(bs_ro);
-    if (!(*err))
+    // Anything left over belongs to snapshots that no longer exist
+    for (int j = 0; j < old_index_len; j++) {
+        if (old_index[j]) {
+            xemu_snapshots_index_entry_free(old_index[j]);
+            xemu_snapshots_index_modified = true;
+        }
+    }
+    g_free(old_index);
+
+    if (bs_ro) {
+        bdrv_flush(bs_ro);
+        bdrv_drain(bs_ro);
+        assert(bs_ro->refcnt == 1);
+        bdrv_unref(bs_ro);
+    }
+
+    if (!(*err)) {
         xemu_snapshots_dirty = false;
+        if (!xemu_snapshots_thumbnails_pending &&
+            xemu_snapshots_index_modified) {
+            xemu_snapshots_index_write();
+        }
+    }
 }
 
 int xemu_snapshots_list(QEMUSnapshotInfo **info, XemuSnapshotData **extra_data,
@@ -182,6 +594,8 @@ int xemu_snapshots_list(QEMUSnapshotInfo **info, XemuSnapshotData **extra_data,
     int snapshots_len;
     assert(err);
 
+    xemu_snapshots_poll_thumbnails();
+
     if (!xemu_snapshots_dirty && xemu_snapshots_extra_data &&
         xemu_snapshots_metadata) {
         goto done;
@@ -240,6 +654,11 @@ char *xemu_get_currently_loaded_disc_path(void)
 
 void xemu_snapshots_load(const char *vm_name, Error **err)
 {
+    if (save_snapshot_in_progress()) {
+        error_setg(err, "Snapshot save in progress");
+        return;
+    }
+
     bool vm_running = runstate_is_running();
     vm_stop(RUN_STATE_RESTORE_VM);
     if (load_snapshot(vm_name, NULL, false, NULL, err) && vm_running) {
@@ -247,13 +666,33 @@ void xemu_snapshots_load(const char *vm_name, Error **err)
     }
 }
 
+static void xemu_snapshots_save_complete(void *opaque, Error *err)
+{
+    if (err) {
+        xemu_queue_error_message(error_get_pretty(err));
+    }
+}
+
 void xemu_snapshots_save(const char *vm_name, Error **err)
 {
-    save_snapshot(vm_name, true, NULL, false, NULL, err);
+    if (g_config.general.snapshots.background_save) {
+        save_snapshot_background(vm_name, true,
+                                 g_config.general.snapshots.compress,
+                                 xemu_snapshots_save_complete, NULL, err);
+    } else if (save_snapshot_in_progress()) {
+        error_setg(err, "Snapshot save in progress");
+    } else {
+        save_snapshot(vm_name, true, NULL, false, NULL, err);
+    }
 }
 
 void xemu_snapshots_delete(const char *vm_name, Error **err)
 {
+    if (save_snapshot_in_progress()) {
+        error_setg(err, "Snapshot save in progress");
+        return;
+    }
+
     delete_snapshot(vm_name, false, NULL, err);
 }
 
@@ -31,9 +31,12 @@ extern "C" {
 
 #define XEMU_SNAPSHOT_DATA_MAGIC 0x78656d75 // 'xemu'
 #define XEMU_SNAPSHOT_DATA_VERSION 1
+// The rest of the VM state may follow compressed, see xemu-snapshot-stream.h
 
 #define XEMU_SNAPSHOT_THUMBNAIL_WIDTH 160
 #define XEMU_SNAPSHOT_THUMBNAIL_HEIGHT 120
+#define XEMU_SNAPSHOT_THUMBNAIL_BYTES \
+    (XEMU_SNAPSHOT_THUMBNAIL_WIDTH * XEMU_SNAPSHOT_THUMBNAIL_HEIGHT * 3)
 
 extern const char **g_snapshot_shortcut_index_key_map[];
 
@@ -58,6 +61,10 @@ void xemu_snapshots_mark_dirty(void);
 // Implemented in xemu-thumbnail.cc
 void xemu_snapshots_set_framebuffer_texture(GLuint tex, bool flip);
 bool xemu_snapshots_load_png_to_texture(GLuint tex, void *buf, size_t size);
+// Decode to RGB at the nominal thumbnail size, safe to call from any thread
+bool xemu_snapshots_decode_png_thumbnail(const void *buf, size_t size,
+                                         uint8_t *rgb);
+void xemu_snapshots_load_thumbnail_to_texture(GLuint tex, const uint8_t *rgb);
 void *xemu_snapshots_create_framebuffer_thumbnail_png(size_t *size);
 
 #ifdef __cplusplus
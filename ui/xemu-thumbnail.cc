@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstdint>
 #include <fpng.h>
 #include <vector>
@@ -55,6 +56,60 @@ bool xemu_snapshots_load_png_to_texture(GLuint tex, void *buf, size_t size)
     return true;
 }
 
+bool xemu_snapshots_decode_png_thumbnail(const void *buf, size_t size,
+                                         uint8_t *rgb)
+{
+    std::vector<uint8_t> pixels;
+    unsigned int width, height, channels;
+    if (fpng::fpng_decode_memory(buf, size, pixels, width, height, channels,
+                                 3) != fpng::FPNG_DECODE_SUCCESS ||
+        !width || !height) {
+        return false;
+    }
+
+    // Box filter down to the nominal size, thumbnails are captured at twice it
+    const unsigned int dw = XEMU_SNAPSHOT_THUMBNAIL_WIDTH;
+    const unsigned int dh = XEMU_SNAPSHOT_THUMBNAIL_HEIGHT;
+    for (unsigned int y = 0; y < dh; y++) {
+        unsigned int y0 = y * height / dh;
+        unsigned int y1 = std::max(y0 + 1, (y + 1) * height / dh);
+        for (unsigned int x = 0; x < dw; x++) {
+            unsigned int x0 = x * width / dw;
+            unsigned int x1 = std::max(x0 + 1, (x + 1) * width / dw);
+            unsigned int sum[3] = { 0, 0, 0 };
+            for (unsigned int sy = y0; sy < y1; sy++) {
+                const uint8_t *p = &pixels[(sy * width + x0) * 3];
+                for (unsigned int sx = x0; sx < x1; sx++, p += 3) {
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                }
+            }
+            unsigned int n = (y1 - y0) * (x1 - x0);
+            uint8_t *d = &rgb[(y * dw + x) * 3];
+            d[0] = sum[0] / n;
+            d[1] = sum[1] / n;
+            d[2] = sum[2] / n;
+        }
+    }
+
+    return true;
+}
+
+void xemu_snapshots_load_thumbnail_to_texture(GLuint tex, const uint8_t *rgb)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, XEMU_SNAPSHOT_THUMBNAIL_WIDTH,
+                 XEMU_SNAPSHOT_THUMBNAIL_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE,
+                 rgb);
+}
+
 void *xemu_snapshots_create_framebuffer_thumbnail_png(size_t *size)
 {
     /*
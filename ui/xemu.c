@@ -32,9 +32,11 @@
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
 #include "qemu/rcu.h"
+#include "qemu/units.h"
 #include "qemu-version.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block.h"
+#include "block/xiso-cache.h"
 #include "qobject/qdict.h"
 #include "ui/console.h"
 #include "ui/input.h"
@@ -43,11 +45,15 @@
 #include "system/runstate-action.h"
 #include "system/system.h"
 #include "xui/xemu-hud.h"
+#include "xemu-frame-pacing.h"
 #include "xemu-input.h"
 #include "xemu-settings.h"
 #include "xemu-snapshots.h"
 #include "xemu-version.h"
 #include "xemu-os-utils.h"
+#include "xemu-benchmark.h"
+#include "xemu-profiler.h"
+#include "xemu-args.h"
 
 #include "data/xemu_64x64.png.h"
 
@@ -70,6 +76,10 @@
 #define DPRINTF(...)
 #endif
 
+// Frames in a row the UI thread skips work that needs the main loop lock
+// before it waits for the lock instead
+#define UI_LOCK_MAX_BUSY_FRAMES 6
+
 uint64_t vblank_interval_ns = 16666666LL;
 bool use_vblank_timer_thread = true;
 
@@ -116,6 +126,7 @@ static QemuSemaphore display_init_sem;
 static QemuSemaphore display_shutdown_sem;
 static QEMUTimer *vblank_timer;
 static QemuThread vblank_thread;
+static QEMUBH *vblank_bh;
 static bool qemu_exiting;
 static int exit_status;
 
@@ -135,6 +146,44 @@ void xemu_main_loop_lock(void)
 #endif
 }
 
+/*
+ * Like xemu_main_loop_lock, but only if the lock is free. The UI thread uses
+ * this so that it can keep presenting frames while the core holds the lock
+ * for a long I/O or snapshot operation.
+ */
+bool xemu_main_loop_trylock(void)
+{
+    if (!qemu_mutex_trylock_main_loop()) {
+        return false;
+    }
+
+    bql_lock();
+#if DEBUG_XEMU_C
+    lock_start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+#endif
+    return true;
+}
+
+/*
+ * Take the lock for a piece of per-frame UI work, which is tried once per
+ * frame and skipped while the core holds the lock. Posting the work to the
+ * main loop instead would need the HUD and every event handler that calls
+ * into the core to become asynchronous. So that input and the HUD can't be
+ * starved, the lock is waited for once the work has been skipped for
+ * UI_LOCK_MAX_BUSY_FRAMES frames in a row.
+ */
+static bool ui_lock_for_frame(int *busy_frames)
+{
+    if (!xemu_main_loop_trylock()) {
+        if (++*busy_frames < UI_LOCK_MAX_BUSY_FRAMES) {
+            return false;
+        }
+        xemu_main_loop_lock();
+    }
+    *busy_frames = 0;
+    return true;
+}
+
 void xemu_main_loop_unlock(void)
 {
 #if DEBUG_XEMU_C
@@ -506,6 +555,13 @@ static void handle_mousewheel(SDL_Event *ev)
     qemu_input_event_sync();
 }
 
+static void update_host_refresh(void)
+{
+    const SDL_DisplayMode *mode =
+        SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(m_window));
+    xemu_frame_pacing_set_host_refresh(mode ? mode->refresh_rate : 0);
+}
+
 static void handle_windowevent(SDL_Event *ev)
 {
     struct xemu_console *scon = get_scon_from_window(ev->window.windowID);
@@ -530,6 +586,9 @@ static void handle_windowevent(SDL_Event *ev)
             }
         }
         break;
+    case SDL_EVENT_WINDOW_DISPLAY_CHANGED:
+        update_host_refresh();
+        break;
     case SDL_EVENT_WINDOW_FOCUS_GAINED:
     case SDL_EVENT_WINDOW_MOUSE_ENTER:
         if (!gui_grab && (qemu_input_is_absolute(scon->dcl.con) || absolute_enabled)) {
@@ -747,29 +806,20 @@ static void vblank_timer_callback(void *opaque)
     timer_mod_ns(vblank_timer, now + vblank_interval_ns);
 }
 
-static void *vblank_timer_thread(void *opaque)
+static void vblank_bh_callback(void *opaque)
 {
-    struct xemu_console *scon = (struct xemu_console *)opaque;
-    int64_t next_vblank = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    process_vblank((struct xemu_console *)opaque);
+}
 
+static void *vblank_timer_thread(void *opaque)
+{
     while (!qatomic_read(&qemu_exiting)) {
-        // Schedule next vblank at fixed interval (absolute deadline)
-        next_vblank += vblank_interval_ns;
-
-        // Wait until deadline
-        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
-        if (now < next_vblank) {
-            SDL_DelayPrecise(next_vblank - now);
-        } else if (now > next_vblank + vblank_interval_ns) {
-            // We've fallen behind by more than one frame, reset to avoid
-            // rapid-fire catch-up
-            next_vblank = now;
-        }
+        xemu_frame_pacing_wait_vblank();
 
+        // Raise the vblank on the main loop, which already holds the BQL,
+        // instead of contending for the lock with device emulation here
         if (!qatomic_read(&qemu_exiting)) {
-            xemu_main_loop_lock();
-            process_vblank(scon);
-            xemu_main_loop_unlock();
+            qemu_bh_schedule(vblank_bh);
         }
     }
 
@@ -822,6 +872,7 @@ static void gl_render_frame(struct xemu_console *scon)
      * the guest code isn't using HW accelerated rendering, but just blitting
      * to the framebuffer, fall back to the VGA path.
      */
+    xemu_frame_pacing_begin_frame();
     GLuint tex = nv2a_get_framebuffer_surface();
 
     assert(glGetError() == GL_NO_ERROR);
@@ -842,13 +893,15 @@ static void gl_render_frame(struct xemu_console *scon)
     xemu_hud_set_framebuffer_texture(tex, flip_required);
 
     /* FIXME: Finer locking. Event handlers in segments of the code expect
-     * to be running on the main thread with the BQL. For now, acquire the
-     * lock and perform rendering, but release before swap to avoid
-     * possible lengthy blocking (for vsync).
+     * to be running on the main thread with the BQL. The HUD is only rebuilt
+     * with the lock held; if the core holds it, the previous HUD is drawn
+     * again over the current frame instead of stalling.
      */
-    xemu_main_loop_lock();
-    xemu_hud_update();
-    xemu_main_loop_unlock();
+    static int hud_busy_frames;
+    if (ui_lock_for_frame(&hud_busy_frames)) {
+        xemu_hud_update();
+        xemu_main_loop_unlock();
+    }
 
     xemu_hud_render();
     glFinish();
@@ -860,7 +913,9 @@ static void gl_render_frame(struct xemu_console *scon)
     }
 
     nv2a_release_framebuffer_surface();
+    int64_t swap_start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     SDL_GL_SwapWindow(scon->real_window);
+    xemu_frame_pacing_end_frame(swap_start);
     assert(glGetError() == GL_NO_ERROR);
 
     qatomic_set(&rendering, false);
@@ -890,8 +945,15 @@ static void poll_events(struct xemu_console *scon)
     int kbd = 0, mouse = 0;
     xemu_hud_should_capture_kbd_mouse(&kbd, &mouse);
 
-    while (SDL_PollEvent(ev)) {
-        xemu_main_loop_lock();
+    // Events are only dequeued once the lock is held, so that while the core
+    // is busy they stay queued for a later frame rather than blocking this one
+    static int events_busy_frames;
+    SDL_PumpEvents();
+    if (!ui_lock_for_frame(&events_busy_frames)) {
+        return;
+    }
+    while (SDL_PeepEvents(ev, 1, SDL_GETEVENT, SDL_EVENT_FIRST,
+                          SDL_EVENT_LAST) == 1) {
 
         // HUD must process events first so that if a controller is detached,
         // a latent rebind request can cancel before the state is freed
@@ -935,11 +997,8 @@ static void poll_events(struct xemu_console *scon)
         default:
             break;
         }
-
-        xemu_main_loop_unlock();
     }
 
-    xemu_main_loop_lock();
     xemu_input_update_controllers();
     xemu_main_loop_unlock();
 }
@@ -1157,7 +1216,12 @@ static void display_init(DisplayState *ds, DisplayOptions *o)
     // Register event watch to handle rendering during these operations.
     SDL_AddEventWatch(event_watch_callback, &scon_list[0]);
 
+    xemu_frame_pacing_init(vblank_interval_ns);
+    nv2a_set_flip_notifier(xemu_frame_pacing_guest_flip);
+    update_host_refresh();
+
     if (use_vblank_timer_thread) {
+        vblank_bh = qemu_bh_new(vblank_bh_callback, &scon_list[0]);
         qemu_thread_create(&vblank_thread, "vblank-timer", vblank_timer_thread,
                            &scon_list[0], QEMU_THREAD_JOINABLE);
     } else {
@@ -1215,6 +1279,38 @@ static void *qemu_main(void *opaque)
     return NULL;
 }
 
+/*
+ * Benchmark runs have no window and no UI thread, so the machine runs on this
+ * thread, as QEMU's own main does with -display none.
+ */
+static int run_benchmark(void)
+{
+    // Keep the APU paced by an audio device, without making any sound
+    SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+
+    if (g_config.display.renderer != CONFIG_DISPLAY_RENDERER_NULL) {
+        // Renderers draw offscreen, but still need a video subsystem for
+        // their contexts
+        if (!SDL_Init(SDL_INIT_VIDEO)) {
+            fprintf(stderr, "Failed to initialize SDL video subsystem: %s\n",
+                    SDL_GetError());
+            exit(1);
+        }
+        nv2a_context_init();
+        SDL_GL_MakeCurrent(NULL, NULL);
+    }
+
+    // Lets the report attribute CPU time to threads by name
+    qemu_thread_naming(true);
+
+    qemu_init(gArgc, gArgv);
+    int status = qemu_main_loop();
+    qemu_cleanup(status);
+    SDL_Quit();
+
+    return status;
+}
+
 #ifdef _WIN32
 static const wchar_t *get_executable_name(void)
 {
@@ -1311,15 +1407,9 @@ int main(int argc, char **argv)
     gArgc = argc;
     gArgv = argv;
 
-    for (int i = 1; i < argc; i++) {
-        if (argv[i] && strcmp(argv[i], "-config_path") == 0) {
-            argv[i] = NULL;
-            if (i < argc - 1 && argv[i+1]) {
-                xemu_settings_set_path(argv[i+1]);
-                argv[i+1] = NULL;
-            }
-            break;
-        }
+    const char *config_path = xemu_args_take_str(argc, argv, "-config_path");
+    if (config_path) {
+        xemu_settings_set_path(config_path);
     }
 
     if (!xemu_settings_load()) {
@@ -1331,6 +1421,12 @@ int main(int argc, char **argv)
         SDL_Quit();
         exit(1);
     }
+
+    if (xemu_benchmark_parse_args(argc, argv)) {
+        // Overrides made for the run must not end up in the config file
+        return run_benchmark();
+    }
+
     atexit(xemu_settings_save);
 
 #ifdef _WIN32
@@ -1363,14 +1459,17 @@ int main(int argc, char **argv)
     xemu_main_loop_lock();
     xemu_input_init();
     xemu_main_loop_unlock();
+    xemu_profiler_init();
 
     struct xemu_console *scon = &scon_list[0];
     while (!qatomic_read(&qemu_exiting)) {
         poll_events(scon);
+        xemu_frame_pacing_wait_for_flip();
         gl_render_frame(scon);
     }
     qemu_sem_post(&display_shutdown_sem);
     qemu_thread_join(&thread);
+    xemu_input_shutdown();
     display_finalize();
     return exit_status;
 }
@@ -1399,7 +1498,13 @@ void xemu_load_disc(const char *path, Error **errp)
     xbox_smc_eject_button();
     xemu_settings_set_string(&g_config.sys.files.dvd_path, "");
 
-    qmp_blockdev_change_medium("ide0-cd1", NULL, path, "raw", false, false,
+    xiso_cache_set_defaults(g_config.perf.dvd_cache.size_mb * MiB,
+                            g_config.perf.dvd_cache.read_ahead_kb * KiB,
+                            g_config.perf.dvd_cache.mmap);
+    const char *format =
+        g_config.perf.dvd_cache.enable ? XISO_CACHE_FORMAT : "raw";
+
+    qmp_blockdev_change_medium("ide0-cd1", NULL, path, format, false, false,
                                false, 0, &error);
     if (error) {
         error_propagate(errp, error);
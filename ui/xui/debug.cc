@@ -22,13 +22,52 @@
 #include "misc.hh"
 #include "font-manager.hh"
 #include "viewport-manager.hh"
+#include "../xemu-frame-pacing.h"
+#include "../xemu-input.h"
+#include "../xemu-notifications.h"
+#include "../xemu-profiler.h"
+#include "block/xiso-cache.h"
 
 #define MAX_VOICES 256
+#define PROFILER_TOP_FUNCTIONS 20
+#define PROFILER_TOP_MODULES 8
+#define PROFILER_REFRESH_MS 500
 
 DebugApuWindow::DebugApuWindow() : m_is_open(false)
 {
 }
 
+static void CaptureApuState(void)
+{
+    Error *err = NULL;
+    char fname[128];
+
+    time_t t = time(NULL);
+    struct tm *tmp = localtime(&t);
+    if (tmp) {
+        strftime(fname, sizeof(fname), "xemu-apu-%Y-%m-%d-%H-%M-%S.bin", tmp);
+    } else {
+        strcpy(fname, "xemu-apu.bin");
+    }
+
+    const char *output_dir = g_config.general.screenshot_dir;
+    if (!strlen(output_dir)) {
+        output_dir = ".";
+    }
+    char *path = g_strdup_printf("%s/%s", output_dir, fname);
+    mcpx_apu_debug_capture(path, &err);
+    g_free(path);
+
+    if (err) {
+        xemu_queue_error_message(error_get_pretty(err));
+        error_report_err(err);
+    } else {
+        char *msg = g_strdup_printf("APU State Captured: %s", fname);
+        xemu_queue_notification(msg);
+        g_free(msg);
+    }
+}
+
 void DebugApuWindow::Draw()
 {
     if (!m_is_open)
@@ -223,6 +262,10 @@ void DebugApuWindow::Draw()
 
     ImGui::Checkbox("HRTF Filtering\n", &g_config.audio.hrtf);
 
+    if (ImGui::Button("Capture State")) {
+        CaptureApuState();
+    }
+
     ImGui::PushFont(g_font_mgr.m_fixed_width_font);
 
     bool color = (dbg->utilization > 0.9);
@@ -311,6 +354,16 @@ void DebugApuWindow::Draw()
     }
     ImGui::Text("GP Cycles:   %04d", dbg->gp.cycles);
     ImGui::Text("EP Cycles:   %04d", dbg->ep.cycles);
+    if (dbg->gp.jit.enabled && ImGui::TreeNode("DSP JIT")) {
+        ImGui::Text("    Hit Miss Last us Total ms");
+        ImGui::Text("GP: %3d %4d %7d %8" PRId64, dbg->gp.jit.cache_hits,
+                    dbg->gp.jit.cache_misses, dbg->gp.jit.last_compile_us,
+                    dbg->gp.jit.total_compile_us / 1000);
+        ImGui::Text("EP: %3d %4d %7d %8" PRId64, dbg->ep.jit.cache_hits,
+                    dbg->ep.jit.cache_misses, dbg->ep.jit.last_compile_us,
+                    dbg->ep.jit.total_compile_us / 1000);
+        ImGui::TreePop();
+    }
 
     ImGui::PopFont();
     ImGui::Columns(1);
@@ -462,6 +515,105 @@ void DebugVideoWindow::Draw()
             ImGui::TreePop();
         }
 
+        if (ImGui::TreeNode("Frame Pacing")) {
+            static XemuFramePacingStats pacing;
+            xemu_frame_pacing_get_stats(&pacing);
+
+            ImGui::Text("Display %.2f Hz, %s, lead %.1f ms, resyncs %u",
+                        pacing.host_refresh_hz,
+                        pacing.aligned ? "aligned" : "free-running",
+                        pacing.vblank_lead_ms, pacing.resyncs);
+
+            if (pacing.count > 0) {
+                float hist_width = 0.5 * (ImGui::GetContentRegionAvail().x -
+                                          ImGui::GetStyle().ItemSpacing.x);
+                ImVec2 size(hist_width, 100 * g_viewport_mgr.m_scale);
+
+                ImGui::SetNextWindowBgAlpha(alpha);
+                if (ImPlot::BeginPlot("Frame time (ms)", size)) {
+                    ImPlot::SetupAxes(NULL, NULL, ImPlotAxisFlags_None,
+                                      ImPlotAxisFlags_AutoFit);
+                    ImPlot::PlotHistogram("##frame", pacing.frame_ms,
+                                          pacing.count, 50, 1.0,
+                                          ImPlotRange(0, 50));
+                    ImPlot::EndPlot();
+                }
+                ImGui::SameLine();
+                ImGui::SetNextWindowBgAlpha(alpha);
+                if (ImPlot::BeginPlot("Flip to present (ms)", size)) {
+                    ImPlot::SetupAxes(NULL, NULL, ImPlotAxisFlags_None,
+                                      ImPlotAxisFlags_AutoFit);
+                    ImPlot::PlotHistogram("##latency", pacing.latency_ms,
+                                          pacing.count, 50, 1.0,
+                                          ImPlotRange(0, 50));
+                    ImPlot::EndPlot();
+                }
+            }
+            ImGui::TreePop();
+        }
+
+        if (ImGui::TreeNode("Input Latency")) {
+            static XemuInputLatencyStats input;
+            xemu_input_get_latency_stats(&input);
+
+            if (input.threaded) {
+                ImGui::Text("Input thread polling at %.0f Hz",
+                            input.poll_rate_hz);
+            } else {
+                ImGui::TextUnformatted("Polling on guest USB reads");
+            }
+
+            if (input.count > 0) {
+                ImVec2 size(-1, 100 * g_viewport_mgr.m_scale);
+                ImGui::SetNextWindowBgAlpha(alpha);
+                if (ImPlot::BeginPlot("Sample to guest (ms)", size)) {
+                    ImPlot::SetupAxes(NULL, NULL, ImPlotAxisFlags_None,
+                                      ImPlotAxisFlags_AutoFit);
+                    ImPlot::PlotHistogram("##input", input.latency_ms,
+                                          input.count, 40, 1.0,
+                                          ImPlotRange(0, 20));
+                    ImPlot::EndPlot();
+                }
+            }
+            ImGui::TreePop();
+        }
+
+        if (ImGui::TreeNode("Disc Cache")) {
+            XisoCacheStats cache;
+            xiso_cache_get_stats(&cache);
+
+            uint64_t reads = cache.hits + cache.misses;
+            if (!cache.active) {
+                ImGui::TextUnformatted("No cached disc loaded");
+            } else if (cache.mapped) {
+                ImGui::Text("%" PRIu64 " reads from mapped image",
+                            cache.mapped);
+            } else {
+                ImGui::Text("Hit rate %.1f%% (%" PRIu64 "/%" PRIu64 ")",
+                            reads ? 100.0 * cache.hits / reads : 0.0,
+                            cache.hits, reads);
+                ImGui::Text("%" PRIu64 " clusters prefetched, %" PRIu64
+                            " KiB cached",
+                            cache.prefetched, cache.cached_bytes / 1024);
+            }
+            ImGui::TreePop();
+        }
+
+        if (ImGui::TreeNode("Snapshot Save")) {
+            if (g_nv2a_stats.savevm.sync_us) {
+                ImGui::Text("GPU sync %.1f ms, %u surfaces (%" PRIu64 " KiB)",
+                            g_nv2a_stats.savevm.sync_us / 1000.0,
+                            g_nv2a_stats.savevm.surfaces,
+                            g_nv2a_stats.savevm.bytes / 1024);
+                ImGui::Text("Worst frame in %d after resume: %d ms",
+                            NV2A_PROF_RESUME_FRAMES,
+                            g_nv2a_stats.savevm.resume_max_mspf);
+            } else {
+                ImGui::TextUnformatted("No snapshot saved yet");
+            }
+            ImGui::TreePop();
+        }
+
         if (ImGui::IsWindowHovered() && ImGui::IsMouseClicked(2)) {
             m_transparent = !m_transparent;
         }
@@ -483,5 +635,116 @@ void DebugVideoWindow::Draw()
     ImGui::PopStyleColor(5);
 }
 
+DebugProfilerWindow::DebugProfilerWindow() : m_is_open(false)
+{
+}
+
+static void SaveProfileReport(void)
+{
+    Error *err = NULL;
+    char fname[128];
+
+    time_t t = time(NULL);
+    struct tm *tmp = localtime(&t);
+    if (tmp) {
+        strftime(fname, sizeof(fname), "xemu-profile-%Y-%m-%d-%H-%M-%S.folded",
+                 tmp);
+    } else {
+        strcpy(fname, "xemu-profile.folded");
+    }
+
+    const char *output_dir = g_config.general.screenshot_dir;
+    if (!strlen(output_dir)) {
+        output_dir = ".";
+    }
+    char *path = g_strdup_printf("%s/%s", output_dir, fname);
+    xemu_profiler_save_report(path, &err);
+    g_free(path);
+
+    if (err) {
+        xemu_queue_error_message(error_get_pretty(err));
+        error_report_err(err);
+    } else {
+        char *msg = g_strdup_printf("CPU Profile Saved: %s", fname);
+        xemu_queue_notification(msg);
+        g_free(msg);
+    }
+}
+
+void DebugProfilerWindow::Draw()
+{
+    static XemuProfilerEntry functions[PROFILER_TOP_FUNCTIONS];
+    static XemuProfilerEntry modules[PROFILER_TOP_MODULES];
+    static int num_functions, num_modules;
+    static uint64_t total;
+    static uint64_t last_refresh;
+
+    if (!m_is_open)
+        return;
+
+    ImGui::SetNextWindowContentSize(ImVec2(500.0f*g_viewport_mgr.m_scale, 0.0f));
+    if (!ImGui::Begin("CPU Profile", &m_is_open,
+                      ImGuiWindowFlags_NoCollapse |
+                          ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::End();
+        return;
+    }
+
+    bool running = xemu_profiler_is_running();
+    if (ImGui::Button(running ? "Stop" : "Start")) {
+        if (running) {
+            xemu_profiler_stop();
+        } else {
+            xemu_profiler_start();
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+        xemu_profiler_reset();
+        last_refresh = 0;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Save Report")) {
+        SaveProfileReport();
+    }
+
+    // Symbolizing reads guest memory, don't do it every frame
+    uint64_t now = SDL_GetTicks();
+    if (!last_refresh || now - last_refresh >= PROFILER_REFRESH_MS) {
+        total = xemu_profiler_get_total_samples();
+        num_functions = xemu_profiler_get_top_functions(
+            functions, PROFILER_TOP_FUNCTIONS);
+        num_modules = xemu_profiler_get_top_modules(modules,
+                                                    PROFILER_TOP_MODULES);
+        last_refresh = now;
+    }
+
+    ImGui::PushFont(g_font_mgr.m_fixed_width_font);
+    ImGui::Text("Samples: %" PRIu64, total);
+
+    if (total) {
+        ImGui::Separator();
+        for (int i = 0; i < num_modules; i++) {
+            float frac = (float)modules[i].samples / total;
+            char label[32];
+            snprintf(label, sizeof(label), "%.1f%%", frac * 100);
+            ImGui::Text("%-10s", modules[i].name);
+            ImGui::SameLine();
+            ImGui::ProgressBar(frac, ImVec2(-1, 0), label);
+        }
+
+        ImGui::Separator();
+        ImGui::Text("%-40s %6s", "Function", "Self");
+        for (int i = 0; i < num_functions; i++) {
+            ImGui::Text("%-40s %5.1f%%", functions[i].name,
+                        functions[i].samples * 100.0 / total);
+        }
+    }
+
+    ImGui::PopFont();
+    ImGui::End();
+}
+
 DebugApuWindow apu_window;
 DebugVideoWindow video_window;
+DebugProfilerWindow profiler_window;
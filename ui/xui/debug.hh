@@ -39,5 +39,14 @@ public:
     void Draw();
 };
 
+class DebugProfilerWindow
+{
+public:
+    bool m_is_open;
+    DebugProfilerWindow();
+    void Draw();
+};
+
 extern DebugApuWindow apu_window;
 extern DebugVideoWindow video_window;
+extern DebugProfilerWindow profiler_window;
@@ -39,6 +39,7 @@
 #include "../xemu-net.h"
 #include "../xemu-os-utils.h"
 #include "../xemu-xbe.h"
+#include "../xemu-hdd.h"
 
 #include "../thirdparty/fatx/fatx.h"
 
@@ -67,6 +68,15 @@ void MainMenuGeneralView::Draw()
 
     Toggle("Cache shaders to disk", &g_config.perf.cache_shaders,
            "Reduce stutter in games by caching previously generated shaders");
+    Toggle("Cache translated code to disk", &g_config.perf.cache_code,
+           "Speed up title startup by translating previously run code ahead "
+           "of time");
+    Toggle("Warm start from snapshots", &g_config.perf.snapshot_warm_start,
+           "Save recently used shaders and textures with snapshots to reduce "
+           "stutter after loading (snapshots only load in this xemu version)");
+    Toggle("Cache disc reads", &g_config.perf.dvd_cache.enable,
+           "Read ahead of sequential disc accesses to reduce load times from "
+           "slow storage (applies to the next disc loaded)");
 
     SectionTitle("Miscellaneous");
     Toggle("Skip startup animation", &g_config.general.skip_boot_anim,
@@ -572,6 +582,14 @@ void MainMenuInputView::Draw()
     Toggle("Background controller input capture",
            &g_config.input.background_input_capture,
            "Capture even if window is unfocused (requires restart)");
+    Toggle("Dedicated input thread", &g_config.input.poll_thread,
+           "Sample controllers independently of the UI (requires restart)");
+    ChevronCombo("Input polling rate", &g_config.input.poll_rate,
+                 "125 Hz\0"
+                 "250 Hz\0"
+                 "500 Hz\0"
+                 "1000 Hz\0",
+                 "How often the input thread samples controllers");
 }
 
 void MainMenuInputView::Hide()
@@ -791,6 +809,12 @@ void MainMenuDisplayView::Draw()
     }
     Toggle("Vertical refresh sync", &g_config.display.window.vsync,
            "Sync to screen vertical refresh to reduce tearing artifacts");
+    ChevronCombo("Frame pacing", &g_config.display.window.frame_pacing,
+                 "Fixed\0"
+                 "Match Display\0"
+                 "Low Latency\0",
+                 "Align emulated vblank to the display, or present each "
+                 "frame as soon as the guest flips");
 
     SectionTitle("Interface");
     Toggle("Show main menu bar", &g_config.display.ui.show_menubar,
@@ -848,6 +872,8 @@ void MainMenuAudioView::Draw()
            "Enable improved audio accuracy (experimental)");
     Toggle("DSP JIT engine", &g_config.audio.use_dsp_jit,
            "Use DSP JIT engine");
+    Toggle("Pipelined DSP processing", &g_config.audio.dsp_pipeline.enable,
+           "Run the encode DSP on a separate thread");
 
 }
 
@@ -1298,6 +1324,11 @@ void MainMenuSnapshotsView::Draw()
            &g_config.general.snapshots.filter_current_game,
            "Only display snapshots created while running the currently running "
            "XBE");
+    Toggle("Save in background", &g_config.general.snapshots.background_save,
+           "Resume the game as soon as its state is captured and write the "
+           "snapshot to disk while it runs");
+    Toggle("Compress", &g_config.general.snapshots.compress,
+           "Compress snapshots saved in the background to save disk space");
 
     if (g_config.general.snapshots.filter_current_game) {
         struct xbe *xbe = xemu_get_xbe_info();
@@ -1508,7 +1539,8 @@ void MainMenuSnapshotsView::DrawSnapshotContextMenu(
     ImGui::EndPopup();
 }
 
-MainMenuSystemView::MainMenuSystemView() : m_dirty(false)
+MainMenuSystemView::MainMenuSystemView()
+    : m_dirty(false), m_new_hdd_size(0), m_new_hdd_preallocate(false)
 {
 }
 
@@ -1568,6 +1600,58 @@ void MainMenuSystemView::Draw()
                    xemu_settings_set_string(&g_config.sys.files.hdd_path, path);
                    m_dirty = true;
                });
+
+    ChevronCombo("New hard disk size", &m_new_hdd_size,
+                 "8 GB (Retail)\0"
+                 "20 GB\0"
+                 "80 GB\0"
+                 "160 GB\0",
+                 "Space beyond the retail partitions becomes F: (and G: past "
+                 "137 GB), which requires a BIOS that supports them");
+#ifndef _WIN32
+    Toggle("Preallocate new hard disk", &m_new_hdd_preallocate,
+           "Reserve the whole image on the host up front so it does not "
+           "fragment as the guest writes to it. xemu stops responding while "
+           "it is created, for minutes if the host file system has to be "
+           "filled with zeroes");
+#endif
+    ImGui::SetCursorPosX(ImGui::GetCursorPosX() +
+                         (ImGui::GetColumnWidth() -
+                          250 * g_viewport_mgr.m_scale) /
+                             2);
+    if (ImGui::Button("Create New Hard Disk",
+                      ImVec2(250 * g_viewport_mgr.m_scale, 0))) {
+        static const uint64_t sizes[] = {
+            FATX_HDD_RETAIL_SIZE,
+            20000000000ULL,
+            80000000000ULL,
+            160000000000ULL,
+        };
+        uint64_t size = sizes[m_new_hdd_size];
+        bool preallocate = m_new_hdd_preallocate;
+        ShowSaveFileDialog(qcow_file_filters, 2, nullptr,
+                           [size, preallocate](const char *path) {
+            g_autofree char *image_path =
+                g_str_has_suffix(path, ".qcow2") ?
+                    g_strdup(path) :
+                    g_strdup_printf("%s.qcow2", path);
+            Error *err = NULL;
+            if (xemu_hdd_create(image_path, "qcow2", size, preallocate,
+                                &err)) {
+                // Without a dashboard it can't boot, keep the current disk
+                g_autofree char *msg = g_strdup_printf(
+                    "Created %s with empty partitions", image_path);
+                xemu_queue_notification(msg);
+            } else {
+                xemu_queue_error_message(error_get_pretty(err));
+                error_free(err);
+            }
+        });
+    }
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Creates a qcow2 image with empty partitions. It has "
+                          "no dashboard, so the current Hard Disk is kept");
+    }
     FilePicker("EEPROM", g_config.sys.files.eeprom_path,
                rom_file_filters, 3, false, [this](const char *path) {
                    xemu_settings_set_string(&g_config.sys.files.eeprom_path, path);
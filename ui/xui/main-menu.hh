@@ -139,6 +139,8 @@ class MainMenuSystemView : public virtual MainMenuTabView
 {
 protected:
     bool m_dirty;
+    int m_new_hdd_size;
+    bool m_new_hdd_preallocate;
 
 public:
     MainMenuSystemView();
@@ -203,12 +203,6 @@ void xemu_hud_update(void)
         g_last_scale = g_viewport_mgr.m_scale;
     }
 
-    if (!first_boot_window.is_open) {
-        int ww, wh;
-        SDL_GetWindowSizeInPixels(xemu_get_window(), &ww, &wh);
-        RenderFramebuffer(g_tex, ww, wh, g_flip_req);
-    }
-
     ImGui_ImplOpenGL3_NewFrame();
     io.ConfigFlags &= ~ImGuiConfigFlags_NavEnableGamepad;
     ImGui_ImplSDL3_NewFrame();
@@ -310,6 +304,7 @@ void xemu_hud_update(void)
     monitor_window.Draw();
     apu_window.Draw();
     video_window.Draw();
+    profiler_window.Draw();
     compatibility_reporter_window.Draw();
 #if defined(_WIN32)
     update_window.Draw();
@@ -320,12 +315,25 @@ void xemu_hud_update(void)
 
     // static bool show_demo = true;
     // if (show_demo) ImGui::ShowDemoWindow(&show_demo);
+
+    ImGui::Render();
 }
 
+// Doesn't need the main loop lock. Draws the current framebuffer under the
+// HUD built by the most recent xemu_hud_update(), which may be from an
+// earlier frame if the core was busy.
 void xemu_hud_render()
 {
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    if (!first_boot_window.is_open) {
+        int ww, wh;
+        SDL_GetWindowSizeInPixels(xemu_get_window(), &ww, &wh);
+        RenderFramebuffer(g_tex, ww, wh, g_flip_req);
+    }
+
+    ImDrawData *draw_data = ImGui::GetDrawData();
+    if (draw_data) {
+        ImGui_ImplOpenGL3_RenderDrawData(draw_data);
+    }
 
     if (g_vsync != g_config.display.window.vsync) {
         g_vsync = g_config.display.window.vsync;
@@ -194,6 +194,11 @@ void qemu_mutex_unlock_main_loop(void)
 {
     qemu_mutex_unlock(&qemu_main_loop_lock);
 }
+
+bool qemu_mutex_trylock_main_loop(void)
+{
+    return qemu_mutex_trylock(&qemu_main_loop_lock) == 0;
+}
 #endif
 
 int qemu_init_main_loop(Error **errp)
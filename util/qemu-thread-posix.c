@@ -253,6 +253,20 @@ bool qemu_cond_timedwait_impl(QemuCond *cond, QemuMutex *mutex, int ms,
     return qemu_cond_timedwait_ts(cond, mutex, &ts, file, line);
 }
 
+bool qemu_cond_timedwait_ns(QemuCond *cond, QemuMutex *mutex, int64_t ns)
+{
+    struct timespec ts;
+
+    clock_gettime(qemu_timedwait_clockid(), &ts);
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec += ns % 1000000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return qemu_cond_timedwait_ts(cond, mutex, &ts, __FILE__, __LINE__);
+}
+
 void qemu_sem_init(QemuSemaphore *sem, int init)
 {
     qemu_mutex_init(&sem->mutex);
@@ -362,6 +376,12 @@ static void *qemu_thread_start(void *args)
      * we're not going to fail if we can't set it.
      */
     if (name_threads && qemu_thread_args->name) {
+#if defined(XBOX) && defined(__linux__)
+        /* Linux rejects names that don't fit in 16 bytes, keep the start */
+        if (strlen(qemu_thread_args->name) > 15) {
+            qemu_thread_args->name[15] = '\0';
+        }
+#endif
 # if defined(CONFIG_PTHREAD_SETNAME_NP_W_TID)
         pthread_setname_np(pthread_self(), qemu_thread_args->name);
 # elif defined(CONFIG_PTHREAD_SETNAME_NP_WO_TID)
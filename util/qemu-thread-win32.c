@@ -188,6 +188,12 @@ bool qemu_cond_timedwait_impl(QemuCond *cond, QemuMutex *mutex, int ms,
     return rc != ERROR_TIMEOUT;
 }
 
+bool qemu_cond_timedwait_ns(QemuCond *cond, QemuMutex *mutex, int64_t ns)
+{
+    return qemu_cond_timedwait_impl(cond, mutex, DIV_ROUND_UP(ns, 1000000),
+                                    __FILE__, __LINE__);
+}
+
 void qemu_sem_init(QemuSemaphore *sem, int init)
 {
     /* Manual reset.  */
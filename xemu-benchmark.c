@@ -0,0 +1,402 @@
+/*
+ * xemu headless benchmark
+ *
+ * Runs the configured title without a window or audio device for a fixed
+ * amount of emulated time, then reports where host time went.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/notify.h"
+#include "qemu/timer.h"
+#include "qobject/json-writer.h"
+#include "system/runstate.h"
+#include "system/system.h"
+#include "system/tcg.h"
+#include "tcg/tcg.h"
+#include "accel/tcg/tb-context.h"
+#include "ui/console.h"
+#include "ui/xemu-args.h"
+#include "ui/xemu-settings.h"
+#include "hw/xbox/nv2a/debug.h"
+#include "xemu-benchmark.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+/*
+ * With no display there is nothing to raise the vblank, so it is driven from
+ * the virtual clock instead. That clock only advances while the guest runs,
+ * which makes the length of a run depend on emulated time alone, however
+ * fast or slow the host is.
+ */
+
+#define VBLANK_INTERVAL_NS 16666666LL
+#define DEFAULT_FRAMES     3600
+#define STALL_TIMEOUT_NS   (10 * NANOSECONDS_PER_SECOND)
+
+typedef struct ThreadTime {
+    int tid;
+    char name[16];
+    uint64_t ticks;
+} ThreadTime;
+
+static struct {
+    bool active;
+    bool finished;
+    int frames;
+    double seconds;
+    const char *snapshot;
+    const char *report_path;
+
+    QEMUTimer *vblank_timer;
+    Notifier exit_notifier;
+    int64_t next_vblank;
+
+    int64_t start_wall;
+    int64_t start_virtual;
+    unsigned int start_frame;
+    unsigned int last_frame;
+    int64_t last_frame_virtual;
+    int64_t start_totals[NV2A_PROF__COUNT];
+    unsigned int start_tb_flushes;
+    unsigned int start_tb_invalidates;
+    GArray *start_threads;
+} bench;
+
+static const char *renderer_names[CONFIG_DISPLAY_RENDERER__COUNT] = {
+    [CONFIG_DISPLAY_RENDERER_NULL] = "null",
+    [CONFIG_DISPLAY_RENDERER_OPENGL] = "opengl",
+    [CONFIG_DISPLAY_RENDERER_VULKAN] = "vulkan",
+};
+
+bool xemu_benchmark_parse_args(int argc, char **argv)
+{
+    CONFIG_DISPLAY_RENDERER renderer = CONFIG_DISPLAY_RENDERER_NULL;
+
+    bench.active = xemu_args_take_flag(argc, argv, "-benchmark");
+    xemu_args_take_int(argc, argv, "-benchmark_frames", 1, &bench.frames);
+    xemu_args_take_double(argc, argv, "-benchmark_seconds", 0, &bench.seconds);
+    bench.snapshot = xemu_args_take_str(argc, argv, "-benchmark_snapshot");
+    bench.report_path = xemu_args_take_str(argc, argv, "-benchmark_report");
+
+    const char *name = xemu_args_take_str(argc, argv, "-benchmark_renderer");
+    if (name) {
+        int r;
+        for (r = 0; r < CONFIG_DISPLAY_RENDERER__COUNT; r++) {
+            if (g_strcmp0(name, renderer_names[r]) == 0) {
+                break;
+            }
+        }
+        if (r == CONFIG_DISPLAY_RENDERER__COUNT) {
+            error_report("benchmark: unknown renderer '%s'", name);
+            exit(1);
+        }
+        renderer = r;
+    }
+
+    if (!bench.active) {
+        return false;
+    }
+
+    if (bench.frames <= 0 && bench.seconds <= 0) {
+        bench.frames = DEFAULT_FRAMES;
+    }
+
+    // Settings are not saved in this mode, so these only last for the run
+    g_config.display.renderer = renderer;
+    g_config.general.show_welcome = false;
+
+    return true;
+}
+
+bool xemu_benchmark_is_active(void)
+{
+    return bench.active;
+}
+
+const char *xemu_benchmark_get_snapshot(void)
+{
+    return bench.snapshot;
+}
+
+/*
+ * Per-thread CPU time, from procfs. Names are whatever the threads were given
+ * at creation, cut to the 15 characters the kernel keeps.
+ */
+static GArray *get_thread_times(void)
+{
+    GArray *threads = g_array_new(false, true, sizeof(ThreadTime));
+
+#ifdef __linux__
+    GDir *dir = g_dir_open("/proc/self/task", 0, NULL);
+    if (!dir) {
+        return threads;
+    }
+
+    const char *ent;
+    while ((ent = g_dir_read_name(dir))) {
+        g_autofree char *path = g_strdup_printf("/proc/self/task/%s/stat", ent);
+        g_autofree char *contents = NULL;
+        if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+            continue;
+        }
+
+        // The name may itself contain parentheses, so look for the last one
+        char *name = strchr(contents, '(');
+        char *name_end = strrchr(contents, ')');
+        if (!name || !name_end || name_end < name) {
+            continue;
+        }
+
+        unsigned long utime, stime;
+        if (sscanf(name_end + 2,
+                   "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                   &utime, &stime) != 2) {
+            continue;
+        }
+
+        ThreadTime t = {
+            .tid = atoi(ent),
+            .ticks = utime + stime,
+        };
+        *name_end = '\0';
+        g_strlcpy(t.name, name + 1, sizeof(t.name));
+        g_array_append_val(threads, t);
+    }
+    g_dir_close(dir);
+#endif
+
+    return threads;
+}
+
+static uint64_t get_start_ticks(int tid)
+{
+    for (int i = 0; i < bench.start_threads->len; i++) {
+        ThreadTime *t = &g_array_index(bench.start_threads, ThreadTime, i);
+        if (t->tid == tid) {
+            return t->ticks;
+        }
+    }
+    return 0;
+}
+
+static void write_threads(JSONWriter *w)
+{
+#ifdef __linux__
+    double tick_s = 1.0 / sysconf(_SC_CLK_TCK);
+    g_autoptr(GArray) threads = get_thread_times();
+    g_autoptr(GHashTable) by_name =
+        g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+    // Worker pools share one name, report them together
+    for (int i = 0; i < threads->len; i++) {
+        ThreadTime *t = &g_array_index(threads, ThreadTime, i);
+        uint64_t *acc = g_hash_table_lookup(by_name, t->name);
+        if (!acc) {
+            acc = g_new0(uint64_t, 2);
+            g_hash_table_insert(by_name, t->name, acc);
+        }
+        acc[0] += t->ticks - get_start_ticks(t->tid);
+        acc[1]++;
+    }
+
+    json_writer_start_array(w, "threads");
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, by_name);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        uint64_t *acc = value;
+        json_writer_start_object(w, NULL);
+        json_writer_str(w, "name", key);
+        json_writer_uint64(w, "count", acc[1]);
+        json_writer_double(w, "cpu_seconds", acc[0] * tick_s);
+        json_writer_end_object(w);
+    }
+    json_writer_end_array(w);
+#endif
+}
+
+static void write_process(JSONWriter *w)
+{
+#ifndef _WIN32
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        json_writer_double(w, "user_seconds",
+                           ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6);
+        json_writer_double(w, "system_seconds",
+                           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6);
+#ifdef __APPLE__
+        json_writer_int64(w, "peak_rss_kb", ru.ru_maxrss / 1024);
+#else
+        json_writer_int64(w, "peak_rss_kb", ru.ru_maxrss);
+#endif
+    }
+#endif
+}
+
+static void write_tcg(JSONWriter *w)
+{
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    json_writer_start_object(w, "tcg");
+    json_writer_uint64(w, "tb_count", tcg_nb_tbs());
+    json_writer_uint64(w, "code_size", tcg_code_size());
+    json_writer_uint64(w, "code_capacity", tcg_code_capacity());
+    json_writer_uint64(w, "flushes",
+                       qatomic_read(&tb_ctx.tb_flush_count) -
+                       bench.start_tb_flushes);
+    json_writer_uint64(w, "invalidates",
+                       qatomic_read(&tb_ctx.tb_phys_invalidate_count) -
+                       bench.start_tb_invalidates);
+    json_writer_end_object(w);
+}
+
+static void write_report(const char *stop_reason)
+{
+    int64_t wall = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - bench.start_wall;
+    int64_t virt = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - bench.start_virtual;
+    unsigned int frames = g_nv2a_stats.frame_count - bench.start_frame;
+    double wall_s = wall / (double)NANOSECONDS_PER_SECOND;
+    double virt_s = virt / (double)NANOSECONDS_PER_SECOND;
+
+    g_autoptr(JSONWriter) w = json_writer_new(true);
+    json_writer_start_object(w, NULL);
+    json_writer_str(w, "stop_reason", stop_reason);
+    json_writer_str(w, "renderer",
+                    renderer_names[g_config.display.renderer]);
+    if (bench.snapshot) {
+        json_writer_str(w, "snapshot", bench.snapshot);
+    }
+    json_writer_uint64(w, "guest_frames", frames);
+    json_writer_double(w, "emulated_seconds", virt_s);
+    json_writer_double(w, "wall_seconds", wall_s);
+    json_writer_double(w, "guest_fps", virt_s > 0 ? frames / virt_s : 0);
+    json_writer_double(w, "speed", wall_s > 0 ? virt_s / wall_s : 0);
+
+    json_writer_start_object(w, "process");
+    write_process(w);
+    json_writer_end_object(w);
+
+    write_threads(w);
+
+    json_writer_start_object(w, "nv2a_counters");
+    for (int i = 0; i < NV2A_PROF__COUNT; i++) {
+        json_writer_int64(w, nv2a_profile_get_counter_name(i),
+                          nv2a_profile_get_counter_total(i) -
+                          bench.start_totals[i]);
+    }
+    json_writer_end_object(w);
+
+    write_tcg(w);
+    json_writer_end_object(w);
+
+    const char *json = json_writer_get(w);
+    if (!bench.report_path) {
+        printf("%s\n", json);
+        fflush(stdout);
+        return;
+    }
+
+    GError *err = NULL;
+    if (!g_file_set_contents(bench.report_path, json, -1, &err)) {
+        error_report("benchmark: failed to write report: %s", err->message);
+        g_error_free(err);
+    }
+}
+
+static void finish(const char *stop_reason, int exit_code)
+{
+    if (bench.finished) {
+        return;
+    }
+    bench.finished = true;
+
+    timer_del(bench.vblank_timer);
+    write_report(stop_reason);
+    qemu_system_shutdown_request_with_code(SHUTDOWN_CAUSE_HOST_UI, exit_code);
+}
+
+static void vblank_tick(void *opaque)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    graphic_hw_update(qemu_console_lookup_by_index(0));
+
+    unsigned int frame = g_nv2a_stats.frame_count;
+    if (frame != bench.last_frame) {
+        bench.last_frame = frame;
+        bench.last_frame_virtual = now;
+    }
+
+    if (bench.frames > 0 && frame - bench.start_frame >= bench.frames) {
+        finish("frames", 0);
+        return;
+    }
+    if (bench.seconds > 0 &&
+        now - bench.start_virtual >= bench.seconds * NANOSECONDS_PER_SECOND) {
+        finish("seconds", 0);
+        return;
+    }
+    if (now - bench.last_frame_virtual >= STALL_TIMEOUT_NS) {
+        finish("stalled", 1);
+        return;
+    }
+
+    bench.next_vblank += VBLANK_INTERVAL_NS;
+    if (bench.next_vblank < now) {
+        bench.next_vblank = now + VBLANK_INTERVAL_NS;
+    }
+    timer_mod_ns(bench.vblank_timer, bench.next_vblank);
+}
+
+static void report_on_exit(Notifier *n, void *data)
+{
+    // The guest shut down, or the run was interrupted
+    if (!bench.finished) {
+        bench.finished = true;
+        write_report("exit");
+    }
+}
+
+void xemu_benchmark_start(void)
+{
+    assert(bench.active);
+
+    bench.start_wall = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    bench.start_virtual = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    bench.start_frame = bench.last_frame = g_nv2a_stats.frame_count;
+    bench.last_frame_virtual = bench.start_virtual;
+    for (int i = 0; i < NV2A_PROF__COUNT; i++) {
+        bench.start_totals[i] = nv2a_profile_get_counter_total(i);
+    }
+    if (tcg_enabled()) {
+        bench.start_tb_flushes = qatomic_read(&tb_ctx.tb_flush_count);
+        bench.start_tb_invalidates =
+            qatomic_read(&tb_ctx.tb_phys_invalidate_count);
+    }
+    bench.start_threads = get_thread_times();
+
+    bench.exit_notifier.notify = report_on_exit;
+    qemu_add_exit_notifier(&bench.exit_notifier);
+
+    bench.vblank_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, vblank_tick, NULL);
+    bench.next_vblank = bench.start_virtual + VBLANK_INTERVAL_NS;
+    timer_mod_ns(bench.vblank_timer, bench.next_vblank);
+}
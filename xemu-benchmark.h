@@ -0,0 +1,45 @@
+/*
+ * xemu headless benchmark
+ *
+ * Runs the configured title without a window or audio device for a fixed
+ * amount of emulated time, then reports where host time went.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEMU_BENCHMARK_H
+#define XEMU_BENCHMARK_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Consume the -benchmark* options, returns true if a benchmark was requested.
+// Must be called after settings are loaded, as it overrides some of them.
+bool xemu_benchmark_parse_args(int argc, char **argv);
+bool xemu_benchmark_is_active(void);
+
+// Snapshot to start from, or NULL to boot
+const char *xemu_benchmark_get_snapshot(void);
+
+// Machine is created and any snapshot loaded, start driving and measuring
+void xemu_benchmark_start(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,568 @@
+/*
+ * xemu guest CPU profiler
+ *
+ * Samples where the guest CPU spends its time and attributes it to XBE
+ * sections and kernel exports.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/cutils.h"
+#include "qemu/lockable.h"
+#include "qemu/thread.h"
+#include "hw/core/cpu.h"
+#include "system/runstate.h"
+#include "cpu.h"
+#include "xemu-profiler.h"
+#include "xemu-xbe.h"
+
+/*
+ * A sampler thread periodically queues work on the vCPU, which records the
+ * guest PC at the next TB boundary along with a best-effort frame pointer
+ * walk of the guest stack. Chained TBs never return to the execution loop,
+ * so sampling is used rather than counting TB executions, which would need
+ * every TB to be instrumented.
+ *
+ * Retail XBEs carry no symbols, but the statically linked libraries (D3D,
+ * DSOUND, XGRPH, ...) each get a named section, so the section containing an
+ * address is enough to tell game code from library code. Within a section,
+ * samples are grouped by the nearest preceding function start found by
+ * scanning back for a frame setup prologue or the int3 padding the compiler
+ * aligns functions with. Kernel addresses are attributed to the nearest
+ * preceding export.
+ */
+
+#define SAMPLE_INTERVAL_US 1000
+#define MAX_DEPTH          16
+#define MAX_STACKS         (1 << 16)
+#define MAX_FRAME_SPAN     (1 << 20)
+#define MAX_MODULES        64
+#define MAX_EXPORTS        512
+#define FUNC_SCAN_MAX      (16 * 1024)
+#define FUNC_ALIGN         16
+
+#define XBE_BASE    0x10000
+#define KERNEL_BASE 0x80010000
+
+typedef struct ProfStack {
+    uint64_t count;
+    uint32_t depth;
+    uint32_t pc[MAX_DEPTH]; /* Leaf first, depth 0 while halted */
+} ProfStack;
+
+typedef struct ProfModule {
+    uint32_t start;
+    uint32_t end;
+    char name[16];
+} ProfModule;
+
+typedef struct ProfExport {
+    uint32_t addr;
+    uint32_t ordinal;
+} ProfExport;
+
+static struct {
+    QemuMutex lock;
+    QemuThread thread;
+    bool running;
+    bool sample_pending;
+    GHashTable *stacks;
+    uint64_t total;
+    uint64_t dropped;
+} prof;
+
+static struct {
+    QemuMutex lock;
+    ProfModule modules[MAX_MODULES];
+    int num_modules;
+    ProfExport exports[MAX_EXPORTS];
+    int num_exports;
+    uint32_t kernel_end;
+    uint64_t xbe_stamp;
+    GHashTable *func_starts; /* Sampled PC -> function start, per title */
+} syms;
+
+static guint stack_hash(gconstpointer p)
+{
+    const ProfStack *s = p;
+    guint h = s->depth;
+    for (uint32_t i = 0; i < s->depth; i++) {
+        h = h * 31 + s->pc[i];
+    }
+    return h;
+}
+
+static gboolean stack_equal(gconstpointer a, gconstpointer b)
+{
+    const ProfStack *x = a, *y = b;
+    return x->depth == y->depth &&
+           !memcmp(x->pc, y->pc, x->depth * sizeof(x->pc[0]));
+}
+
+static bool is_code_addr(uint32_t addr)
+{
+    return (addr >= XBE_BASE && addr < 0x04000000) || addr >= 0x80000000;
+}
+
+static void walk_frames(CPUState *cs, CPUX86State *env, ProfStack *s)
+{
+    uint32_t esp = env->regs[R_ESP];
+    uint32_t fp = env->regs[R_EBP];
+
+    /* EBP is a general purpose register in FPO code, so check every link */
+    while (s->depth < MAX_DEPTH && fp >= esp && fp - esp < MAX_FRAME_SPAN &&
+           !(fp & 3)) {
+        uint32_t frame[2];
+        if (cpu_memory_rw_debug(cs, fp, frame, sizeof(frame), false)) {
+            break;
+        }
+        uint32_t next = le32_to_cpu(frame[0]);
+        uint32_t ret = le32_to_cpu(frame[1]);
+        if (!is_code_addr(ret)) {
+            break;
+        }
+        s->pc[s->depth++] = ret;
+        if (next <= fp) {
+            break;
+        }
+        fp = next;
+    }
+}
+
+static void sample_cpu(CPUState *cs, run_on_cpu_data data)
+{
+    qatomic_set(&prof.sample_pending, false);
+
+    if (!qatomic_read(&prof.running) || !runstate_is_running()) {
+        return;
+    }
+
+    ProfStack s = { .count = 1 };
+    if (!cs->halted) {
+        CPUX86State *env = cpu_env(cs);
+        s.pc[s.depth++] = env->eip + env->segs[R_CS].base;
+        walk_frames(cs, env, &s);
+    }
+
+    QEMU_LOCK_GUARD(&prof.lock);
+    prof.total++;
+    ProfStack *e = g_hash_table_lookup(prof.stacks, &s);
+    if (e) {
+        e->count++;
+    } else if (g_hash_table_size(prof.stacks) < MAX_STACKS) {
+        g_hash_table_add(prof.stacks, g_memdup2(&s, sizeof(s)));
+    } else {
+        prof.dropped++;
+    }
+}
+
+static void *sampler_thread(void *arg)
+{
+    while (qatomic_read(&prof.running)) {
+        g_usleep(SAMPLE_INTERVAL_US);
+
+        /* Don't queue up work while the vCPU is busy elsewhere */
+        CPUState *cs = first_cpu;
+        if (cs && !qatomic_xchg(&prof.sample_pending, true)) {
+            async_run_on_cpu(cs, sample_cpu, RUN_ON_CPU_NULL);
+        }
+    }
+
+    return NULL;
+}
+
+void xemu_profiler_init(void)
+{
+    qemu_mutex_init(&prof.lock);
+    qemu_mutex_init(&syms.lock);
+    prof.stacks = g_hash_table_new_full(stack_hash, stack_equal, g_free, NULL);
+    syms.func_starts = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+void xemu_profiler_start(void)
+{
+    if (qatomic_read(&prof.running)) {
+        return;
+    }
+
+    qatomic_set(&prof.running, true);
+    qemu_thread_create(&prof.thread, "xemu-profiler", sampler_thread, NULL,
+                       QEMU_THREAD_JOINABLE);
+}
+
+void xemu_profiler_stop(void)
+{
+    if (!qatomic_read(&prof.running)) {
+        return;
+    }
+
+    qatomic_set(&prof.running, false);
+    qemu_thread_join(&prof.thread);
+}
+
+bool xemu_profiler_is_running(void)
+{
+    return qatomic_read(&prof.running);
+}
+
+void xemu_profiler_reset(void)
+{
+    QEMU_LOCK_GUARD(&prof.lock);
+    g_hash_table_remove_all(prof.stacks);
+    prof.total = 0;
+    prof.dropped = 0;
+}
+
+uint64_t xemu_profiler_get_total_samples(void)
+{
+    QEMU_LOCK_GUARD(&prof.lock);
+    return prof.total;
+}
+
+static bool read_guest(uint32_t addr, void *buf, size_t len)
+{
+    return first_cpu && !cpu_memory_rw_debug(first_cpu, addr, buf, len, false);
+}
+
+static int export_cmp(const void *a, const void *b)
+{
+    const ProfExport *x = a, *y = b;
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static void load_kernel_exports(void)
+{
+    uint32_t lfanew, pe_sig, dir[10];
+    uint8_t opt[104];
+
+    if (!read_guest(KERNEL_BASE + 0x3c, &lfanew, sizeof(lfanew))) {
+        return;
+    }
+    uint32_t nt = KERNEL_BASE + le32_to_cpu(lfanew);
+    if (!read_guest(nt, &pe_sig, sizeof(pe_sig)) ||
+        le32_to_cpu(pe_sig) != 0x00004550 /* "PE\0\0" */ ||
+        !read_guest(nt + 24, opt, sizeof(opt))) {
+        return;
+    }
+
+    uint32_t size_of_image = ldl_le_p(opt + 56);
+    uint32_t export_rva = ldl_le_p(opt + 96);
+    if (!export_rva || !read_guest(KERNEL_BASE + export_rva, dir, sizeof(dir))) {
+        return;
+    }
+
+    uint32_t ordinal_base = le32_to_cpu(dir[4]);
+    uint32_t num_funcs = MIN(le32_to_cpu(dir[5]), MAX_EXPORTS);
+    g_autofree uint32_t *rvas = g_new(uint32_t, num_funcs);
+    if (!read_guest(KERNEL_BASE + le32_to_cpu(dir[7]), rvas,
+                    num_funcs * sizeof(uint32_t))) {
+        return;
+    }
+
+    syms.num_exports = 0;
+    for (uint32_t i = 0; i < num_funcs; i++) {
+        uint32_t rva = le32_to_cpu(rvas[i]);
+        if (rva && rva < size_of_image) {
+            syms.exports[syms.num_exports++] = (ProfExport){
+                .addr = KERNEL_BASE + rva,
+                .ordinal = ordinal_base + i,
+            };
+        }
+    }
+    qsort(syms.exports, syms.num_exports, sizeof(ProfExport), export_cmp);
+    syms.kernel_end = KERNEL_BASE + size_of_image;
+}
+
+static void load_xbe_sections(void)
+{
+    syms.num_modules = 0;
+
+    struct xbe *xbe = xemu_get_xbe_info();
+    if (!xbe) {
+        return;
+    }
+
+    uint32_t base = ldl_le_p(&xbe->header->m_base);
+    uint32_t count = ldl_le_p(&xbe->header->m_sections);
+    uint32_t offset = ldl_le_p(&xbe->header->m_section_headers_addr) - base;
+    if (offset > xbe->headers_len ||
+        count > (xbe->headers_len - offset) / sizeof(struct xbe_section_header)) {
+        return;
+    }
+
+    struct xbe_section_header *sh =
+        (struct xbe_section_header *)(xbe->headers + offset);
+    for (uint32_t i = 0; i < count && syms.num_modules < MAX_MODULES; i++) {
+        ProfModule *m = &syms.modules[syms.num_modules];
+        m->start = ldl_le_p(&sh[i].m_virtual_addr);
+        m->end = m->start + ldl_le_p(&sh[i].m_virtual_size);
+
+        uint32_t name = ldl_le_p(&sh[i].m_section_name_addr) - base;
+        if (name >= xbe->headers_len) {
+            continue;
+        }
+        pstrcpy(m->name, MIN(sizeof(m->name), xbe->headers_len - name + 1),
+                (const char *)xbe->headers + name);
+        syms.num_modules++;
+    }
+}
+
+/* The running title can change at any time, so reload on every query */
+static void refresh_symbols(void)
+{
+    QEMU_LOCK_GUARD(&syms.lock);
+
+    uint64_t stamp = xemu_get_xbe_stamp();
+    if (stamp != syms.xbe_stamp) {
+        g_hash_table_remove_all(syms.func_starts);
+        syms.xbe_stamp = stamp;
+    }
+
+    load_xbe_sections();
+    if (!syms.num_exports) {
+        load_kernel_exports();
+    }
+}
+
+static const ProfModule *find_module_locked(uint32_t addr)
+{
+    for (int i = 0; i < syms.num_modules; i++) {
+        if (addr >= syms.modules[i].start && addr < syms.modules[i].end) {
+            return &syms.modules[i];
+        }
+    }
+    return NULL;
+}
+
+static const char *module_name_locked(uint32_t addr)
+{
+    const ProfModule *m = find_module_locked(addr);
+    if (m) {
+        return m->name;
+    }
+    if (addr >= KERNEL_BASE && addr < syms.kernel_end) {
+        return "xboxkrnl";
+    }
+    return "unknown";
+}
+
+static const ProfExport *find_export_locked(uint32_t addr)
+{
+    if (addr < KERNEL_BASE || addr >= syms.kernel_end) {
+        return NULL;
+    }
+
+    const ProfExport *best = NULL;
+    int lo = 0, hi = syms.num_exports;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (syms.exports[mid].addr <= addr) {
+            best = &syms.exports[mid];
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return best;
+}
+
+/*
+ * Scan back from addr, within its section, for the start of the function
+ * containing it: a push ebp; mov ebp, esp prologue, or an aligned address
+ * after int3 padding. Functions built without a frame pointer and without
+ * padding are folded into the preceding one. Returns addr if nothing is found.
+ */
+static uint32_t find_function_start_locked(uint32_t addr)
+{
+    const ProfModule *m = find_module_locked(addr);
+    if (!m) {
+        return addr;
+    }
+
+    uint32_t start = MAX(m->start, addr - MIN(addr, FUNC_SCAN_MAX));
+    uint32_t len = MIN(addr + 3, m->end) - start;
+    g_autofree uint8_t *buf = g_malloc(len);
+    if (!read_guest(start, buf, len)) {
+        return addr;
+    }
+
+    for (uint32_t i = addr - start + 1; i-- > 0;) {
+        if (i + 3 <= len && buf[i] == 0x55 && buf[i + 1] == 0x8b &&
+            buf[i + 2] == 0xec) {
+            return start + i;
+        }
+        if (i && !((start + i) % FUNC_ALIGN) && buf[i - 1] == 0xcc &&
+            buf[i] != 0xcc) {
+            return start + i;
+        }
+    }
+    return addr;
+}
+
+/* Key samples by kernel export, or by function start within the XBE */
+static uint32_t function_key_locked(uint32_t addr)
+{
+    const ProfExport *e = find_export_locked(addr);
+    if (e) {
+        return e->addr;
+    }
+
+    gpointer key = GUINT_TO_POINTER(addr);
+    gpointer start;
+    if (!g_hash_table_lookup_extended(syms.func_starts, key, NULL, &start)) {
+        start = GUINT_TO_POINTER(find_function_start_locked(addr));
+        g_hash_table_insert(syms.func_starts, key, start);
+    }
+    return GPOINTER_TO_UINT(start);
+}
+
+static void describe_locked(uint32_t addr, char *buf, size_t len)
+{
+    const ProfExport *e = find_export_locked(addr);
+    if (e) {
+        snprintf(buf, len, "xboxkrnl!#%u+0x%x", e->ordinal, addr - e->addr);
+    } else {
+        snprintf(buf, len, "%s!0x%08x", module_name_locked(addr), addr);
+    }
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const XemuProfilerEntry *x = a, *y = b;
+    return x->samples > y->samples ? -1 : x->samples < y->samples;
+}
+
+static int collect_top(GHashTable *counts, bool by_module,
+                       XemuProfilerEntry *out, int max)
+{
+    int n = g_hash_table_size(counts);
+    g_autofree XemuProfilerEntry *all = g_new0(XemuProfilerEntry, n);
+    GHashTableIter iter;
+    gpointer key, value;
+    int i = 0;
+
+    g_hash_table_iter_init(&iter, counts);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        XemuProfilerEntry *e = &all[i++];
+        e->samples = *(uint64_t *)value;
+        if (by_module) {
+            pstrcpy(e->name, sizeof(e->name), key);
+        } else {
+            e->addr = GPOINTER_TO_UINT(key);
+        }
+    }
+    qsort(all, n, sizeof(*all), entry_cmp);
+
+    n = MIN(n, max);
+    memcpy(out, all, n * sizeof(*out));
+    return n;
+}
+
+static void add_count(GHashTable *counts, gpointer key, uint64_t count)
+{
+    uint64_t *v = g_hash_table_lookup(counts, key);
+    if (!v) {
+        v = g_new0(uint64_t, 1);
+        g_hash_table_insert(counts, key, v);
+    }
+    *v += count;
+}
+
+int xemu_profiler_get_top_functions(XemuProfilerEntry *out, int max)
+{
+    g_autoptr(GHashTable) counts =
+        g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    GHashTableIter iter;
+    ProfStack *s;
+
+    refresh_symbols();
+    QEMU_LOCK_GUARD(&syms.lock);
+
+    WITH_QEMU_LOCK_GUARD(&prof.lock) {
+        g_hash_table_iter_init(&iter, prof.stacks);
+        while (g_hash_table_iter_next(&iter, (gpointer *)&s, NULL)) {
+            /* Key 0 collects the samples taken while halted */
+            uint32_t key = s->depth ? function_key_locked(s->pc[0]) : 0;
+            add_count(counts, GUINT_TO_POINTER(key), s->count);
+        }
+    }
+
+    int n = collect_top(counts, false, out, max);
+    for (int i = 0; i < n; i++) {
+        if (out[i].addr) {
+            describe_locked(out[i].addr, out[i].name, sizeof(out[i].name));
+        } else {
+            pstrcpy(out[i].name, sizeof(out[i].name), "idle");
+        }
+    }
+    return n;
+}
+
+int xemu_profiler_get_top_modules(XemuProfilerEntry *out, int max)
+{
+    g_autoptr(GHashTable) counts =
+        g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+    GHashTableIter iter;
+    ProfStack *s;
+
+    refresh_symbols();
+    QEMU_LOCK_GUARD(&syms.lock);
+
+    WITH_QEMU_LOCK_GUARD(&prof.lock) {
+        g_hash_table_iter_init(&iter, prof.stacks);
+        while (g_hash_table_iter_next(&iter, (gpointer *)&s, NULL)) {
+            const char *name = s->depth ? module_name_locked(s->pc[0]) : "idle";
+            add_count(counts, (gpointer)name, s->count);
+        }
+    }
+
+    return collect_top(counts, true, out, max);
+}
+
+void xemu_profiler_save_report(const char *path, Error **errp)
+{
+    g_autoptr(GString) out = g_string_new(NULL);
+    g_autoptr(GError) err = NULL;
+    GHashTableIter iter;
+    ProfStack *s;
+    char frame[64];
+
+    refresh_symbols();
+
+    WITH_QEMU_LOCK_GUARD(&syms.lock) {
+        QEMU_LOCK_GUARD(&prof.lock);
+
+        g_hash_table_iter_init(&iter, prof.stacks);
+        while (g_hash_table_iter_next(&iter, (gpointer *)&s, NULL)) {
+            if (!s->depth) {
+                g_string_append(out, "idle");
+            }
+            for (int i = s->depth - 1; i >= 0; i--) {
+                describe_locked(function_key_locked(s->pc[i]), frame,
+                                sizeof(frame));
+                g_string_append(out, frame);
+                if (i) {
+                    g_string_append_c(out, ';');
+                }
+            }
+            g_string_append_printf(out, " %" PRIu64 "\n", s->count);
+        }
+    }
+
+    if (!g_file_set_contents(path, out->str, out->len, &err)) {
+        error_setg(errp, "Failed to write profile: %s", err->message);
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * xemu guest CPU profiler
+ *
+ * Samples where the guest CPU spends its time and attributes it to XBE
+ * sections and kernel exports.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEMU_PROFILER_H
+#define XEMU_PROFILER_H
+
+#include "qemu/osdep.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct XemuProfilerEntry {
+    uint32_t addr;
+    char name[64];
+    uint64_t samples;
+} XemuProfilerEntry;
+
+void xemu_profiler_init(void);
+void xemu_profiler_start(void);
+void xemu_profiler_stop(void);
+bool xemu_profiler_is_running(void);
+void xemu_profiler_reset(void);
+uint64_t xemu_profiler_get_total_samples(void);
+
+// Fill `out` with the hottest functions, returns the number filled
+int xemu_profiler_get_top_functions(XemuProfilerEntry *out, int max);
+
+// Fill `out` with per XBE section / kernel totals, returns the number filled
+int xemu_profiler_get_top_modules(XemuProfilerEntry *out, int max);
+
+// Write samples as collapsed stacks, as consumed by flamegraph.pl
+void xemu_profiler_save_report(const char *path, Error **errp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
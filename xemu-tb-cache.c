@@ -0,0 +1,131 @@
+/*
+ * xemu translated code cache
+ *
+ * Selects the persistent TB cache file for the running title.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/fast-hash.h"
+#include "qemu/timer.h"
+#include "system/runstate.h"
+#include "system/system.h"
+#include "system/tcg.h"
+#include "accel/tcg/tb-cache.h"
+#include "ui/xemu-settings.h"
+#include "xemu-tb-cache.h"
+#include "xemu-version.h"
+#include "xemu-xbe.h"
+
+/*
+ * Each cache file covers one combination of title (XBE certificate), flash
+ * image and xemu build, so a cache is never replayed against a different
+ * kernel or translator. While no XBE is mapped, i.e. during kernel boot and
+ * between titles, the flash image alone selects the cache.
+ */
+
+#define POLL_INTERVAL_MS 1000
+#define SAVE_INTERVAL_MS (60 * 1000)
+
+static QEMUTimer *poll_timer;
+static Notifier exit_notifier;
+static uint64_t flash_hash;
+static uint64_t build_hash;
+static uint64_t current_key;
+static uint64_t current_stamp;
+static int64_t last_save_ms;
+
+static uint64_t get_title_key(void)
+{
+    uint64_t cert_hash = 0;
+
+    struct xbe *xbe = xemu_get_xbe_info();
+    if (xbe && xbe->cert) {
+        cert_hash = fast_hash((const uint8_t *)xbe->cert,
+                              sizeof(struct xbe_certificate));
+    }
+
+    uint64_t ids[3] = { cert_hash, flash_hash, build_hash };
+    return fast_hash((const uint8_t *)ids, sizeof(ids));
+}
+
+static void open_cache(uint64_t key)
+{
+    char *dir = g_strdup_printf("%scode_cache", xemu_settings_get_base_path());
+    qemu_mkdir(dir);
+    char *path = g_strdup_printf("%s/%016" PRIx64 ".bin", dir, key);
+    tb_cache_open(path);
+    g_free(path);
+    g_free(dir);
+}
+
+static void poll_title(void *opaque)
+{
+    int64_t now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    uint64_t key = 0;
+
+    if (g_config.perf.cache_code) {
+        key = current_key;
+        /*
+         * Guest memory is only meaningful while the machine is running. Only
+         * read the certificate when the title's header looks different.
+         */
+        if (runstate_is_running()) {
+            uint64_t stamp = xemu_get_xbe_stamp();
+            if (!current_key || stamp != current_stamp) {
+                key = get_title_key();
+                current_stamp = stamp;
+            }
+        }
+    }
+
+    if (key != current_key) {
+        if (key) {
+            open_cache(key);
+        } else {
+            tb_cache_close();
+        }
+        current_key = key;
+        last_save_ms = now;
+    } else if (key && now - last_save_ms >= SAVE_INTERVAL_MS) {
+        tb_cache_save();
+        last_save_ms = now;
+    }
+
+    timer_mod(poll_timer, now + POLL_INTERVAL_MS);
+}
+
+static void save_on_exit(Notifier *n, void *data)
+{
+    tb_cache_close();
+}
+
+void xemu_tb_cache_init(const void *flash, size_t flash_size)
+{
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    flash_hash = fast_hash(flash, flash_size);
+    char *build = g_strdup_printf("%s-%s", xemu_version, xemu_commit);
+    build_hash = fast_hash((const uint8_t *)build, strlen(build));
+    g_free(build);
+
+    exit_notifier.notify = save_on_exit;
+    qemu_add_exit_notifier(&exit_notifier);
+
+    poll_timer = timer_new_ms(QEMU_CLOCK_REALTIME, poll_title, NULL);
+    timer_mod(poll_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME));
+}
@@ -0,0 +1,36 @@
+/*
+ * xemu translated code cache
+ *
+ * Selects the persistent TB cache file for the running title.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEMU_TB_CACHE_H
+#define XEMU_TB_CACHE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Start tracking the running title, with the final flash image contents
+void xemu_tb_cache_init(const void *flash, size_t flash_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
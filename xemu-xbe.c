@@ -135,3 +135,25 @@ struct xbe *xemu_get_xbe_info(void)
 
     return &xbe;
 }
+
+uint64_t xemu_get_xbe_stamp(void)
+{
+    vaddr hdr_addr_virt = 0x10000;
+    hwaddr hdr_addr_phys = 0;
+
+    if (virt_to_phys(hdr_addr_virt, &hdr_addr_phys) != 0) {
+        return 0;
+    }
+
+    uint32_t sig = ldl_le_phys(&address_space_memory, hdr_addr_phys);
+    if (sig != 0x48454258) {
+        return 0;
+    }
+
+    uint32_t timedate = ldl_le_phys(&address_space_memory,
+        hdr_addr_phys + offsetof(struct xbe_header, m_timedate));
+    uint32_t image_size = ldl_le_phys(&address_space_memory,
+        hdr_addr_phys + offsetof(struct xbe_header, m_sizeof_image));
+
+    return ((uint64_t)timedate << 32) | image_size | 1;
+}
@@ -89,6 +89,20 @@ struct xbe_certificate
     uint8_t  m_sig_key[16];                   // signature key
     uint8_t  m_title_alt_sig_key[16][16];     // alternate signature keys
 };
+
+struct xbe_section_header
+{
+    uint32_t m_flags;                         // section flags
+    uint32_t m_virtual_addr;                  // virtual address
+    uint32_t m_virtual_size;                  // virtual size
+    uint32_t m_raw_addr;                      // file offset to raw data
+    uint32_t m_sizeof_raw;                    // size of raw data
+    uint32_t m_section_name_addr;             // section name addr
+    uint32_t m_section_reference_count;       // section reference count
+    uint32_t m_head_shared_ref_count_addr;    // head shared page reference count address
+    uint32_t m_tail_shared_ref_count_addr;    // tail shared page reference count address
+    uint8_t  m_section_digest[20];            // section digest
+};
 #pragma pack()
 
 struct xbe {
@@ -108,6 +122,10 @@ extern "C" {
 // Get current XBE info
 struct xbe *xemu_get_xbe_info(void);
 
+// Cheap identifier of the loaded XBE, from its link time stamp and size,
+// without copying the headers. Returns 0 if no XBE is mapped.
+uint64_t xemu_get_xbe_stamp(void);
+
 #ifdef __cplusplus
 }
 #endif